@@ -0,0 +1,159 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+// Browsers the extension is installed into. Adding a browser takes one row in kBrowsers and
+// its ProgIDs in kBrowserProgIds, which name the browser they belong to; the registry key
+// list is generated from them at compile time, so the install and uninstall paths walk the
+// same static tables and allocate nothing.
+
+struct BrowserInfo {
+    const wchar_t* name;
+    const wchar_t* executable; // File name shortcuts point to. Channels of a browser share it,
+                               // so their shortcuts are attributed to the first row with it.
+};
+
+constexpr BrowserInfo kBrowsers[] = {
+    { L"Google Chrome", L"chrome.exe" },
+    { L"Google Chrome Beta", L"chrome.exe" },
+    { L"Google Chrome Dev", L"chrome.exe" },
+    { L"Google Chrome Canary", L"chrome.exe" },
+    { L"Chromium", L"chrome.exe" },
+    { L"Microsoft Edge", L"msedge.exe" },
+    { L"Microsoft Edge Beta", L"msedge.exe" },
+    { L"Microsoft Edge Dev", L"msedge.exe" },
+    { L"Microsoft Edge Canary", L"msedge.exe" },
+    { L"Brave", L"brave.exe" },
+    { L"Brave Beta", L"brave.exe" },
+    { L"Brave Nightly", L"brave.exe" }
+};
+
+constexpr size_t kBrowserCount = sizeof(kBrowsers) / sizeof(kBrowsers[0]);
+
+// Marks a registry key that is not owned by one browser, such as the http protocol handler
+constexpr size_t kAnyBrowser = kBrowserCount;
+
+// Class under HKEY_CLASSES_ROOT whose shell verbs launch a browser
+struct BrowserProgId {
+    const wchar_t* browser;  // Name of the kBrowsers row, or null for kAnyBrowser
+    const wchar_t* progId;
+    bool runAs;              // Also has a "runas" verb with its own command
+};
+
+constexpr BrowserProgId kBrowserProgIds[] = {
+    { L"Google Chrome", L"ChromeHTML", false },
+    { L"Google Chrome Beta", L"ChromeBHTML", false },
+    { L"Google Chrome Dev", L"ChromeDHTML", false },
+    { L"Google Chrome Canary", L"ChromeSSHTM", false },
+    { L"Chromium", L"ChromiumHTM", false },
+    { L"Microsoft Edge", L"MSEdgeHTM", true },
+    { L"Microsoft Edge", L"MSEdgeMHT", true },
+    { L"Microsoft Edge", L"MSEdgePDF", true },
+    { L"Microsoft Edge", L"microsoft-edge", false },
+    { L"Microsoft Edge Beta", L"MSEdgeBHTML", false },
+    { L"Microsoft Edge Dev", L"MSEdgeDHTML", false },
+    { L"Microsoft Edge Canary", L"MSEdgeSHTML", false },
+    { L"Brave", L"BraveHTML", false },
+    { L"Brave Beta", L"BraveBHTML", false },
+    { L"Brave Nightly", L"BraveSSHTM", false },
+    { nullptr, L"VisioViewer.Viewer", false },
+    { nullptr, L"http", false },
+    { nullptr, L"https", false }
+};
+
+// Longest generated key, including the terminator
+constexpr size_t kMaxBrowserCommandKey = 64;
+
+// "<ProgID>\shell\<verb>\command" under HKEY_CLASSES_ROOT
+struct BrowserCommandKey {
+    size_t browser = kAnyBrowser;   // Index into kBrowsers
+    wchar_t subKey[kMaxBrowserCommandKey] = {};
+};
+
+namespace BrowserCatalogDetail {
+    constexpr size_t Length(const wchar_t* text) {
+        size_t length = 0;
+        while (text[length] != 0) {
+            ++length;
+        }
+        return length;
+    }
+
+    constexpr bool Equal(const wchar_t* a, const wchar_t* b) {
+        size_t i = 0;
+        while (a[i] != 0 && a[i] == b[i]) {
+            ++i;
+        }
+        return a[i] == b[i];
+    }
+
+    // Index of the browser named `name`, kAnyBrowser for null, or past kAnyBrowser if no row has the name
+    constexpr size_t BrowserIndex(const wchar_t* name) {
+        if (name == nullptr) {
+            return kAnyBrowser;
+        }
+        for (size_t i = 0; i < kBrowserCount; ++i) {
+            if (Equal(kBrowsers[i].name, name)) {
+                return i;
+            }
+        }
+        return kAnyBrowser + 1;
+    }
+
+    constexpr bool BrowserNamesUnique() {
+        for (size_t i = 0; i < kBrowserCount; ++i) {
+            if (BrowserIndex(kBrowsers[i].name) != i) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    constexpr size_t CountCommandKeys() {
+        size_t count = 0;
+        for (const auto& progId : kBrowserProgIds) {
+            count += progId.runAs ? 2 : 1;
+        }
+        return count;
+    }
+
+    constexpr bool ProgIdsFit() {
+        for (const auto& progId : kBrowserProgIds) {
+            if (BrowserIndex(progId.browser) > kAnyBrowser || Length(progId.progId) + Length(L"\\shell\\runas\\command") >= kMaxBrowserCommandKey) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    constexpr BrowserCommandKey MakeCommandKey(const BrowserProgId& progId, const wchar_t* verb) {
+        BrowserCommandKey key;
+        key.browser = BrowserIndex(progId.browser);
+        size_t length = 0;
+        for (const wchar_t* part : { progId.progId, L"\\shell\\", verb, L"\\command" }) {
+            for (size_t i = 0; part[i] != 0 && length + 1 < kMaxBrowserCommandKey; ++i) {
+                key.subKey[length++] = part[i];
+            }
+        }
+        return key;
+    }
+
+    constexpr std::array<BrowserCommandKey, CountCommandKeys()> BuildCommandKeys() {
+        std::array<BrowserCommandKey, CountCommandKeys()> keys = {};
+        size_t count = 0;
+        for (const auto& progId : kBrowserProgIds) {
+            keys[count++] = MakeCommandKey(progId, L"open");
+            if (progId.runAs) {
+                keys[count++] = MakeCommandKey(progId, L"runas");
+            }
+        }
+        return keys;
+    }
+}
+
+static_assert(BrowserCatalogDetail::BrowserNamesUnique(), "Browser names must be unique; ProgIDs refer to browsers by name");
+static_assert(BrowserCatalogDetail::ProgIdsFit(), "Browser ProgID names an unknown browser or is too long for kMaxBrowserCommandKey");
+
+// Every command key the installer rewrites and the uninstaller restores, in catalog order
+constexpr auto kBrowserCommandKeys = BrowserCatalogDetail::BuildCommandKeys();
@@ -7,367 +7,742 @@
 #include <string>
 #include <filesystem>
 #include <vector>
+#include <algorithm>
 #include <process.h> // Include for process creation
+#include "BrowserCatalog.h"
+#include "CommandLineRewriter.h"
+#include "PolicyRefresh.h"
+#include "../Common/ActionLog.h"
+#include "../Common/Trace.h"
+#include "ProfileFanOut.h"
+#include "RegistryTransaction.h"
+#include "ShortcutIndex.h"
+#include "ShortcutSession.h"
 
 #pragma comment(lib, "shell32.lib")
-
-// Helper function to set registry key values
-bool setRegistryKeyValue(HKEY root, const std::wstring& subKey, const std::wstring& extensionPath) {
-    HKEY hKey;
-    if (RegOpenKeyEx(root, subKey.c_str(), 0, KEY_SET_VALUE | KEY_QUERY_VALUE, &hKey) != ERROR_SUCCESS) {
-        WcaLog(LOGMSG_STANDARD, "Failed to open registry key: %S", subKey.c_str());
+#pragma comment(lib, "advapi32.lib")
+
+// Registry backend on top of the Win32 registry API
+class WindowsRegistryBackend : public RegistryBackend {
+public:
+    bool ReadDefaultValue(RegistryRoot root, const std::wstring& subKey, std::wstring& value) override {
+        // RegGetValue opens, queries and closes the key in one call; size the buffer to the data
+        DWORD size = 0;
+        LSTATUS status = RegGetValue(rootKey(root), subKey.c_str(), nullptr, RRF_RT_REG_SZ, nullptr, nullptr, &size);
+        while (status == ERROR_SUCCESS || status == ERROR_MORE_DATA) {
+            value.resize(size / sizeof(wchar_t) + 1);
+            status = RegGetValue(rootKey(root), subKey.c_str(), nullptr, RRF_RT_REG_SZ, nullptr, &value[0], &size);
+            if (status == ERROR_SUCCESS) {
+                value.resize(wcsnlen(value.c_str(), value.size()));
+                return true;
+            }
+        }
         return false;
     }
 
-    std::wstring currentValue(1024, L'\0');
-    DWORD size = static_cast<DWORD>(currentValue.size() * sizeof(wchar_t));
-    RegQueryValueEx(hKey, nullptr, nullptr, nullptr, reinterpret_cast<LPBYTE>(&currentValue[0]), &size);
-    currentValue.resize(size / sizeof(wchar_t) - 1);
+    bool WriteDefaultValue(RegistryRoot root, const std::wstring& subKey, const std::wstring& value) override {
+        DWORD size = static_cast<DWORD>((value.size() + 1) * sizeof(wchar_t));
+        return RegSetKeyValue(rootKey(root), subKey.c_str(), nullptr, REG_SZ, value.c_str(), size) == ERROR_SUCCESS;
+    }
 
-    // Remove "--single-argument" if present
-    std::wstring::size_type startPos = currentValue.find(L"--single-argument");
-    if (startPos != std::wstring::npos) {
-        std::wstring::size_type endPos = currentValue.find(L" ", startPos + 16); // Find the end of the parameter
-        if (endPos == std::wstring::npos) {
-            endPos = currentValue.size();
+private:
+    static HKEY rootKey(RegistryRoot root) {
+        switch (root) {
+        case RegistryRoot::CurrentUser:
+            return HKEY_CURRENT_USER;
+        case RegistryRoot::LocalMachine:
+            return HKEY_LOCAL_MACHINE;
+        case RegistryRoot::Users:
+            return HKEY_USERS;
+        default:
+            return HKEY_CLASSES_ROOT;
         }
-        currentValue.erase(startPos, endPos - startPos); // Remove the parameter
     }
+};
 
-    // Add new argument if not already present
-    if (currentValue.find(L"--load-extension") == std::wstring::npos) {
-        std::wstring newValue = currentValue;
-        size_t pos = newValue.find(L" %1");
-        if (pos == std::wstring::npos) {
-            pos = newValue.find(L" \"%1\"");
-        }
-        if (pos != std::wstring::npos) {
-            newValue.insert(pos, L" --load-extension=\"" + extensionPath + L"\"");
-            if (RegSetValueEx(hKey, nullptr, 0, REG_SZ, reinterpret_cast<const BYTE*>(newValue.c_str()), static_cast<DWORD>((newValue.size() + 1) * sizeof(wchar_t))) != ERROR_SUCCESS) {
-                RegCloseKey(hKey);
-                WcaLog(LOGMSG_STANDARD, "Failed to set registry key value: %S", subKey.c_str());
-                return false;
-            }
-        }
+// Log sink that hands batches of lines to the MSI log
+class WcaLogSink : public LogSink {
+public:
+    void Write(const char* lines, size_t length) override {
+        WcaLog(LOGMSG_STANDARD, "%.*s", static_cast<int>(length), lines);
     }
 
-    RegCloseKey(hKey);
+    size_t MaxBatch() const override {
+        return kMsiLogBatch;
+    }
+};
+
+// Helper function to apply command line edits, writing the result straight into `newValue`
+bool rewriteCommandLine(const std::wstring& currentValue, const CommandLineEdit* edits, size_t editCount, std::wstring& newValue, ActionLog& log) {
+    newValue.resize(CommandLineRewriteBound(currentValue.size(), edits, editCount));
+    size_t length = 0;
+    if (!RewriteCommandLine(currentValue.c_str(), currentValue.size(), edits, editCount, &newValue[0], newValue.size(), length)) {
+        log.Log(LogLevel::Error, "Failed to rewrite command line: %S", currentValue.c_str());
+        return false;
+    }
+    newValue.resize(length);
     return true;
 }
 
-// Helper function to restore registry key values
-bool restoreRegistryKeyValue(HKEY root, const std::wstring& subKey, const std::wstring& extensionPath) {
-    HKEY hKey;
-    if (RegOpenKeyEx(root, subKey.c_str(), 0, KEY_SET_VALUE | KEY_QUERY_VALUE, &hKey) != ERROR_SUCCESS) {
-        WcaLog(LOGMSG_STANDARD, "Failed to open registry key: %S", subKey.c_str());
+// Helper function to add the extension argument to a browser command line
+bool addExtensionArgument(const std::wstring& currentValue, const std::wstring& extensionPath, std::wstring& newValue, ActionLog& log) {
+    // A command without even an executable is left alone
+    if (currentValue.find_first_not_of(L" \t") == std::wstring::npos) {
         return false;
     }
 
-    std::wstring currentValue(1024, L'\0');
-    DWORD size = static_cast<DWORD>(currentValue.size() * sizeof(wchar_t));
-    RegQueryValueEx(hKey, nullptr, nullptr, nullptr, reinterpret_cast<LPBYTE>(&currentValue[0]), &size);
-    currentValue.resize(size / sizeof(wchar_t) - 1);
+    // "--single-argument" makes the browser treat the rest of the line as one URL, so it has to go
+    const CommandLineEdit edits[] = {
+        { CommandLineEditKind::RemoveFlag, L"--single-argument", nullptr },
+        { CommandLineEditKind::SetFlag, L"--load-extension", extensionPath.c_str() }
+    };
+    return rewriteCommandLine(currentValue, edits, sizeof(edits) / sizeof(edits[0]), newValue, log);
+}
 
-    // Remove the argument if present
-    std::wstring extensionArgument = L" --load-extension=\"" + extensionPath + L"\"";
-    size_t pos = currentValue.find(extensionArgument);
-    if (pos != std::wstring::npos) {
-        currentValue.erase(pos, extensionArgument.length());
-        if (RegSetValueEx(hKey, nullptr, 0, REG_SZ, reinterpret_cast<const BYTE*>(currentValue.c_str()), static_cast<DWORD>((currentValue.size() + 1) * sizeof(wchar_t))) != ERROR_SUCCESS) {
-            RegCloseKey(hKey);
-            WcaLog(LOGMSG_STANDARD, "Failed to restore registry key value: %S", subKey.c_str());
-            return false;
+// Helper function to remove the extension argument from a browser command line
+bool removeExtensionArgument(const std::wstring& currentValue, const std::wstring& extensionPath, std::wstring& newValue, ActionLog& log) {
+    const CommandLineEdit edits[] = {
+        { CommandLineEditKind::RemoveFlag, L"--load-extension", extensionPath.c_str() }
+    };
+    return rewriteCommandLine(currentValue, edits, sizeof(edits) / sizeof(edits[0]), newValue, log);
+}
+
+// Helper function to commit a batch of registry changes and log the outcome for each key
+bool commitRegistryChanges(RegistryTransaction& transaction, const char* action, ActionLog& log) {
+    bool committed = transaction.Commit();
+
+    for (const auto& change : transaction.Changes()) {
+        switch (change.state) {
+        case RegistryChangeState::Missing:
+            // Most catalog keys are absent on any one machine or profile
+            log.Log(LogLevel::Verbose, "Registry key not found: %S", change.subKey.c_str());
+            break;
+        case RegistryChangeState::Unchanged:
+            log.Log(LogLevel::Standard, "Registry key already %s: %S", action, change.subKey.c_str());
+            break;
+        case RegistryChangeState::Written:
+            log.Log(LogLevel::Standard, "Registry key %s: %S", action, change.subKey.c_str());
+            break;
+        case RegistryChangeState::Failed:
+            log.Log(LogLevel::Error, "Failed to set registry key value: %S", change.subKey.c_str());
+            break;
+        case RegistryChangeState::RolledBack:
+            log.Log(LogLevel::Standard, "Registry key rolled back: %S", change.subKey.c_str());
+            break;
+        default:
+            break;
         }
     }
 
-    RegCloseKey(hKey);
-    return true;
+    if (!committed) {
+        log.Log(LogLevel::Error, "Registry changes were rolled back.");
+    }
+    return committed;
 }
 
-// Function to find the Chrome or Edge shortcut path
-std::wstring findShortcut(const std::wstring& browserName) {
-    wchar_t* programsPath = nullptr;
-    SHGetKnownFolderPath(FOLDERID_ProgramData, 0, NULL, &programsPath);
-    std::wstring shortcutPath = std::wstring(programsPath) + L"\\Microsoft\\Windows\\Start Menu\\Programs\\" + browserName + L".lnk";
-    CoTaskMemFree(programsPath);
+// Shortcut discovery backend on top of the Win32 file API
+class WindowsShortcutFileSystem : public ShortcutFileSystem {
+public:
+    bool ListShortcuts(const std::wstring& folder, bool recursive, std::vector<std::wstring>& paths) override {
+        WIN32_FIND_DATA findData;
+        std::wstring pattern = folder + L"\\*";
+        HANDLE find = FindFirstFileEx(pattern.c_str(), FindExInfoBasic, &findData, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+        if (find == INVALID_HANDLE_VALUE) {
+            return false;
+        }
 
-    // Check if the file exists
-    if (std::filesystem::exists(shortcutPath)) {
-        return shortcutPath;
-    }
-    else {
-        WcaLog(LOGMSG_STANDARD, "%S shortcut not found at default location.", browserName.c_str());
-        return L"";
+        do {
+            std::wstring name = findData.cFileName;
+            if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+                if (recursive && name != L"." && name != L"..") {
+                    ListShortcuts(folder + L"\\" + name, true, paths);
+                }
+            }
+            else if (name.size() > 4 && _wcsicmp(name.c_str() + name.size() - 4, L".lnk") == 0) {
+                paths.push_back(folder + L"\\" + name);
+            }
+        } while (FindNextFile(find, &findData));
+
+        FindClose(find);
+        return true;
     }
-}
 
-// Function to find the Chrome or Edge taskbar pin
-std::wstring findPin(const std::wstring& browserName) {
-    wchar_t* appDataPath = nullptr;
-    SHGetKnownFolderPath(FOLDERID_RoamingAppData, 0, NULL, &appDataPath);
-    std::wstring pinPath = std::wstring(appDataPath) + L"\\Microsoft\\Internet Explorer\\Quick Launch\\User Pinned\\TaskBar\\" + browserName + L".lnk";
-    CoTaskMemFree(appDataPath);
+    bool ReadFileHead(const std::wstring& path, size_t maxBytes, std::vector<unsigned char>& contents) override {
+        HANDLE file = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
 
-    // Check if the file exists
-    if (std::filesystem::exists(pinPath)) {
-        return pinPath;
+        contents.resize(maxBytes);
+        DWORD read = 0;
+        BOOL success = ReadFile(file, contents.data(), static_cast<DWORD>(maxBytes), &read, NULL);
+        CloseHandle(file);
+        contents.resize(read);
+        return success != FALSE;
     }
-    else {
-        WcaLog(LOGMSG_STANDARD, "%S pin not found at default location.", browserName.c_str());
-        return L"";
+};
+
+// Helper function to resolve a known folder, optionally with a subfolder appended
+std::wstring getKnownFolder(REFKNOWNFOLDERID folderId, const wchar_t* subFolder) {
+    wchar_t* folderPath = nullptr;
+    std::wstring result;
+    if (SUCCEEDED(SHGetKnownFolderPath(folderId, 0, NULL, &folderPath))) {
+        result = std::wstring(folderPath) + subFolder;
+    }
+    CoTaskMemFree(folderPath);
+    return result;
+}
+
+// Function to list the shared shortcut folders, plus the running account's own when no
+// profile could be enumerated
+std::vector<ShortcutFolder> machineShortcutFolders(bool includeCurrentUser) {
+    // Resolve each known folder once
+    std::vector<ShortcutFolder> folders = {
+        { ShortcutLocation::CommonStartMenu, getKnownFolder(FOLDERID_CommonPrograms, L""), true },
+        { ShortcutLocation::PublicDesktop, getKnownFolder(FOLDERID_PublicDesktop, L""), false }
+    };
+    if (includeCurrentUser) {
+        folders.push_back({ ShortcutLocation::UserStartMenu, getKnownFolder(FOLDERID_Programs, L""), true });
+        folders.push_back({ ShortcutLocation::UserDesktop, getKnownFolder(FOLDERID_Desktop, L""), false });
+        folders.push_back({ ShortcutLocation::TaskbarPins, getKnownFolder(FOLDERID_RoamingAppData, L"\\Microsoft\\Internet Explorer\\Quick Launch\\User Pinned\\TaskBar"), false });
     }
+    return folders;
 }
 
-// Function to find the Chrome or Edge desktop shortcut
-std::wstring findDesktopShortcut(const std::wstring& browserName) {
-    wchar_t* desktopPath = nullptr;
-    SHGetKnownFolderPath(FOLDERID_PublicDesktop, 0, NULL, &desktopPath);
-    std::wstring shortcutPath = std::wstring(desktopPath) + L"\\" + browserName + L".lnk";
-    CoTaskMemFree(desktopPath);
+// Function to find every catalog browser's shortcut in the given Start Menu, desktop and taskbar folders
+void buildShortcutIndex(ShortcutIndex& index, std::vector<ShortcutFolder> folders, ActionLog& log) {
+    TraceSpan span("shortcut-index");
+    folders.erase(std::remove_if(folders.begin(), folders.end(), [](const ShortcutFolder& folder) {
+        return folder.path.empty();
+    }), folders.end());
 
-    // Check if the file exists
-    if (std::filesystem::exists(shortcutPath)) {
-        return shortcutPath;
+    WindowsShortcutFileSystem fileSystem;
+    index.Build(fileSystem, folders);
+
+    for (const auto& folder : index.MissingFolders()) {
+        log.Log(LogLevel::Standard, "Shortcut folder not found: %S", folder.c_str());
     }
-    else {
-        WcaLog(LOGMSG_STANDARD, "%S desktop shortcut not found at default location.", browserName.c_str());
-        return L"";
+    for (const auto& shortcut : index.Shortcuts()) {
+        log.Log(LogLevel::Standard, "Found %S shortcut: %S", shortcut.browser->name, shortcut.path.c_str());
     }
 }
 
-// Function to update the browser shortcut with a new argument
-bool updateShortcut(const std::wstring& shortcutPath, const std::wstring& extensionPath) {
-    CoInitialize(NULL);
-
-    IShellLinkW* pShellLink = nullptr;
-    HRESULT hres = CoCreateInstance(CLSID_ShellLink, NULL, CLSCTX_INPROC_SERVER, IID_IShellLinkW, (LPVOID*)&pShellLink);
+// Shortcut store that initializes COM once and reuses one IShellLinkW/IPersistFile pair
+class ComShortcutLinkStore : public ShortcutLinkStore {
+public:
+    ComShortcutLinkStore() {
+        HRESULT hr = CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
+        comInitialized_ = SUCCEEDED(hr);
+        if (!comInitialized_) {
+            return;
+        }
 
-    if (SUCCEEDED(hres)) {
-        IPersistFile* pPersistFile = nullptr;
+        hr = CoCreateInstance(CLSID_ShellLink, NULL, CLSCTX_INPROC_SERVER, IID_IShellLinkW, (LPVOID*)&pShellLink_);
+        if (SUCCEEDED(hr)) {
+            pShellLink_->QueryInterface(IID_IPersistFile, (LPVOID*)&pPersistFile_);
+        }
+    }
 
-        // Load the shortcut
-        hres = pShellLink->QueryInterface(IID_IPersistFile, (LPVOID*)&pPersistFile);
-        if (SUCCEEDED(hres)) {
-            hres = pPersistFile->Load(shortcutPath.c_str(), STGM_READWRITE);
+    ~ComShortcutLinkStore() override {
+        if (pPersistFile_ != nullptr) {
+            pPersistFile_->Release();
+        }
+        if (pShellLink_ != nullptr) {
+            pShellLink_->Release();
+        }
+        if (comInitialized_) {
+            CoUninitialize();
+        }
+    }
 
-            if (SUCCEEDED(hres)) {
-                // Get the current target
-                wchar_t targetPath[MAX_PATH];
-                pShellLink->GetPath(targetPath, MAX_PATH, NULL, SLGP_UNCPRIORITY);
+    bool IsReady() const override {
+        return pPersistFile_ != nullptr;
+    }
 
-                // Update the arguments
-                std::wstring fullCommand = L"--load-extension=\"" + extensionPath + L"\"";
-                pShellLink->SetArguments(fullCommand.c_str());
+    bool Load(const std::wstring& path) override {
+        path_ = path;
+        return SUCCEEDED(pPersistFile_->Load(path.c_str(), STGM_READWRITE));
+    }
 
-                // Save the updated shortcut
-                hres = pPersistFile->Save(shortcutPath.c_str(), TRUE);
-                WcaLog(LOGMSG_STANDARD, "Shortcut updated: %S", shortcutPath.c_str());
-            }
-            pPersistFile->Release();
+    bool GetArguments(std::wstring& arguments) override {
+        wchar_t buffer[INFOTIPSIZE];
+        if (FAILED(pShellLink_->GetArguments(buffer, INFOTIPSIZE))) {
+            return false;
         }
-        pShellLink->Release();
+        arguments.assign(buffer);
+        return true;
+    }
+
+    bool SetArguments(const std::wstring& arguments) override {
+        return SUCCEEDED(pShellLink_->SetArguments(arguments.c_str()));
+    }
+
+    bool Save() override {
+        return SUCCEEDED(pPersistFile_->Save(path_.c_str(), TRUE));
     }
 
-    CoUninitialize();
+private:
+    bool comInitialized_ = false;
+    IShellLinkW* pShellLink_ = nullptr;
+    IPersistFile* pPersistFile_ = nullptr;
+    std::wstring path_;
+};
+
+// Function to apply argument edits to every indexed shortcut in one COM session
+std::vector<ShortcutEditResult> editShortcuts(const ShortcutIndex& index, const CommandLineEdit* edits, size_t editCount, const char* action, ActionLog& log) {
+    std::vector<std::wstring> paths;
+    for (const auto& shortcut : index.Shortcuts()) {
+        paths.push_back(shortcut.path);
+    }
+    if (paths.empty()) {
+        return {};
+    }
+
+    TraceSpan span("shortcut-edit");
+    ComShortcutLinkStore store;
+    if (!store.IsReady()) {
+        log.Log(LogLevel::Error, "Failed to create the shell link object.");
+        return {};
+    }
 
-    return SUCCEEDED(hres);
+    ShortcutEditSession session(store);
+    std::vector<ShortcutEditResult> results = session.Apply(paths, edits, editCount);
+    for (const auto& result : results) {
+        if (!result.success) {
+            log.Log(LogLevel::Error, "Failed to %s shortcut: %S", action, result.path.c_str());
+        }
+        else if (result.changed) {
+            log.Log(LogLevel::Standard, "Shortcut %sd: %S", action, result.path.c_str());
+        }
+        else {
+            log.Log(LogLevel::Standard, "Shortcut already %sd: %S", action, result.path.c_str());
+        }
+    }
+    return results;
 }
 
-// Function to restore the browser shortcut to its original state
-bool restoreShortcut(const std::wstring& shortcutPath) {
-    CoInitialize(NULL);
+// Hives of a user who is not logged on, loaded with RegLoadKey and unloaded when destroyed
+class UnloadingHive : public LoadedHive {
+public:
+    UnloadingHive(const std::wstring& sid, bool classesLoaded) : sid_(sid), classesLoaded_(classesLoaded) {}
+
+    ~UnloadingHive() override {
+        if (classesLoaded_) {
+            RegUnLoadKey(HKEY_USERS, (sid_ + L"_Classes").c_str());
+        }
+        RegUnLoadKey(HKEY_USERS, sid_.c_str());
+    }
 
-    IShellLinkW* pShellLink = nullptr;
-    HRESULT hres = CoCreateInstance(CLSID_ShellLink, NULL, CLSCTX_INPROC_SERVER, IID_IShellLinkW, (LPVOID*)&pShellLink);
+private:
+    std::wstring sid_;
+    bool classesLoaded_;
+};
 
-    if (SUCCEEDED(hres)) {
-        IPersistFile* pPersistFile = nullptr;
+// Function to enable a privilege in the process token; RegLoadKey and RegUnLoadKey need
+// SeRestorePrivilege and SeBackupPrivilege even when running as LocalSystem
+bool enablePrivilege(const wchar_t* name) {
+    HANDLE token;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+        return false;
+    }
+    TOKEN_PRIVILEGES privileges = {};
+    privileges.PrivilegeCount = 1;
+    privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    bool enabled = LookupPrivilegeValue(NULL, name, &privileges.Privileges[0].Luid) &&
+        AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL, NULL) && GetLastError() == ERROR_SUCCESS;
+    CloseHandle(token);
+    return enabled;
+}
 
-        // Load the shortcut
-        hres = pShellLink->QueryInterface(IID_IPersistFile, (LPVOID*)&pPersistFile);
-        if (SUCCEEDED(hres)) {
-            hres = pPersistFile->Load(shortcutPath.c_str(), STGM_READWRITE);
+// Profile store on top of the ProfileList key and HKEY_USERS
+class WindowsProfileStore : public ProfileStore {
+public:
+    WindowsProfileStore() {
+        canLoadHives_ = enablePrivilege(SE_RESTORE_NAME) && enablePrivilege(SE_BACKUP_NAME);
+    }
 
-            if (SUCCEEDED(hres)) {
-                // Reset the arguments to an empty string
-                pShellLink->SetArguments(L"");
+    bool ListProfileDirectories(std::vector<ProfileDirectory>& profiles) override {
+        HKEY profileList;
+        if (RegOpenKeyEx(HKEY_LOCAL_MACHINE, L"SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion\\ProfileList", 0, KEY_READ, &profileList) != ERROR_SUCCESS) {
+            return false;
+        }
 
-                // Save the updated shortcut
-                hres = pPersistFile->Save(shortcutPath.c_str(), TRUE);
-                WcaLog(LOGMSG_STANDARD, "Shortcut restored: %S", shortcutPath.c_str());
+        std::vector<std::wstring> sids;
+        listSubKeys(profileList, sids);
+        for (const auto& sid : sids) {
+            // ProfileImagePath is REG_EXPAND_SZ; RegGetValue expands it
+            wchar_t path[MAX_PATH];
+            DWORD size = sizeof(path);
+            if (RegGetValue(profileList, sid.c_str(), L"ProfileImagePath", RRF_RT_REG_SZ, nullptr, path, &size) == ERROR_SUCCESS) {
+                profiles.push_back({ sid, path });
             }
-            pPersistFile->Release();
         }
-        pShellLink->Release();
+        RegCloseKey(profileList);
+        return true;
     }
 
-    CoUninitialize();
+    bool ListLoadedHives(std::vector<std::wstring>& sids) override {
+        return listSubKeys(HKEY_USERS, sids);
+    }
 
-    return SUCCEEDED(hres);
-}
+    std::unique_ptr<LoadedHive> LoadHive(const UserProfile& profile) override {
+        if (!canLoadHives_) {
+            return nullptr;
+        }
+        std::wstring userHive = profile.directory + L"\\NTUSER.DAT";
+        if (RegLoadKey(HKEY_USERS, profile.sid.c_str(), userHive.c_str()) != ERROR_SUCCESS) {
+            return nullptr;
+        }
+        // Profiles that never opened a packaged app may have no UsrClass.dat; their command
+        // keys then read as missing
+        std::wstring classesHive = profile.directory + L"\\AppData\\Local\\Microsoft\\Windows\\UsrClass.dat";
+        bool classesLoaded = RegLoadKey(HKEY_USERS, (profile.sid + L"_Classes").c_str(), classesHive.c_str()) == ERROR_SUCCESS;
+        return std::unique_ptr<LoadedHive>(new UnloadingHive(profile.sid, classesLoaded));
+    }
 
-// Function to run a command line process
-bool runCommand(const std::wstring& command) {
-    STARTUPINFO si;
-    PROCESS_INFORMATION pi;
-    ZeroMemory(&si, sizeof(si));
-    si.cb = sizeof(si);
-    ZeroMemory(&pi, sizeof(pi));
-
-    if (!CreateProcess(
-        NULL,
-        const_cast<LPWSTR>(command.c_str()),
-        NULL,
-        NULL,
-        FALSE,
-        CREATE_NO_WINDOW,
-        NULL,
-        NULL,
-        &si,
-        &pi)) {
-        WcaLog(LOGMSG_STANDARD, "Failed to run command: %S", command.c_str());
-        return false;
+    bool ReadShellFolder(const std::wstring& sid, const wchar_t* name, std::wstring& value) override {
+        std::wstring key = sid + L"\\Software\\Microsoft\\Windows\\CurrentVersion\\Explorer\\User Shell Folders";
+        const DWORD flags = RRF_RT_REG_SZ | RRF_RT_REG_EXPAND_SZ | RRF_NOEXPAND;
+        DWORD size = 0;
+        if (RegGetValue(HKEY_USERS, key.c_str(), name, flags, nullptr, nullptr, &size) != ERROR_SUCCESS || size < sizeof(wchar_t)) {
+            return false;
+        }
+        value.resize(size / sizeof(wchar_t));
+        if (RegGetValue(HKEY_USERS, key.c_str(), name, flags, nullptr, &value[0], &size) != ERROR_SUCCESS) {
+            return false;
+        }
+        value.resize(wcsnlen(value.c_str(), size / sizeof(wchar_t)));
+        return true;
     }
 
-    // Wait for the process to complete
-    WaitForSingleObject(pi.hProcess, INFINITE);
+private:
+    bool canLoadHives_ = false;
 
-    // Close process and thread handles
-    CloseHandle(pi.hProcess);
-    CloseHandle(pi.hThread);
+    static bool listSubKeys(HKEY key, std::vector<std::wstring>& names) {
+        wchar_t name[256];
+        for (DWORD index = 0;; ++index) {
+            DWORD length = sizeof(name) / sizeof(name[0]);
+            LSTATUS status = RegEnumKeyEx(key, index, name, &length, nullptr, nullptr, nullptr, nullptr);
+            if (status == ERROR_NO_MORE_ITEMS) {
+                return true;
+            }
+            if (status != ERROR_SUCCESS) {
+                return false;
+            }
+            names.push_back(name);
+        }
+    }
+};
+
+// Process runner that places the process in a job object, so a deadline stops it and
+// anything it started
+class JobProcessRunner : public ProcessRunner {
+public:
+    ProcessResult Run(const std::wstring& commandLine, uint32_t timeoutMilliseconds) override {
+        ProcessResult result;
+        HANDLE job = CreateJobObject(NULL, NULL);
+        if (job != NULL) {
+            JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits = {};
+            limits.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+            SetInformationJobObject(job, JobObjectExtendedLimitInformation, &limits, sizeof(limits));
+        }
 
-    return true;
-}
+        STARTUPINFO si;
+        PROCESS_INFORMATION pi;
+        ZeroMemory(&si, sizeof(si));
+        si.cb = sizeof(si);
+        ZeroMemory(&pi, sizeof(pi));
+        std::wstring command = commandLine;  // CreateProcess may write to the buffer
+
+        // Started suspended so it cannot spawn children before it is in the job
+        if (!CreateProcess(NULL, &command[0], NULL, NULL, FALSE, CREATE_NO_WINDOW | CREATE_SUSPENDED, NULL, NULL, &si, &pi)) {
+            WcaLog(LOGMSG_STANDARD, "Failed to run command: %S (error %u)", commandLine.c_str(), GetLastError());
+            if (job != NULL) {
+                CloseHandle(job);
+            }
+            return result;
+        }
+        bool inJob = job != NULL && AssignProcessToJobObject(job, pi.hProcess);
+        if (!inJob) {
+            WcaLog(LOGMSG_VERBOSE, "Running without a job object (error %u)", GetLastError());
+        }
+        ResumeThread(pi.hThread);
 
-// Function to apply all changes
-void applyAllChanges(const std::wstring& extensionPath) {
-    std::wstring chromeShortcutPath = findShortcut(L"Google Chrome");
-    std::wstring edgeShortcutPath = findShortcut(L"Microsoft Edge");
-    std::wstring chromeDesktopShortcutPath = findDesktopShortcut(L"Google Chrome");
-    std::wstring edgeDesktopShortcutPath = findDesktopShortcut(L"Microsoft Edge");
-    std::wstring chromePinPath = findPin(L"Google Chrome");
-    std::wstring edgePinPath = findPin(L"Microsoft Edge");
+        if (WaitForSingleObject(pi.hProcess, timeoutMilliseconds) == WAIT_TIMEOUT) {
+            if (inJob) {
+                TerminateJobObject(job, ERROR_TIMEOUT);
+            }
+            else {
+                TerminateProcess(pi.hProcess, ERROR_TIMEOUT);
+            }
+            result.outcome = ProcessOutcome::TimedOut;
+        }
+        else {
+            DWORD exitCode = 0;
+            GetExitCodeProcess(pi.hProcess, &exitCode);
+            result.outcome = ProcessOutcome::Exited;
+            result.exitCode = exitCode;
+        }
 
-    if (!chromeShortcutPath.empty()) {
-        updateShortcut(chromeShortcutPath, extensionPath);
+        CloseHandle(pi.hProcess);
+        CloseHandle(pi.hThread);
+        if (job != NULL) {
+            CloseHandle(job);
+        }
+        return result;
+    }
+};
+
+// Policy reader over HKEY_LOCAL_MACHINE. Policies live in the 64-bit view, which the browsers read.
+class MachinePolicyReader : public PolicyReader {
+public:
+    bool ReadDword(const wchar_t* key, const wchar_t* name, uint32_t& value) override {
+        DWORD data = 0;
+        DWORD size = sizeof(data);
+        if (RegGetValue(HKEY_LOCAL_MACHINE, key, name, RRF_RT_REG_DWORD | RRF_SUBKEY_WOW6464KEY, nullptr, &data, &size) != ERROR_SUCCESS) {
+            return false;
+        }
+        value = data;
+        return true;
     }
 
-    if (!edgeShortcutPath.empty()) {
-        updateShortcut(edgeShortcutPath, extensionPath);
+    bool ReadString(const wchar_t* key, const wchar_t* name, std::wstring& value) override {
+        DWORD size = 0;
+        LSTATUS status = RegGetValue(HKEY_LOCAL_MACHINE, key, name, RRF_RT_REG_SZ | RRF_SUBKEY_WOW6464KEY, nullptr, nullptr, &size);
+        while (status == ERROR_SUCCESS || status == ERROR_MORE_DATA) {
+            value.resize(size / sizeof(wchar_t) + 1);
+            status = RegGetValue(HKEY_LOCAL_MACHINE, key, name, RRF_RT_REG_SZ | RRF_SUBKEY_WOW6464KEY, nullptr, &value[0], &size);
+            if (status == ERROR_SUCCESS) {
+                value.resize(wcsnlen(value.c_str(), value.size()));
+                return true;
+            }
+        }
+        return false;
     }
+};
+
+// Profiles updated at once; each mostly waits on registry and shortcut I/O
+const unsigned kProfileWorkers = 8;
+
+// One direction of the extension change, applied machine-wide and to every user profile
+struct ExtensionChange {
+    const CommandLineEdit* shortcutEdits;
+    size_t shortcutEditCount;
+    const char* shortcutAction; // "update" or "restore"
+    RegistryValueTransform registryTransform;
+    const char* registryAction; // "updated" or "restored"
+};
+
+// Function to rewrite every catalog command key as one batch, under HKEY_CLASSES_ROOT or, for
+// a profile, under its classes hive. Install and uninstall both go through here.
+void updateBrowserCommands(const UserProfile* profile, const ExtensionChange& change, ProfileSummary& summary, ActionLog& log) {
+    TraceSpan span("registry");
+    WindowsRegistryBackend backend;
+    RegistryTransaction transaction(backend);
+    AddBrowserCommandKeys(transaction, profile);
+
+    transaction.Prepare(change.registryTransform);
+    bool committed = commitRegistryChanges(transaction, change.registryAction, log);
+    CountRegistryChanges(transaction.Changes(), committed, summary);
+}
 
-    if (!chromeDesktopShortcutPath.empty()) {
-        updateShortcut(chromeDesktopShortcutPath, extensionPath);
+// Function to apply the shortcut and registry edits of one profile. Runs on a fan-out worker.
+// The hive of a user who is not logged on is loaded for the change, so an uninstall reaches
+// every profile the install did.
+void updateProfile(ProfileStore& store, const UserProfile& profile, const ExtensionChange& change, ProfileSummary& summary, ActionLog& log) {
+    TraceSpan span("profile");
+    OpenedProfile opened = OpenProfile(store, profile);
+    if (!opened.shortcutFolders.empty()) {
+        ShortcutIndex shortcuts;
+        buildShortcutIndex(shortcuts, opened.shortcutFolders, log);
+        CountShortcutEdits(editShortcuts(shortcuts, change.shortcutEdits, change.shortcutEditCount, change.shortcutAction, log), summary);
     }
 
-    if (!edgeDesktopShortcutPath.empty()) {
-        updateShortcut(edgeDesktopShortcutPath, extensionPath);
+    if (opened.registryReachable) {
+        updateBrowserCommands(&profile, change, summary, log);
+    }
+    else {
+        summary.registrySkipped = true;
     }
+}
+
+// Function to log the outcome for one profile
+void logProfileSummary(const ProfileSummary& summary, const ExtensionChange& change, ActionLog& log) {
+    const wchar_t* name = summary.profile.sid.empty() ? L"machine-wide" : summary.profile.sid.c_str();
+    log.Log(summary.registryRolledBack || summary.registrySkipped || summary.shortcutsFailed != 0 ? LogLevel::Error : LogLevel::Standard,
+        "Profile %S: %u registry keys %s, %u unchanged, %u missing%s; %u shortcuts %sd, %u unchanged, %u failed",
+        name, summary.keysWritten, change.registryAction, summary.keysUnchanged, summary.keysMissing,
+        summary.registryRolledBack ? " (rolled back)" : summary.registrySkipped ? " (hive could not be loaded)" : "",
+        summary.shortcutsChanged, change.shortcutAction,
+        summary.shortcutsUnchanged, summary.shortcutsFailed);
+}
 
-    if (!chromePinPath.empty()) {
-        updateShortcut(chromePinPath, extensionPath);
+// Function to apply a change to the shared shortcuts and HKEY_CLASSES_ROOT, then to every
+// user profile on a worker pool
+void applyExtensionChange(const ExtensionChange& change, ActionLog& log) {
+    TraceSpan enumerateSpan("enumerate-profiles");
+    WindowsProfileStore profileStore;
+    std::vector<UserProfile> profiles = EnumerateProfiles(profileStore);
+    log.Log(LogLevel::Standard, "Found %zu user profiles", profiles.size());
+    TraceCounter("profiles", static_cast<int64_t>(profiles.size()));
+    enumerateSpan.End();
+
+    ProfileSummary machine;
+    ShortcutIndex shortcuts;
+    buildShortcutIndex(shortcuts, machineShortcutFolders(profiles.empty()), log);
+    CountShortcutEdits(editShortcuts(shortcuts, change.shortcutEdits, change.shortcutEditCount, change.shortcutAction, log), machine);
+    updateBrowserCommands(nullptr, change, machine, log);
+    logProfileSummary(machine, change, log);
+
+    TraceSpan fanOutSpan("fan-out-profiles");
+    std::vector<ProfileSummary> summaries = FanOutProfiles(profiles, [&profileStore, &change, &log](const UserProfile& profile, ProfileSummary& summary) {
+        updateProfile(profileStore, profile, change, summary, log);
+    }, kProfileWorkers);
+    fanOutSpan.End();
+
+    uint64_t keysWritten = machine.keysWritten;
+    uint64_t shortcutsChanged = machine.shortcutsChanged;
+    for (const auto& summary : summaries) {
+        logProfileSummary(summary, change, log);
+        keysWritten += summary.keysWritten;
+        shortcutsChanged += summary.shortcutsChanged;
     }
+    TraceCounter("registry-keys-written", static_cast<int64_t>(keysWritten));
+    TraceCounter("shortcuts-changed", static_cast<int64_t>(shortcutsChanged));
+}
 
-    if (!edgePinPath.empty()) {
-        updateShortcut(edgePinPath, extensionPath);
+// Function to name the trace file of a custom action; empty when the SFX did not ask for a trace
+std::wstring traceFilePath(const std::wstring& traceDirectory, const wchar_t* action) {
+    if (traceDirectory.empty()) {
+        return std::wstring();
     }
+    return traceDirectory + action + L"-" + std::to_wstring(GetCurrentProcessId()) + L".json";
+}
 
-    // Chrome registry keys
-    std::vector<std::wstring> chromeRegistryKeys = {
-        L"ChromeHTML\\shell\\open\\command"
-    };
+// Function to log the span and counter totals of a trace
+void logTraceSummary(const TraceSession& trace) {
+    if (trace.Enabled()) {
+        for (const auto& summary : trace.Recorder()->Summarize()) {
+            WcaLog(LOGMSG_STANDARD, "Trace %s", FormatTraceSummary(summary).c_str());
+        }
+    }
+}
 
-    for (const auto& key : chromeRegistryKeys) {
-        setRegistryKeyValue(HKEY_CLASSES_ROOT, key, extensionPath);
-        WcaLog(LOGMSG_STANDARD, "Chrome registry key updated: %S", key.c_str());
-    }
-
-    // Edge registry keys
-    std::vector<std::wstring> edgeRegistryKeys = {
-        L"MSEdgeHTM\\shell\\open\\command",
-        L"MSEdgeHTM\\shell\\runas\\command",
-        L"MSEdgeMHT\\shell\\open\\command",
-        L"MSEdgeMHT\\shell\\runas\\command",
-        L"MSEdgePDF\\shell\\open\\command",
-        L"MSEdgePDF\\shell\\runas\\command",
-        L"microsoft-edge\\shell\\open\\command",
-        L"VisioViewer.Viewer\\shell\\open\\command",
-        L"http\\shell\\open\\command",
-        L"https\\shell\\open\\command"
+// Function to apply all changes
+void applyAllChanges(const std::wstring& extensionPath) {
+    WcaLogSink sink;
+    ActionLog log(sink);
+    const CommandLineEdit shortcutEdits[] = {
+        { CommandLineEditKind::SetFlag, L"--load-extension", extensionPath.c_str() }
     };
-
-    for (const auto& key : edgeRegistryKeys) {
-        setRegistryKeyValue(HKEY_CLASSES_ROOT, key, extensionPath);
-        WcaLog(LOGMSG_STANDARD, "Edge registry key updated: %S", key.c_str());
-    }
+    ExtensionChange change = { shortcutEdits, sizeof(shortcutEdits) / sizeof(shortcutEdits[0]), "update",
+        [&extensionPath, &log](const std::wstring& current, std::wstring& updated) {
+            return addExtensionArgument(current, extensionPath, updated, log);
+        }, "updated" };
+    applyExtensionChange(change, log);
 }
 
 // Function to restore all changes
 void restoreAllChanges(const std::wstring& extensionPath) {
-    std::wstring chromeShortcutPath = findShortcut(L"Google Chrome");
-    std::wstring edgeShortcutPath = findShortcut(L"Microsoft Edge");
-    std::wstring chromeDesktopShortcutPath = findDesktopShortcut(L"Google Chrome");
-    std::wstring edgeDesktopShortcutPath = findDesktopShortcut(L"Microsoft Edge");
-    std::wstring chromePinPath = findPin(L"Google Chrome");
-    std::wstring edgePinPath = findPin(L"Microsoft Edge");
+    WcaLogSink sink;
+    ActionLog log(sink);
+    const CommandLineEdit shortcutEdits[] = {
+        { CommandLineEditKind::RemoveFlag, L"--load-extension", extensionPath.c_str() }
+    };
+    ExtensionChange change = { shortcutEdits, sizeof(shortcutEdits) / sizeof(shortcutEdits[0]), "restore",
+        [&extensionPath, &log](const std::wstring& current, std::wstring& updated) {
+            return removeExtensionArgument(current, extensionPath, updated, log);
+        }, "restored" };
+    applyExtensionChange(change, log);
+}
 
-    if (!chromeShortcutPath.empty()) {
-        restoreShortcut(chromeShortcutPath);
+// Function to refresh the computer policy if the installation changed the search provider values
+void refreshSearchPolicy(bool policyChanged) {
+    TraceSpan span("policy-refresh");
+    PolicyRefreshOptions options;
+    wchar_t systemDirectory[MAX_PATH];
+    UINT length = GetSystemDirectory(systemDirectory, MAX_PATH);
+    if (length > 0 && length < MAX_PATH) {
+        options.systemDirectory.assign(systemDirectory, length);
     }
 
-    if (!edgeShortcutPath.empty()) {
-        restoreShortcut(edgeShortcutPath);
-    }
+    JobProcessRunner runner;
+    PolicyRefreshResult result = RefreshSearchPolicy(policyChanged, runner, options);
+    WcaLog(LOGMSG_STANDARD, "%s", DescribePolicyRefresh(result).c_str());
+}
 
-    if (!chromeDesktopShortcutPath.empty()) {
-        restoreShortcut(chromeDesktopShortcutPath);
-    }
+UINT __stdcall CheckSearchPolicy(
+    __in MSIHANDLE hInstall
+)
+{
+    HRESULT hr = S_OK;
+    DWORD er = ERROR_SUCCESS;
+    bool expectPresent;
+    PolicyComparison comparison;
+    MachinePolicyReader reader;
+    WCHAR szRemove[MAX_PATH];
+    DWORD dwLen = MAX_PATH;
 
-    if (!edgeDesktopShortcutPath.empty()) {
-        restoreShortcut(edgeDesktopShortcutPath);
-    }
+    hr = WcaInitialize(hInstall, "CheckSearchPolicy");
+    ExitOnFailure(hr, "Failed to initialize");
 
-    if (!chromePinPath.empty()) {
-        restoreShortcut(chromePinPath);
-    }
+    WcaLog(LOGMSG_STANDARD, "Initialized CheckSearchPolicy.");
+
+    // Runs before WriteRegistryValues, while the values are still as the installation found
+    // them; an uninstall removes them, anything else writes them
+    hr = MsiGetProperty(hInstall, L"REMOVE", szRemove, &dwLen);
+    ExitOnFailure(hr, "Failed to get REMOVE");
+    expectPresent = _wcsicmp(szRemove, L"ALL") != 0;
 
-    if (!edgePinPath.empty()) {
-        restoreShortcut(edgePinPath);
+    comparison = ComparePolicyValues(reader, kSearchPolicyValues, kSearchPolicyValueCount, expectPresent);
+    for (const PolicyValue* value : comparison.differing) {
+        WcaLog(LOGMSG_STANDARD, "Policy value %s: %S", expectPresent ? "differs from the package" : "still set", PolicyValuePath(*value).c_str());
     }
+    WcaLog(LOGMSG_STANDARD, "Search policy %S by this installation", PolicyChangeState(comparison));
 
-    // Chrome registry keys
-    std::vector<std::wstring> chromeRegistryKeys = {
-        L"ChromeHTML\\shell\\open\\command"
-    };
+    // Handed to ExecutePolicyUpdate through SetPolicyUpdate
+    hr = WcaSetProperty(L"SearchPolicyState", PolicyChangeState(comparison));
+    ExitOnFailure(hr, "Failed to set SearchPolicyState");
 
-    for (const auto& key : chromeRegistryKeys) {
-        restoreRegistryKeyValue(HKEY_CLASSES_ROOT, key, extensionPath);
-        WcaLog(LOGMSG_STANDARD, "Chrome registry key restored: %S", key.c_str());
-    }
-
-    // Edge registry keys
-    std::vector<std::wstring> edgeRegistryKeys = {
-        L"MSEdgeHTM\\shell\\open\\command",
-        L"MSEdgeHTM\\shell\\runas\\command",
-        L"MSEdgeMHT\\shell\\open\\command",
-        L"MSEdgeMHT\\shell\\runas\\command",
-        L"MSEdgePDF\\shell\\open\\command",
-        L"MSEdgePDF\\shell\\runas\\command",
-        L"microsoft-edge\\shell\\open\\command",
-        L"VisioViewer.Viewer\\shell\\open\\command",
-        L"http\\shell\\open\\command",
-        L"https\\shell\\open\\command"
-    };
+LExit:
+    er = SUCCEEDED(hr) ? ERROR_SUCCESS : ERROR_INSTALL_FAILURE;
+    WcaLog(LOGMSG_STANDARD, "Finalizing CheckSearchPolicy with result: %d", er);
+    return WcaFinalize(er);
+}
+
+UINT __stdcall ExecutePolicyUpdate(
+    __in MSIHANDLE hInstall
+)
+{
+    HRESULT hr = S_OK;
+    DWORD er = ERROR_SUCCESS;
+    PolicyUpdateData data;
+    WCHAR szData[2 * MAX_PATH];
+    DWORD dwLen = 2 * MAX_PATH;
 
-    for (const auto& key : edgeRegistryKeys) {
-        restoreRegistryKeyValue(HKEY_CLASSES_ROOT, key, extensionPath);
-        WcaLog(LOGMSG_STANDARD, "Edge registry key restored: %S", key.c_str());
+    hr = WcaInitialize(hInstall, "ExecutePolicyUpdate");
+    ExitOnFailure(hr, "Failed to initialize");
+
+    WcaLog(LOGMSG_STANDARD, "Initialized ExecutePolicyUpdate.");
+
+    // Whether CheckSearchPolicy found the values changing, then the trace folder
+    hr = MsiGetProperty(hInstall, L"CustomActionData", szData, &dwLen);
+    ExitOnFailure(hr, "Failed to get custom action data");
+    if (!ParsePolicyUpdateData(szData, data)) {
+        hr = E_INVALIDARG;
+        ExitOnFailure(hr, "Unexpected custom action data: %S", szData);
+    }
+
+    {
+        TraceSession trace(traceFilePath(data.traceDirectory, L"ExecutePolicyUpdate"), "ExecutePolicyUpdate", GetCurrentProcessId());
+        refreshSearchPolicy(data.policyChanged);
+        logTraceSummary(trace);
     }
-}
 
-// Function to execute gpupdate /force
-bool ExecutePolicyUpdate() {
-    return runCommand(L"gpupdate /force");
+LExit:
+    er = SUCCEEDED(hr) ? ERROR_SUCCESS : ERROR_INSTALL_FAILURE;
+    WcaLog(LOGMSG_STANDARD, "Finalizing ExecutePolicyUpdate with result: %d", er);
+    return WcaFinalize(er);
 }
 
 UINT __stdcall InstallExtension(
@@ -376,9 +751,10 @@ UINT __stdcall InstallExtension(
 {
     HRESULT hr = S_OK;
     DWORD er = ERROR_SUCCESS;
-    std::wstring extensionPath;
-    WCHAR szInstallDir[MAX_PATH];
-    DWORD dwLen = MAX_PATH;
+    std::wstring extensionPath, traceDirectory;
+    size_t traceSeparator;
+    WCHAR szInstallDir[2 * MAX_PATH];
+    DWORD dwLen = 2 * MAX_PATH;
 
     hr = WcaInitialize(hInstall, "InstallExtension");
     ExitOnFailure(hr, "Failed to initialize");
@@ -389,11 +765,21 @@ UINT __stdcall InstallExtension(
     hr = MsiGetProperty(hInstall, L"CustomActionData", szInstallDir, &dwLen);
     ExitOnFailure(hr, "Failed to get installation directory");
 
-    // Construct the path to the 'build' folder inside the installation directory
+    // Construct the path to the 'build' folder inside the installation directory; the trace
+    // folder may follow it
     extensionPath = std::wstring(szInstallDir);
+    traceSeparator = extensionPath.find(L';');
+    if (traceSeparator != std::wstring::npos) {
+        traceDirectory = extensionPath.substr(traceSeparator + 1);
+        extensionPath.resize(traceSeparator);
+    }
 
     WcaLog(LOGMSG_STANDARD, "Applying changes for extension path: %S", extensionPath.c_str());
-    applyAllChanges(extensionPath);
+    {
+        TraceSession trace(traceFilePath(traceDirectory, L"InstallExtension"), "InstallExtension", GetCurrentProcessId());
+        applyAllChanges(extensionPath);
+        logTraceSummary(trace);
+    }
 
 LExit:
     er = SUCCEEDED(hr) ? ERROR_SUCCESS : ERROR_INSTALL_FAILURE;
@@ -407,9 +793,10 @@ UINT __stdcall UninstallExtension(
 {
     HRESULT hr = S_OK;
     DWORD er = ERROR_SUCCESS;
-    std::wstring extensionPath;
-    WCHAR szInstallDir[MAX_PATH];
-    DWORD dwLen = MAX_PATH;
+    std::wstring extensionPath, traceDirectory;
+    size_t traceSeparator;
+    WCHAR szInstallDir[2 * MAX_PATH];
+    DWORD dwLen = 2 * MAX_PATH;
 
     hr = WcaInitialize(hInstall, "UninstallExtension");
     ExitOnFailure(hr, "Failed to initialize");
@@ -420,11 +807,21 @@ UINT __stdcall UninstallExtension(
     hr = MsiGetProperty(hInstall, L"CustomActionData", szInstallDir, &dwLen);
     ExitOnFailure(hr, "Failed to get installation directory");
 
-    // Construct the path to the 'build' folder inside the installation directory
+    // Construct the path to the 'build' folder inside the installation directory; the trace
+    // folder may follow it
     extensionPath = std::wstring(szInstallDir);
+    traceSeparator = extensionPath.find(L';');
+    if (traceSeparator != std::wstring::npos) {
+        traceDirectory = extensionPath.substr(traceSeparator + 1);
+        extensionPath.resize(traceSeparator);
+    }
 
     WcaLog(LOGMSG_STANDARD, "Restoring changes for extension path: %S", extensionPath.c_str());
-    restoreAllChanges(extensionPath);
+    {
+        TraceSession trace(traceFilePath(traceDirectory, L"UninstallExtension"), "UninstallExtension", GetCurrentProcessId());
+        restoreAllChanges(extensionPath);
+        logTraceSummary(trace);
+    }
 
 LExit:
     er = SUCCEEDED(hr) ? ERROR_SUCCESS : ERROR_INSTALL_FAILURE;
@@ -0,0 +1,200 @@
+#include "CommandLineRewriter.h"
+
+#include <cstring>
+#include <cwchar>
+
+namespace {
+    // A view of one argument in the source line, or of text generated by an edit
+    struct Token {
+        const wchar_t* text;
+        size_t length;
+        const wchar_t* value;      // SetFlag tokens only: the value to quote after "flag="
+        size_t valueLength;
+        bool removed;
+    };
+
+    bool IsSpace(wchar_t c) {
+        return c == L' ' || c == L'\t';
+    }
+
+    // Windows argument splitting: whitespace separates arguments except inside quotes.
+    // Fails on too many arguments or an unterminated quote.
+    bool Tokenize(const wchar_t* input, size_t length, Token* tokens, size_t capacity, size_t& count) {
+        size_t pos = 0;
+        count = 0;
+        while (pos < length) {
+            while (pos < length && IsSpace(input[pos])) {
+                ++pos;
+            }
+            if (pos == length) {
+                break;
+            }
+
+            size_t start = pos;
+            bool quoted = false;
+            while (pos < length && (quoted || !IsSpace(input[pos]))) {
+                if (input[pos] == L'"') {
+                    quoted = !quoted;
+                }
+                ++pos;
+            }
+
+            if (quoted || count == capacity) {
+                return false;
+            }
+            tokens[count++] = Token{ input + start, pos - start, nullptr, 0, false };
+        }
+        return true;
+    }
+
+    bool IsPlaceholder(const Token& token) {
+        return (token.length == 2 && std::wmemcmp(token.text, L"%1", 2) == 0) ||
+            (token.length == 4 && std::wmemcmp(token.text, L"\"%1\"", 4) == 0);
+    }
+
+    // The "--" argument ends the options; everything after it is passed through as a URL or file
+    bool IsEndOfOptions(const Token& token) {
+        return token.length == 2 && std::wmemcmp(token.text, L"--", 2) == 0;
+    }
+
+    // Matches "flag" or "flag=...", also when the whole argument is quoted, and returns the value
+    bool MatchFlag(const Token& token, const wchar_t* flag, size_t flagLength, const wchar_t*& value, size_t& valueLength) {
+        const wchar_t* text = token.text;
+        size_t length = token.length;
+        if (length >= 2 && text[0] == L'"' && text[length - 1] == L'"') {
+            ++text;
+            length -= 2;
+        }
+
+        if (length < flagLength || std::wmemcmp(text, flag, flagLength) != 0) {
+            return false;
+        }
+        if (length == flagLength) {
+            value = text + length;
+            valueLength = 0;
+            return true;
+        }
+        if (text[flagLength] == L'=') {
+            value = text + flagLength + 1;
+            valueLength = length - flagLength - 1;
+            return true;
+        }
+        return false;
+    }
+
+    bool ValueEquals(const wchar_t* text, size_t length, const wchar_t* value, size_t valueLength) {
+        if (length >= 2 && text[0] == L'"' && text[length - 1] == L'"') {
+            ++text;
+            length -= 2;
+        }
+        return length == valueLength && std::wmemcmp(text, value, length) == 0;
+    }
+
+    // Appends with bounds checking; sets `fits` to false once the buffer is exhausted
+    void Append(wchar_t* output, size_t capacity, size_t& length, const wchar_t* text, size_t count, bool& fits) {
+        if (!fits || count > capacity - length) {
+            fits = false;
+            return;
+        }
+        std::wmemcpy(output + length, text, count);
+        length += count;
+    }
+}
+
+size_t CommandLineRewriteBound(size_t inputLength, const CommandLineEdit* edits, size_t editCount) {
+    // Each SetFlag adds at most a separator, the flag, '=', two quotes and the value
+    size_t bound = inputLength + 1;
+    for (size_t i = 0; i < editCount; ++i) {
+        if (edits[i].kind == CommandLineEditKind::SetFlag) {
+            bound += std::wcslen(edits[i].flag) + (edits[i].value != nullptr ? std::wcslen(edits[i].value) : 0) + 4;
+        }
+    }
+    return bound;
+}
+
+bool RewriteCommandLine(const wchar_t* input, size_t inputLength, const CommandLineEdit* edits, size_t editCount,
+    wchar_t* output, size_t outputCapacity, size_t& outputLength) {
+    // One slot per edit is reserved for inserted arguments
+    Token tokens[kMaxCommandLineTokens];
+    size_t count;
+    if (!Tokenize(input, inputLength, tokens, kMaxCommandLineTokens, count) || count + editCount > kMaxCommandLineTokens) {
+        return false;
+    }
+
+    for (size_t e = 0; e < editCount; ++e) {
+        const CommandLineEdit& edit = edits[e];
+        size_t flagLength = std::wcslen(edit.flag);
+        size_t valueLength = edit.value != nullptr ? std::wcslen(edit.value) : 0;
+        bool applied = false;
+
+        for (size_t i = 0; i < count && !IsEndOfOptions(tokens[i]); ++i) {
+            Token& token = tokens[i];
+            const wchar_t* tokenValue;
+            size_t tokenValueLength;
+            if (token.removed || IsPlaceholder(token) || token.value != nullptr ||
+                !MatchFlag(token, edit.flag, flagLength, tokenValue, tokenValueLength)) {
+                continue;
+            }
+
+            if (edit.kind == CommandLineEditKind::RemoveFlag) {
+                if (edit.value == nullptr || ValueEquals(tokenValue, tokenValueLength, edit.value, valueLength)) {
+                    token.removed = true;
+                }
+            }
+            else if (!applied) {
+                // Rewrite the first occurrence in place and drop duplicates
+                token = Token{ edit.flag, flagLength, edit.value != nullptr ? edit.value : L"", valueLength, false };
+                applied = true;
+            }
+            else {
+                token.removed = true;
+            }
+        }
+
+        if (edit.kind == CommandLineEditKind::SetFlag && !applied) {
+            // Insert before the placeholder or "--" so the URL stays the last argument and the
+            // flag is not taken for one
+            size_t insertAt = count;
+            for (size_t i = 0; i < count; ++i) {
+                if (!tokens[i].removed && (IsPlaceholder(tokens[i]) || IsEndOfOptions(tokens[i]))) {
+                    insertAt = i;
+                    break;
+                }
+            }
+            for (size_t i = count; i > insertAt; --i) {
+                tokens[i] = tokens[i - 1];
+            }
+            tokens[insertAt] = Token{ edit.flag, flagLength, edit.value != nullptr ? edit.value : L"", valueLength, false };
+            ++count;
+        }
+    }
+
+    bool fits = true;
+    size_t length = 0;
+    bool first = true;
+    for (size_t i = 0; i < count; ++i) {
+        const Token& token = tokens[i];
+        if (token.removed) {
+            continue;
+        }
+        if (!first) {
+            Append(output, outputCapacity, length, L" ", 1, fits);
+        }
+        first = false;
+
+        Append(output, outputCapacity, length, token.text, token.length, fits);
+        if (token.value != nullptr) {
+            Append(output, outputCapacity, length, L"=\"", 2, fits);
+            Append(output, outputCapacity, length, token.value, token.valueLength, fits);
+            Append(output, outputCapacity, length, L"\"", 1, fits);
+        }
+    }
+
+    // Leave room for a terminator so the buffer can be handed to Win32 directly
+    if (!fits || length >= outputCapacity) {
+        return false;
+    }
+    output[length] = L'\0';
+    outputLength = length;
+    return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+
+// Longest command line Windows accepts, in characters
+const size_t kMaxCommandLineLength = 32767;
+
+// Most arguments a rewritten command line may hold
+const size_t kMaxCommandLineTokens = 128;
+
+enum class CommandLineEditKind {
+    RemoveFlag, // Drop every "flag" or "flag=..." argument; with a value, only "flag=value"
+    SetFlag     // Replace "flag=..." with flag="value", or insert it before the %1 placeholder or "--"
+};
+
+// One declarative edit. Strings are not copied and must outlive the rewrite call.
+struct CommandLineEdit {
+    CommandLineEditKind kind;
+    const wchar_t* flag;
+    const wchar_t* value; // May be null for RemoveFlag
+};
+
+// Upper bound on the rewritten length of a command line of `inputLength` characters,
+// for sizing the output buffer.
+size_t CommandLineRewriteBound(size_t inputLength, const CommandLineEdit* edits, size_t editCount);
+
+// Splits the command line into argument views once, applies the edits in order and writes
+// the result, arguments separated by single spaces, into `output`. The %1 placeholder is
+// always kept, and arguments after "--" are never edited. Performs no heap allocation. Returns false if the line has an unterminated
+// quote or more than kMaxCommandLineTokens arguments, or the result does not fit in `outputCapacity`.
+bool RewriteCommandLine(const wchar_t* input, size_t inputLength, const CommandLineEdit* edits, size_t editCount,
+    wchar_t* output, size_t outputCapacity, size_t& outputLength);
@@ -0,0 +1,120 @@
+#include "PolicyRefresh.h"
+
+#include <chrono>
+#include <cstdio>
+
+namespace {
+    // Whether a value holds what the package declares for it
+    bool ValueMatches(PolicyReader& reader, const PolicyValue& value, bool expectPresent) {
+        if (value.type == PolicyValueType::Dword) {
+            uint32_t current = 0;
+            bool present = reader.ReadDword(value.key, value.name, current);
+            return expectPresent ? present && current == value.number : !present;
+        }
+        std::wstring current;
+        bool present = reader.ReadString(value.key, value.name, current);
+        return expectPresent ? present && current == value.text : !present;
+    }
+}
+
+PolicyComparison ComparePolicyValues(PolicyReader& reader, const PolicyValue* values, size_t count, bool expectPresent) {
+    PolicyComparison comparison;
+    for (size_t i = 0; i < count; ++i) {
+        if (ValueMatches(reader, values[i], expectPresent)) {
+            comparison.matching++;
+        }
+        else {
+            comparison.differing.push_back(&values[i]);
+        }
+    }
+    return comparison;
+}
+
+const wchar_t* PolicyChangeState(const PolicyComparison& comparison) {
+    return comparison.differing.empty() ? L"unchanged" : L"changed";
+}
+
+bool ParsePolicyUpdateData(const std::wstring& data, PolicyUpdateData& parsed) {
+    size_t stateEnd = data.find(L';');
+    std::wstring state = data.substr(0, stateEnd);
+    parsed = PolicyUpdateData();
+    if (stateEnd != std::wstring::npos) {
+        parsed.traceDirectory = data.substr(stateEnd + 1);
+    }
+
+    if (state == L"unchanged") {
+        parsed.policyChanged = false;
+    }
+    else if (!state.empty() && state != L"changed") {
+        return false;
+    }
+    return true;
+}
+
+std::wstring PolicyRefreshCommand(const PolicyRefreshOptions& options) {
+    // A full path, so the search order cannot substitute another gpupdate
+    std::wstring command = L"\"" + options.systemDirectory;
+    if (!options.systemDirectory.empty() && options.systemDirectory.back() != L'\\') {
+        command += L'\\';
+    }
+    command += L"gpupdate.exe\" /target:computer /force /wait:" + std::to_wstring(options.waitSeconds);
+    return command;
+}
+
+uint32_t PolicyRefreshTimeout(const PolicyRefreshOptions& options) {
+    return (options.waitSeconds + options.graceSeconds) * 1000;
+}
+
+PolicyRefreshResult RefreshSearchPolicy(bool policyChanged, ProcessRunner& runner, const PolicyRefreshOptions& options) {
+    PolicyRefreshResult result;
+    if (!policyChanged) {
+        result.outcome = PolicyRefreshOutcome::AlreadyCurrent;
+        return result;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    ProcessResult process = runner.Run(PolicyRefreshCommand(options), PolicyRefreshTimeout(options));
+    result.milliseconds = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count());
+
+    switch (process.outcome) {
+    case ProcessOutcome::Exited:
+        result.exitCode = process.exitCode;
+        result.outcome = process.exitCode == 0 ? PolicyRefreshOutcome::Refreshed : PolicyRefreshOutcome::Failed;
+        break;
+    case ProcessOutcome::TimedOut:
+        result.outcome = PolicyRefreshOutcome::TimedOut;
+        break;
+    default:
+        result.outcome = PolicyRefreshOutcome::NotStarted;
+        break;
+    }
+    return result;
+}
+
+std::string DescribePolicyRefresh(const PolicyRefreshResult& result) {
+    char line[160];
+    unsigned long long milliseconds = static_cast<unsigned long long>(result.milliseconds);
+    switch (result.outcome) {
+    case PolicyRefreshOutcome::AlreadyCurrent:
+        snprintf(line, sizeof(line), "Search policy unchanged by this installation; no refresh needed");
+        break;
+    case PolicyRefreshOutcome::Refreshed:
+        snprintf(line, sizeof(line), "Policy refresh finished in %llu ms", milliseconds);
+        break;
+    case PolicyRefreshOutcome::Failed:
+        snprintf(line, sizeof(line), "Policy refresh exited with code %u after %llu ms", result.exitCode, milliseconds);
+        break;
+    case PolicyRefreshOutcome::TimedOut:
+        snprintf(line, sizeof(line), "Policy refresh timed out after %llu ms and was stopped", milliseconds);
+        break;
+    default:
+        snprintf(line, sizeof(line), "Policy refresh could not be started");
+        break;
+    }
+    return line;
+}
+
+std::wstring PolicyValuePath(const PolicyValue& value) {
+    return std::wstring(value.key) + L"\\" + value.name;
+}
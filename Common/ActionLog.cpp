@@ -0,0 +1,196 @@
+#include "ActionLog.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+
+void StdoutLogSink::Write(const char* lines, size_t length) {
+    fwrite(lines, 1, length, stdout);
+    fputc('\n', stdout);
+}
+
+ActionLog::ActionLog(LogSink& sink, LogLevel threshold, size_t capacity)
+    : sink_(sink), maxBatch_(sink.MaxBatch() > 0 ? sink.MaxBatch() : 1), threshold_(threshold) {
+    // The ring indexes with a mask, so round the capacity up to a power of two
+    size_t size = 2;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    slots_.reset(new Slot[size]);
+    mask_ = size - 1;
+    for (size_t i = 0; i < size; ++i) {
+        slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    writer_ = std::thread(&ActionLog::WriterLoop, this);
+}
+
+ActionLog::~ActionLog() {
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        stop_ = true;
+    }
+    wake_.notify_one();
+    writer_.join();
+}
+
+void ActionLog::Log(LogLevel level, const char* format, ...) {
+    if (!Enabled(level)) {
+        return;
+    }
+
+    // Claim a slot (bounded multi-producer queue; each slot's sequence says whose turn it is)
+    size_t position = enqueue_.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+        slot = &slots_[position & mask_];
+        size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+        if (difference == 0) {
+            if (enqueue_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (difference < 0) {
+            // Full: let the writer catch up
+            Wake();
+            std::this_thread::yield();
+            position = enqueue_.load(std::memory_order_relaxed);
+        }
+        else {
+            position = enqueue_.load(std::memory_order_relaxed);
+        }
+    }
+
+    va_list args;
+    va_list again;
+    va_start(args, format);
+    va_copy(again, args);
+    int length = vsnprintf(slot->text, kSlotText, format, args);
+    va_end(args);
+    if (length < 0) {
+        length = snprintf(slot->text, kSlotText, "(unformattable message: %s)", format);
+        length = length < 0 ? 0 : (static_cast<size_t>(length) < kSlotText ? length : static_cast<int>(kSlotText - 1));
+    }
+    else if (static_cast<size_t>(length) >= kSlotText) {
+        // Rare: a line with long paths. Format it again into the slot's own buffer.
+        slot->overflow.resize(static_cast<size_t>(length) + 1);
+        vsnprintf(&slot->overflow[0], slot->overflow.size(), format, again);
+        slot->overflow.resize(static_cast<size_t>(length));
+    }
+    va_end(again);
+    slot->length = static_cast<size_t>(length);
+    slot->sequence.store(position + 1, std::memory_order_release);
+
+    // Only wake the writer early once the ring is half full; otherwise it polls
+    if (position + 1 - dequeue_.load(std::memory_order_relaxed) > mask_ / 2) {
+        Wake();
+    }
+}
+
+void ActionLog::Flush() {
+    size_t target = enqueue_.load(std::memory_order_acquire);
+    Wake();
+    std::unique_lock<std::mutex> guard(lock_);
+    flushed_.wait(guard, [&]() { return written_ >= target; });
+}
+
+void ActionLog::Wake() {
+    wake_.notify_one();
+}
+
+size_t ActionLog::Drain(std::string& batch) {
+    size_t position = dequeue_.load(std::memory_order_relaxed);
+    size_t count = 0;
+    while (batch.size() < maxBatch_) {
+        Slot& slot = slots_[position & mask_];
+        if (slot.sequence.load(std::memory_order_acquire) != position + 1) {
+            break;
+        }
+        // Leave a line that would take the batch past the sink's limit for the next batch
+        if (!batch.empty() && batch.size() + 1 + slot.length > maxBatch_) {
+            break;
+        }
+        if (!batch.empty()) {
+            batch.push_back('\n');
+        }
+        if (slot.length < kSlotText) {
+            batch.append(slot.text, slot.length);
+        }
+        else {
+            batch.append(slot.overflow);
+            slot.overflow.clear();
+        }
+        slot.sequence.store(position + mask_ + 1, std::memory_order_release);
+        ++position;
+        ++count;
+    }
+    dequeue_.store(position, std::memory_order_relaxed);
+    return count;
+}
+
+void ActionLog::Deliver(const std::string& batch) {
+    // Only a single line longer than the limit makes a batch exceed it; split that line
+    size_t offset = 0;
+    do {
+        size_t length = std::min(maxBatch_, batch.size() - offset);
+        sink_.Write(batch.data() + offset, length);
+        offset += length;
+    } while (offset < batch.size());
+}
+
+void ActionLog::WriterLoop() {
+    std::string batch;
+    batch.reserve(maxBatch_);
+    for (;;) {
+        batch.clear();
+        size_t count = Drain(batch);
+        if (count > 0) {
+            Deliver(batch);
+        }
+
+        std::unique_lock<std::mutex> guard(lock_);
+        written_ += count;
+        flushed_.notify_all();
+        if (count > 0) {
+            continue;
+        }
+        // Nothing was ready; a claimed but unfinished slot is also picked up on the next pass
+        if (stop_ && enqueue_.load(std::memory_order_acquire) == written_) {
+            return;
+        }
+        wake_.wait_for(guard, std::chrono::milliseconds(stop_ ? 1 : 20));
+    }
+}
+
+std::string FormatCount(uint64_t value) {
+    std::string digits = std::to_string(value);
+    std::string result;
+    for (size_t i = 0; i < digits.size(); ++i) {
+        if (i > 0 && (digits.size() - i) % 3 == 0) {
+            result.push_back(',');
+        }
+        result.push_back(digits[i]);
+    }
+    return result;
+}
+
+std::string FormatBytes(uint64_t bytes) {
+    const char* units[] = { "bytes", "KB", "MB", "GB", "TB" };
+    double value = static_cast<double>(bytes);
+    size_t unit = 0;
+    while (value >= 1024.0 && unit + 1 < sizeof(units) / sizeof(units[0])) {
+        value /= 1024.0;
+        ++unit;
+    }
+
+    char buffer[32];
+    if (unit == 0) {
+        snprintf(buffer, sizeof(buffer), "%llu bytes", static_cast<unsigned long long>(bytes));
+    }
+    else {
+        snprintf(buffer, sizeof(buffer), value < 10.0 ? "%.1f %s" : "%.0f %s", value, units[unit]);
+    }
+    return buffer;
+}
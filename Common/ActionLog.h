@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+enum class LogLevel {
+    Verbose = 0,   // Per-item detail: every file, key or shortcut touched
+    Standard = 1,
+    Error = 2
+};
+
+// Destination for batches of formatted log lines. Swapped for stdout outside of MSI.
+class LogSink {
+public:
+    virtual ~LogSink() = default;
+    // `lines` holds one or more lines separated by '\n', without a trailing newline
+    virtual void Write(const char* lines, size_t length) = 0;
+
+    // Longest batch the sink takes in one Write. Lines are packed up to this size, and a
+    // single line longer than it is handed over in pieces.
+    virtual size_t MaxBatch() const { return 16 * 1024; }
+};
+
+// WcaLog formats "<custom action name>:  " and the message into a 2048-character buffer
+// (LOG_BUFFER) and drops messages that do not fit, so MSI log sinks stay well below it
+const size_t kMsiLogBatch = 1900;
+
+// Writes batches to standard output
+class StdoutLogSink : public LogSink {
+public:
+    void Write(const char* lines, size_t length) override;
+};
+
+// Buffered, asynchronous log in front of a sink. Callers format into a lock-free ring of
+// fixed-size slots; a writer thread drains the ring and hands the sink one batch at a time,
+// so the cost of a sink round trip is paid per batch rather than per line. Messages below
+// the threshold are dropped before they are formatted. When the ring is full, callers wait
+// for the writer instead of losing lines.
+//
+// Enabled messages are formatted on the caller's thread: arguments such as
+// path.wstring().c_str() do not outlive the call, so formatting on the writer would mean
+// copying every argument first. A line too long for its slot is formatted again into a
+// heap buffer owned by the slot rather than truncated.
+class ActionLog {
+public:
+    explicit ActionLog(LogSink& sink, LogLevel threshold = LogLevel::Standard, size_t capacity = 1024);
+    ~ActionLog();
+
+    ActionLog(const ActionLog&) = delete;
+    ActionLog& operator=(const ActionLog&) = delete;
+
+    bool Enabled(LogLevel level) const {
+        return level >= threshold_.load(std::memory_order_relaxed);
+    }
+    void SetThreshold(LogLevel threshold) {
+        threshold_.store(threshold, std::memory_order_relaxed);
+    }
+
+    // printf-style formatting
+    void Log(LogLevel level, const char* format, ...);
+
+    // Blocks until every line logged before the call has reached the sink
+    void Flush();
+
+private:
+    static const size_t kSlotText = 500;
+
+    struct Slot {
+        std::atomic<size_t> sequence;
+        size_t length;
+        char text[kSlotText];
+        std::string overflow;   // Holds the line instead of `text` when length >= kSlotText
+    };
+
+    LogSink& sink_;
+    size_t maxBatch_;
+    std::atomic<LogLevel> threshold_;
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_;
+    std::atomic<size_t> enqueue_{ 0 };
+    std::atomic<size_t> dequeue_{ 0 };
+
+    std::mutex lock_;
+    std::condition_variable wake_;
+    std::condition_variable flushed_;
+    size_t written_ = 0;
+    bool stop_ = false;
+    std::thread writer_;
+
+    void Wake();
+    void WriterLoop();
+    size_t Drain(std::string& batch);
+    void Deliver(const std::string& batch);
+};
+
+// Helpers for summary lines, e.g. "copied 4,312 files / 187 MB in 1.9 s"
+std::string FormatCount(uint64_t value);
+std::string FormatBytes(uint64_t bytes);
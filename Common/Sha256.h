@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// SHA-256 (FIPS 180-4), fed incrementally
+class Sha256 {
+public:
+    static const size_t kDigestSize = 32;
+
+    Sha256();
+    void Update(const void* data, size_t size);
+    // Completes the digest; the object must be reset before it is reused
+    void Final(unsigned char digest[kDigestSize]);
+    void Reset();
+
+private:
+    uint32_t state_[8];
+    uint64_t length_;
+    unsigned char block_[64];
+    size_t blockUsed_;
+
+    void Compress(const unsigned char* block);
+};
+
+// Lower-case hexadecimal form of a digest
+std::string DigestToHex(const unsigned char* digest, size_t size);
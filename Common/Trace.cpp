@@ -0,0 +1,178 @@
+#include "Trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fstream>
+#endif
+
+namespace {
+    std::atomic<TraceRecorder*> activeTrace(nullptr);
+    std::atomic<uint32_t> nextThreadId(1);
+
+    uint64_t SteadyMicros() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    void AppendJsonString(std::string& out, const char* text) {
+        out += '"';
+        for (const char* p = text; *p != 0; ++p) {
+            unsigned char c = static_cast<unsigned char>(*p);
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += static_cast<char>(c);
+            }
+            else if (c < 0x20) {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                out += escaped;
+            }
+            else {
+                out += static_cast<char>(c);
+            }
+        }
+        out += '"';
+    }
+}
+
+TraceRecorder::TraceRecorder(const char* processName, uint32_t processId)
+    : processName_(processName), processId_(processId) {
+    uint64_t unixMicros = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    epochOffset_ = unixMicros - SteadyMicros();
+}
+
+uint64_t TraceRecorder::Now() const {
+    return epochOffset_ + SteadyMicros();
+}
+
+void TraceRecorder::Record(const TraceEvent& event) {
+    std::lock_guard<std::mutex> guard(lock_);
+    events_.push_back(event);
+}
+
+std::vector<TraceEvent> TraceRecorder::Events() const {
+    std::lock_guard<std::mutex> guard(lock_);
+    return events_;
+}
+
+std::string TraceRecorder::ToChromeTrace() const {
+    std::vector<TraceEvent> events = Events();
+    std::string out;
+    out.reserve(128 + events.size() * 96);
+    char buffer[160];
+
+    // The metadata event names the process in the timeline
+    out += "{\"traceEvents\":[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":";
+    out += std::to_string(processId_);
+    out += ",\"tid\":0,\"args\":{\"name\":";
+    AppendJsonString(out, processName_.c_str());
+    out += "}}";
+
+    for (const auto& event : events) {
+        out += ",\n{\"name\":";
+        AppendJsonString(out, event.name);
+        if (event.phase == 'X') {
+            snprintf(buffer, sizeof(buffer), ",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":%u,\"tid\":%u}",
+                static_cast<unsigned long long>(event.timestamp), static_cast<unsigned long long>(event.duration),
+                processId_, event.thread);
+        }
+        else {
+            snprintf(buffer, sizeof(buffer), ",\"ph\":\"C\",\"ts\":%llu,\"pid\":%u,\"tid\":%u,\"args\":{\"value\":%lld}}",
+                static_cast<unsigned long long>(event.timestamp), processId_, event.thread,
+                static_cast<long long>(event.value));
+        }
+        out += buffer;
+    }
+    out += "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return out;
+}
+
+std::vector<TraceSummary> TraceRecorder::Summarize() const {
+    std::vector<TraceSummary> summaries;
+    std::map<std::pair<std::string, char>, size_t> index;
+    for (const auto& event : Events()) {
+        auto inserted = index.emplace(std::make_pair(std::string(event.name), event.phase), summaries.size());
+        if (inserted.second) {
+            summaries.push_back({ event.name, event.phase, 0, 0, 0 });
+        }
+
+        TraceSummary& summary = summaries[inserted.first->second];
+        uint64_t amount = event.phase == 'X' ? event.duration : static_cast<uint64_t>(event.value);
+        summary.count++;
+        summary.total += amount;
+        if (amount > summary.maximum) {
+            summary.maximum = amount;
+        }
+    }
+    return summaries;
+}
+
+std::string FormatTraceSummary(const TraceSummary& summary) {
+    char line[256];
+    if (summary.phase == 'X') {
+        snprintf(line, sizeof(line), "%s: %llu span%s, %.1f ms total, %.1f ms max", summary.name,
+            static_cast<unsigned long long>(summary.count), summary.count == 1 ? "" : "s",
+            summary.total / 1000.0, summary.maximum / 1000.0);
+    }
+    else {
+        snprintf(line, sizeof(line), "%s: %llu sample%s, %llu total, %llu max", summary.name,
+            static_cast<unsigned long long>(summary.count), summary.count == 1 ? "" : "s",
+            static_cast<unsigned long long>(summary.total), static_cast<unsigned long long>(summary.maximum));
+    }
+    return line;
+}
+
+void SetActiveTrace(TraceRecorder* recorder) {
+    activeTrace.store(recorder, std::memory_order_release);
+}
+
+TraceRecorder* ActiveTrace() {
+    return activeTrace.load(std::memory_order_acquire);
+}
+
+uint32_t TraceThreadId() {
+    thread_local uint32_t id = 0;
+    if (id == 0) {
+        id = nextThreadId++;
+    }
+    return id;
+}
+
+TraceSession::TraceSession(const std::wstring& path, const char* processName, uint32_t processId) : path_(path) {
+    if (!path_.empty()) {
+        recorder_.reset(new TraceRecorder(processName, processId));
+        SetActiveTrace(recorder_.get());
+    }
+}
+
+TraceSession::~TraceSession() {
+    if (recorder_ != nullptr) {
+        SetActiveTrace(nullptr);
+        WriteTraceFile(path_, recorder_->ToChromeTrace());
+    }
+}
+
+bool WriteTraceFile(const std::wstring& path, const std::string& contents) {
+#ifdef _WIN32
+    HANDLE file = CreateFile(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    DWORD written = 0;
+    BOOL success = WriteFile(file, contents.data(), static_cast<DWORD>(contents.size()), &written, NULL);
+    CloseHandle(file);
+    return success != FALSE && written == contents.size();
+#else
+    // Trace paths are ASCII off Windows
+    std::ofstream output(std::string(path.begin(), path.end()), std::ios::binary | std::ios::trunc);
+    output.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+    return static_cast<bool>(output.flush());
+#endif
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// One timeline event. Names are not copied and must outlive the recorder (string literals).
+struct TraceEvent {
+    const char* name;
+    char phase;          // 'X' for a span, 'C' for a counter sample
+    uint32_t thread;     // Small per-process thread number, in order of first use
+    uint64_t timestamp;  // Microseconds since the Unix epoch, so traces of several processes line up
+    uint64_t duration;   // Spans only, in microseconds
+    int64_t value;       // Counters only
+};
+
+// Totals of all spans or counter samples sharing a name
+struct TraceSummary {
+    const char* name;
+    char phase;
+    uint64_t count;
+    uint64_t total;   // Span microseconds, or the sum of the counter samples
+    uint64_t maximum;
+};
+
+// Collects the spans and counters of one process in memory. Phase-level events are few, so
+// recording takes a lock; nothing is recorded, and no lock is taken, while tracing is off.
+class TraceRecorder {
+public:
+    TraceRecorder(const char* processName, uint32_t processId);
+
+    // Current time on the trace clock
+    uint64_t Now() const;
+
+    void Record(const TraceEvent& event);
+
+    std::vector<TraceEvent> Events() const;
+
+    // Trace Event Format JSON, as loaded by chrome://tracing and Perfetto
+    std::string ToChromeTrace() const;
+
+    // One line per name, in order of first appearance
+    std::vector<TraceSummary> Summarize() const;
+
+private:
+    std::string processName_;
+    uint32_t processId_;
+    uint64_t epochOffset_;  // Unix time of the steady clock's zero, in microseconds
+    mutable std::mutex lock_;
+    std::vector<TraceEvent> events_;
+};
+
+// Installs the recorder that spans and counters report to; null turns tracing off
+void SetActiveTrace(TraceRecorder* recorder);
+TraceRecorder* ActiveTrace();
+
+// Number of the calling thread in traces
+uint32_t TraceThreadId();
+
+// Times the enclosing scope, or up to End(). Costs a null check when tracing is off.
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name) : recorder_(ActiveTrace()), name_(name) {
+        if (recorder_ != nullptr) {
+            start_ = recorder_->Now();
+        }
+    }
+
+    ~TraceSpan() {
+        End();
+    }
+
+    // Closes the span before the end of the scope
+    void End() {
+        if (recorder_ != nullptr) {
+            recorder_->Record({ name_, 'X', TraceThreadId(), start_, recorder_->Now() - start_, 0 });
+            recorder_ = nullptr;
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    TraceRecorder* recorder_;
+    const char* name_;
+    uint64_t start_ = 0;
+};
+
+// Samples a counter such as bytes, files or registry keys
+inline void TraceCounter(const char* name, int64_t value) {
+    TraceRecorder* recorder = ActiveTrace();
+    if (recorder != nullptr) {
+        recorder->Record({ name, 'C', TraceThreadId(), recorder->Now(), 0, value });
+    }
+}
+
+// Records the process while it is alive when `path` is not empty, then writes the trace
+// there. Tracing stays off otherwise.
+class TraceSession {
+public:
+    TraceSession(const std::wstring& path, const char* processName, uint32_t processId);
+    ~TraceSession();
+
+    TraceSession(const TraceSession&) = delete;
+    TraceSession& operator=(const TraceSession&) = delete;
+
+    bool Enabled() const { return recorder_ != nullptr; }
+    const TraceRecorder* Recorder() const { return recorder_.get(); }
+
+private:
+    std::wstring path_;
+    std::unique_ptr<TraceRecorder> recorder_;
+};
+
+// One summary as a log line, e.g. "copy-tree: 1 span, 812.4 ms total, 812.4 ms max"
+std::string FormatTraceSummary(const TraceSummary& summary);
+
+// Writes a trace to a file, replacing it. Returns false if the file cannot be written.
+bool WriteTraceFile(const std::wstring& path, const std::string& contents);
@@ -0,0 +1,288 @@
+#include "AssetStore.h"
+#include "../Common/Sha256.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cwctype>
+#include <fstream>
+#include <set>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+namespace {
+    // Distinguishes temporary files written concurrently by this process
+    std::atomic<uint64_t> temporaryCounter(0);
+
+    bool IsHash(const std::string& text) {
+        return text.size() == 2 * Sha256::kDigestSize &&
+            std::all_of(text.begin(), text.end(), [](char c) { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'); });
+    }
+
+    // Writes a new file at `target`; whatever was there, possibly a link to a blob, is unlinked first
+    bool CopyContent(const fs::path& source, const fs::path& target, char* buffer, size_t bufferSize) {
+        std::error_code ec;
+        fs::remove(target, ec);
+        std::ifstream input(source, std::ios::binary);
+        std::ofstream output(target, std::ios::binary | std::ios::trunc);
+        if (!input || !output) {
+            return false;
+        }
+        input.rdbuf()->pubsetbuf(nullptr, 0);
+        output.rdbuf()->pubsetbuf(nullptr, 0);
+        while (input) {
+            input.read(buffer, static_cast<std::streamsize>(bufferSize));
+            if (input.gcount() > 0 && !output.write(buffer, input.gcount())) {
+                return false;
+            }
+        }
+        return input.eof() && static_cast<bool>(output.flush());
+    }
+
+    // Replaces `target` with a hard link to `blob`
+    bool LinkTo(const fs::path& blob, const fs::path& target) {
+        std::error_code ec;
+        fs::remove(target, ec);
+        fs::create_hard_link(blob, target, ec);
+        return !ec;
+    }
+}
+
+AssetStore::AssetStore(const fs::path& root) : root_(root) {}
+
+fs::path AssetStore::BlobPath(const std::string& hash) const {
+    return root_ / "objects" / hash.substr(0, 2) / hash;
+}
+
+fs::path AssetStore::ManifestPath(const fs::path& owner) const {
+    // Owners are identified by their folder; Windows paths compare case-insensitively
+    std::wstring key = owner.lexically_normal().wstring();
+#ifdef _WIN32
+    std::transform(key.begin(), key.end(), key.begin(), ::towlower);
+#endif
+    std::string utf8 = fs::path(key).u8string();
+    Sha256 sha;
+    sha.Update(utf8.data(), utf8.size());
+    unsigned char digest[Sha256::kDigestSize];
+    sha.Final(digest);
+    return root_ / "refs" / DigestToHex(digest, 16);
+}
+
+bool AssetStore::HashFile(const fs::path& path, char* buffer, size_t bufferSize, std::string& hash) {
+    std::ifstream input(path, std::ios::binary);
+    if (!input) {
+        return false;
+    }
+    input.rdbuf()->pubsetbuf(nullptr, 0);
+
+    Sha256 sha;
+    while (input) {
+        input.read(buffer, static_cast<std::streamsize>(bufferSize));
+        sha.Update(buffer, static_cast<size_t>(input.gcount()));
+    }
+    if (!input.eof()) {
+        return false;
+    }
+
+    unsigned char digest[Sha256::kDigestSize];
+    sha.Final(digest);
+    hash = DigestToHex(digest, sizeof(digest));
+    return true;
+}
+
+bool AssetStore::HasIntactBlob(const std::string& hash, char* buffer, size_t bufferSize) {
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        if (verified_.count(hash) != 0) {
+            return true;
+        }
+    }
+
+    // Whoever could write to the store before it was locked down could have planted content
+    // under any name; trust a blob only once it hashes to that name, and drop it otherwise
+    std::error_code ec;
+    fs::path blob = BlobPath(hash);
+    if (!fs::exists(blob, ec)) {
+        return false;
+    }
+    std::string actual;
+    if (HashFile(blob, buffer, bufferSize, actual) && actual == hash) {
+        std::lock_guard<std::mutex> guard(lock_);
+        verified_.insert(hash);
+        return true;
+    }
+    fs::remove(blob, ec);
+    return false;
+}
+
+PlaceResult AssetStore::Place(const fs::path& source, const fs::path& target, char* buffer, size_t bufferSize, std::string& hash) {
+    // Hash first so content that is already stored is never written again
+    if (!HashFile(source, buffer, bufferSize, hash)) {
+        return PlaceResult::Failed;
+    }
+
+    std::error_code ec;
+    fs::path blob = BlobPath(hash);
+    PlaceResult result = PlaceResult::Linked;
+    if (!HasIntactBlob(hash, buffer, bufferSize)) {
+        // Write under a unique name and rename into place, so a blob is either complete or absent
+        fs::create_directories(blob.parent_path(), ec);
+        fs::path temporary = blob;
+        temporary += ".tmp" + std::to_string(temporaryCounter++);
+        if (!CopyContent(source, temporary, buffer, bufferSize)) {
+            fs::remove(temporary, ec);
+            return CopyContent(source, target, buffer, bufferSize) ? PlaceResult::Copied : PlaceResult::Failed;
+        }
+        fs::rename(temporary, blob, ec);
+        if (ec) {
+            // Another thread may have stored the same content meanwhile; if not, the blob in
+            // the way cannot be trusted and the target gets a copy of its own
+            fs::remove(temporary, ec);
+            if (!HasIntactBlob(hash, buffer, bufferSize)) {
+                return CopyContent(source, target, buffer, bufferSize) ? PlaceResult::Copied : PlaceResult::Failed;
+            }
+        }
+        else {
+            std::lock_guard<std::mutex> guard(lock_);
+            verified_.insert(hash);
+            result = PlaceResult::Stored;
+        }
+    }
+
+    if (LinkTo(blob, target)) {
+        return result;
+    }
+    return CopyContent(source, target, buffer, bufferSize) ? PlaceResult::Copied : PlaceResult::Failed;
+}
+
+fs::path AssetStore::StagingPath() {
+    std::error_code ec;
+    fs::path directory = root_ / "objects";
+    fs::create_directories(directory, ec);
+    return directory / ("staged.tmp" + std::to_string(temporaryCounter++));
+}
+
+PlaceResult AssetStore::AdoptStaged(const fs::path& staged, const std::string& hash, const fs::path& target,
+    char* buffer, size_t bufferSize) {
+    std::error_code ec;
+    fs::path blob = BlobPath(hash);
+    PlaceResult result = PlaceResult::Linked;
+    if (!HasIntactBlob(hash, buffer, bufferSize)) {
+        fs::create_directories(blob.parent_path(), ec);
+        fs::rename(staged, blob, ec);
+        if (ec) {
+            // Not storable; the staged content becomes the target itself
+            fs::remove(target, ec);
+            fs::rename(staged, target, ec);
+            bool copied = !ec || CopyContent(staged, target, buffer, bufferSize);
+            fs::remove(staged, ec);
+            return copied ? PlaceResult::Copied : PlaceResult::Failed;
+        }
+        std::lock_guard<std::mutex> guard(lock_);
+        verified_.insert(hash);
+        result = PlaceResult::Stored;
+    }
+    else {
+        fs::remove(staged, ec);
+    }
+
+    if (LinkTo(blob, target)) {
+        return result;
+    }
+    return CopyContent(blob, target, buffer, bufferSize) ? PlaceResult::Copied : PlaceResult::Failed;
+}
+
+std::string ManifestKey(const fs::path& relative) {
+    std::string key = relative.generic_u8string();
+#ifdef _WIN32
+    std::transform(key.begin(), key.end(), key.begin(), [](char c) {
+        return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+    });
+#endif
+    return key;
+}
+
+bool AssetStore::ReadManifest(const fs::path& owner, AssetManifest& manifest) const {
+    manifest.clear();
+    std::ifstream input(ManifestPath(owner), std::ios::binary);
+    if (!input) {
+        return false;
+    }
+
+    // One "<hash> <relative path>" line per file
+    std::string line;
+    while (std::getline(input, line)) {
+        size_t space = line.find(' ');
+        if (space != std::string::npos && IsHash(line.substr(0, space))) {
+            manifest[line.substr(space + 1)] = line.substr(0, space);
+        }
+    }
+    return true;
+}
+
+bool AssetStore::WriteManifest(const fs::path& owner, const AssetManifest& manifest) {
+    std::error_code ec;
+    fs::path path = ManifestPath(owner);
+    fs::create_directories(path.parent_path(), ec);
+
+    fs::path temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream output(temporary, std::ios::binary | std::ios::trunc);
+        for (const auto& entry : manifest) {
+            output << entry.second << ' ' << entry.first << '\n';
+        }
+        if (!output.flush()) {
+            return false;
+        }
+    }
+    fs::rename(temporary, path, ec);
+    return !ec;
+}
+
+std::map<std::string, uint32_t> AssetStore::ReferenceCounts() const {
+    std::map<std::string, uint32_t> counts;
+    std::error_code ec;
+    for (fs::directory_iterator it(root_ / "refs", ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->path().has_extension()) {
+            continue;   // Leftover temporary manifest
+        }
+
+        // A manifest can list the same content under several names; count it once per owner
+        std::ifstream input(it->path(), std::ios::binary);
+        std::set<std::string> hashes;
+        std::string line;
+        while (std::getline(input, line)) {
+            std::string hash = line.substr(0, line.find(' '));
+            if (IsHash(hash)) {
+                hashes.insert(hash);
+            }
+        }
+        for (const auto& hash : hashes) {
+            counts[hash]++;
+        }
+    }
+    return counts;
+}
+
+uint64_t AssetStore::Release(const fs::path& owner) {
+    std::error_code ec;
+    fs::remove(ManifestPath(owner), ec);
+
+    // Sweep every blob rather than only the owner's, which also collects blobs orphaned by
+    // an install that failed before writing its manifest
+    std::map<std::string, uint32_t> counts = ReferenceCounts();
+    uint64_t removed = 0;
+    for (fs::recursive_directory_iterator it(root_ / "objects", ec), end; !ec && it != end; it.increment(ec)) {
+        if (!it->is_regular_file(ec)) {
+            continue;
+        }
+        std::string name = it->path().filename().u8string();
+        if (counts.count(name) == 0 && fs::remove(it->path(), ec)) {
+            std::lock_guard<std::mutex> guard(lock_);
+            verified_.erase(name);
+            removed++;
+        }
+    }
+    return removed;
+}
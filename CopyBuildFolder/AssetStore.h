@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+
+enum class PlaceResult {
+    Linked,    // Content was already in the store; the target is a hard link to it
+    Stored,    // New content was added to the store and linked
+    Copied,    // The store could not be linked to (e.g. another volume); the target is a plain copy
+    Failed
+};
+
+// Relative path (as UTF-8, '/'-separated) to content hash for every file an install references
+using AssetManifest = std::map<std::string, std::string>;
+
+// Content-addressed store of installed files, shared by every theme.
+//
+//   <root>/objects/<2 hex>/<sha-256>   one blob per distinct file content
+//   <root>/refs/<owner id>             the manifest of one install folder
+//
+// Installed files are hard links to blobs, so they share storage and must be treated as
+// read-only: anything that writes an installed file removes it first rather than writing
+// through the link. Links also share one security descriptor, so the DACL a blob inherits
+// from the store root is the DACL of every installed file linked to it.
+//
+// A blob found in the store is re-hashed before anything is linked to it, and replaced if
+// its content no longer matches its name. A blob's reference count is the number of
+// manifests that list it; Release drops an owner's manifest and deletes the blobs that no
+// manifest lists any more. Manifests are replaced atomically, so an interrupted install
+// never loses references.
+class AssetStore {
+public:
+    explicit AssetStore(const std::filesystem::path& root);
+
+    // Puts the content of `source` at `target`, reusing an existing blob when one matches.
+    // `buffer` is scratch space for reading. Safe to call from several threads.
+    PlaceResult Place(const std::filesystem::path& source, const std::filesystem::path& target,
+        char* buffer, size_t bufferSize, std::string& hash);
+
+    // Unique path on the store's volume for content whose hash is not known until it has been
+    // written, such as an entry decoded from an archive
+    std::filesystem::path StagingPath();
+
+    // Moves a staged file into the store under `hash`, or drops it if the blob already exists,
+    // then puts the content at `target` as Place does. The staged file is always consumed.
+    PlaceResult AdoptStaged(const std::filesystem::path& staged, const std::string& hash,
+        const std::filesystem::path& target, char* buffer, size_t bufferSize);
+
+    bool ReadManifest(const std::filesystem::path& owner, AssetManifest& manifest) const;
+    bool WriteManifest(const std::filesystem::path& owner, const AssetManifest& manifest);
+
+    // Counts how many manifests reference each blob
+    std::map<std::string, uint32_t> ReferenceCounts() const;
+
+    // Forgets `owner` and deletes blobs no longer referenced. Returns the number of blobs removed.
+    uint64_t Release(const std::filesystem::path& owner);
+
+    // Hashes a file with SHA-256, returned as lower-case hex
+    static bool HashFile(const std::filesystem::path& path, char* buffer, size_t bufferSize, std::string& hash);
+
+private:
+    std::filesystem::path root_;
+    std::mutex lock_;
+    std::set<std::string> verified_; // Blobs this instance stored or re-hashed
+
+    bool HasIntactBlob(const std::string& hash, char* buffer, size_t bufferSize);
+
+    std::filesystem::path BlobPath(const std::string& hash) const;
+    std::filesystem::path ManifestPath(const std::filesystem::path& owner) const;
+};
+
+// Relative path key used in manifests
+std::string ManifestKey(const std::filesystem::path& relative);
@@ -1,54 +1,285 @@
 // CopyBuildFolder.cpp : Defines the entry point for the custom action.
 #include "pch.h"
+#include <chrono>
 #include <filesystem>
+#include <memory>
 #include <sstream>
 #include <windows.h>
+#include <aclapi.h>
 #include <msi.h>
+#include <sddl.h>
 #include <msiquery.h>
+#include "AssetStore.h"
+#include "CopyEngine.h"
+#include "DeleteEngine.h"
+#include "PayloadInstall.h"
+#include "../Common/ActionLog.h"
+#include "../Common/Trace.h"
 
-// Copy directory recursively
-void CopyDirectoryRecursively(const std::wstring& source, const std::wstring& destination) {
+// Log sink that hands batches of lines to the MSI log
+class WcaLogSink : public LogSink {
+public:
+    void Write(const char* lines, size_t length) override {
+        WcaLog(LOGMSG_STANDARD, "%.*s", static_cast<int>(length), lines);
+    }
+
+    size_t MaxBatch() const override {
+        return kMsiLogBatch;
+    }
+};
+
+// Read-only view of the SFX image, released on destruction
+class MappedImage {
+public:
+    ~MappedImage() {
+        if (data_ != nullptr) {
+            UnmapViewOfFile(data_);
+        }
+        if (mapping_ != NULL) {
+            CloseHandle(mapping_);
+        }
+        if (file_ != INVALID_HANDLE_VALUE) {
+            CloseHandle(file_);
+        }
+    }
+
+    bool Open(const std::wstring& path) {
+        file_ = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        LARGE_INTEGER size;
+        if (file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &size) || size.QuadPart == 0 ||
+            static_cast<unsigned long long>(size.QuadPart) > SIZE_MAX) {
+            return false;
+        }
+        mapping_ = CreateFileMapping(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping_ == NULL) {
+            return false;
+        }
+        data_ = static_cast<const unsigned char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        size_ = static_cast<size_t>(size.QuadPart);
+        return data_ != nullptr;
+    }
+
+    const unsigned char* Data() const { return data_; }
+    size_t Size() const { return size_; }
+
+private:
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = NULL;
+    const unsigned char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Creates the asset store root with a protected DACL, owned by administrators, that grants
+// full control to SYSTEM and administrators only and read and execute to Users and to ALL
+// APPLICATION PACKAGES. Without it the root would inherit "Users: create" from ProgramData.
+// Installed files are hard links to the blobs and so carry this DACL too; the browser runs
+// without administrator rights and must still be able to read the extension. A root that
+// exists with any other owner or DACL is taken over: the whole tree is reset, so nothing a
+// user created or could write before stays in their hands.
+bool SecureStoreRoot(const std::wstring& path) {
+    // 0x1200a9 is FRFX (FILE_GENERIC_READ | FILE_GENERIC_EXECUTE), written as the mask that
+    // ConvertSecurityDescriptorToStringSecurityDescriptor reports, so an intact root compares equal
+    const wchar_t* sddl = L"O:BAD:P(A;OICI;FA;;;SY)(A;OICI;FA;;;BA)(A;OICI;0x1200a9;;;BU)(A;OICI;0x1200a9;;;AC)";
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+
+    PSECURITY_DESCRIPTOR descriptor = NULL;
+    if (!ConvertStringSecurityDescriptorToSecurityDescriptor(sddl, SDDL_REVISION_1, &descriptor, NULL)) {
+        return false;
+    }
+    SECURITY_ATTRIBUTES attributes = { sizeof(attributes), descriptor, FALSE };
+    bool secured = CreateDirectory(path.c_str(), &attributes) != FALSE;
+    if (!secured && GetLastError() == ERROR_ALREADY_EXISTS) {
+        PSECURITY_DESCRIPTOR current = NULL;
+        LPWSTR currentSddl = NULL;
+        if (GetNamedSecurityInfo(path.c_str(), SE_FILE_OBJECT, OWNER_SECURITY_INFORMATION | DACL_SECURITY_INFORMATION,
+                NULL, NULL, NULL, NULL, &current) == ERROR_SUCCESS &&
+            ConvertSecurityDescriptorToStringSecurityDescriptor(current, SDDL_REVISION_1,
+                OWNER_SECURITY_INFORMATION | DACL_SECURITY_INFORMATION, &currentSddl, NULL)) {
+            secured = wcscmp(currentSddl, sddl) == 0;
+        }
+        LocalFree(currentSddl);
+        LocalFree(current);
+
+        if (!secured) {
+            PSID owner = NULL;
+            PACL dacl = NULL;
+            BOOL present = FALSE;
+            BOOL defaulted = FALSE;
+            GetSecurityDescriptorOwner(descriptor, &owner, &defaulted);
+            GetSecurityDescriptorDacl(descriptor, &present, &dacl, &defaulted);
+            secured = TreeResetNamedSecurityInfo(const_cast<LPWSTR>(path.c_str()), SE_FILE_OBJECT,
+                OWNER_SECURITY_INFORMATION | DACL_SECURITY_INFORMATION | PROTECTED_DACL_SECURITY_INFORMATION,
+                owner, NULL, dacl, NULL, FALSE, NULL, ProgressInvokeNever, NULL) == ERROR_SUCCESS;
+        }
+    }
+    LocalFree(descriptor);
+    return secured;
+}
+
+// Copy directory recursively, or install it straight from the SFX payload when one is given
+void CopyDirectoryRecursively(const std::wstring& source, const std::wstring& destination, const std::wstring& storePath,
+    const std::wstring& payloadPath, bool verbose) {
+    WcaLogSink sink;
+    ActionLog log(sink, verbose ? LogLevel::Verbose : LogLevel::Standard);
     try {
-        for (const auto& entry : std::filesystem::recursive_directory_iterator(source)) {
-            const auto& path = entry.path();
-            auto relativePathStr = std::filesystem::relative(path, source).wstring();
-            std::wstring targetPath = destination + L"\\" + relativePathStr;
-
-            if (std::filesystem::is_directory(path)) {
-                std::filesystem::create_directories(targetPath);
-                WcaLog(LOGMSG_STANDARD, "Created directory: %S", targetPath.c_str());
-            }
-            else if (std::filesystem::is_regular_file(path)) {
-                std::filesystem::copy(path, targetPath, std::filesystem::copy_options::overwrite_existing);
-                WcaLog(LOGMSG_STANDARD, "Copied file: %S to %S", path.c_str(), targetPath.c_str());
+        // Upgrades and repairs only rewrite what changed and drop files the new build no longer has
+        CopyOptions options;
+        options.incremental = true;
+        options.removeStale = true;
+        options.log = &log;
+
+        // Themes share identical files through the asset store when one is configured
+        std::unique_ptr<AssetStore> store;
+        if (!storePath.empty()) {
+            if (SecureStoreRoot(storePath)) {
+                store.reset(new AssetStore(storePath));
+                options.store = store.get();
             }
             else {
-                WcaLog(LOGMSG_STANDARD, "Skipping non-regular file: %S", path.c_str());
+                log.Log(LogLevel::Error, "Could not restrict access to the asset store %S; installing without it",
+                    storePath.c_str());
+            }
+        }
+        CopyStats stats;
+        auto start = std::chrono::steady_clock::now();
+        bool copied;
+        if (!payloadPath.empty()) {
+            // The SFX left the theme in its archive; decode it once, into place
+            TraceSpan span("install-from-payload");
+            MappedImage image;
+            copied = image.Open(payloadPath) && InstallFromPayload(image.Data(), image.Size(), "build/", destination, options, stats);
+            if (!copied && stats.errors.empty()) {
+                stats.errors.push_back(L"Failed to open the installer payload: " + payloadPath);
             }
         }
+        else {
+            TraceSpan span("copy-tree");
+            copied = CopyTree(source, destination, options, stats);
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        TraceCounter("files", static_cast<int64_t>(stats.files));
+        TraceCounter("bytes", static_cast<int64_t>(stats.bytes));
+        TraceCounter("bytes-read", static_cast<int64_t>(stats.bytesRead));
+        TraceCounter("bytes-written", static_cast<int64_t>(stats.bytesWritten));
+        TraceCounter("files-skipped", static_cast<int64_t>(stats.skipped));
+        TraceCounter("entries-removed", static_cast<int64_t>(stats.removed));
+
+        for (const auto& error : stats.errors) {
+            log.Log(LogLevel::Error, "%S", error.c_str());
+        }
+        log.Log(LogLevel::Standard, "%s %s files / %s in %.1f s to %S", payloadPath.empty() ? "Copied" : "Extracted",
+            FormatCount(stats.files).c_str(), FormatBytes(stats.bytes).c_str(), elapsed.count(), destination.c_str());
+        log.Log(LogLevel::Standard, "Disk I/O: read %s, wrote %s",
+            FormatBytes(stats.bytesRead).c_str(), FormatBytes(stats.bytesWritten).c_str());
+        log.Log(LogLevel::Standard, "Created %s directories, skipped %s unchanged files, removed %s stale entries",
+            FormatCount(stats.directories).c_str(), FormatCount(stats.skipped).c_str(), FormatCount(stats.removed).c_str());
+        if (store) {
+            log.Log(LogLevel::Standard, "Linked %s files to content already in %S", FormatCount(stats.linked).c_str(), storePath.c_str());
+        }
+        if (!copied) {
+            log.Log(LogLevel::Error, "Copy of %S completed with %zu errors",
+                payloadPath.empty() ? source.c_str() : payloadPath.c_str(), stats.errors.size());
+        }
     }
     catch (const std::exception& e) {
-        WcaLog(LOGMSG_STANDARD, "Exception in CopyDirectoryRecursively: %s", e.what());
+        log.Log(LogLevel::Error, "Exception in CopyDirectoryRecursively: %s", e.what());
     }
 }
 
+// Removal backend on top of the Win32 file API
+class WindowsRemoveBackend : public RemoveBackend {
+public:
+    RemoveResult RemoveFile(const std::filesystem::path& path) override {
+        if (DeleteFile(path.c_str())) {
+            return RemoveResult::Removed;
+        }
+        DWORD error = GetLastError();
+        if (error == ERROR_ACCESS_DENIED && clearReadOnly(path) && DeleteFile(path.c_str())) {
+            return RemoveResult::Removed;
+        }
+        return classify(GetLastError());
+    }
+
+    RemoveResult RemoveEmptyDirectory(const std::filesystem::path& path) override {
+        if (::RemoveDirectory(path.c_str())) {
+            return RemoveResult::Removed;
+        }
+        DWORD error = GetLastError();
+        if (error == ERROR_ACCESS_DENIED && clearReadOnly(path) && ::RemoveDirectory(path.c_str())) {
+            return RemoveResult::Removed;
+        }
+        return classify(GetLastError());
+    }
+
+    bool ScheduleRemoval(const std::filesystem::path& path) override {
+        return MoveFileEx(path.c_str(), NULL, MOVEFILE_DELAY_UNTIL_REBOOT) != FALSE;
+    }
+
+private:
+    static bool clearReadOnly(const std::filesystem::path& path) {
+        DWORD attributes = GetFileAttributes(path.c_str());
+        return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_READONLY) &&
+            SetFileAttributes(path.c_str(), attributes & ~FILE_ATTRIBUTE_READONLY);
+    }
+
+    static RemoveResult classify(DWORD error) {
+        switch (error) {
+        case ERROR_FILE_NOT_FOUND:
+        case ERROR_PATH_NOT_FOUND:
+            return RemoveResult::Missing;
+        case ERROR_SHARING_VIOLATION:
+        case ERROR_LOCK_VIOLATION:
+        case ERROR_ACCESS_DENIED:      // Also returned for a file that is pending deletion
+        case ERROR_DIR_NOT_EMPTY:
+            return RemoveResult::Busy;
+        default:
+            return RemoveResult::Failed;
+        }
+    }
+};
+
 // Delete directory recursively
-void DeleteDirectoryRecursively(const std::wstring& path) {
+void DeleteDirectoryRecursively(const std::wstring& path, const std::wstring& storePath) {
+    WcaLogSink sink;
+    ActionLog log(sink);
     try {
-        std::filesystem::remove_all(path);
-        WcaLog(LOGMSG_STANDARD, "Successfully deleted directory: %S", path.c_str());
+        WindowsRemoveBackend backend;
+        RemoveOptions options;
+        auto start = std::chrono::steady_clock::now();
+        RemoveReport report = RemoveTree(path, backend, options);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        log.Log(LogLevel::Standard, "Removed %s files and %s directories from %S in %.1f s",
+            FormatCount(report.filesRemoved).c_str(), FormatCount(report.directoriesRemoved).c_str(), path.c_str(), elapsed.count());
+        if (report.retried > 0) {
+            log.Log(LogLevel::Standard, "%s files were locked and retried", FormatCount(report.retried).c_str());
+        }
+        for (const auto& deferred : report.deferred) {
+            log.Log(LogLevel::Standard, "Deferred until reboot: %S", deferred.c_str());
+        }
+        for (const auto& failed : report.failed) {
+            log.Log(LogLevel::Error, "Failed to delete: %S", failed.c_str());
+        }
+
+        // Drop this install's references; content no other theme uses leaves the store
+        if (!storePath.empty()) {
+            AssetStore store(storePath);
+            uint64_t released = store.Release(path);
+            log.Log(LogLevel::Standard, "Released %s unreferenced files from %S", FormatCount(released).c_str(), storePath.c_str());
+        }
     }
     catch (const std::exception& e) {
-        WcaLog(LOGMSG_STANDARD, "Failed to delete directory: %S, Error: %s", path.c_str(), e.what());
+        log.Log(LogLevel::Error, "Failed to delete directory: %S, Error: %s", path.c_str(), e.what());
     }
 }
 
 UINT __stdcall CopyBuildFolder(MSIHANDLE hInstall) {
     HRESULT hr = WcaInitialize(hInstall, "CopyBuildFolder");
-    WCHAR szCustomActionData[2 * MAX_PATH];
+    WCHAR szCustomActionData[6 * MAX_PATH];
     DWORD dwLen = sizeof(szCustomActionData) / sizeof(WCHAR);
     std::wistringstream dataStream;
-    std::wstring sourcePath, targetPath, buildSourcePath;
+    std::wstring sourcePath, targetPath, verboseLog, storePath, payloadPath, traceDirectory;
     ExitOnFailure(hr, "Failed to initialize");
 
     hr = MsiGetProperty(hInstall, L"CustomActionData", szCustomActionData, &dwLen);
@@ -59,13 +290,34 @@ UINT __stdcall CopyBuildFolder(MSIHANDLE hInstall) {
     dataStream = std::wistringstream(szCustomActionData);
     std::getline(dataStream, sourcePath, L';');
     std::getline(dataStream, targetPath, L';');
+    std::getline(dataStream, verboseLog, L';');
+    std::getline(dataStream, storePath, L';');
+    std::getline(dataStream, payloadPath, L';');
+    std::getline(dataStream, traceDirectory, L';');
 
-    WcaLog(LOGMSG_STANDARD, "Source path: %S", sourcePath.c_str());
+    // An SFX that did not extract the theme places its payload next to the MSI; the path comes
+    // from [SourceDir], never from a property a caller could set
+    if (GetFileAttributes(payloadPath.c_str()) == INVALID_FILE_ATTRIBUTES) {
+        payloadPath.clear();
+    }
+    WcaLog(LOGMSG_STANDARD, "Source path: %S", payloadPath.empty() ? sourcePath.c_str() : payloadPath.c_str());
     WcaLog(LOGMSG_STANDARD, "Target path: %S", targetPath.c_str());
 
     // Perform the copy operation
     try {
-        CopyDirectoryRecursively(sourcePath, targetPath);
+        // When tracing, the SFX's staging directory has a folder for a timeline of this action
+        DWORD processId = GetCurrentProcessId();
+        TraceSession trace(traceDirectory.empty() ? std::wstring() : traceDirectory + L"CopyBuildFolder-" + std::to_wstring(processId) + L".json",
+            "CopyBuildFolder", processId);
+
+        // BUILDLOGVERBOSE=1 logs every file and directory instead of a summary
+        CopyDirectoryRecursively(sourcePath, targetPath, storePath, payloadPath, verboseLog == L"1");
+
+        if (trace.Enabled()) {
+            for (const auto& summary : trace.Recorder()->Summarize()) {
+                WcaLog(LOGMSG_STANDARD, "Trace %s", FormatTraceSummary(summary).c_str());
+            }
+        }
     }
     catch (const std::exception& e) {
         WcaLog(LOGMSG_STANDARD, "Exception occurred: %s", e.what());
@@ -78,21 +330,26 @@ LExit:
 
 UINT __stdcall DeleteBuildFolder(MSIHANDLE hInstall) {
     HRESULT hr = WcaInitialize(hInstall, "DeleteBuildFolder");
-    WCHAR szInstallDir[MAX_PATH];
-    DWORD dwLen = MAX_PATH;
+    WCHAR szCustomActionData[2 * MAX_PATH];
+    DWORD dwLen = sizeof(szCustomActionData) / sizeof(WCHAR);
+    std::wistringstream dataStream;
+    std::wstring installDir, storePath;
     ExitOnFailure(hr, "Failed to initialize");
 
     WcaLog(LOGMSG_STANDARD, "Initialized DeleteBuildFolder.");
 
-    // Get the installation directory from the MSI
-    hr = MsiGetProperty(hInstall, L"CustomActionData", szInstallDir, &dwLen);
+    // Get the installation directory and the asset store from the MSI
+    hr = MsiGetProperty(hInstall, L"CustomActionData", szCustomActionData, &dwLen);
     ExitOnFailure(hr, "Failed to get installation directory");
+    dataStream = std::wistringstream(szCustomActionData);
+    std::getline(dataStream, installDir, L';');
+    std::getline(dataStream, storePath, L';');
 
     // Log the deletion
-    WcaLog(LOGMSG_STANDARD, "Deleting build directory: %S", szInstallDir);
+    WcaLog(LOGMSG_STANDARD, "Deleting build directory: %S", installDir.c_str());
 
     // Delete the directory recursively
-    DeleteDirectoryRecursively(szInstallDir);
+    DeleteDirectoryRecursively(installDir, storePath);
 
 LExit:
     hr = SUCCEEDED(hr) ? ERROR_SUCCESS : ERROR_INSTALL_FAILURE;
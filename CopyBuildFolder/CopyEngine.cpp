@@ -0,0 +1,453 @@
+#include "CopyEngine.h"
+#include "AssetStore.h"
+#include "../Common/ActionLog.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <cwchar>
+#include <cwctype>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+namespace {
+    const size_t kBufferAlignment = 4096;
+
+    struct CopyFile {
+        fs::path source;
+        fs::path target;
+        fs::path relative;
+        std::string hash;      // Content hash once placed through the asset store
+        PlaceResult placed = PlaceResult::Failed;
+        uint64_t size;
+        fs::file_time_type lastWrite;
+        bool chunked = false;  // Pre-sized and copied by several chunk tasks
+        bool verify = false;   // Destination may already match; compare before copying
+        bool skipped = false;
+        std::atomic<uint64_t> chunksLeft{ 0 };
+        std::atomic<bool> failed{ false };
+    };
+
+    // A unit of work: either a run of small files or one chunk of a large file
+    struct CopyTask {
+        size_t firstFile;
+        size_t fileCount;
+        uint64_t offset;
+        uint64_t length;
+        bool chunk;
+    };
+
+    struct AlignedDelete {
+        void operator()(char* p) const {
+            ::operator delete[](p, std::align_val_t(kBufferAlignment));
+        }
+    };
+    using AlignedBuffer = std::unique_ptr<char[], AlignedDelete>;
+
+    AlignedBuffer AllocateBuffer(size_t size) {
+        return AlignedBuffer(static_cast<char*>(::operator new[](size, std::align_val_t(kBufferAlignment))));
+    }
+
+    // Helper functions for per-item lines; paths are only converted when Verbose is enabled
+    void LogPath(ActionLog* log, const char* format, const fs::path& path) {
+        if (log != nullptr && log->Enabled(LogLevel::Verbose)) {
+            log->Log(LogLevel::Verbose, format, path.wstring().c_str());
+        }
+    }
+
+    void LogPaths(ActionLog* log, const char* format, const fs::path& first, const fs::path& second) {
+        if (log != nullptr && log->Enabled(LogLevel::Verbose)) {
+            log->Log(LogLevel::Verbose, format, first.wstring().c_str(), second.wstring().c_str());
+        }
+    }
+
+    // Returns true if both files hold the same bytes. `buffer` is split between the two reads.
+    bool SameContent(const fs::path& a, const fs::path& b, uint64_t size, char* buffer, size_t bufferSize) {
+        std::ifstream first(a, std::ios::binary);
+        std::ifstream second(b, std::ios::binary);
+        if (!first || !second) {
+            return false;
+        }
+        first.rdbuf()->pubsetbuf(nullptr, 0);
+        second.rdbuf()->pubsetbuf(nullptr, 0);
+
+        const size_t half = bufferSize / 2;
+        while (size > 0) {
+            size_t block = static_cast<size_t>(std::min<uint64_t>(size, half));
+            if (!first.read(buffer, static_cast<std::streamsize>(block)) ||
+                !second.read(buffer + half, static_cast<std::streamsize>(block)) ||
+                std::memcmp(buffer, buffer + half, block) != 0) {
+                return false;
+            }
+            size -= block;
+        }
+        return true;
+    }
+
+    // Destination entries without a counterpart in the source; stale directories are returned
+    // once and not descended into.
+    std::vector<fs::path> FindStaleEntries(const fs::path& destination, const std::unordered_set<std::wstring>& keep) {
+        std::vector<fs::path> stale;
+        std::error_code ec;
+        const size_t destinationLength = destination.native().size();
+        fs::recursive_directory_iterator it(destination, ec);
+        for (; !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+            const fs::path& path = it->path();
+            fs::path relative = path.native().substr(std::min(path.native().size(), destinationLength + 1));
+            if (keep.count(PathKey(relative)) == 0) {
+                stale.push_back(path);
+                it.disable_recursion_pending();
+            }
+        }
+        return stale;
+    }
+
+    unsigned ResolveThreadCount(const CopyOptions& options, size_t tasks) {
+        unsigned threads = std::thread::hardware_concurrency();
+        if (threads == 0) {
+            threads = 1;
+        }
+        if (options.maxThreads != 0 && options.maxThreads < threads) {
+            threads = options.maxThreads;
+        }
+        return static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(threads, tasks)));
+    }
+
+    class Copier {
+    public:
+        Copier(std::vector<std::unique_ptr<CopyFile>>& files, const CopyOptions& options, CopyStats& stats)
+            : files_(files), options_(options), stats_(stats) {}
+
+        void Run(const std::vector<CopyTask>& tasks) {
+            unsigned threadCount = ResolveThreadCount(options_, tasks.size());
+            std::atomic<size_t> next(0);
+            auto worker = [&]() {
+                AlignedBuffer buffer = AllocateBuffer(options_.bufferSize);
+                for (size_t i = next++; i < tasks.size(); i = next++) {
+                    Execute(tasks[i], buffer.get());
+                }
+            };
+
+            std::vector<std::thread> threads;
+            for (unsigned i = 1; i < threadCount; ++i) {
+                threads.emplace_back(worker);
+            }
+            worker();
+            for (auto& thread : threads) {
+                thread.join();
+            }
+        }
+
+    private:
+        std::vector<std::unique_ptr<CopyFile>>& files_;
+        const CopyOptions& options_;
+        CopyStats& stats_;
+        std::mutex statsLock_;
+
+        void Execute(const CopyTask& task, char* buffer) {
+            if (task.chunk) {
+                CopyFile& file = *files_[task.firstFile];
+                if (!CopyRange(file, task.offset, task.length, buffer)) {
+                    file.failed = true;
+                }
+                // Whoever finishes the last chunk completes the file
+                if (--file.chunksLeft == 0) {
+                    Finish(file);
+                }
+                return;
+            }
+
+            for (size_t i = 0; i < task.fileCount; ++i) {
+                CopyFile& file = *files_[task.firstFile + i];
+                if (file.verify && SameContent(file.source, file.target, file.size, buffer, options_.bufferSize)) {
+                    file.skipped = true;
+                }
+                else if (options_.store != nullptr) {
+                    file.placed = options_.store->Place(file.source, file.target, buffer, options_.bufferSize, file.hash);
+                    if (file.placed == PlaceResult::Failed) {
+                        file.failed = true;
+                    }
+                }
+                else if (!CopyRange(file, 0, file.size, buffer)) {
+                    file.failed = true;
+                }
+                Finish(file);
+            }
+        }
+
+        bool CopyRange(CopyFile& file, uint64_t offset, uint64_t length, char* buffer) {
+            std::ifstream input(file.source, std::ios::binary);
+            if (!input) {
+                return false;
+            }
+
+            // Chunks write into a file that was already created and sized, so open it without
+            // truncating. A whole file replaces the target instead of opening it in place: an
+            // earlier install may have left it as a hard link to a shared asset store blob.
+            std::ios::openmode mode = std::ios::binary | std::ios::out;
+            if (file.chunked) {
+                mode |= std::ios::in;
+            }
+            else {
+                std::error_code ec;
+                fs::remove(file.target, ec);
+                mode |= std::ios::trunc;
+            }
+            std::fstream output(file.target, mode);
+            if (!output) {
+                return false;
+            }
+
+            // Our buffer is already large; skip the streams' own copy of the data
+            input.rdbuf()->pubsetbuf(nullptr, 0);
+            output.rdbuf()->pubsetbuf(nullptr, 0);
+            if (offset != 0) {
+                input.seekg(static_cast<std::streamoff>(offset));
+                output.seekp(static_cast<std::streamoff>(offset));
+            }
+
+            while (length > 0) {
+                size_t block = static_cast<size_t>(std::min<uint64_t>(length, options_.bufferSize));
+                if (!input.read(buffer, static_cast<std::streamsize>(block)) ||
+                    !output.write(buffer, static_cast<std::streamsize>(block))) {
+                    return false;
+                }
+                length -= block;
+            }
+            return static_cast<bool>(output.flush());
+        }
+
+        void Finish(CopyFile& file) {
+            std::error_code ec;
+            if (!file.failed) {
+                // Keep the source timestamp, as CopyFile does, so later runs can compare them
+                fs::last_write_time(file.target, file.lastWrite, ec);
+            }
+
+            if (file.skipped) {
+                LogPath(options_.log, "Skipped unchanged file: %S", file.target);
+            }
+            else if (!file.failed) {
+                LogPaths(options_.log, "Copied file: %S to %S", file.source, file.target);
+            }
+
+            std::lock_guard<std::mutex> guard(statsLock_);
+            if (file.failed) {
+                stats_.errors.push_back(L"Failed to copy file: " + file.source.wstring());
+                return;
+            }
+
+            // A comparison reads both files; the store hashes the source, then copies it
+            // into a blob unless the content was already there
+            if (file.verify) {
+                stats_.bytesRead += 2 * file.size;
+            }
+            if (file.skipped) {
+                stats_.skipped++;
+                return;
+            }
+            if (file.placed == PlaceResult::Linked) {
+                stats_.linked++;
+                stats_.bytesRead += file.size;
+            }
+            else {
+                stats_.bytesRead += options_.store != nullptr ? 2 * file.size : file.size;
+                stats_.bytesWritten += file.size;
+            }
+            stats_.files++;
+            stats_.bytes += file.size;
+        }
+    };
+}
+
+std::wstring PathKey(const fs::path& relative) {
+    std::wstring key = relative.wstring();
+#ifdef _WIN32
+    std::transform(key.begin(), key.end(), key.begin(), ::towlower);
+#endif
+    return key;
+}
+
+void RemoveStaleEntries(const fs::path& destination, const std::unordered_set<std::wstring>& keep,
+    const CopyOptions& options, CopyStats& stats) {
+    std::error_code ec;
+    for (const auto& path : FindStaleEntries(destination, keep)) {
+        uintmax_t count = fs::remove_all(path, ec);
+        if (ec) {
+            stats.errors.push_back(L"Failed to remove stale entry: " + path.wstring());
+        }
+        else {
+            stats.removed += count;
+            LogPath(options.log, "Removed stale entry: %S", path);
+        }
+    }
+}
+
+bool CopyTree(const fs::path& source, const fs::path& destination, const CopyOptions& options, CopyStats& stats) {
+    std::error_code ec;
+    std::vector<std::unique_ptr<CopyFile>> files;
+    std::unordered_set<std::wstring> sourceKeys;
+    const size_t sourceLength = source.native().size();
+
+    // Single pass over the tree: create directories as they are met (parents always come
+    // first) and collect files for the copy phase.
+    fs::create_directories(destination, ec);
+    fs::recursive_directory_iterator it(source, ec);
+    if (ec) {
+        stats.errors.push_back(L"Failed to enumerate directory: " + source.wstring());
+        return false;
+    }
+    for (; it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (ec) {
+            stats.errors.push_back(L"Failed to enumerate directory: " + source.wstring());
+            break;
+        }
+
+        // Strip the source prefix instead of calling fs::relative, which canonicalizes both paths
+        const fs::path& path = it->path();
+        fs::path relative = path.native().substr(std::min(path.native().size(), sourceLength + 1));
+        fs::path target = destination / relative;
+        if (options.removeStale) {
+            sourceKeys.insert(PathKey(relative));
+        }
+
+        if (it->is_directory(ec)) {
+            fs::create_directories(target, ec);
+            if (ec) {
+                stats.errors.push_back(L"Failed to create directory: " + target.wstring());
+            }
+            else {
+                stats.directories++;
+                LogPath(options.log, "Created directory: %S", target);
+            }
+        }
+        else if (it->is_regular_file(ec)) {
+            std::unique_ptr<CopyFile> file(new CopyFile());
+            file->source = path;
+            file->target = std::move(target);
+            file->relative = std::move(relative);
+            file->size = it->file_size(ec);
+            file->lastWrite = it->last_write_time(ec);
+            files.push_back(std::move(file));
+        }
+    }
+
+    // Sweep the destination before copying, so a stale name that differs from a new one only
+    // in case cannot take the new file with it
+    if (options.removeStale && stats.errors.empty()) {
+        RemoveStaleEntries(destination, sourceKeys, options, stats);
+    }
+
+    // Drop files whose destination is already up to date. Batches cover contiguous runs of
+    // `files`, so this has to happen before they are formed.
+    std::vector<std::string> unchanged;
+    if (options.incremental) {
+        auto upToDate = [&](const std::unique_ptr<CopyFile>& file) {
+            fs::directory_entry existing(file->target, ec);
+            if (ec || !existing.is_regular_file(ec) || existing.file_size(ec) != file->size || ec) {
+                return false;
+            }
+            if (existing.last_write_time(ec) == file->lastWrite && !ec) {
+                stats.skipped++;
+                LogPath(options.log, "Skipped unchanged file: %S", file->target);
+                if (options.store != nullptr) {
+                    unchanged.push_back(ManifestKey(file->relative));
+                }
+                return true;
+            }
+            file->verify = options.compareContent;
+            return false;
+        };
+        files.erase(std::remove_if(files.begin(), files.end(), upToDate), files.end());
+    }
+
+    // Small files are batched to amortize scheduling; large files are pre-sized and chunked
+    std::vector<CopyTask> tasks;
+    size_t batchStart = 0;
+    size_t batchCount = 0;
+    auto flushBatch = [&]() {
+        if (batchCount > 0) {
+            tasks.push_back(CopyTask{ batchStart, batchCount, 0, 0, false });
+            batchCount = 0;
+        }
+    };
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        CopyFile& file = *files[i];
+        // Files that may match are read whole by one worker, so they are never chunked
+        if (file.size > options.chunkSize && !file.verify && options.store == nullptr) {
+            flushBatch();
+            fs::remove(file.target, ec);
+            std::ofstream create(file.target, std::ios::binary | std::ios::trunc);
+            create.close();
+            fs::resize_file(file.target, file.size, ec);
+            if (!create || ec) {
+                stats.errors.push_back(L"Failed to create file: " + file.target.wstring());
+                continue;
+            }
+
+            file.chunked = true;
+            file.chunksLeft = (file.size + options.chunkSize - 1) / options.chunkSize;
+            for (uint64_t offset = 0; offset < file.size; offset += options.chunkSize) {
+                tasks.push_back(CopyTask{ i, 1, offset, std::min(options.chunkSize, file.size - offset), true });
+            }
+            continue;
+        }
+
+        // Medium files get a task of their own; runs of small files share one
+        if (file.size > options.smallFileThreshold) {
+            flushBatch();
+            tasks.push_back(CopyTask{ i, 1, 0, 0, false });
+            continue;
+        }
+        if (batchCount == 0) {
+            batchStart = i;
+        }
+        if (++batchCount >= options.smallFileBatch) {
+            flushBatch();
+        }
+    }
+    flushBatch();
+
+    // Biggest tasks first so a large file does not become the tail of the run
+    std::stable_sort(tasks.begin(), tasks.end(), [](const CopyTask& a, const CopyTask& b) {
+        return a.chunk && !b.chunk;
+    });
+
+    Copier copier(files, options, stats);
+    copier.Run(tasks);
+
+    if (options.store != nullptr) {
+        // Unchanged files keep the blobs they were linked to; everything placed this run is
+        // recorded with its new hash, and files that are gone drop out of the manifest
+        AssetManifest previous;
+        AssetManifest manifest;
+        options.store->ReadManifest(destination, previous);
+        for (const auto& key : unchanged) {
+            auto entry = previous.find(key);
+            if (entry != previous.end()) {
+                manifest.insert(*entry);
+            }
+        }
+        for (const auto& file : files) {
+            std::string key = ManifestKey(file->relative);
+            if (file->skipped && previous.count(key) != 0) {
+                manifest[key] = previous[key];
+            }
+            else if (file->placed == PlaceResult::Linked || file->placed == PlaceResult::Stored) {
+                manifest[key] = file->hash;
+            }
+        }
+        if (!options.store->WriteManifest(destination, manifest)) {
+            stats.errors.push_back(L"Failed to record the asset manifest for " + destination.wstring());
+        }
+    }
+    return stats.errors.empty();
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+class ActionLog;
+class AssetStore;
+
+struct CopyOptions {
+    unsigned maxThreads = 0;                   // 0 uses the hardware thread count
+    size_t bufferSize = 1024 * 1024;           // Per-worker I/O buffer
+    uint64_t smallFileThreshold = 64 * 1024;   // Files up to this size are copied in batches
+    size_t smallFileBatch = 32;                // Small files handed to a worker at once
+    uint64_t chunkSize = 16 * 1024 * 1024;     // Large files are split into chunks of this size
+
+    // Incremental mode: skip files whose destination has the same size and timestamp
+    bool incremental = false;
+    // With incremental, decide equal-sized files by their content rather than their timestamp
+    bool compareContent = false;
+    // Remove destination files and directories that no longer exist in the source
+    bool removeStale = false;
+
+    // Places files through a shared content-addressed store and records them in its manifest
+    // for `destination`. Files are then never chunked, as each one is hashed whole.
+    AssetStore* store = nullptr;
+
+    // Receives a Verbose line per directory created, file copied, skipped or removed
+    ActionLog* log = nullptr;
+};
+
+struct CopyStats {
+    uint64_t directories = 0;
+    uint64_t files = 0;
+    uint64_t bytes = 0;
+    uint64_t skipped = 0;  // Files left alone because the destination was already up to date
+    uint64_t removed = 0;  // Stale destination entries deleted
+    uint64_t linked = 0;   // Files whose content was already in the asset store
+    uint64_t bytesRead = 0;     // Bytes read from disk, including comparisons and hashing
+    uint64_t bytesWritten = 0;  // Bytes written to disk, including the asset store
+    std::vector<std::wstring> errors; // One line per path that could not be created or copied
+};
+
+// Key for matching source and destination paths; Windows paths compare case-insensitively
+std::wstring PathKey(const std::filesystem::path& relative);
+
+// Deletes the entries of `destination` whose relative path keys are not in `keep`. Stale
+// directories are removed whole. Counts them in stats.removed and logs them.
+void RemoveStaleEntries(const std::filesystem::path& destination, const std::unordered_set<std::wstring>& keep,
+    const CopyOptions& options, CopyStats& stats);
+
+// Copies the contents of `source` into `destination`, overwriting existing files.
+// The tree is enumerated once, directories are created up front, and file data is copied on
+// a bounded thread pool with large buffers. In incremental mode only new and changed files
+// are written, so the cost of an upgrade follows the size of the change.
+// Returns false if anything failed to copy.
+bool CopyTree(const std::filesystem::path& source, const std::filesystem::path& destination,
+    const CopyOptions& options, CopyStats& stats);
@@ -0,0 +1,178 @@
+#include "DeleteEngine.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace {
+    unsigned ResolveThreadCount(const RemoveOptions& options, size_t tasks) {
+        unsigned threads = std::thread::hardware_concurrency();
+        if (threads == 0) {
+            threads = 1;
+        }
+        if (options.maxThreads != 0 && options.maxThreads < threads) {
+            threads = options.maxThreads;
+        }
+        return static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(threads, tasks)));
+    }
+
+    // Unlinks `files` in parallel batches. Busy files are collected for the next round.
+    void RemoveFiles(const std::vector<fs::path>& files, RemoveBackend& backend, const RemoveOptions& options,
+        RemoveReport& report, std::vector<fs::path>& busy) {
+        const size_t batchSize = std::max<size_t>(1, options.batchSize);
+        const size_t batches = (files.size() + batchSize - 1) / batchSize;
+        std::atomic<size_t> next(0);
+        std::mutex lock;
+
+        auto worker = [&]() {
+            std::vector<fs::path> localBusy;
+            std::vector<fs::path> localFailed;
+            uint64_t removed = 0;
+            for (size_t batch = next++; batch < batches; batch = next++) {
+                size_t end = std::min(files.size(), (batch + 1) * batchSize);
+                for (size_t i = batch * batchSize; i < end; ++i) {
+                    switch (backend.RemoveFile(files[i])) {
+                    case RemoveResult::Removed:
+                        ++removed;
+                        break;
+                    case RemoveResult::Missing:
+                        break;
+                    case RemoveResult::Busy:
+                        localBusy.push_back(files[i]);
+                        break;
+                    default:
+                        localFailed.push_back(files[i]);
+                        break;
+                    }
+                }
+            }
+
+            std::lock_guard<std::mutex> guard(lock);
+            report.filesRemoved += removed;
+            busy.insert(busy.end(), localBusy.begin(), localBusy.end());
+            report.failed.insert(report.failed.end(), localFailed.begin(), localFailed.end());
+        };
+
+        unsigned threadCount = ResolveThreadCount(options, batches);
+        std::vector<std::thread> threads;
+        for (unsigned i = 1; i < threadCount; ++i) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+}
+
+RemoveResult StdRemoveBackend::RemoveFile(const fs::path& path) {
+    std::error_code ec;
+    if (fs::remove(path, ec)) {
+        return RemoveResult::Removed;
+    }
+    if (!ec) {
+        return RemoveResult::Missing;
+    }
+    if (ec == std::errc::device_or_resource_busy || ec == std::errc::text_file_busy) {
+        return RemoveResult::Busy;
+    }
+    return RemoveResult::Failed;
+}
+
+RemoveResult StdRemoveBackend::RemoveEmptyDirectory(const fs::path& path) {
+    return RemoveFile(path);
+}
+
+bool StdRemoveBackend::ScheduleRemoval(const fs::path&) {
+    return false;
+}
+
+RemoveReport RemoveTree(const fs::path& root, RemoveBackend& backend, const RemoveOptions& options) {
+    RemoveReport report;
+    std::error_code ec;
+    if (!fs::exists(fs::symlink_status(root, ec))) {
+        return report;
+    }
+
+    // Single pass over the tree. Directories come out parents first; symlinked directories are
+    // not followed and are removed as links.
+    std::vector<fs::path> files;
+    std::vector<fs::path> directories{ root };
+    fs::recursive_directory_iterator it(root, ec);
+    for (; !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (it->is_directory(ec) && !it->is_symlink(ec)) {
+            directories.push_back(it->path());
+        }
+        else {
+            files.push_back(it->path());
+        }
+    }
+    if (ec) {
+        // Whatever could not be listed will surface when its directory fails to go
+        ec.clear();
+    }
+
+    std::vector<fs::path> busy;
+    RemoveFiles(files, backend, options, report, busy);
+
+    // Locked files are usually released within moments (a browser closing, an AV scan); retry
+    // them together once per round rather than sleeping per file
+    uint64_t delay = options.retryDelayMs;
+    std::vector<fs::path> stillBusy;
+    report.retried = busy.size();
+    for (unsigned round = 0; round < options.retries && !busy.empty(); ++round) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+        delay *= 2;
+
+        stillBusy.clear();
+        for (const auto& path : busy) {
+            switch (backend.RemoveFile(path)) {
+            case RemoveResult::Removed:
+                report.filesRemoved++;
+                break;
+            case RemoveResult::Missing:
+                break;
+            case RemoveResult::Busy:
+                stillBusy.push_back(path);
+                break;
+            default:
+                report.failed.push_back(path);
+                break;
+            }
+        }
+        busy.swap(stillBusy);
+    }
+
+    for (const auto& path : busy) {
+        if (backend.ScheduleRemoval(path)) {
+            report.deferred.push_back(path);
+        }
+        else {
+            report.failed.push_back(path);
+        }
+    }
+
+    // Deepest first. A directory still holding deferred files is deferred as well; pending
+    // removals run in the order they were queued, so its contents go before it does.
+    for (auto dir = directories.rbegin(); dir != directories.rend(); ++dir) {
+        RemoveResult result = backend.RemoveEmptyDirectory(*dir);
+        if (result == RemoveResult::Removed) {
+            report.directoriesRemoved++;
+        }
+        else if (result != RemoveResult::Missing) {
+            if (!report.deferred.empty() && backend.ScheduleRemoval(*dir)) {
+                report.deferred.push_back(*dir);
+            }
+            else {
+                report.failed.push_back(*dir);
+            }
+        }
+    }
+
+    return report;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+enum class RemoveResult {
+    Removed,
+    Missing,   // Already gone
+    Busy,      // Held open by another process; worth retrying
+    Failed
+};
+
+// Platform operations used to take a tree apart
+class RemoveBackend {
+public:
+    virtual ~RemoveBackend() = default;
+    virtual RemoveResult RemoveFile(const std::filesystem::path& path) = 0;
+    virtual RemoveResult RemoveEmptyDirectory(const std::filesystem::path& path) = 0;
+    // Queues the path for deletion when the machine restarts. Returns false if that is not possible.
+    virtual bool ScheduleRemoval(const std::filesystem::path& path) = 0;
+};
+
+// Backend on top of std::filesystem. It cannot defer removals, so locked files are reported as failed.
+class StdRemoveBackend : public RemoveBackend {
+public:
+    RemoveResult RemoveFile(const std::filesystem::path& path) override;
+    RemoveResult RemoveEmptyDirectory(const std::filesystem::path& path) override;
+    bool ScheduleRemoval(const std::filesystem::path& path) override;
+};
+
+struct RemoveOptions {
+    unsigned maxThreads = 0;      // 0 uses the hardware thread count
+    size_t batchSize = 64;        // Files unlinked per task
+    unsigned retries = 5;         // Rounds of retries for busy files
+    unsigned retryDelayMs = 50;   // Delay before the first retry; doubled every round
+};
+
+struct RemoveReport {
+    uint64_t filesRemoved = 0;
+    uint64_t directoriesRemoved = 0;
+    uint64_t retried = 0;                          // Files that were busy at least once
+    std::vector<std::filesystem::path> deferred;   // Scheduled for deletion on reboot
+    std::vector<std::filesystem::path> failed;     // Neither removed nor deferred
+
+    bool Complete() const {
+        return deferred.empty() && failed.empty();
+    }
+};
+
+// Removes `root` and everything below it. The tree is enumerated once, files are unlinked in
+// parallel batches, busy files are retried with exponential backoff and then deferred to the
+// next reboot, and directories are removed deepest first.
+RemoveReport RemoveTree(const std::filesystem::path& root, RemoveBackend& backend, const RemoveOptions& options);
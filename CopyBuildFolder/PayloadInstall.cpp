@@ -0,0 +1,242 @@
+#include "PayloadInstall.h"
+#include "AssetStore.h"
+#include "../Common/ActionLog.h"
+#include "../Common/Sha256.h"
+#include "../SFX/Crc32.h"
+#include "../SFX/ParallelExtract.h"
+#include "../SFX/ZipReader.h"
+
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <unordered_set>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+    class StreamSink : public OutputSink {
+    public:
+        explicit StreamSink(std::ofstream& output) : output_(output) {}
+
+        bool Write(const unsigned char* data, size_t size) override {
+            return static_cast<bool>(output_.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size)));
+        }
+
+    private:
+        std::ofstream& output_;
+    };
+
+    // Hashes what passes through, so content decoded for the asset store is hashed once
+    class HashingSink : public OutputSink {
+    public:
+        explicit HashingSink(OutputSink& inner) : inner_(inner) {}
+
+        bool Write(const unsigned char* data, size_t size) override {
+            sha_.Update(data, size);
+            return inner_.Write(data, size);
+        }
+
+        std::string Hex() {
+            unsigned char digest[Sha256::kDigestSize];
+            sha_.Final(digest);
+            return DigestToHex(digest, sizeof(digest));
+        }
+
+    private:
+        OutputSink& inner_;
+        Sha256 sha_;
+    };
+
+    // Entry names are '/'-separated UTF-8 below the prefix
+    fs::path EntryPath(const std::string& name) {
+        return fs::u8path(name).make_preferred();
+    }
+
+    class PayloadTarget : public ExtractionTarget {
+    public:
+        PayloadTarget(const fs::path& destination, const CopyOptions& options, CopyStats& stats)
+            : destination_(destination), options_(options), stats_(stats) {}
+
+        bool MakeDirectory(const ZipEntry& directory) override {
+            std::error_code ec;
+            fs::path target = destination_ / EntryPath(directory.name);
+            fs::create_directories(target, ec);
+            std::lock_guard<std::mutex> guard(statsLock_);
+            if (ec) {
+                stats_.errors.push_back(L"Failed to create directory: " + target.wstring());
+                return false;
+            }
+            stats_.directories++;
+            LogPath("Created directory: %S", target);
+            return true;
+        }
+
+        bool IsExtracted(const ZipEntry& entry) override {
+            std::error_code ec;
+            fs::path target = destination_ / EntryPath(entry.name);
+            if (!fs::is_regular_file(target, ec) || fs::file_size(target, ec) != entry.uncompressedSize || ec) {
+                return false;
+            }
+
+            std::ifstream input(target, std::ios::binary);
+            std::vector<char> buffer(options_.bufferSize);
+            input.rdbuf()->pubsetbuf(nullptr, 0);
+            uint32_t crc = 0;
+            while (input) {
+                input.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+                crc = UpdateCrc32(crc, reinterpret_cast<const unsigned char*>(buffer.data()), static_cast<size_t>(input.gcount()));
+            }
+
+            std::lock_guard<std::mutex> guard(statsLock_);
+            stats_.bytesRead += entry.uncompressedSize;
+            if (!input.eof() || crc != entry.crc32) {
+                return false;
+            }
+            stats_.skipped++;
+            unchanged_.push_back(ManifestKey(EntryPath(entry.name)));
+            LogPath("Skipped unchanged file: %S", target);
+            return true;
+        }
+
+        bool WriteEntry(const unsigned char* image, size_t size, const ZipEntry& entry) override {
+            std::error_code ec;
+            fs::path target = destination_ / EntryPath(entry.name);
+            PlaceResult placed = PlaceResult::Copied;
+            std::string hash;
+            if (options_.store != nullptr) {
+                // Decode into the store's volume while hashing, then link the target to the blob
+                fs::path staged = options_.store->StagingPath();
+                bool decoded = Decode(image, size, entry, staged, &hash);
+                std::vector<char> buffer(decoded ? options_.bufferSize : 0);
+                placed = decoded ? options_.store->AdoptStaged(staged, hash, target, buffer.data(), buffer.size()) : PlaceResult::Failed;
+            }
+            else if (!Decode(image, size, entry, target, nullptr)) {
+                placed = PlaceResult::Failed;
+            }
+
+            std::lock_guard<std::mutex> guard(statsLock_);
+            stats_.bytesRead += entry.compressedSize;
+            if (placed == PlaceResult::Failed) {
+                stats_.errors.push_back(L"Failed to extract file: " + target.wstring());
+                return false;
+            }
+            if (placed == PlaceResult::Linked) {
+                stats_.linked++;
+            }
+            if (placed == PlaceResult::Linked || placed == PlaceResult::Stored) {
+                placedHashes_.emplace_back(ManifestKey(EntryPath(entry.name)), hash);
+            }
+            stats_.files++;
+            stats_.bytes += entry.uncompressedSize;
+            stats_.bytesWritten += entry.uncompressedSize;
+            LogPath("Extracted file: %S", target);
+            return true;
+        }
+
+        const std::vector<std::string>& Unchanged() const { return unchanged_; }
+        const std::vector<std::pair<std::string, std::string>>& PlacedHashes() const { return placedHashes_; }
+
+    private:
+        fs::path destination_;
+        const CopyOptions& options_;
+        CopyStats& stats_;
+        std::mutex statsLock_;
+        std::vector<std::string> unchanged_;
+        std::vector<std::pair<std::string, std::string>> placedHashes_;
+
+        // Decodes one entry into `path`, checking its CRC-32. A partial file is removed. An
+        // existing file is removed first, so a hard link into the asset store is never written through.
+        static bool Decode(const unsigned char* image, size_t size, const ZipEntry& entry, const fs::path& path, std::string* hash) {
+            std::error_code ec;
+            fs::remove(path, ec);
+            bool decoded;
+            {
+                std::ofstream output(path, std::ios::binary | std::ios::trunc);
+                StreamSink file(output);
+                HashingSink hashing(file);
+                OutputSink& sink = hash != nullptr ? static_cast<OutputSink&>(hashing) : file;
+                decoded = output && ExtractZipEntry(image, size, entry, sink) && output.flush();
+                if (decoded && hash != nullptr) {
+                    *hash = hashing.Hex();
+                }
+            }
+            if (!decoded) {
+                fs::remove(path, ec);
+            }
+            return decoded;
+        }
+
+        // Called with statsLock_ held; paths are only converted when Verbose is enabled
+        void LogPath(const char* format, const fs::path& path) {
+            if (options_.log != nullptr && options_.log->Enabled(LogLevel::Verbose)) {
+                options_.log->Log(LogLevel::Verbose, format, path.wstring().c_str());
+            }
+        }
+    };
+}
+
+bool InstallFromPayload(const unsigned char* image, size_t size, const std::string& prefix,
+    const fs::path& destination, const CopyOptions& options, CopyStats& stats) {
+    PayloadLocation location;
+    std::vector<ZipEntry> all;
+    if (!LocateZipPayload(image, size, location) || !ReadZipEntries(image, size, location, all)) {
+        stats.errors.push_back(L"Failed to read the installer payload");
+        return false;
+    }
+
+    // Keep the entries below the prefix, named relative to it
+    std::vector<ZipEntry> entries;
+    for (auto& entry : all) {
+        if (entry.name.size() > prefix.size() && entry.name.compare(0, prefix.size(), prefix) == 0) {
+            entry.name.erase(0, prefix.size());
+            entries.push_back(std::move(entry));
+        }
+    }
+
+    std::error_code ec;
+    fs::create_directories(destination, ec);
+    if (options.removeStale) {
+        std::unordered_set<std::wstring> keep;
+        for (const auto& entry : entries) {
+            std::string name = entry.name;
+            if (!name.empty() && name.back() == '/') {
+                name.pop_back();
+            }
+            keep.insert(PathKey(EntryPath(name)));
+        }
+        for (const auto& directory : PlanDirectories(entries)) {
+            keep.insert(PathKey(EntryPath(directory.name)));
+        }
+        RemoveStaleEntries(destination, keep, options, stats);
+    }
+
+    PayloadTarget target(destination, options, stats);
+    ExtractionOptions extraction;
+    extraction.maxThreads = options.maxThreads;
+    extraction.resume = options.incremental;
+    if (!ExtractEntriesParallel(image, size, entries, target, extraction) && stats.errors.empty()) {
+        stats.errors.push_back(L"Failed to extract the installer payload");
+    }
+
+    if (options.store != nullptr) {
+        // As in CopyTree: unchanged files keep their recorded hashes, placed files get new ones
+        AssetManifest previous;
+        AssetManifest manifest;
+        options.store->ReadManifest(destination, previous);
+        for (const auto& key : target.Unchanged()) {
+            auto entry = previous.find(key);
+            if (entry != previous.end()) {
+                manifest.insert(*entry);
+            }
+        }
+        for (const auto& placed : target.PlacedHashes()) {
+            manifest[placed.first] = placed.second;
+        }
+        if (!options.store->WriteManifest(destination, manifest)) {
+            stats.errors.push_back(L"Failed to record the asset manifest for " + destination.wstring());
+        }
+    }
+    return stats.errors.empty();
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include "CopyEngine.h"
+
+// Installs the files below `prefix` (e.g. "build/") in the ZIP payload of an SFX image held in
+// memory into `destination`, decoding each entry straight to its final place. The theme is
+// then written once, instead of being extracted by the SFX and copied again from there.
+// Honors the incremental, removeStale, store, maxThreads and log options as CopyTree does;
+// in incremental mode a file whose size and CRC-32 already match its entry is left alone.
+// Returns false if the payload cannot be read or anything failed to install.
+bool InstallFromPayload(const unsigned char* image, size_t size, const std::string& prefix,
+    const std::filesystem::path& destination, const CopyOptions& options, CopyStats& stats);
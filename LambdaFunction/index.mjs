@@ -26,15 +26,11 @@ function clearDirectory(directoryPath) {
 // Main handler function
 export const handler = async (event) => {
     const tempDir = os.tmpdir();
-    const buildDir = path.join(tempDir, 'build');
     const inputZipPath = path.join(tempDir, 'input.zip');
     const msiPath = path.join(tempDir, 'NewTabSetup.msi');
-    const archivePath = path.join(tempDir, 'archive.7z');
-    const configFilePath = path.join(tempDir, 'config.txt');
-    const sfxModulePath = '/opt/bin/7zSD.sfx'; // Ensure this is the correct path to 7zSD.sfx
+    const sfxStubPath = '/opt/bin/SFX.exe'; // Release build of the SFX project
     const outputSfxPath = path.join(tempDir, 'output.exe');
     const certificatePath = path.join(tempDir, 'certificate.pfx');
-    const signedOutputPath = path.join(tempDir, 'signed-output.exe');
 
     // Retrieve input details from the event
     const inputBucket = event.inputBucket;
@@ -51,45 +47,21 @@ export const handler = async (event) => {
         // Clear /tmp directory to prevent conflicts with previous runs
         clearDirectory(tempDir);
 
-        // Create build directory
-        if (!fs.existsSync(buildDir)) {
-            fs.mkdirSync(buildDir);
-        }
-
         // Download the input zip file from S3
         await downloadFileFromS3(inputBucket, inputKey, inputZipPath);
 
-        // Extract zip to build directory, preserving directory structure
-        await execPromise(`/opt/bin/7za x ${inputZipPath} -o${buildDir} -y`);
-
         // Download the MSI file from S3
         await downloadFileFromS3(msiBucket, msiKey, msiPath);
 
         // Download the certificate file from S3
         await downloadFileFromS3(certBucket, certKey, certificatePath);
 
-        // Create a 7z archive with the correct structure
-        await createArchiveWithStructure(buildDir, msiPath, archivePath);
-
-        // Create config file for the SFX archive
-        const configContent = `
-;!@Install@!UTF-8!
-Title="New Tab Setup"
-ExecuteFile="msiexec.exe"
-ExecuteParameters="/i NewTabSetup.msi"
-GUIMode="2"
-;!@InstallEnd@!
-`;
-        fs.writeFileSync(configFilePath, configContent);
-
-        // Concatenate the SFX module, config file, and 7z archive into an executable
-        await execPromise(`cat ${sfxModulePath} ${configFilePath} ${archivePath} > ${outputSfxPath}`);
-
-        // Sign the SFX executable using osslsigncode
-        await signExecutable(outputSfxPath, signedOutputPath, certificatePath, certPassword);
+        // Build and sign the SFX in one pass: stub, then an archive with the MSI and the theme
+        // under build/, hashed as it is written and signed in place
+        await createSfxExecutable(sfxStubPath, msiPath, inputZipPath, outputSfxPath, certificatePath, certPassword);
 
         // Upload the signed SFX archive to S3
-        await uploadFileToS3(outputBucket, outputKey, signedOutputPath);
+        await uploadFileToS3(outputBucket, outputKey, outputSfxPath);
 
         return {
             statusCode: 200,
@@ -126,44 +98,13 @@ async function uploadFileToS3(bucket, key, filePath) {
     await s3.upload(params).promise();
 }
 
-// Create a 7z archive with the specified structure
-async function createArchiveWithStructure(buildDir, msiPath, archivePath) {
-    // Create a temporary directory to hold the archive contents
-    const tempDir = path.join(buildDir, 'temp');
-    if (!fs.existsSync(tempDir)) {
-        fs.mkdirSync(tempDir);
-    }
-
-    // Create a 'build' folder inside the temp directory
-    const buildFolder = path.join(tempDir, 'build');
-    if (!fs.existsSync(buildFolder)) {
-        fs.mkdirSync(buildFolder);
-    }
-
-    // Move all files and directories to the 'build' folder
-    const files = fs.readdirSync(buildDir);
-    files.forEach(file => {
-        const filePath = path.join(buildDir, file);
-        const destinationPath = path.join(buildFolder, file);
-
-        // Avoid moving the 'temp' directory into itself
-        if (filePath !== tempDir) {
-            fs.renameSync(filePath, destinationPath);
-        }
-    });
-
-    // Move the MSI file to the root of the temp directory
-    fs.copyFileSync(msiPath, path.join(tempDir, 'NewTabSetup.msi'));
-
-    // Create the 7z archive from the temp directory, including subdirectories
-    await execPromise(`/opt/bin/7za a ${archivePath} ${tempDir}/* -m0=lzma2 -mx=0 -r`);
-}
-
-// Sign an executable using osslsigncode
-async function signExecutable(inputFile, outputFile, certFile, certPassword) {
-    // Set the environment variable in the Lambda script
+// Pack and sign the SFX executable with sfxpack (see SFXPacker/). The compressed MSI is kept
+// in /tmp, so warm invocations splice it in instead of compressing it again. The Authenticode
+// digest is taken while the installer is written, so it is neither re-read nor copied to sign it.
+async function createSfxExecutable(stubPath, msiPath, themeZipPath, outputPath, certFile, certPassword) {
+    // Older PFX files need OpenSSL's legacy provider, which is loaded from here
     process.env.OPENSSL_MODULES = '/opt/lib';
 
-    const command = `/opt/bin/osslsigncode sign -pkcs12 ${certFile} -pass ${certPassword} -n "New Tab Setup" -i https://newtabthemebuilder.com/ -in ${inputFile} -out ${outputFile}`;
+    const command = `/opt/bin/sfxpack --stub ${stubPath} --msi ${msiPath} --theme ${themeZipPath} --output ${outputPath} --cache-dir /tmp/sfxpack-cache --pkcs12 ${certFile} --pass ${certPassword} --description "New Tab Setup" --url https://newtabthemebuilder.com/`;
     await execPromise(command);
 }
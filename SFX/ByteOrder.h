@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+
+// Little-endian readers and writers for the PE and ZIP structures.
+// Written byte by byte so they are safe on unaligned data and big-endian hosts.
+
+inline uint16_t ReadLE16(const unsigned char* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+inline uint32_t ReadLE32(const unsigned char* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+        (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline uint64_t ReadLE64(const unsigned char* p) {
+    return static_cast<uint64_t>(ReadLE32(p)) | (static_cast<uint64_t>(ReadLE32(p + 4)) << 32);
+}
+
+inline void WriteLE16(unsigned char* p, uint16_t value) {
+    p[0] = static_cast<unsigned char>(value);
+    p[1] = static_cast<unsigned char>(value >> 8);
+}
+
+inline void WriteLE32(unsigned char* p, uint32_t value) {
+    WriteLE16(p, static_cast<uint16_t>(value));
+    WriteLE16(p + 2, static_cast<uint16_t>(value >> 16));
+}
+
+inline void WriteLE64(unsigned char* p, uint64_t value) {
+    WriteLE32(p, static_cast<uint32_t>(value));
+    WriteLE32(p + 4, static_cast<uint32_t>(value >> 32));
+}
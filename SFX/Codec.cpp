@@ -0,0 +1,31 @@
+#include "Codec.h"
+#include <cstring>
+
+namespace {
+    bool DecodeStored(const unsigned char* input, size_t inputSize, OutputSink& output) {
+        return inputSize == 0 || output.Write(input, inputSize);
+    }
+
+    const PayloadCodec kCodecs[] = {
+        { kZipMethodStored, "store", DecodeStored },
+        { kZipMethodDeflated, "deflate", InflateRaw },
+    };
+}
+
+const PayloadCodec* FindCodec(uint16_t method) {
+    for (const auto& codec : kCodecs) {
+        if (codec.method == method) {
+            return &codec;
+        }
+    }
+    return nullptr;
+}
+
+const PayloadCodec* FindCodecByName(const char* name) {
+    for (const auto& codec : kCodecs) {
+        if (strcmp(codec.name, name) == 0) {
+            return &codec;
+        }
+    }
+    return nullptr;
+}
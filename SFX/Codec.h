@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "Inflate.h"
+
+// ZIP compression method ids (APPNOTE 4.4.5) used for payload entries
+const uint16_t kZipMethodStored = 0;
+const uint16_t kZipMethodDeflated = 8;
+
+// Decodes one entry's compressed bytes into the sink. Returns false on corrupt input.
+typedef bool (*DecodeFunction)(const unsigned char* input, size_t inputSize, OutputSink& output);
+
+// A payload codec the stub can decode. The packer selects among the same methods, so an
+// archive never uses a method the stub does not have.
+struct PayloadCodec {
+    uint16_t method;
+    const char* name;
+    DecodeFunction decode;
+};
+
+// Returns the codec for a ZIP method id, or nullptr if the stub cannot decode it
+const PayloadCodec* FindCodec(uint16_t method);
+
+// Returns the codec with the given name ("store", "deflate"), or nullptr
+const PayloadCodec* FindCodecByName(const char* name);
@@ -0,0 +1,155 @@
+#include "Crc32.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CRC32_CLMUL 1
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define CRC32_TARGET_CLMUL
+#else
+#include <cpuid.h>
+#define CRC32_TARGET_CLMUL __attribute__((target("pclmul,sse2")))
+#endif
+#endif
+
+namespace {
+    // Slicing-by-4 tables, built once on first use
+    struct Crc32Tables {
+        uint32_t table[4][256];
+
+        Crc32Tables() {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t crc = i;
+                for (int bit = 0; bit < 8; ++bit) {
+                    crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+                }
+                table[0][i] = crc;
+            }
+            for (uint32_t i = 0; i < 256; ++i) {
+                for (int slice = 1; slice < 4; ++slice) {
+                    uint32_t previous = table[slice - 1][i];
+                    table[slice][i] = (previous >> 8) ^ table[0][previous & 0xFF];
+                }
+            }
+        }
+    };
+
+    const Crc32Tables& GetTables() {
+        static const Crc32Tables tables;
+        return tables;
+    }
+
+    // Table-driven update of the inverted CRC state
+    uint32_t UpdateTable(uint32_t crc, const unsigned char* data, size_t size) {
+        const Crc32Tables& t = GetTables();
+        while (size >= 4) {
+            crc ^= static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) |
+                (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+            crc = t.table[3][crc & 0xFF] ^ t.table[2][(crc >> 8) & 0xFF] ^
+                t.table[1][(crc >> 16) & 0xFF] ^ t.table[0][crc >> 24];
+            data += 4;
+            size -= 4;
+        }
+        while (size-- > 0) {
+            crc = (crc >> 8) ^ t.table[0][(crc ^ *data++) & 0xFF];
+        }
+        return crc;
+    }
+
+#ifdef CRC32_CLMUL
+    bool HasClmul() {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 1)) != 0;
+#else
+        unsigned eax, ebx, ecx, edx;
+        return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_PCLMUL) != 0;
+#endif
+    }
+
+    // Folds 64-byte blocks with carry-less multiplication (Intel, "Fast CRC Computation for
+    // Generic Polynomials Using PCLMULQDQ"), four 128-bit lanes at a time, then reduces to 32
+    // bits with Barrett reduction. Takes and returns the inverted CRC state. `size` must be at
+    // least 64 and a multiple of 16.
+    CRC32_TARGET_CLMUL uint32_t UpdateClmul(uint32_t crc, const unsigned char* data, size_t size) {
+        const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+        const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+        const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124);
+        const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+        const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+        __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+        __m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16));
+        __m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 32));
+        __m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 48));
+        x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(crc)));
+        data += 64;
+        size -= 64;
+
+        while (size >= 64) {
+            __m128i x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+            __m128i x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+            __m128i x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+            __m128i x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+            x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+            x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+            x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+            x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data)));
+            x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16)));
+            x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 32)));
+            x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 48)));
+            data += 64;
+            size -= 64;
+        }
+
+        // Fold the four lanes into one, then any remaining 16-byte blocks into it
+        const __m128i lanes[3] = { x2, x3, x4 };
+        for (const __m128i& lane : lanes) {
+            __m128i low = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+            x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, lane), low);
+        }
+        while (size >= 16) {
+            __m128i low = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+            x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data))), low);
+            data += 16;
+            size -= 16;
+        }
+
+        // 128 bits to 64
+        x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+        x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+        x2 = _mm_srli_si128(x1, 4);
+        x1 = _mm_and_si128(x1, mask32);
+        x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        // Barrett reduction to 32 bits
+        x2 = _mm_and_si128(x1, mask32);
+        x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+        x2 = _mm_and_si128(x2, mask32);
+        x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+        return static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(x1, 4)));
+    }
+#endif
+}
+
+uint32_t UpdateCrc32(uint32_t crc, const unsigned char* data, size_t size) {
+    crc = ~crc;
+#ifdef CRC32_CLMUL
+    // Short inputs are not worth the setup; the table handles them and the tail
+    static const bool clmul = HasClmul();
+    if (clmul && size >= 64) {
+        size_t folded = size & ~static_cast<size_t>(15);
+        crc = UpdateClmul(crc, data, folded);
+        data += folded;
+        size -= folded;
+    }
+#endif
+    return ~UpdateTable(crc, data, size);
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Updates a running CRC-32 (ISO-HDLC, as used by ZIP). Start with crc = 0.
+uint32_t UpdateCrc32(uint32_t crc, const unsigned char* data, size_t size);
@@ -0,0 +1,409 @@
+#include "Inflate.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace {
+    const int kMaxBits = 15;
+    const int kFastBits = 10;
+    const int kMaxLiteralCodes = 288;
+    const int kMaxDistanceCodes = 30;
+    const size_t kWindowSize = 1 << 16; // Must be a power of two and at least 32 KiB
+    const size_t kWindowMask = kWindowSize - 1;
+
+    const uint16_t kLengthBase[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    const uint8_t kLengthExtra[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    const uint16_t kDistanceBase[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    const uint8_t kDistanceExtra[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+    const uint8_t kCodeLengthOrder[19] = {
+        16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    // Canonical Huffman decoding table. Codes up to kFastBits long resolve with a single
+    // lookup; longer codes fall back to a canonical walk over count/symbol.
+    struct Huffman {
+        uint16_t fast[1 << kFastBits]; // (length << 9) | symbol, 0 when the code is longer
+        uint16_t count[kMaxBits + 1];
+        uint16_t symbol[kMaxLiteralCodes];
+    };
+
+    bool BuildHuffman(Huffman& h, const uint8_t* lengths, int n) {
+        std::memset(h.count, 0, sizeof(h.count));
+        std::memset(h.fast, 0, sizeof(h.fast));
+        for (int i = 0; i < n; ++i) {
+            h.count[lengths[i]]++;
+        }
+        if (h.count[0] == n) {
+            return true; // Empty code: valid, but any decode attempt fails
+        }
+
+        // Reject over-subscribed codes; incomplete codes are allowed
+        int left = 1;
+        for (int len = 1; len <= kMaxBits; ++len) {
+            left <<= 1;
+            left -= h.count[len];
+            if (left < 0) {
+                return false;
+            }
+        }
+
+        uint16_t offsets[kMaxBits + 2];
+        uint16_t nextCode[kMaxBits + 1];
+        offsets[1] = 0;
+        int code = 0;
+        h.count[0] = 0;
+        for (int len = 1; len <= kMaxBits; ++len) {
+            offsets[len + 1] = static_cast<uint16_t>(offsets[len] + h.count[len]);
+            code = (code + h.count[len - 1]) << 1;
+            nextCode[len] = static_cast<uint16_t>(code);
+        }
+
+        for (int sym = 0; sym < n; ++sym) {
+            int len = lengths[sym];
+            if (len == 0) {
+                continue;
+            }
+            h.symbol[offsets[len]++] = static_cast<uint16_t>(sym);
+
+            if (len <= kFastBits) {
+                // DEFLATE stores Huffman codes most-significant bit first
+                int reversed = 0;
+                int value = nextCode[len];
+                for (int i = 0; i < len; ++i) {
+                    reversed = (reversed << 1) | ((value >> i) & 1);
+                }
+                for (int r = reversed; r < (1 << kFastBits); r += 1 << len) {
+                    h.fast[r] = static_cast<uint16_t>((len << 9) | sym);
+                }
+            }
+            nextCode[len]++;
+        }
+        return true;
+    }
+
+    class Decoder {
+    public:
+        Decoder(const unsigned char* input, size_t inputSize, OutputSink& output)
+            : in_(input), end_(input + inputSize), output_(output), window_(kWindowSize) {}
+
+        bool Run() {
+            int last = 0;
+            do {
+                uint32_t header;
+                if (!Bits(3, header)) {
+                    return false;
+                }
+                last = header & 1;
+                bool ok;
+                switch (header >> 1) {
+                case 0:
+                    ok = Stored();
+                    break;
+                case 1:
+                    ok = Fixed();
+                    break;
+                case 2:
+                    ok = Dynamic();
+                    break;
+                default:
+                    ok = false;
+                    break;
+                }
+                if (!ok) {
+                    return false;
+                }
+            } while (!last);
+            return Flush();
+        }
+
+    private:
+        const unsigned char* in_;
+        const unsigned char* end_;
+        OutputSink& output_;
+        uint64_t bitBuffer_ = 0;
+        int bitCount_ = 0;
+        std::vector<unsigned char> window_;
+        size_t position_ = 0; // Total bytes produced
+        size_t flushed_ = 0;  // Total bytes handed to the sink
+        Huffman literals_;
+        Huffman distances_;
+
+        void Refill() {
+            while (bitCount_ <= 56 && in_ < end_) {
+                bitBuffer_ |= static_cast<uint64_t>(*in_++) << bitCount_;
+                bitCount_ += 8;
+            }
+        }
+
+        bool Bits(int n, uint32_t& value) {
+            if (bitCount_ < n) {
+                Refill();
+                if (bitCount_ < n) {
+                    return false;
+                }
+            }
+            value = static_cast<uint32_t>(bitBuffer_ & ((1ull << n) - 1));
+            bitBuffer_ >>= n;
+            bitCount_ -= n;
+            return true;
+        }
+
+        bool Decode(const Huffman& h, int& symbol) {
+            if (bitCount_ < kMaxBits) {
+                Refill();
+            }
+
+            uint16_t entry = h.fast[bitBuffer_ & ((1u << kFastBits) - 1)];
+            if (entry != 0) {
+                int len = entry >> 9;
+                if (len > bitCount_) {
+                    return false;
+                }
+                bitBuffer_ >>= len;
+                bitCount_ -= len;
+                symbol = entry & 0x1FF;
+                return true;
+            }
+
+            // Canonical decode for codes longer than the fast table
+            int code = 0;
+            int first = 0;
+            int index = 0;
+            for (int len = 1; len <= kMaxBits && len <= bitCount_; ++len) {
+                code |= static_cast<int>((bitBuffer_ >> (len - 1)) & 1);
+                int count = h.count[len];
+                if (code - count < first) {
+                    bitBuffer_ >>= len;
+                    bitCount_ -= len;
+                    symbol = h.symbol[index + (code - first)];
+                    return true;
+                }
+                index += count;
+                first += count;
+                first <<= 1;
+                code <<= 1;
+            }
+            return false;
+        }
+
+        bool Flush() {
+            while (flushed_ < position_) {
+                size_t start = flushed_ & kWindowMask;
+                size_t size = position_ - flushed_;
+                if (size > kWindowSize - start) {
+                    size = kWindowSize - start;
+                }
+                if (!output_.Write(window_.data() + start, size)) {
+                    return false;
+                }
+                flushed_ += size;
+            }
+            return true;
+        }
+
+        bool Put(unsigned char byte) {
+            window_[position_ & kWindowMask] = byte;
+            ++position_;
+            // Flush once the unflushed part fills half the window, keeping 32 KiB of history
+            if (position_ - flushed_ >= kWindowSize / 2) {
+                return Flush();
+            }
+            return true;
+        }
+
+        bool Stored() {
+            // Discard the remaining bits of the current byte
+            bitBuffer_ >>= bitCount_ & 7;
+            bitCount_ -= bitCount_ & 7;
+
+            uint32_t length;
+            uint32_t complement;
+            if (!Bits(16, length) || !Bits(16, complement) || length != (~complement & 0xFFFF)) {
+                return false;
+            }
+
+            // Drain whole bytes still held in the bit buffer
+            while (length > 0 && bitCount_ >= 8) {
+                if (!Put(static_cast<unsigned char>(bitBuffer_))) {
+                    return false;
+                }
+                bitBuffer_ >>= 8;
+                bitCount_ -= 8;
+                --length;
+            }
+
+            if (static_cast<size_t>(end_ - in_) < length) {
+                return false;
+            }
+            while (length > 0) {
+                size_t offset = position_ & kWindowMask;
+                size_t chunk = kWindowSize / 2 - (position_ - flushed_);
+                if (chunk > kWindowSize - offset) {
+                    chunk = kWindowSize - offset;
+                }
+                if (chunk > length) {
+                    chunk = length;
+                }
+                std::memcpy(window_.data() + offset, in_, chunk);
+                in_ += chunk;
+                position_ += chunk;
+                length -= static_cast<uint32_t>(chunk);
+                if (position_ - flushed_ >= kWindowSize / 2 && !Flush()) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool Codes() {
+            for (;;) {
+                int symbol;
+                if (!Decode(literals_, symbol)) {
+                    return false;
+                }
+                if (symbol < 256) {
+                    if (!Put(static_cast<unsigned char>(symbol))) {
+                        return false;
+                    }
+                    continue;
+                }
+                if (symbol == 256) {
+                    return true;
+                }
+
+                symbol -= 257;
+                if (symbol >= 29) {
+                    return false;
+                }
+                uint32_t extra;
+                if (!Bits(kLengthExtra[symbol], extra)) {
+                    return false;
+                }
+                size_t length = kLengthBase[symbol] + extra;
+
+                if (!Decode(distances_, symbol) || symbol >= kMaxDistanceCodes) {
+                    return false;
+                }
+                if (!Bits(kDistanceExtra[symbol], extra)) {
+                    return false;
+                }
+                size_t distance = kDistanceBase[symbol] + extra;
+                if (distance > position_) {
+                    return false;
+                }
+
+                while (length-- > 0) {
+                    if (!Put(window_[(position_ - distance) & kWindowMask])) {
+                        return false;
+                    }
+                }
+            }
+        }
+
+        bool Fixed() {
+            uint8_t lengths[kMaxLiteralCodes];
+            int sym = 0;
+            for (; sym < 144; ++sym) lengths[sym] = 8;
+            for (; sym < 256; ++sym) lengths[sym] = 9;
+            for (; sym < 280; ++sym) lengths[sym] = 7;
+            for (; sym < kMaxLiteralCodes; ++sym) lengths[sym] = 8;
+            BuildHuffman(literals_, lengths, kMaxLiteralCodes);
+
+            for (sym = 0; sym < kMaxDistanceCodes; ++sym) lengths[sym] = 5;
+            BuildHuffman(distances_, lengths, kMaxDistanceCodes);
+            return Codes();
+        }
+
+        bool Dynamic() {
+            uint32_t literalCount;
+            uint32_t distanceCount;
+            uint32_t codeLengthCount;
+            if (!Bits(5, literalCount) || !Bits(5, distanceCount) || !Bits(4, codeLengthCount)) {
+                return false;
+            }
+            literalCount += 257;
+            distanceCount += 1;
+            codeLengthCount += 4;
+            if (literalCount > 286 || distanceCount > kMaxDistanceCodes) {
+                return false;
+            }
+
+            uint8_t lengths[kMaxLiteralCodes + kMaxDistanceCodes] = {};
+            for (uint32_t i = 0; i < codeLengthCount; ++i) {
+                uint32_t value;
+                if (!Bits(3, value)) {
+                    return false;
+                }
+                lengths[kCodeLengthOrder[i]] = static_cast<uint8_t>(value);
+            }
+
+            Huffman codeLengths;
+            if (!BuildHuffman(codeLengths, lengths, 19)) {
+                return false;
+            }
+
+            uint32_t index = 0;
+            while (index < literalCount + distanceCount) {
+                int symbol;
+                if (!Decode(codeLengths, symbol)) {
+                    return false;
+                }
+                if (symbol < 16) {
+                    lengths[index++] = static_cast<uint8_t>(symbol);
+                    continue;
+                }
+
+                uint8_t value = 0;
+                uint32_t repeat;
+                if (symbol == 16) {
+                    if (index == 0 || !Bits(2, repeat)) {
+                        return false;
+                    }
+                    value = lengths[index - 1];
+                    repeat += 3;
+                }
+                else if (symbol == 17) {
+                    if (!Bits(3, repeat)) {
+                        return false;
+                    }
+                    repeat += 3;
+                }
+                else {
+                    if (!Bits(7, repeat)) {
+                        return false;
+                    }
+                    repeat += 11;
+                }
+                if (index + repeat > literalCount + distanceCount) {
+                    return false;
+                }
+                while (repeat-- > 0) {
+                    lengths[index++] = value;
+                }
+            }
+
+            // A block without an end-of-block code cannot terminate
+            if (lengths[256] == 0) {
+                return false;
+            }
+            if (!BuildHuffman(literals_, lengths, literalCount) ||
+                !BuildHuffman(distances_, lengths + literalCount, distanceCount)) {
+                return false;
+            }
+            return Codes();
+        }
+    };
+}
+
+bool InflateRaw(const unsigned char* input, size_t inputSize, OutputSink& output) {
+    Decoder decoder(input, inputSize, output);
+    return decoder.Run();
+}
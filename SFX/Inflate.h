@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+
+// Destination for decoded bytes. Returning false aborts the operation.
+class OutputSink {
+public:
+    virtual ~OutputSink() = default;
+    virtual bool Write(const unsigned char* data, size_t size) = 0;
+};
+
+// Decodes a raw DEFLATE stream (RFC 1951, as stored in ZIP method 8) held in memory.
+// Output is streamed to the sink through a 64 KiB window, so memory use does not
+// depend on the size of the entry. Returns false on corrupt or truncated input.
+bool InflateRaw(const unsigned char* input, size_t inputSize, OutputSink& output);
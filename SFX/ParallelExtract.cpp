@@ -0,0 +1,155 @@
+#include "ParallelExtract.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace {
+    // Per-worker queue of entry indices. The owner takes from the front, thieves from the back.
+    struct WorkQueue {
+        std::mutex lock;
+        std::deque<size_t> items;
+
+        bool PopFront(size_t& item) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (items.empty()) {
+                return false;
+            }
+            item = items.front();
+            items.pop_front();
+            return true;
+        }
+
+        bool PopBack(size_t& item) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (items.empty()) {
+                return false;
+            }
+            item = items.back();
+            items.pop_back();
+            return true;
+        }
+    };
+
+    unsigned ResolveThreadCount(const ExtractionOptions& options, size_t workItems) {
+        unsigned threads = std::thread::hardware_concurrency();
+        if (threads == 0) {
+            threads = 1;
+        }
+        if (options.maxThreads != 0 && options.maxThreads < threads) {
+            threads = options.maxThreads;
+        }
+        if (workItems < threads) {
+            threads = static_cast<unsigned>(std::max<size_t>(workItems, 1));
+        }
+        return threads;
+    }
+
+    bool ProcessEntry(const unsigned char* image, size_t size, const ZipEntry& entry, ExtractionTarget& target,
+        const ExtractionOptions& options) {
+        return (options.resume && target.IsExtracted(entry)) || target.WriteEntry(image, size, entry);
+    }
+}
+
+std::vector<ZipEntry> PlanDirectories(const std::vector<ZipEntry>& entries) {
+    std::map<std::string, bool> directories; // Name to UTF-8 flag of the first entry that needs it
+    for (const auto& entry : entries) {
+        // Every prefix ending in '/' is a directory, including the entry itself for directory entries
+        for (size_t pos = entry.name.find('/'); pos != std::string::npos; pos = entry.name.find('/', pos + 1)) {
+            directories.emplace(entry.name.substr(0, pos), entry.utf8Name);
+        }
+    }
+
+    std::vector<ZipEntry> ordered;
+    ordered.reserve(directories.size());
+    for (const auto& directory : directories) {
+        ZipEntry entry;
+        entry.name = directory.first;
+        entry.utf8Name = directory.second;
+        entry.isDirectory = true;
+        ordered.push_back(std::move(entry));
+    }
+
+    // A parent is a strict prefix of its children, so ordering by depth puts parents first
+    std::stable_sort(ordered.begin(), ordered.end(), [](const ZipEntry& a, const ZipEntry& b) {
+        return std::count(a.name.begin(), a.name.end(), '/') < std::count(b.name.begin(), b.name.end(), '/');
+    });
+    return ordered;
+}
+
+bool ExtractEntriesParallel(const unsigned char* image, size_t size, const std::vector<ZipEntry>& entries,
+    ExtractionTarget& target, const ExtractionOptions& options) {
+    for (const auto& entry : entries) {
+        if (!IsSafeEntryName(entry.name)) {
+            return false;
+        }
+    }
+
+    for (const auto& directory : PlanDirectories(entries)) {
+        if (!target.MakeDirectory(directory)) {
+            return false;
+        }
+    }
+
+    // Largest entries first so a big file does not become the tail of the run
+    std::vector<size_t> files;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (!entries[i].isDirectory) {
+            files.push_back(i);
+        }
+    }
+    std::stable_sort(files.begin(), files.end(), [&entries](size_t a, size_t b) {
+        return entries[a].uncompressedSize > entries[b].uncompressedSize;
+    });
+
+    unsigned threadCount = ResolveThreadCount(options, files.size());
+    if (threadCount == 1) {
+        for (size_t index : files) {
+            if (!ProcessEntry(image, size, entries[index], target, options)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Deal entries round-robin so every worker starts with a similar share of large files
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    for (unsigned i = 0; i < threadCount; ++i) {
+        queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+    }
+    for (size_t i = 0; i < files.size(); ++i) {
+        queues[i % threadCount]->items.push_back(files[i]);
+    }
+
+    std::atomic<bool> failed(false);
+    auto worker = [&](unsigned self) {
+        size_t index;
+        while (!failed.load(std::memory_order_relaxed)) {
+            bool found = queues[self]->PopFront(index);
+            for (unsigned offset = 1; !found && offset < threadCount; ++offset) {
+                found = queues[(self + offset) % threadCount]->PopBack(index);
+            }
+            if (!found) {
+                return; // No work is ever added, so empty queues mean we are done
+            }
+            if (!ProcessEntry(image, size, entries[index], target, options)) {
+                failed.store(true, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < threadCount; ++i) {
+        threads.emplace_back(worker, i);
+    }
+    worker(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    return !failed.load();
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "ZipReader.h"
+
+// Platform-specific side of extraction: where directories and files end up
+class ExtractionTarget {
+public:
+    virtual ~ExtractionTarget() = default;
+
+    // Creates one directory (name without trailing '/'). Its parent is guaranteed to exist already.
+    virtual bool MakeDirectory(const ZipEntry& directory) = 0;
+
+    // Creates the entry's file and decodes it from the image, typically via ExtractZipEntry.
+    // Called concurrently from worker threads.
+    virtual bool WriteEntry(const unsigned char* image, size_t size, const ZipEntry& entry) = 0;
+
+    // Returns true if the entry's file already exists with the entry's size and CRC-32, so an
+    // interrupted run can resume without writing it again. Called concurrently when resuming.
+    virtual bool IsExtracted(const ZipEntry& entry) {
+        (void)entry;
+        return false;
+    }
+};
+
+struct ExtractionOptions {
+    unsigned maxThreads = 0; // 0 uses the hardware thread count
+    bool resume = false;     // Skip entries the target reports as already extracted and intact
+};
+
+// Returns the directories that must exist before the entries can be written, parents first
+std::vector<ZipEntry> PlanDirectories(const std::vector<ZipEntry>& entries);
+
+// Creates all directories serially, then decodes file entries in parallel on a bounded
+// work-stealing pool. Stops scheduling new entries after the first failure. When resuming,
+// entries already on disk are verified instead of decoded.
+bool ExtractEntriesParallel(const unsigned char* image, size_t size, const std::vector<ZipEntry>& entries,
+    ExtractionTarget& target, const ExtractionOptions& options);
@@ -0,0 +1,183 @@
+#include "PayloadLocator.h"
+#include "ByteOrder.h"
+
+namespace {
+    const uint32_t kPeSignature = 0x00004550;        // "PE\0\0"
+    const uint32_t kEndOfCentralDirectory = 0x06054b50;
+    const uint64_t kEndOfCentralDirectorySize = 22;
+    const uint64_t kMaxCommentSize = 0xFFFF;
+    const uint16_t kOptionalHeaderPe32 = 0x10b;
+    const uint16_t kOptionalHeaderPe32Plus = 0x20b;
+    const uint32_t kSecurityDirectoryIndex = 4;
+    const uint64_t kSignaturePadding = 8;
+
+    // Returns the offset of the PE signature, or 0 if the image is not a PE file
+    uint64_t FindPeHeader(const unsigned char* data, size_t size) {
+        if (size < 0x40 || data[0] != 'M' || data[1] != 'Z') {
+            return 0;
+        }
+        uint64_t peOffset = ReadLE32(data + 0x3C);
+        if (peOffset == 0 || peOffset + 24 > size || ReadLE32(data + peOffset) != kPeSignature) {
+            return 0;
+        }
+        return peOffset;
+    }
+
+    bool IsZeroFilled(const unsigned char* data, uint64_t size) {
+        for (uint64_t i = 0; i < size; ++i) {
+            if (data[i] != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+uint64_t FindPeOverlayOffset(const unsigned char* data, size_t size) {
+    uint64_t peOffset = FindPeHeader(data, size);
+    if (peOffset == 0) {
+        return 0;
+    }
+
+    // COFF file header follows the 4-byte signature
+    uint16_t sectionCount = ReadLE16(data + peOffset + 6);
+    uint16_t optionalHeaderSize = ReadLE16(data + peOffset + 20);
+    uint64_t sectionTable = peOffset + 24 + optionalHeaderSize;
+    if (sectionTable + static_cast<uint64_t>(sectionCount) * 40 > size) {
+        return 0;
+    }
+
+    uint64_t overlay = 0;
+    for (uint16_t i = 0; i < sectionCount; ++i) {
+        const unsigned char* section = data + sectionTable + static_cast<uint64_t>(i) * 40;
+        uint64_t rawSize = ReadLE32(section + 16);
+        uint64_t rawPointer = ReadLE32(section + 20);
+        if (rawSize != 0 && rawPointer + rawSize > overlay) {
+            overlay = rawPointer + rawSize;
+        }
+    }
+
+    return overlay <= size ? overlay : 0;
+}
+
+bool FindPeSignatureFields(const unsigned char* data, size_t size, PeSignatureFields& fields) {
+    uint64_t peOffset = FindPeHeader(data, size);
+    if (peOffset == 0) {
+        return false;
+    }
+
+    uint64_t optionalHeader = peOffset + 24;
+    uint16_t optionalHeaderSize = ReadLE16(data + peOffset + 20);
+    if (optionalHeaderSize < 68 || optionalHeader + optionalHeaderSize > size) {
+        return false;
+    }
+
+    // Data directories start at a fixed offset that depends on PE32 vs PE32+
+    uint16_t magic = ReadLE16(data + optionalHeader);
+    uint64_t directories;
+    if (magic == kOptionalHeaderPe32) {
+        directories = optionalHeader + 96;
+    }
+    else if (magic == kOptionalHeaderPe32Plus) {
+        directories = optionalHeader + 112;
+    }
+    else {
+        return false;
+    }
+
+    uint64_t securityEntry = directories + kSecurityDirectoryIndex * 8;
+    if (securityEntry + 8 > optionalHeader + optionalHeaderSize) {
+        return false;
+    }
+
+    // The security directory holds a file offset, not an RVA
+    fields.checksumOffset = optionalHeader + 64;
+    fields.securityEntryOffset = securityEntry;
+    fields.certificateOffset = ReadLE32(data + securityEntry);
+    fields.certificateSize = ReadLE32(data + securityEntry + 4);
+    return true;
+}
+
+uint64_t FindPayloadEnd(const unsigned char* data, size_t size) {
+    PeSignatureFields fields;
+    if (FindPeSignatureFields(data, size, fields) && fields.certificateOffset != 0 && fields.certificateSize != 0 &&
+        fields.certificateOffset < size) {
+        return fields.certificateOffset;
+    }
+    return size;
+}
+
+uint64_t FindEndOfCentralDirectory(const unsigned char* data, uint64_t begin, uint64_t end) {
+    if (end < begin || end - begin < kEndOfCentralDirectorySize) {
+        return UINT64_MAX;
+    }
+
+    uint64_t lowest = begin;
+    if (end - begin > kEndOfCentralDirectorySize + kMaxCommentSize) {
+        lowest = end - kEndOfCentralDirectorySize - kMaxCommentSize;
+    }
+
+    for (uint64_t pos = end - kEndOfCentralDirectorySize + 1; pos-- > lowest;) {
+        // Cheap first-byte filter before the full signature compare
+        if (data[pos] != 'P' || ReadLE32(data + pos) != kEndOfCentralDirectory) {
+            continue;
+        }
+        // The comment must run to the end of the payload, save for the zero bytes a signer
+        // adds to start the certificate table on an 8-byte boundary
+        uint64_t recordEnd = pos + kEndOfCentralDirectorySize + ReadLE16(data + pos + 20);
+        if (recordEnd <= end && end - recordEnd < kSignaturePadding && IsZeroFilled(data + recordEnd, end - recordEnd)) {
+            return pos;
+        }
+    }
+    return UINT64_MAX;
+}
+
+bool LocateZipPayload(const unsigned char* data, size_t size, PayloadLocation& location) {
+    uint64_t overlay = FindPeOverlayOffset(data, size);
+    uint64_t payloadEnd = FindPayloadEnd(data, size);
+    if (payloadEnd < overlay) {
+        return false;
+    }
+
+    uint64_t eocd = FindEndOfCentralDirectory(data, overlay, payloadEnd);
+    if (eocd == UINT64_MAX) {
+        return false;
+    }
+
+    const unsigned char* record = data + eocd;
+    uint16_t diskNumber = ReadLE16(record + 4);
+    uint16_t centralDirectoryDisk = ReadLE16(record + 6);
+    uint16_t entryCount = ReadLE16(record + 10);
+    uint64_t centralDirectorySize = ReadLE32(record + 12);
+    uint64_t centralDirectoryOffset = ReadLE32(record + 16);
+
+    // Multi-disk and ZIP64 archives are not produced by our packers
+    if (diskNumber != 0 || centralDirectoryDisk != 0 || centralDirectoryOffset == 0xFFFFFFFF) {
+        return false;
+    }
+    if (centralDirectorySize > eocd - overlay) {
+        return false;
+    }
+
+    // The central directory immediately precedes the end record. Its recorded offset is
+    // relative to the start of the archive, which tells us where the archive begins even
+    // when it was concatenated onto the stub without adjusting offsets.
+    uint64_t absoluteCentralDirectory = eocd - centralDirectorySize;
+    if (centralDirectoryOffset > absoluteCentralDirectory) {
+        return false;
+    }
+    // Archives whose offsets were already rebased onto the image (zip -A) yield a base of 0.
+    uint64_t archiveOffset = absoluteCentralDirectory - centralDirectoryOffset;
+    if (archiveOffset < overlay && archiveOffset != 0) {
+        return false;
+    }
+
+    location.overlayOffset = overlay;
+    location.archiveOffset = archiveOffset;
+    location.archiveSize = payloadEnd - archiveOffset;
+    location.centralDirectoryOffset = absoluteCentralDirectory;
+    location.centralDirectorySize = centralDirectorySize;
+    location.endOfCentralDirectoryOffset = eocd;
+    location.entryCount = entryCount;
+    return true;
+}
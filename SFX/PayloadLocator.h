@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Location of the ZIP payload appended to the SFX image.
+// All offsets are absolute offsets into the image.
+struct PayloadLocation {
+    uint64_t overlayOffset = 0;          // First byte after the last PE section
+    uint64_t archiveOffset = 0;          // Offset base of the ZIP archive; 0 if its offsets are already absolute
+    uint64_t archiveSize = 0;            // Bytes from archiveOffset through the end record and comment
+    uint64_t centralDirectoryOffset = 0; // Absolute offset of the first central directory header
+    uint64_t centralDirectorySize = 0;
+    uint64_t endOfCentralDirectoryOffset = 0;
+    uint32_t entryCount = 0;
+};
+
+// Returns the offset of the PE overlay (the end of the last section's raw data),
+// or 0 if the buffer does not start with a valid PE image.
+uint64_t FindPeOverlayOffset(const unsigned char* data, size_t size);
+
+// Header fields that Authenticode leaves out of the image digest. All offsets are absolute.
+struct PeSignatureFields {
+    uint64_t checksumOffset = 0;       // 4-byte CheckSum of the optional header
+    uint64_t securityEntryOffset = 0;  // 8-byte certificate table entry of the data directories
+    uint64_t certificateOffset = 0;    // Current contents of that entry; zero if the image is unsigned
+    uint64_t certificateSize = 0;
+};
+
+// Locates the checksum and certificate table fields of a PE image.
+// Returns false if the buffer does not start with a PE image that has a certificate table entry.
+bool FindPeSignatureFields(const unsigned char* data, size_t size, PeSignatureFields& fields);
+
+// Returns the end of the data that may hold the payload. For a signed image this is
+// the start of the Authenticode certificate table, otherwise it is the image size.
+uint64_t FindPayloadEnd(const unsigned char* data, size_t size);
+
+// Scans backwards from `end` for the ZIP End-of-Central-Directory record. Only the
+// last 64 KiB + 22 bytes are examined, as the record sits at most a comment away from the tail.
+// Up to 7 zero bytes may follow the record, as signing pads the image before its certificate table.
+// Returns the absolute offset of the record, or UINT64_MAX if none is found.
+uint64_t FindEndOfCentralDirectory(const unsigned char* data, uint64_t begin, uint64_t end);
+
+// Locates the ZIP payload of an SFX image held in memory (typically a mapped view).
+// Does not copy or scan the image front to back: it jumps to the overlay and reads the tail.
+bool LocateZipPayload(const unsigned char* data, size_t size, PayloadLocation& location);
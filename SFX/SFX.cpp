@@ -1,180 +1,419 @@
 #include <windows.h>
 #include <shlobj.h>
 #include <shlwapi.h>
-#include <iostream>
-#include <fstream>
+#include <sddl.h>
+#include <string>
 #include <vector>
 #include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <Msi.h>
+#include "Crc32.h"
+#include "ParallelExtract.h"
+#include "PayloadLocator.h"
+#include "StagingDirectory.h"
+#include "ZipReader.h"
+#include "../Common/Trace.h"
+
+struct MappedFile;
 
 // Function prototypes
-bool ExtractZipWithShell(const std::wstring& zipPath, const std::wstring& outputPath);
-bool ExecuteMSI(const std::wstring& msiPath);
+bool ExtractPayload(const MappedFile& image, const PayloadLocation& payload, const std::wstring& outputPath,
+    const ExtractionOptions& options, bool skipTheme);
+bool PlacePayload(const wchar_t* exePath, const std::wstring& stagingPath);
+bool ExecuteMSI(const std::wstring& msiPath, bool trace);
 void ShowError(LPCWSTR message);
 
-// Helper function to find the ZIP signature manually
-std::vector<char>::iterator FindZipSignature(std::vector<char>& data, const char* signature, size_t sigSize) {
-    for (auto it = data.begin(); it != data.end() - sigSize + 1; ++it) {
-        if (std::equal(signature, signature + sigSize, it)) {
-            return it;
+// Read-only memory mapping of a file. The view is released on destruction.
+struct MappedFile {
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+
+    ~MappedFile() {
+        if (data != nullptr) {
+            UnmapViewOfFile(data);
+        }
+        if (mapping != NULL) {
+            CloseHandle(mapping);
         }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+    }
+};
+
+// Helper function to map a file into memory without reading it
+bool MapFile(const wchar_t* path, MappedFile& mapped) {
+    mapped.file = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (mapped.file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(mapped.file, &fileSize) || fileSize.QuadPart == 0 ||
+        static_cast<unsigned long long>(fileSize.QuadPart) > SIZE_MAX) {
+        return false;
+    }
+
+    mapped.mapping = CreateFileMapping(mapped.file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapped.mapping == NULL) {
+        return false;
     }
-    return data.end();
+
+    mapped.data = static_cast<const unsigned char*>(MapViewOfFile(mapped.mapping, FILE_MAP_READ, 0, 0, 0));
+    mapped.size = static_cast<size_t>(fileSize.QuadPart);
+    return mapped.data != nullptr;
 }
 
-int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
-    wchar_t exePath[MAX_PATH];
-    GetModuleFileName(NULL, exePath, MAX_PATH);
+// Writes decoded entry data to a file handle
+class FileSink : public OutputSink {
+public:
+    explicit FileSink(HANDLE file) : file_(file) {}
+
+    bool Write(const unsigned char* data, size_t size) override {
+        const size_t blockSize = 4 * 1024 * 1024;
+        while (size > 0) {
+            DWORD chunk = static_cast<DWORD>(size > blockSize ? blockSize : size);
+            DWORD written = 0;
+            if (!WriteFile(file_, data, chunk, &written, NULL) || written != chunk) {
+                return false;
+            }
+            data += chunk;
+            size -= chunk;
+        }
+        return true;
+    }
 
-    // Open the executable file
-    std::ifstream exeFile(exePath, std::ios::binary | std::ios::ate);
-    if (!exeFile) {
-        ShowError(L"Failed to open the executable file!");
-        return 1;
+private:
+    HANDLE file_;
+};
+
+// Helper function to convert an archive entry name to a Windows path
+std::wstring EntryNameToPath(const ZipEntry& entry) {
+    UINT codePage = entry.utf8Name ? CP_UTF8 : CP_OEMCP;
+    int length = MultiByteToWideChar(codePage, 0, entry.name.data(), static_cast<int>(entry.name.size()), NULL, 0);
+    std::wstring path(length, L'\0');
+    MultiByteToWideChar(codePage, 0, entry.name.data(), static_cast<int>(entry.name.size()), &path[0], length);
+    std::replace(path.begin(), path.end(), L'/', L'\\');
+    return path;
+}
+
+// Extraction target that writes entries below a directory on disk
+class DirectoryTarget : public ExtractionTarget {
+public:
+    explicit DirectoryTarget(const std::wstring& root) : root_(root) {}
+
+    bool MakeDirectory(const ZipEntry& directory) override {
+        std::wstring path = root_ + EntryNameToPath(directory);
+        return CreateDirectory(path.c_str(), NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
     }
 
-    // Get the size of the executable
-    std::streamsize exeSize = exeFile.tellg();
-    exeFile.seekg(0, std::ios::beg);
+    bool WriteEntry(const unsigned char* image, size_t size, const ZipEntry& entry) override {
+        std::wstring path = root_ + EntryNameToPath(entry);
+        HANDLE file = CreateFile(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
 
-    // Read the entire executable into memory
-    std::vector<char> exeData(exeSize);
-    if (!exeFile.read(exeData.data(), exeSize)) {
-        ShowError(L"Failed to read the executable file!");
-        return 1;
+        FileSink sink(file);
+        bool extracted = ExtractZipEntry(image, size, entry, sink);
+        CloseHandle(file);
+        if (!extracted) {
+            DeleteFile(path.c_str());
+        }
+        return extracted;
     }
 
-    exeFile.close();
+    bool IsExtracted(const ZipEntry& entry) override {
+        std::wstring path = root_ + EntryNameToPath(entry);
+        HANDLE file = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
 
-    // Find the ZIP signature (PK\x03\x04) manually
-    const char zipSignature[] = { 'P', 'K', 0x03, 0x04 };
-    auto zipStart = FindZipSignature(exeData, zipSignature, sizeof(zipSignature));
+        // A file cut short by an interrupted run fails the size check; anything else the CRC
+        LARGE_INTEGER fileSize;
+        bool intact = GetFileSizeEx(file, &fileSize) && static_cast<uint64_t>(fileSize.QuadPart) == entry.uncompressedSize;
+        if (intact) {
+            std::vector<unsigned char> buffer(1024 * 1024);
+            uint32_t crc = 0;
+            DWORD read = 0;
+            while (ReadFile(file, buffer.data(), static_cast<DWORD>(buffer.size()), &read, NULL) && read > 0) {
+                crc = UpdateCrc32(crc, buffer.data(), read);
+            }
+            intact = crc == entry.crc32;
+        }
+        CloseHandle(file);
+        return intact;
+    }
 
-    if (zipStart == exeData.end()) {
-        ShowError(L"No ZIP file found at the end of the executable!");
-        return 1;
+private:
+    std::wstring root_;
+};
+
+// Lock file held open without sharing; Windows closes it if the process dies
+class HandleLock : public StagingLock {
+public:
+    explicit HandleLock(HANDLE file) : file_(file) {}
+    ~HandleLock() override { CloseHandle(file_); }
+
+private:
+    HANDLE file_;
+};
+
+// Staging directories under %TEMP%, readable only by their owner, SYSTEM and administrators
+class Win32StagingBackend : public StagingBackend {
+public:
+    wchar_t Separator() const override { return L'\\'; }
+
+    std::vector<std::wstring> ListDirectories(const std::wstring& root, const std::wstring& prefix) override {
+        std::vector<std::wstring> names;
+        WIN32_FIND_DATA data;
+        HANDLE find = FindFirstFile((root + prefix + L"*").c_str(), &data);
+        if (find == INVALID_HANDLE_VALUE) {
+            return names;
+        }
+        do {
+            if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0) {
+                names.push_back(data.cFileName);
+            }
+        } while (FindNextFile(find, &data));
+        FindClose(find);
+        return names;
     }
 
-    // Save the ZIP data to a temporary file
-    wchar_t tempPath[MAX_PATH];
-    GetTempPath(MAX_PATH, tempPath);
-    std::wstring zipPath = std::wstring(tempPath) + L"extracted.zip";
+    bool CreatePrivateDirectory(const std::wstring& path) override {
+        // Protected DACL: full control for the owner, SYSTEM (the installer service) and administrators
+        PSECURITY_DESCRIPTOR descriptor = NULL;
+        if (!ConvertStringSecurityDescriptorToSecurityDescriptor(L"D:P(A;OICI;FA;;;OW)(A;OICI;FA;;;SY)(A;OICI;FA;;;BA)",
+            SDDL_REVISION_1, &descriptor, NULL)) {
+            return false;
+        }
+        SECURITY_ATTRIBUTES attributes = { sizeof(attributes), descriptor, FALSE };
+        BOOL created = CreateDirectory(path.c_str(), &attributes);
+        LocalFree(descriptor);
+        return created != FALSE;
+    }
 
-    std::ofstream zipFile(zipPath, std::ios::binary);
-    zipFile.write(&(*zipStart), std::distance(zipStart, exeData.end()));
-    zipFile.close();
+    std::unique_ptr<StagingLock> Lock(const std::wstring& path) override {
+        HANDLE file = CreateFile(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_HIDDEN, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            return nullptr;
+        }
+        return std::unique_ptr<StagingLock>(new HandleLock(file));
+    }
 
-    // Define the extraction path (temporary directory)
-    std::wstring extractionPath = std::wstring(tempPath);
+    void RemoveContents(const std::wstring& directory, const std::wstring& keep) override {
+        WIN32_FIND_DATA data;
+        HANDLE find = FindFirstFile((directory + L"*").c_str(), &data);
+        if (find == INVALID_HANDLE_VALUE) {
+            return;
+        }
+        do {
+            std::wstring name = data.cFileName;
+            if (name == L"." || name == L".." || name == keep) {
+                continue;
+            }
+            std::wstring path = directory + name;
+            if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0) {
+                RemoveContents(path + L"\\", std::wstring());
+                RemoveEmptyDirectory(path);
+            }
+            else {
+                RemoveFile(path);
+            }
+        } while (FindNextFile(find, &data));
+        FindClose(find);
+    }
 
-    if (!ExtractZipWithShell(zipPath, extractionPath)) {
-        ShowError(L"Failed to extract the ZIP file!");
-        return 1;
+    bool RemoveFile(const std::wstring& path) override {
+        SetFileAttributes(path.c_str(), FILE_ATTRIBUTE_NORMAL);
+        return DeleteFile(path.c_str()) != FALSE;
     }
 
-    // Execute the NewTabSetup.msi file
-    std::wstring msiPath = extractionPath + L"NewTabSetup.msi";
-    if (!ExecuteMSI(msiPath)) {
-        ShowError(L"Failed to execute the MSI file!");
-        return 1;
+    bool RemoveEmptyDirectory(const std::wstring& path) override {
+        return ::RemoveDirectory(path.c_str()) != FALSE;
     }
+};
+
+// Helper function to name staging directories after the payload, so a rerun of the same
+// installer can resume an interrupted run and a different payload never mixes with it
+std::wstring PayloadDirectoryPrefix(const MappedFile& image, const PayloadLocation& payload) {
+    uint32_t crc = UpdateCrc32(0, image.data + payload.centralDirectoryOffset, static_cast<size_t>(payload.centralDirectorySize));
+    wchar_t prefix[32];
+    swprintf_s(prefix, L"NewTabSetup-%08X-", crc);
+    return prefix;
+}
 
-    // Cleanup: Delete the temporary ZIP file
-    DeleteFile(zipPath.c_str());
+// Helper function to read the "/threads:N" switch that caps extraction threads
+unsigned ParseThreadLimit(const char* commandLine) {
+    const char* option = commandLine != NULL ? strstr(commandLine, "/threads:") : NULL;
+    if (option == NULL) {
+        return 0;
+    }
+    long value = strtol(option + 9, NULL, 10);
+    return value > 0 ? static_cast<unsigned>(value) : 0;
+}
 
-    return 0;
+// Helper function to test for a switch such as "/staged" on the command line
+bool HasSwitch(const char* commandLine, const char* name) {
+    return commandLine != NULL && strstr(commandLine, name) != NULL;
 }
 
-bool ExtractZipWithShell(const std::wstring& zipPath, const std::wstring& outputPath) {
-    IShellDispatch* pShellDisp = NULL;
-    HRESULT hr = CoInitialize(NULL);
-    if (FAILED(hr)) {
-        return false;
+// Helper function to create the folder that "/trace" writes timelines to
+std::wstring CreateTraceDirectory(const wchar_t* tempPath) {
+    std::wstring directory = std::wstring(tempPath) + L"NewTabSetup-trace\\";
+    if (!CreateDirectory(directory.c_str(), NULL) && GetLastError() != ERROR_ALREADY_EXISTS) {
+        return std::wstring();
     }
+    return directory;
+}
 
-    hr = CoCreateInstance(CLSID_Shell, NULL, CLSCTX_INPROC_SERVER, IID_IShellDispatch, (void**)&pShellDisp);
-    if (FAILED(hr)) {
-        CoUninitialize();
-        return false;
+// Folder of the staging directory the custom actions write their timelines to. The MSI derives
+// it from [SourceDir], so the elevated actions only ever write inside this private directory.
+const wchar_t kStagedTraceFolder[] = L"trace\\";
+
+// Helper function to move the custom actions' timelines next to the stub's before the staging
+// directory is removed
+void CollectTraceFiles(const std::wstring& stagingPath, const std::wstring& traceDirectory) {
+    std::wstring source = stagingPath + kStagedTraceFolder;
+    WIN32_FIND_DATA data;
+    HANDLE find = FindFirstFile((source + L"*.json").c_str(), &data);
+    if (find == INVALID_HANDLE_VALUE) {
+        return;
     }
+    do {
+        MoveFileEx((source + data.cFileName).c_str(), (traceDirectory + data.cFileName).c_str(),
+            MOVEFILE_REPLACE_EXISTING | MOVEFILE_COPY_ALLOWED);
+    } while (FindNextFile(find, &data));
+    FindClose(find);
+}
 
-    BSTR bstrZipPath = SysAllocString(zipPath.c_str());
-    VARIANT vtZipFile;
-    VariantInit(&vtZipFile);
-    vtZipFile.vt = VT_BSTR;
-    vtZipFile.bstrVal = bstrZipPath;
+// Theme files live under this folder of the payload
+const char kThemePrefix[] = "build/";
 
-    VARIANT vtOutPath;
-    VariantInit(&vtOutPath);
-    vtOutPath.vt = VT_BSTR;
-    BSTR bstrOutPath = SysAllocString(outputPath.c_str());
-    vtOutPath.bstrVal = bstrOutPath;
+// Name the CopyBuildFolder custom action looks for next to the MSI ([SourceDir]) to install the
+// theme straight from the payload
+const wchar_t kPayloadName[] = L"NewTabSetup.payload";
 
-    Folder* pZipFolder = NULL;
-    hr = pShellDisp->NameSpace(vtZipFile, &pZipFolder);
-    if (FAILED(hr) || pZipFolder == NULL) {
-        pShellDisp->Release();
-        CoUninitialize();
-        return false;
+int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
+    wchar_t exePath[MAX_PATH];
+    GetModuleFileName(NULL, exePath, MAX_PATH);
+    wchar_t tempPath[MAX_PATH];
+    GetTempPath(MAX_PATH, tempPath);
+
+    // "/trace" records a Chrome-trace timeline of each phase, written when WinMain returns
+    std::wstring traceDirectory = HasSwitch(lpCmdLine, "/trace") ? CreateTraceDirectory(tempPath) : std::wstring();
+    DWORD processId = GetCurrentProcessId();
+    TraceSession trace(traceDirectory.empty() ? std::wstring() : traceDirectory + L"SFX-" + std::to_wstring(processId) + L".json",
+        "SFX", processId);
+    TraceSpan runSpan("sfx");
+
+    // Map the executable instead of reading it into memory
+    TraceSpan locateSpan("locate-payload");
+    MappedFile exeImage;
+    if (!MapFile(exePath, exeImage)) {
+        ShowError(L"Failed to open the executable file!");
+        return 1;
     }
 
-    Folder* pOutFolder = NULL;
-    hr = pShellDisp->NameSpace(vtOutPath, &pOutFolder);
-    if (FAILED(hr) || pOutFolder == NULL) {
-        pZipFolder->Release();
-        pShellDisp->Release();
-        CoUninitialize();
-        return false;
+    // Locate the ZIP payload from the PE overlay and the end-of-central-directory record
+    PayloadLocation payload;
+    if (!LocateZipPayload(exeImage.data, exeImage.size, payload)) {
+        ShowError(L"No ZIP file found at the end of the executable!");
+        return 1;
+    }
+    locateSpan.End();
+
+    // Extract into a private directory of this run under the temporary directory. It is
+    // removed when WinMain returns, whether or not the installation succeeded.
+    TraceSpan stagingSpan("acquire-staging");
+    Win32StagingBackend stagingBackend;
+    StagingDirectory staging(stagingBackend, tempPath, PayloadDirectoryPrefix(exeImage, payload));
+    if (!staging.Acquire()) {
+        ShowError(L"Failed to create the extraction directory!");
+        return 1;
+    }
+    const std::wstring& extractionPath = staging.Path();
+    stagingSpan.End();
+
+    // Extraction is synchronous: every file is closed before the MSI starts. Every entry is
+    // checked against its CRC-32, whether it is decoded now or left by an interrupted run.
+    ExtractionOptions options;
+    options.maxThreads = ParseThreadLimit(lpCmdLine);
+    options.resume = staging.Resumed();
+
+    // By default only the MSI is staged, next to this executable placed as the payload. The
+    // CopyBuildFolder custom action decodes the theme from it straight into the install folder,
+    // so it is written once. "/staged" extracts everything here and lets the custom action
+    // copy it as before.
+    bool direct = !HasSwitch(lpCmdLine, "/staged");
+    if (!ExtractPayload(exeImage, payload, extractionPath, options, direct)) {
+        ShowError(L"Failed to extract the ZIP file!");
+        return 1;
+    }
+    if (direct && !PlacePayload(exePath, extractionPath)) {
+        ShowError(L"Failed to stage the installer payload!");
+        return 1;
     }
 
-    FolderItems* pItems = NULL;
-    hr = pZipFolder->Items(&pItems);
-    if (FAILED(hr) || pItems == NULL) {
-        pOutFolder->Release();
-        pZipFolder->Release();
-        pShellDisp->Release();
-        CoUninitialize();
-        return false;
+    // Execute the NewTabSetup.msi file. The staged trace folder inherits the staging
+    // directory's protected DACL.
+    bool trace = !traceDirectory.empty() && CreateDirectory((extractionPath + kStagedTraceFolder).c_str(), NULL);
+    std::wstring msiPath = extractionPath + L"NewTabSetup.msi";
+    bool installed = ExecuteMSI(msiPath, trace);
+    if (trace) {
+        CollectTraceFiles(extractionPath, traceDirectory);
     }
+    if (!installed) {
+        ShowError(L"Failed to execute the MSI file!");
+        return 1;
+    }
+
+    return 0;
+}
 
-    // Wrap the FolderItems in a VARIANT
-    VARIANT vtItems;
-    VariantInit(&vtItems);
-    vtItems.vt = VT_DISPATCH;
-    vtItems.pdispVal = pItems;
-
-    VARIANT vtOptions;
-    VariantInit(&vtOptions);
-    vtOptions.vt = VT_I4;
-    vtOptions.lVal = FOF_NO_UI; // Or use 0 if you don't want to suppress the UI
-
-    hr = pOutFolder->CopyHere(vtItems, vtOptions);
-    if (FAILED(hr)) {
-        pItems->Release();
-        pOutFolder->Release();
-        pZipFolder->Release();
-        pShellDisp->Release();
-        CoUninitialize();
+bool ExtractPayload(const MappedFile& image, const PayloadLocation& payload, const std::wstring& outputPath,
+    const ExtractionOptions& options, bool skipTheme) {
+    TraceSpan span("extract-payload");
+    std::vector<ZipEntry> entries;
+    if (!ReadZipEntries(image.data, image.size, payload, entries)) {
         return false;
     }
+    if (skipTheme) {
+        entries.erase(std::remove_if(entries.begin(), entries.end(), [](const ZipEntry& entry) {
+            return entry.name.compare(0, sizeof(kThemePrefix) - 1, kThemePrefix) == 0;
+        }), entries.end());
+    }
 
-    // Cleanup
-    VariantClear(&vtItems);
-    pItems->Release();
-    pOutFolder->Release();
-    pZipFolder->Release();
-    pShellDisp->Release();
-    CoUninitialize();
+    uint64_t bytes = 0;
+    for (const auto& entry : entries) {
+        bytes += entry.uncompressedSize;
+    }
+    TraceCounter("payload-files", static_cast<int64_t>(entries.size()));
+    TraceCounter("payload-bytes", static_cast<int64_t>(bytes));
+
+    DirectoryTarget target(outputPath);
+    return ExtractEntriesParallel(image.data, image.size, entries, target, options);
+}
 
-    return true;
+// Helper function to place this executable next to the MSI as the payload. The elevated custom
+// action finds it there rather than through a property, so a caller cannot point it at another
+// file. A hard link costs no copy; a temporary directory on another volume gets a copy instead.
+bool PlacePayload(const wchar_t* exePath, const std::wstring& stagingPath) {
+    std::wstring payloadPath = stagingPath + kPayloadName;
+    DeleteFile(payloadPath.c_str());
+    return CreateHardLink(payloadPath.c_str(), exePath, NULL) || CopyFile(exePath, payloadPath.c_str(), FALSE);
 }
 
-bool ExecuteMSI(const std::wstring& msiPath) {
-    // The command line can be left as NULL if no special options are needed
-    LPCWSTR commandLine = NULL;
+bool ExecuteMSI(const std::wstring& msiPath, bool trace) {
+    TraceSpan span("install-msi");
 
-    // Call the MsiInstallProduct function to install the MSI package
-    UINT result = MsiInstallProduct(msiPath.c_str(), commandLine);
+    // Call the MsiInstallProduct function to install the MSI package. SFXTRACE only asks the
+    // custom actions for timelines; the MSI derives their folder from [SourceDir].
+    UINT result = MsiInstallProduct(msiPath.c_str(), trace ? L"SFXTRACE=1" : NULL);
 
     // Check the result to see if the installation succeeded
     return (result == ERROR_SUCCESS);
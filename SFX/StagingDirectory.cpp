@@ -0,0 +1,82 @@
+#include "StagingDirectory.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cwchar>
+#include <random>
+
+namespace {
+    const wchar_t kLockName[] = L".lock";
+    const int kCreateAttempts = 16;
+
+    // Helper function to make a suffix no other run picks: a random value mixed with the clock
+    // and a per-process counter, so even runs started in the same instant differ
+    std::wstring UniqueSuffix() {
+        static std::atomic<uint32_t> counter(0);
+        std::random_device device;
+        uint64_t value = (static_cast<uint64_t>(device()) << 32) ^ device() ^
+            static_cast<uint64_t>(std::chrono::high_resolution_clock::now().time_since_epoch().count()) ^
+            (static_cast<uint64_t>(counter++) << 48);
+        wchar_t suffix[17];
+        swprintf(suffix, sizeof(suffix) / sizeof(suffix[0]), L"%016llX", static_cast<unsigned long long>(value));
+        return suffix;
+    }
+}
+
+StagingDirectory::StagingDirectory(StagingBackend& backend, const std::wstring& root, const std::wstring& prefix)
+    : backend_(backend), root_(root), prefix_(prefix) {
+    if (!root_.empty() && root_.back() != backend_.Separator()) {
+        root_.push_back(backend_.Separator());
+    }
+}
+
+StagingDirectory::~StagingDirectory() {
+    Release();
+}
+
+bool StagingDirectory::Claim(const std::wstring& name, bool created) {
+    std::wstring path = root_ + name + backend_.Separator();
+    lock_ = backend_.Lock(path + kLockName);
+    if (!lock_) {
+        return false;
+    }
+    path_ = path;
+    resumed_ = !created;
+    return true;
+}
+
+bool StagingDirectory::Acquire() {
+    // A directory whose lock is free belongs to no running installer
+    for (const auto& name : backend_.ListDirectories(root_, prefix_)) {
+        if (Claim(name, false)) {
+            return true;
+        }
+    }
+
+    // Another run can adopt a new directory before its creator locks it; then try another name
+    for (int attempt = 0; attempt < kCreateAttempts; ++attempt) {
+        std::wstring name = prefix_ + UniqueSuffix();
+        if (backend_.CreatePrivateDirectory(root_ + name) && Claim(name, true)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void StagingDirectory::Release() {
+    if (!lock_) {
+        return;
+    }
+
+    // Empty the directory while still holding it, so no other run adopts it half deleted.
+    // A run that adopts it after the lock is dropped holds the lock file open, which keeps
+    // the file and the directory from being removed under it.
+    backend_.RemoveContents(path_, kLockName);
+    lock_.reset();
+    backend_.RemoveFile(path_ + kLockName);
+    std::wstring directory = path_.substr(0, path_.size() - 1);
+    backend_.RemoveEmptyDirectory(directory);
+    path_.clear();
+    resumed_ = false;
+}
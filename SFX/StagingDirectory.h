@@ -0,0 +1,69 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// An exclusive hold on a path, released when destroyed or when the process ends
+class StagingLock {
+public:
+    virtual ~StagingLock() = default;
+};
+
+// File system operations the staging logic needs. The stub implements them with Win32 calls;
+// the logic itself is portable.
+class StagingBackend {
+public:
+    virtual ~StagingBackend() = default;
+
+    virtual wchar_t Separator() const = 0;
+
+    // Names (not paths) of the directories directly below `root` that start with `prefix`
+    virtual std::vector<std::wstring> ListDirectories(const std::wstring& root, const std::wstring& prefix) = 0;
+
+    // Creates a directory that only the current user and the system can open.
+    // Fails if the path already exists.
+    virtual bool CreatePrivateDirectory(const std::wstring& path) = 0;
+
+    // Opens `path` for exclusive use, creating it if needed. Returns nullptr if another
+    // process holds it. While held, the file cannot be deleted by others.
+    virtual std::unique_ptr<StagingLock> Lock(const std::wstring& path) = 0;
+
+    // Deletes everything below `directory` except the entry named `keep`
+    virtual void RemoveContents(const std::wstring& directory, const std::wstring& keep) = 0;
+    virtual bool RemoveFile(const std::wstring& path) = 0;
+    virtual bool RemoveEmptyDirectory(const std::wstring& path) = 0;
+};
+
+// Work directory of one installer run, named "<prefix><unique suffix>" below a root such as
+// %TEMP%. A run holds a lock file inside it for as long as it lives, so concurrent runs never
+// share a directory. A directory whose lock can be taken was left by a run that was killed;
+// a run with the same prefix (the same payload) adopts it and resumes its extraction.
+// The directory is removed when the object is destroyed, on every exit path.
+class StagingDirectory {
+public:
+    StagingDirectory(StagingBackend& backend, const std::wstring& root, const std::wstring& prefix);
+    ~StagingDirectory();
+    StagingDirectory(const StagingDirectory&) = delete;
+    StagingDirectory& operator=(const StagingDirectory&) = delete;
+
+    // Adopts an abandoned directory with this prefix or creates a new one
+    bool Acquire();
+
+    // Removes the directory and everything in it. Called by the destructor.
+    void Release();
+
+    // Path of the directory, ending in a separator
+    const std::wstring& Path() const { return path_; }
+    bool Resumed() const { return resumed_; }
+
+private:
+    StagingBackend& backend_;
+    std::wstring root_;
+    std::wstring prefix_;
+    std::wstring path_;
+    std::unique_ptr<StagingLock> lock_;
+    bool resumed_ = false;
+
+    bool Claim(const std::wstring& name, bool created);
+};
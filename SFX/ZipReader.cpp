@@ -0,0 +1,118 @@
+#include "ZipReader.h"
+#include "ByteOrder.h"
+#include "Crc32.h"
+
+namespace {
+    const uint32_t kCentralDirectoryHeader = 0x02014b50;
+    const uint32_t kLocalFileHeader = 0x04034b50;
+    const uint64_t kCentralDirectoryHeaderSize = 46;
+    const uint64_t kLocalFileHeaderSize = 30;
+    const uint16_t kFlagEncrypted = 0x0001;
+    const uint16_t kFlagUtf8 = 0x0800;
+
+    // Forwards output to another sink while tracking the CRC-32 and byte count
+    class CheckedSink : public OutputSink {
+    public:
+        explicit CheckedSink(OutputSink& inner) : inner_(inner) {}
+
+        bool Write(const unsigned char* data, size_t size) override {
+            crc_ = UpdateCrc32(crc_, data, size);
+            written_ += size;
+            return inner_.Write(data, size);
+        }
+
+        uint32_t Crc() const { return crc_; }
+        uint64_t Written() const { return written_; }
+
+    private:
+        OutputSink& inner_;
+        uint32_t crc_ = 0;
+        uint64_t written_ = 0;
+    };
+}
+
+bool ReadZipEntries(const unsigned char* data, size_t size, const PayloadLocation& location, std::vector<ZipEntry>& entries) {
+    entries.clear();
+    entries.reserve(location.entryCount);
+
+    uint64_t pos = location.centralDirectoryOffset;
+    uint64_t end = location.centralDirectoryOffset + location.centralDirectorySize;
+    if (end > size) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < location.entryCount; ++i) {
+        if (pos + kCentralDirectoryHeaderSize > end || ReadLE32(data + pos) != kCentralDirectoryHeader) {
+            return false;
+        }
+        const unsigned char* header = data + pos;
+        uint16_t flags = ReadLE16(header + 8);
+        uint16_t nameLength = ReadLE16(header + 28);
+        uint16_t extraLength = ReadLE16(header + 30);
+        uint16_t commentLength = ReadLE16(header + 32);
+        uint64_t recordSize = kCentralDirectoryHeaderSize + nameLength + extraLength + commentLength;
+        if (pos + recordSize > end || (flags & kFlagEncrypted) != 0) {
+            return false;
+        }
+
+        ZipEntry entry;
+        entry.utf8Name = (flags & kFlagUtf8) != 0;
+        entry.method = ReadLE16(header + 10);
+        entry.crc32 = ReadLE32(header + 16);
+        entry.compressedSize = ReadLE32(header + 20);
+        entry.uncompressedSize = ReadLE32(header + 24);
+        entry.localHeaderOffset = location.archiveOffset + ReadLE32(header + 42);
+        entry.name.assign(reinterpret_cast<const char*>(header + kCentralDirectoryHeaderSize), nameLength);
+        for (char& c : entry.name) {
+            if (c == '\\') {
+                c = '/';
+            }
+        }
+        entry.isDirectory = !entry.name.empty() && entry.name.back() == '/';
+        entries.push_back(std::move(entry));
+
+        pos += recordSize;
+    }
+    return true;
+}
+
+bool IsSafeEntryName(const std::string& name) {
+    if (name.empty() || name[0] == '/' || name.find(':') != std::string::npos) {
+        return false;
+    }
+
+    size_t start = 0;
+    while (start <= name.size()) {
+        size_t slash = name.find('/', start);
+        if (slash == std::string::npos) {
+            slash = name.size();
+        }
+        if (name.compare(start, slash - start, "..") == 0 && slash - start == 2) {
+            return false;
+        }
+        start = slash + 1;
+    }
+    return true;
+}
+
+bool ExtractZipEntry(const unsigned char* data, size_t size, const ZipEntry& entry, OutputSink& output) {
+    uint64_t pos = entry.localHeaderOffset;
+    if (pos + kLocalFileHeaderSize > size || ReadLE32(data + pos) != kLocalFileHeader) {
+        return false;
+    }
+
+    // The local header's name and extra field can differ in length from the central directory
+    uint64_t dataOffset = pos + kLocalFileHeaderSize + ReadLE16(data + pos + 26) + ReadLE16(data + pos + 28);
+    if (dataOffset + entry.compressedSize > size) {
+        return false;
+    }
+
+    const PayloadCodec* codec = FindCodec(entry.method);
+    if (codec == nullptr || (entry.method == kZipMethodStored && entry.compressedSize != entry.uncompressedSize)) {
+        return false;
+    }
+
+    CheckedSink checked(output);
+    bool success = codec->decode(data + dataOffset, static_cast<size_t>(entry.compressedSize), checked);
+    return success && checked.Written() == entry.uncompressedSize && checked.Crc() == entry.crc32;
+}
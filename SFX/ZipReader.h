@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Codec.h"
+#include "PayloadLocator.h"
+
+// One file or directory record from the ZIP central directory
+struct ZipEntry {
+    std::string name;               // Path as stored in the archive, '/'-separated
+    bool utf8Name = false;          // General purpose flag bit 11; otherwise the name is CP437
+    bool isDirectory = false;
+    uint16_t method = 0;
+    uint32_t crc32 = 0;
+    uint64_t compressedSize = 0;
+    uint64_t uncompressedSize = 0;
+    uint64_t localHeaderOffset = 0; // Absolute offset into the image
+};
+
+// Parses the central directory of a located payload. Entries keep archive order.
+bool ReadZipEntries(const unsigned char* data, size_t size, const PayloadLocation& location, std::vector<ZipEntry>& entries);
+
+// Rejects absolute paths, drive letters and ".." components so an entry cannot escape the
+// extraction directory.
+bool IsSafeEntryName(const std::string& name);
+
+// Decodes one entry straight from the image into the sink and verifies its size and CRC-32.
+bool ExtractZipEntry(const unsigned char* data, size_t size, const ZipEntry& entry, OutputSink& output);
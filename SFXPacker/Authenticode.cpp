@@ -0,0 +1,381 @@
+#include "Authenticode.h"
+#include "../SFX/ByteOrder.h"
+
+#include <algorithm>
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/objects.h>
+#include <openssl/pkcs12.h>
+#include <openssl/pkcs7.h>
+#include <openssl/x509.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/provider.h>
+#endif
+
+namespace {
+    const uint16_t kWinCertRevision2 = 0x0200;
+    const uint16_t kWinCertTypePkcsSignedData = 0x0002;
+    const size_t kWinCertHeaderSize = 8;
+
+    const char* const kSpcIndirectDataOid = "1.3.6.1.4.1.311.2.1.4";
+    const char* const kSpcStatementTypeOid = "1.3.6.1.4.1.311.2.1.11";
+    const char* const kSpcSpOpusInfoOid = "1.3.6.1.4.1.311.2.1.12";
+    const char* const kSpcPeImageDataOid = "1.3.6.1.4.1.311.2.1.15";
+    const char* const kIndividualCodeSigningOid = "1.3.6.1.4.1.311.2.1.21";
+    const char* const kSha256Oid = "2.16.840.1.101.3.4.2.1";
+
+    // Bytes to add to `size` to reach a multiple of 8
+    uint64_t PaddingTo8(uint64_t size) {
+        return (8 - size % 8) % 8;
+    }
+
+    // Adds a byte at an absolute offset to a PE checksum: even offsets hold the low byte of a word
+    uint64_t ChecksumByte(unsigned char value, uint64_t offset) {
+        return static_cast<uint64_t>(value) << ((offset & 1) * 8);
+    }
+
+    // Minimal DER encoding for the few Authenticode structures OpenSSL has no type for
+    void AppendDer(std::vector<unsigned char>& out, unsigned char tag, const std::vector<unsigned char>& content) {
+        out.push_back(tag);
+        size_t length = content.size();
+        if (length < 0x80) {
+            out.push_back(static_cast<unsigned char>(length));
+        }
+        else {
+            unsigned char bytes[sizeof(size_t)];
+            size_t count = 0;
+            for (; length != 0; length >>= 8) {
+                bytes[count++] = static_cast<unsigned char>(length & 0xFF);
+            }
+            out.push_back(static_cast<unsigned char>(0x80 | count));
+            while (count > 0) {
+                out.push_back(bytes[--count]);
+            }
+        }
+        out.insert(out.end(), content.begin(), content.end());
+    }
+
+    std::vector<unsigned char> Der(unsigned char tag, const std::vector<unsigned char>& content) {
+        std::vector<unsigned char> out;
+        AppendDer(out, tag, content);
+        return out;
+    }
+
+    std::vector<unsigned char> Concat(std::initializer_list<std::vector<unsigned char>> parts) {
+        std::vector<unsigned char> out;
+        for (const auto& part : parts) {
+            out.insert(out.end(), part.begin(), part.end());
+        }
+        return out;
+    }
+
+    std::vector<unsigned char> DerObject(const char* oid) {
+        std::vector<unsigned char> out;
+        ASN1_OBJECT* object = OBJ_txt2obj(oid, 1);
+        if (object != nullptr) {
+            int length = i2d_ASN1_OBJECT(object, nullptr);
+            if (length > 0) {
+                out.resize(static_cast<size_t>(length));
+                unsigned char* p = out.data();
+                i2d_ASN1_OBJECT(object, &p);
+            }
+            ASN1_OBJECT_free(object);
+        }
+        return out;
+    }
+
+    // BMPString contents of an ASCII string
+    std::vector<unsigned char> Utf16BigEndian(const char* text) {
+        std::vector<unsigned char> out;
+        for (const char* p = text; *p != 0; ++p) {
+            out.push_back(0);
+            out.push_back(static_cast<unsigned char>(*p));
+        }
+        return out;
+    }
+
+    // SpcIndirectDataContent: an SpcPeImageData with the obsolete file link every signer
+    // writes, then the image digest as a DigestInfo
+    std::vector<unsigned char> IndirectDataContent(const unsigned char digest[Sha256::kDigestSize]) {
+        std::vector<unsigned char> obsoleteLink = Der(0xA0, Der(0xA2, Der(0x80, Utf16BigEndian("<<<Obsolete>>>"))));
+        std::vector<unsigned char> peImageData = Der(0x30, Concat({ { 0x03, 0x01, 0x00 }, obsoleteLink }));
+        std::vector<unsigned char> attribute = Der(0x30, Concat({ DerObject(kSpcPeImageDataOid), peImageData }));
+
+        std::vector<unsigned char> algorithm = Der(0x30, Concat({ DerObject(kSha256Oid), { 0x05, 0x00 } }));
+        std::vector<unsigned char> digestInfo = Der(0x30, Concat({ algorithm,
+            Der(0x04, std::vector<unsigned char>(digest, digest + Sha256::kDigestSize)) }));
+        return Der(0x30, Concat({ attribute, digestInfo }));
+    }
+
+    // SpcSpOpusInfo: the program name as an ASCII SpcString and the URL as an SpcLink
+    std::vector<unsigned char> OpusInfo(const std::string& description, const std::string& url) {
+        std::vector<unsigned char> content;
+        if (!description.empty()) {
+            AppendDer(content, 0xA0, Der(0x81, std::vector<unsigned char>(description.begin(), description.end())));
+        }
+        if (!url.empty()) {
+            AppendDer(content, 0xA1, Der(0x80, std::vector<unsigned char>(url.begin(), url.end())));
+        }
+        return Der(0x30, content);
+    }
+
+    // Length of the tag and length octets of a DER element
+    size_t DerHeaderSize(const std::vector<unsigned char>& element) {
+        return element[1] < 0x80 ? 2 : 2 + (element[1] & 0x7F);
+    }
+
+    // NID of an OID, registering it with OpenSSL if it has none
+    int ObjectNid(const char* oid, const char* name) {
+        int nid = OBJ_txt2nid(oid);
+        return nid != NID_undef ? nid : OBJ_create(oid, name, name);
+    }
+
+    bool AddSequenceAttribute(PKCS7_SIGNER_INFO* signer, int nid, const std::vector<unsigned char>& der) {
+        ASN1_STRING* value = ASN1_STRING_new();
+        if (value == nullptr || !ASN1_STRING_set(value, der.data(), static_cast<int>(der.size()))) {
+            ASN1_STRING_free(value);
+            return false;
+        }
+        if (!PKCS7_add_signed_attribute(signer, nid, V_ASN1_SEQUENCE, value)) {
+            ASN1_STRING_free(value);
+            return false;
+        }
+        return true;
+    }
+
+    std::string OpenSslError(const char* what) {
+        std::string message = what;
+        unsigned long code = ERR_get_error();
+        if (code != 0) {
+            char text[256];
+            ERR_error_string_n(code, text, sizeof(text));
+            message += ": ";
+            message += text;
+        }
+        ERR_clear_error();
+        return message;
+    }
+}
+
+AuthenticodeHasher::AuthenticodeHasher(const PeSignatureFields& fields) : fields_(fields), sha_(EVP_MD_CTX_new()) {
+    EVP_DigestInit_ex(sha_, EVP_sha256(), nullptr);
+}
+
+AuthenticodeHasher::~AuthenticodeHasher() {
+    EVP_MD_CTX_free(sha_);
+}
+
+void AuthenticodeHasher::Update(const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    while (size > 0) {
+        // Hash up to the next skipped field, then step over the part of it in this buffer
+        uint64_t skipBegin = UINT64_MAX;
+        uint64_t skipEnd = UINT64_MAX;
+        if (position_ < fields_.checksumOffset + 4) {
+            skipBegin = fields_.checksumOffset;
+            skipEnd = fields_.checksumOffset + 4;
+        }
+        else if (position_ < fields_.securityEntryOffset + 8) {
+            skipBegin = fields_.securityEntryOffset;
+            skipEnd = fields_.securityEntryOffset + 8;
+        }
+
+        size_t run = size;
+        if (position_ < skipBegin) {
+            run = static_cast<size_t>(std::min<uint64_t>(size, skipBegin - position_));
+            Add(bytes, run);
+        }
+        else {
+            run = static_cast<size_t>(std::min<uint64_t>(size, skipEnd - position_));
+        }
+        position_ += run;
+        bytes += run;
+        size -= run;
+    }
+}
+
+void AuthenticodeHasher::Add(const unsigned char* data, size_t size) {
+    if (!digested_) {
+        EVP_DigestUpdate(sha_, data, size);
+    }
+
+    // The checksum sums little-endian words; a run may start half way through one
+    uint64_t offset = position_;
+    size_t i = 0;
+    if (size > 0 && (offset & 1) != 0) {
+        checksum_ += ChecksumByte(data[0], offset);
+        i = 1;
+    }
+    uint64_t sum = 0;
+    for (; i + 1 < size; i += 2) {
+        sum += static_cast<uint64_t>(data[i]) | (static_cast<uint64_t>(data[i + 1]) << 8);
+    }
+    if (i < size) {
+        sum += data[i];
+    }
+    checksum_ += sum;
+}
+
+void AuthenticodeHasher::Digest(unsigned char digest[Sha256::kDigestSize]) {
+    static const unsigned char zeros[8] = {};
+    EVP_DigestUpdate(sha_, zeros, static_cast<size_t>(PaddingTo8(position_)));
+    EVP_DigestFinal_ex(sha_, digest, nullptr);
+    digested_ = true;
+}
+
+uint32_t AuthenticodeHasher::Checksum(const unsigned char securityEntry[8]) const {
+    uint64_t sum = checksum_;
+    for (uint64_t i = 0; i < 8; ++i) {
+        sum += ChecksumByte(securityEntry[i], fields_.securityEntryOffset + i);
+    }
+    while ((sum >> 16) != 0) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return static_cast<uint32_t>(sum + position_);
+}
+
+CertificatePlacement PlaceCertificateTable(uint64_t imageSize) {
+    uint64_t padding = PaddingTo8(imageSize);
+    return { padding, imageSize + padding };
+}
+
+std::vector<unsigned char> BuildCertificateTable(const std::vector<unsigned char>& signature) {
+    size_t length = kWinCertHeaderSize + signature.size();
+    std::vector<unsigned char> table(length + static_cast<size_t>(PaddingTo8(length)), 0);
+    WriteLE32(table.data(), static_cast<uint32_t>(table.size()));
+    WriteLE16(table.data() + 4, kWinCertRevision2);
+    WriteLE16(table.data() + 6, kWinCertTypePkcsSignedData);
+    std::copy(signature.begin(), signature.end(), table.begin() + kWinCertHeaderSize);
+    return table;
+}
+
+struct CodeSigner::Keys {
+    EVP_PKEY* key = nullptr;
+    X509* certificate = nullptr;
+    STACK_OF(X509)* chain = nullptr;
+    int indirectDataNid = NID_undef;
+    int statementTypeNid = NID_undef;
+    int opusInfoNid = NID_undef;
+
+    ~Keys() {
+        EVP_PKEY_free(key);
+        X509_free(certificate);
+        sk_X509_pop_free(chain, X509_free);
+    }
+};
+
+CodeSigner::CodeSigner() : keys_(new Keys()) {}
+
+CodeSigner::~CodeSigner() = default;
+
+bool CodeSigner::Load(const SigningOptions& options, std::string& error) {
+    options_ = options;
+
+    BIO* file = BIO_new_file(options.pkcs12Path.c_str(), "rb");
+    if (file == nullptr) {
+        error = "cannot open " + options.pkcs12Path;
+        return false;
+    }
+    PKCS12* pkcs12 = d2i_PKCS12_bio(file, nullptr);
+    BIO_free(file);
+    if (pkcs12 == nullptr) {
+        error = OpenSslError(("not a PKCS#12 file: " + options.pkcs12Path).c_str());
+        return false;
+    }
+
+    bool parsed = PKCS12_parse(pkcs12, options.password.c_str(), &keys_->key, &keys_->certificate, &keys_->chain) == 1;
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    // Older PFX files use RC2 or 3DES, which OpenSSL 3 keeps in its legacy provider
+    if (!parsed && OSSL_PROVIDER_load(nullptr, "legacy") != nullptr) {
+        OSSL_PROVIDER_load(nullptr, "default");
+        ERR_clear_error();
+        parsed = PKCS12_parse(pkcs12, options.password.c_str(), &keys_->key, &keys_->certificate, &keys_->chain) == 1;
+    }
+#endif
+    PKCS12_free(pkcs12);
+    if (!parsed || keys_->key == nullptr || keys_->certificate == nullptr) {
+        error = OpenSslError(("cannot read the key and certificate from " + options.pkcs12Path).c_str());
+        return false;
+    }
+
+    // Registered here, before any signing thread starts, as OBJ_create is not thread-safe
+    keys_->indirectDataNid = ObjectNid(kSpcIndirectDataOid, "SPC_INDIRECT_DATA");
+    keys_->statementTypeNid = ObjectNid(kSpcStatementTypeOid, "SPC_STATEMENT_TYPE");
+    keys_->opusInfoNid = ObjectNid(kSpcSpOpusInfoOid, "SPC_SP_OPUS_INFO");
+    if (keys_->indirectDataNid == NID_undef || keys_->statementTypeNid == NID_undef || keys_->opusInfoNid == NID_undef) {
+        error = OpenSslError("cannot register the Authenticode object identifiers");
+        return false;
+    }
+    return true;
+}
+
+bool CodeSigner::Sign(const unsigned char digest[Sha256::kDigestSize], std::vector<unsigned char>& signature,
+    std::string& error) const {
+    std::vector<unsigned char> content = IndirectDataContent(digest);
+    std::unique_ptr<PKCS7, decltype(&PKCS7_free)> pkcs7(PKCS7_new(), PKCS7_free);
+    if (pkcs7 == nullptr || !PKCS7_set_type(pkcs7.get(), NID_pkcs7_signed)) {
+        error = OpenSslError("failed to create the signature");
+        return false;
+    }
+
+    PKCS7_SIGNER_INFO* signer = PKCS7_add_signature(pkcs7.get(), keys_->certificate, keys_->key, EVP_sha256());
+    if (signer == nullptr ||
+        !PKCS7_add_signed_attribute(signer, NID_pkcs9_contentType, V_ASN1_OBJECT, OBJ_nid2obj(keys_->indirectDataNid)) ||
+        !AddSequenceAttribute(signer, keys_->statementTypeNid, Der(0x30, DerObject(kIndividualCodeSigningOid))) ||
+        !AddSequenceAttribute(signer, keys_->opusInfoNid, OpusInfo(options_.description, options_.url))) {
+        error = OpenSslError("failed to add the signer");
+        return false;
+    }
+    bool certificatesAdded = PKCS7_add_certificate(pkcs7.get(), keys_->certificate) == 1;
+    for (int i = 0; certificatesAdded && i < sk_X509_num(keys_->chain); ++i) {
+        certificatesAdded = PKCS7_add_certificate(pkcs7.get(), sk_X509_value(keys_->chain, i)) == 1;
+    }
+    if (!certificatesAdded || !PKCS7_content_new(pkcs7.get(), NID_pkcs7_data)) {
+        error = OpenSslError("failed to add the certificates");
+        return false;
+    }
+
+    // The signed bytes are the content without its outer SEQUENCE header
+    BIO* data = PKCS7_dataInit(pkcs7.get(), nullptr);
+    if (data == nullptr) {
+        error = OpenSslError("failed to sign the installer");
+        return false;
+    }
+    size_t header = DerHeaderSize(content);
+    int signedSize = static_cast<int>(content.size() - header);
+    bool finished = BIO_write(data, content.data() + header, signedSize) == signedSize &&
+        PKCS7_dataFinal(pkcs7.get(), data) == 1;
+    BIO_free_all(data);
+    if (!finished) {
+        error = OpenSslError("failed to sign the installer");
+        return false;
+    }
+
+    // Then replace the placeholder data with the SpcIndirectDataContent it stood for
+    std::unique_ptr<PKCS7, decltype(&PKCS7_free)> inner(PKCS7_new(), PKCS7_free);
+    ASN1_STRING* value = ASN1_STRING_new();
+    if (inner == nullptr || value == nullptr || !ASN1_STRING_set(value, content.data(), static_cast<int>(content.size())) ||
+        (inner->d.other = ASN1_TYPE_new()) == nullptr) {
+        ASN1_STRING_free(value);
+        error = OpenSslError("failed to sign the installer");
+        return false;
+    }
+    inner->type = OBJ_nid2obj(keys_->indirectDataNid);
+    ASN1_TYPE_set(inner->d.other, V_ASN1_SEQUENCE, value);
+    if (!PKCS7_set_content(pkcs7.get(), inner.get())) {
+        error = OpenSslError("failed to sign the installer");
+        return false;
+    }
+    inner.release();
+
+    int length = i2d_PKCS7(pkcs7.get(), nullptr);
+    if (length <= 0) {
+        error = OpenSslError("failed to encode the signature");
+        return false;
+    }
+    signature.resize(static_cast<size_t>(length));
+    unsigned char* p = signature.data();
+    i2d_PKCS7(pkcs7.get(), &p);
+    return true;
+}
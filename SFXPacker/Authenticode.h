@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <openssl/ossl_typ.h>
+#include "../Common/Sha256.h"
+#include "../SFX/PayloadLocator.h"
+
+// Computes the Authenticode digest and the PE checksum of an image as it is written, so
+// signing needs no second pass over the output. The digest skips the CheckSum field and the
+// certificate table entry and, as osslsigncode does, hashes an unsigned image as if it were
+// padded with zeros to a multiple of 8 bytes.
+class AuthenticodeHasher {
+public:
+    explicit AuthenticodeHasher(const PeSignatureFields& fields);
+    ~AuthenticodeHasher();
+    AuthenticodeHasher(const AuthenticodeHasher&) = delete;
+    AuthenticodeHasher& operator=(const AuthenticodeHasher&) = delete;
+
+    // Adds the next bytes of the image
+    void Update(const void* data, size_t size);
+
+    // SHA-256 image digest over the bytes added so far. Bytes added later, such as the
+    // certificate table, count towards the checksum only.
+    void Digest(unsigned char digest[Sha256::kDigestSize]);
+
+    // PE checksum of the image once the certificate table entry holds `securityEntry`
+    uint32_t Checksum(const unsigned char securityEntry[8]) const;
+
+    uint64_t Position() const { return position_; }
+
+private:
+    PeSignatureFields fields_;
+    EVP_MD_CTX* sha_;           // OpenSSL's SHA-256 uses the CPU's SHA extensions where present
+    bool digested_ = false;
+    uint64_t position_ = 0;
+    uint64_t checksum_ = 0;     // Sum of the 16-bit words outside the skipped fields
+
+    void Add(const unsigned char* data, size_t size);
+};
+
+// Where the signature goes in the image: `padding` zero bytes bring the image to an 8-byte
+// boundary, then the certificate table follows
+struct CertificatePlacement {
+    uint64_t padding;
+    uint64_t offset;
+};
+CertificatePlacement PlaceCertificateTable(uint64_t imageSize);
+
+// WIN_CERTIFICATE holding a PKCS#7 signature, padded to a multiple of 8 bytes
+std::vector<unsigned char> BuildCertificateTable(const std::vector<unsigned char>& signature);
+
+// What goes into the signature besides the digest (osslsigncode's -n and -i)
+struct SigningOptions {
+    std::string pkcs12Path;   // Certificate and private key; empty leaves the output unsigned
+    std::string password;
+    std::string description;  // Program name shown in the UAC prompt
+    std::string url;          // More-information link
+};
+
+// Authenticode signer holding a certificate loaded from a PKCS#12 file. Sign is safe to call
+// from several threads once Load has returned.
+class CodeSigner {
+public:
+    CodeSigner();
+    ~CodeSigner();
+    CodeSigner(const CodeSigner&) = delete;
+    CodeSigner& operator=(const CodeSigner&) = delete;
+
+    bool Load(const SigningOptions& options, std::string& error);
+
+    // DER PKCS#7 SignedData over an SpcIndirectDataContent carrying the image digest
+    bool Sign(const unsigned char digest[Sha256::kDigestSize], std::vector<unsigned char>& signature,
+        std::string& error) const;
+
+private:
+    struct Keys;
+    std::unique_ptr<Keys> keys_;
+    SigningOptions options_;
+};
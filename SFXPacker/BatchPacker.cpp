@@ -0,0 +1,113 @@
+#include "BatchPacker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+namespace {
+    // Counting semaphore limiting how many installers are written at once
+    class IoSlots {
+    public:
+        explicit IoSlots(unsigned count) : available_(std::max(1u, count)) {}
+
+        void Acquire() {
+            std::unique_lock<std::mutex> guard(lock_);
+            released_.wait(guard, [this]() { return available_ > 0; });
+            --available_;
+        }
+
+        void Release() {
+            {
+                std::lock_guard<std::mutex> guard(lock_);
+                ++available_;
+            }
+            released_.notify_one();
+        }
+
+    private:
+        std::mutex lock_;
+        std::condition_variable released_;
+        unsigned available_;
+    };
+
+    std::string ResolvePath(const std::string& directory, const std::string& path) {
+        if (directory.empty() || path.empty() || path[0] == '/') {
+            return path;
+        }
+        return directory.back() == '/' ? directory + path : directory + "/" + path;
+    }
+
+    std::string Trim(const std::string& text) {
+        size_t begin = text.find_first_not_of(" \t\r");
+        if (begin == std::string::npos) {
+            return std::string();
+        }
+        size_t end = text.find_last_not_of(" \t\r");
+        return text.substr(begin, end - begin + 1);
+    }
+}
+
+bool ReadBatchManifest(const std::string& path, const std::string& inputDir, const std::string& outputDir,
+    std::vector<BatchItem>& items, std::string& error) {
+    std::ifstream manifest(path);
+    if (!manifest) {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    std::string line;
+    for (size_t number = 1; std::getline(manifest, line); ++number) {
+        std::string trimmed = Trim(line);
+        if (trimmed.empty() || trimmed[0] == '#') {
+            continue;
+        }
+
+        size_t tab = trimmed.find('\t');
+        if (tab == std::string::npos) {
+            error = path + ":" + std::to_string(number) + ": expected <theme zip><TAB><output path>";
+            return false;
+        }
+        BatchItem item;
+        item.themePath = ResolvePath(inputDir, Trim(trimmed.substr(0, tab)));
+        item.outputPath = ResolvePath(outputDir, Trim(trimmed.substr(tab + 1)));
+        items.push_back(std::move(item));
+    }
+    return true;
+}
+
+std::vector<BatchResult> PackBatch(const PackShared& shared, const std::vector<BatchItem>& items, const BatchOptions& options) {
+    std::vector<BatchResult> results(items.size());
+    IoSlots slots(options.ioSlots);
+    std::atomic<size_t> next(0);
+
+    auto worker = [&]() {
+        for (size_t i = next++; i < items.size(); i = next++) {
+            auto start = std::chrono::steady_clock::now();
+
+            // Parsing, checking and re-encoding the theme need no slot; only writing the installer does
+            ThemeInput theme;
+            if (theme.Open(items[i].themePath, options.theme, results[i].error)) {
+                slots.Acquire();
+                results[i].success = WriteInstaller(shared, theme, items[i].outputPath, results[i].stats, results[i].error);
+                slots.Release();
+            }
+            results[i].milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+    };
+
+    unsigned threadCount = options.workers != 0 ? options.workers : std::thread::hardware_concurrency();
+    threadCount = static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(std::max(1u, threadCount), items.size())));
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < threadCount; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return results;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "SfxPacker.h"
+
+struct BatchItem {
+    std::string themePath;
+    std::string outputPath;
+};
+
+struct BatchOptions {
+    unsigned workers = 0;   // 0 uses the hardware thread count
+    unsigned ioSlots = 4;   // Installers being written at the same time; themes are read outside the limit
+    ThemeOptions theme;
+};
+
+struct BatchResult {
+    bool success = false;
+    std::string error;
+    double milliseconds = 0;   // Wall time for this installer, including any wait for an I/O slot
+    PackStats stats;
+};
+
+// Reads a manifest with one "<theme zip>\t<output path>" pair per line. Blank lines and lines
+// starting with '#' are skipped. Relative paths are resolved against inputDir and outputDir,
+// which stand in for the input and output buckets.
+bool ReadBatchManifest(const std::string& path, const std::string& inputDir, const std::string& outputDir,
+    std::vector<BatchItem>& items, std::string& error);
+
+// Builds every item from the same shared inputs on a pool of workers. Results keep the
+// order of `items`.
+std::vector<BatchResult> PackBatch(const PackShared& shared, const std::vector<BatchItem>& items, const BatchOptions& options);
@@ -0,0 +1,92 @@
+#include "CodecMeasure.h"
+#include "SfxPacker.h"
+#include "../SFX/ZipReader.h"
+
+#include <chrono>
+
+namespace {
+    // Counts decoded bytes without keeping them, as the cost of writing files is not the codec's
+    class CountingSink : public OutputSink {
+    public:
+        bool Write(const unsigned char*, size_t size) override {
+            written_ += size;
+            return true;
+        }
+        uint64_t Written() const { return written_; }
+
+    private:
+        uint64_t written_ = 0;
+    };
+
+    bool LoadCorpus(const std::vector<std::string>& themePaths, std::vector<std::vector<unsigned char>>& files, std::string& error) {
+        for (const auto& path : themePaths) {
+            MappedInput theme;
+            PayloadLocation location;
+            std::vector<ZipEntry> entries;
+            if (!theme.Open(path) || !LocateZipPayload(theme.Data(), theme.Size(), location) ||
+                !ReadZipEntries(theme.Data(), theme.Size(), location, entries)) {
+                error = "the theme is not a readable ZIP archive: " + path;
+                return false;
+            }
+            for (const auto& entry : entries) {
+                if (entry.isDirectory) {
+                    continue;
+                }
+                files.emplace_back();
+                files.back().reserve(static_cast<size_t>(entry.uncompressedSize));
+                BufferSink sink(files.back());
+                if (!ExtractZipEntry(theme.Data(), theme.Size(), entry, sink)) {
+                    error = "cannot decode " + entry.name + " in " + path;
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    double SecondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+bool MeasureCodecs(const std::vector<std::string>& themePaths, const std::vector<CodecChoice>& codecs,
+    std::vector<CodecMeasurement>& results, std::string& error) {
+    std::vector<std::vector<unsigned char>> files;
+    if (!LoadCorpus(themePaths, files, error)) {
+        return false;
+    }
+
+    for (const auto& codec : codecs) {
+        CodecMeasurement measurement;
+        measurement.codec = codec;
+        measurement.files = files.size();
+
+        // Encode everything first, so decoding runs over the encoded set as the stub would
+        std::vector<std::vector<unsigned char>> encoded(files.size());
+        std::vector<uint16_t> methods(files.size());
+        auto packStart = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < files.size(); ++i) {
+            if (!EncodePayload(codec, files[i].data(), files[i].size(), encoded[i], methods[i])) {
+                error = "failed to encode with " + DescribeCodecChoice(codec);
+                return false;
+            }
+        }
+        measurement.packSeconds = SecondsSince(packStart);
+
+        auto unpackStart = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < files.size(); ++i) {
+            const std::vector<unsigned char>& data = methods[i] == kZipMethodStored ? files[i] : encoded[i];
+            CountingSink sink;
+            const PayloadCodec* decoder = FindCodec(methods[i]);
+            if (decoder == nullptr || !decoder->decode(data.data(), data.size(), sink) || sink.Written() != files[i].size()) {
+                error = "round trip failed with " + DescribeCodecChoice(codec);
+                return false;
+            }
+            measurement.inputBytes += files[i].size();
+            measurement.outputBytes += data.size();
+        }
+        measurement.unpackSeconds = SecondsSince(unpackStart);
+        results.push_back(measurement);
+    }
+    return true;
+}
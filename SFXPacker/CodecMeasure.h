@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "PayloadEncoder.h"
+
+struct CodecMeasurement {
+    CodecChoice codec;
+    uint64_t files = 0;
+    uint64_t inputBytes = 0;
+    uint64_t outputBytes = 0;
+    double packSeconds = 0;     // Encoding every file
+    double unpackSeconds = 0;   // Decoding every file with the stub's decoder
+};
+
+// Measures each codec on the files of real theme archives, so a codec and level can be
+// chosen per deployment from size and speed rather than by default. Files are decoded from
+// the themes once up front; each codec then encodes every file separately, as the packer
+// does, and decodes the result again through the same codec table the SFX stub uses.
+bool MeasureCodecs(const std::vector<std::string>& themePaths, const std::vector<CodecChoice>& codecs,
+    std::vector<CodecMeasurement>& results, std::string& error);
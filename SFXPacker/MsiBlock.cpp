@@ -0,0 +1,118 @@
+#include "MsiBlock.h"
+#include "SfxPacker.h"
+#include "ZipWriter.h"
+#include "../Common/Sha256.h"
+#include "../SFX/ByteOrder.h"
+#include "../SFX/Crc32.h"
+#include "../SFX/ZipReader.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    // Block file: magic, version, method, CRC-32, sizes, SHA-256 of the fields before it and
+    // of the data, then the compressed data
+    const uint32_t kBlockMagic = 0x424d544e;   // "NTMB"
+    const uint16_t kBlockVersion = 2;
+    const size_t kBlockFieldsSize = 32;
+    const size_t kBlockHeaderSize = kBlockFieldsSize + Sha256::kDigestSize;
+
+    void BlockDigest(const unsigned char* fields, const unsigned char* data, size_t dataSize, unsigned char* digest) {
+        Sha256 hash;
+        hash.Update(fields, kBlockFieldsSize);
+        hash.Update(data, dataSize);
+        hash.Final(digest);
+    }
+}
+
+bool CompressMsi(const MappedInput& msi, const CodecChoice& codec, std::vector<unsigned char>& buffer, MsiBlock& block) {
+    block.crc32 = UpdateCrc32(0, msi.Data(), msi.Size());
+    block.uncompressedSize = msi.Size();
+    if (!EncodePayload(codec, msi.Data(), msi.Size(), buffer, block.method)) {
+        return false;
+    }
+    block.compressedSize = buffer.empty() ? msi.Size() : buffer.size();
+    block.data = buffer.empty() ? msi.Data() : buffer.data();
+    return true;
+}
+
+bool MsiBlockCache::Find(const std::string& key, const MappedInput& msi, MappedInput& file, MsiBlock& block) const {
+    if (!file.Open(PathFor(key)) || file.Size() < kBlockHeaderSize) {
+        return false;
+    }
+
+    const unsigned char* header = file.Data();
+    uint16_t method = ReadLE16(header + 6);
+    uint64_t uncompressedSize = ReadLE64(header + 16);
+    uint64_t dataSize = ReadLE64(header + 24);
+    if (ReadLE32(header) != kBlockMagic || ReadLE16(header + 4) != kBlockVersion ||
+        uncompressedSize != msi.Size() || dataSize != file.Size() - kBlockHeaderSize ||
+        (method != kZipMethodStored && method != kZipMethodDeflated)) {
+        return false;
+    }
+
+    // The block goes into every installer as it is, and a damaged one would only fail its
+    // CRC on the user's machine; hashing it once per run is far cheaper than compressing
+    unsigned char digest[Sha256::kDigestSize];
+    BlockDigest(header, header + kBlockHeaderSize, static_cast<size_t>(dataSize), digest);
+    if (!std::equal(digest, digest + sizeof(digest), header + kBlockFieldsSize)) {
+        return false;
+    }
+
+    block.method = method;
+    block.crc32 = ReadLE32(header + 8);
+    block.uncompressedSize = uncompressedSize;
+    // A stored block keeps no copy of the MSI, only the note that deflate did not help
+    if (method == kZipMethodStored) {
+        block.compressedSize = uncompressedSize;
+        block.data = msi.Data();
+    }
+    else {
+        block.compressedSize = dataSize;
+        block.data = header + kBlockHeaderSize;
+    }
+    return true;
+}
+
+bool MsiBlockCache::Store(const std::string& key, const MsiBlock& block, std::string& error) const {
+    if (mkdir(directory_.c_str(), 0755) != 0 && errno != EEXIST) {
+        error = "cannot create " + directory_;
+        return false;
+    }
+
+    unsigned char header[kBlockHeaderSize] = {};
+    bool stored = block.method == kZipMethodStored;
+    uint64_t dataSize = stored ? 0 : block.compressedSize;
+    WriteLE32(header, kBlockMagic);
+    WriteLE16(header + 4, kBlockVersion);
+    WriteLE16(header + 6, block.method);
+    WriteLE32(header + 8, block.crc32);
+    WriteLE64(header + 16, block.uncompressedSize);
+    WriteLE64(header + 24, dataSize);
+    BlockDigest(header, block.data, static_cast<size_t>(dataSize), header + kBlockFieldsSize);
+
+    std::string path = PathFor(key);
+    std::string temporary = path + ".tmp." + std::to_string(getpid());
+    OutputFile output;
+    bool written = output.Open(temporary.c_str()) && output.Write(header, sizeof(header)) &&
+        output.Write(block.data, static_cast<size_t>(dataSize));
+    if (!output.Close() || !written || rename(temporary.c_str(), path.c_str()) != 0) {
+        remove(temporary.c_str());
+        error = "cannot write " + path;
+        return false;
+    }
+    return true;
+}
+
+std::string MsiBlockCache::Key(const MappedInput& msi, const CodecChoice& codec) {
+    Sha256 hash;
+    hash.Update(msi.Data(), msi.Size());
+    unsigned char digest[Sha256::kDigestSize];
+    hash.Final(digest);
+    std::string key = DigestToHex(digest, sizeof(digest)) + "-" + DescribeCodecChoice(codec);
+    key.erase(std::remove(key.begin(), key.end(), ':'), key.end());
+    return key;
+}
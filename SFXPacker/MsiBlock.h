@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "PayloadEncoder.h"
+
+class MappedInput;
+
+// The MSI entry as it is spliced into every archive
+struct MsiBlock {
+    uint16_t method = 0;
+    uint32_t crc32 = 0;
+    uint64_t compressedSize = 0;
+    uint64_t uncompressedSize = 0;
+    const unsigned char* data = nullptr;
+};
+
+// Encodes the MSI into `buffer` with the chosen codec. When that does not make it smaller
+// the block points at the MSI itself and is stored. Returns false only if the encoder fails.
+bool CompressMsi(const MappedInput& msi, const CodecChoice& codec, std::vector<unsigned char>& buffer, MsiBlock& block);
+
+// Directory of compressed MSI blocks named by the SHA-256 of the MSI and the codec, so the MSI is
+// compressed once per content rather than once per installer. Entries are written to a
+// temporary name and renamed, so concurrent packers can share the directory. Each entry
+// carries a SHA-256 of its header and data, and one that does not match is compressed afresh.
+class MsiBlockCache {
+public:
+    explicit MsiBlockCache(const std::string& directory) : directory_(directory) {}
+
+    // Maps the block for `key` into `file`. Returns false when there is no usable entry.
+    bool Find(const std::string& key, const MappedInput& msi, MappedInput& file, MsiBlock& block) const;
+    bool Store(const std::string& key, const MsiBlock& block, std::string& error) const;
+
+    // Hex SHA-256 of the MSI's content followed by the codec, e.g. "...-deflate9"
+    static std::string Key(const MappedInput& msi, const CodecChoice& codec);
+
+private:
+    std::string directory_;
+
+    std::string PathFor(const std::string& key) const { return directory_ + "/" + key + ".msiblock"; }
+};
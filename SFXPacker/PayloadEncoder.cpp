@@ -0,0 +1,109 @@
+#include "PayloadEncoder.h"
+
+#include <climits>
+#include <cstdlib>
+#include <zlib.h>
+
+namespace {
+    typedef bool (*EncodeFunction)(const unsigned char* data, size_t size, int level, std::vector<unsigned char>& output);
+
+    // Raw deflate, as ZIP entries carry no zlib wrapper
+    bool EncodeDeflate(const unsigned char* data, size_t size, int level, std::vector<unsigned char>& output) {
+        if (size > UINT_MAX) {
+            return false;
+        }
+        z_stream stream = {};
+        if (deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return false;
+        }
+        output.resize(deflateBound(&stream, static_cast<uLong>(size)));
+        stream.next_in = const_cast<Bytef*>(data);
+        stream.avail_in = static_cast<uInt>(size);
+        stream.next_out = output.data();
+        stream.avail_out = static_cast<uInt>(output.size());
+        int status = deflate(&stream, Z_FINISH);
+        deflateEnd(&stream);
+        output.resize(status == Z_STREAM_END ? stream.total_out : 0);
+        return status == Z_STREAM_END;
+    }
+
+    struct Encoder {
+        uint16_t method;
+        int minLevel;
+        int maxLevel;
+        int defaultLevel;
+        EncodeFunction encode;
+    };
+
+    // Storing needs no encoder. Each method listed here must also be in the stub's codec table.
+    const Encoder kEncoders[] = {
+        { kZipMethodDeflated, 1, 9, 9, EncodeDeflate },
+    };
+
+    const Encoder* FindEncoder(uint16_t method) {
+        for (const auto& encoder : kEncoders) {
+            if (encoder.method == method) {
+                return &encoder;
+            }
+        }
+        return nullptr;
+    }
+}
+
+bool ParseCodecChoice(const std::string& text, CodecChoice& choice) {
+    size_t colon = text.find(':');
+    std::string name = text.substr(0, colon);
+    const PayloadCodec* codec = FindCodecByName(name.c_str());
+    if (codec == nullptr) {
+        return false;
+    }
+
+    if (codec->method == kZipMethodStored) {
+        choice.method = kZipMethodStored;
+        choice.level = 0;
+        return colon == std::string::npos;
+    }
+
+    const Encoder* encoder = FindEncoder(codec->method);
+    if (encoder == nullptr) {
+        return false;
+    }
+    int level = encoder->defaultLevel;
+    if (colon != std::string::npos) {
+        char* end = nullptr;
+        level = static_cast<int>(strtol(text.c_str() + colon + 1, &end, 10));
+        if (*end != '\0' || end == text.c_str() + colon + 1 || level < encoder->minLevel || level > encoder->maxLevel) {
+            return false;
+        }
+    }
+    choice.method = codec->method;
+    choice.level = level;
+    return true;
+}
+
+std::string DescribeCodecChoice(const CodecChoice& choice) {
+    const PayloadCodec* codec = FindCodec(choice.method);
+    std::string name = codec != nullptr ? codec->name : "method " + std::to_string(choice.method);
+    return choice.method == kZipMethodStored ? name : name + ":" + std::to_string(choice.level);
+}
+
+bool EncodePayload(const CodecChoice& choice, const unsigned char* data, size_t size,
+    std::vector<unsigned char>& output, uint16_t& method) {
+    output.clear();
+    method = kZipMethodStored;
+    const Encoder* encoder = FindEncoder(choice.method);
+    if (encoder == nullptr || size == 0) {
+        return choice.method == kZipMethodStored || size == 0;
+    }
+
+    if (!encoder->encode(data, size, choice.level, output)) {
+        output.clear();
+        return false;
+    }
+    if (output.size() >= size) {
+        output.clear();
+        return true;
+    }
+    method = choice.method;
+    return true;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "../SFX/Codec.h"
+
+// Collects decoded bytes in memory
+class BufferSink : public OutputSink {
+public:
+    explicit BufferSink(std::vector<unsigned char>& buffer) : buffer_(buffer) {}
+
+    bool Write(const unsigned char* data, size_t size) override {
+        buffer_.insert(buffer_.end(), data, data + size);
+        return true;
+    }
+
+private:
+    std::vector<unsigned char>& buffer_;
+};
+
+// A payload codec and level, written "store", "deflate" or "deflate:<level>"
+struct CodecChoice {
+    uint16_t method = kZipMethodDeflated;
+    int level = 9;
+};
+
+// Accepts only codecs that both the packer can encode and the stub can decode
+bool ParseCodecChoice(const std::string& text, CodecChoice& choice);
+std::string DescribeCodecChoice(const CodecChoice& choice);
+
+// Encodes `data` into `output` and sets `method` to the method used. When the codec does not
+// make the data smaller, `output` is left empty and `method` is stored, so the caller keeps
+// the original bytes. Returns false only if the encoder fails.
+bool EncodePayload(const CodecChoice& choice, const unsigned char* data, size_t size,
+    std::vector<unsigned char>& output, uint16_t& method);
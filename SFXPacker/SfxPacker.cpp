@@ -0,0 +1,334 @@
+#include "SfxPacker.h"
+#include "ZipWriter.h"
+#include "../SFX/ByteOrder.h"
+#include "../SFX/Crc32.h"
+#include "../SFX/PayloadLocator.h"
+#include "../SFX/ZipReader.h"
+
+#include <cstdio>
+#include <memory>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    const uint32_t kLocalFileHeader = 0x04034b50;
+    const uint64_t kLocalFileHeaderSize = 30;
+    const uint16_t kDefaultDosDate = (1 << 5) | 1;   // 1980-01-01
+
+    bool Pack(const PackShared& shared, const ThemeInput& theme, OutputFile& output, PackStats& stats, std::string& error) {
+        if (!output.Write(shared.Stub().Data(), shared.Stub().Size())) {
+            error = "failed to write output";
+            return false;
+        }
+        if (shared.Config() != nullptr && !output.Write(shared.Config()->Data(), shared.Config()->Size())) {
+            error = "failed to write output";
+            return false;
+        }
+
+        const MsiBlock& msi = shared.Msi();
+        ZipWriter writer(output);
+        if (!writer.AddRaw("NewTabSetup.msi", false, msi.method, msi.crc32, msi.compressedSize, msi.uncompressedSize,
+            0, kDefaultDosDate, msi.data)) {
+            error = "failed to add the MSI";
+            return false;
+        }
+        // Theme entries go in still compressed
+        for (const auto& entry : theme.Entries()) {
+            bool added = entry.isDirectory ? writer.AddDirectory(entry.name, entry.utf8Name) :
+                writer.AddRaw(entry.name, entry.utf8Name, entry.method, entry.crc32, entry.compressedSize,
+                    entry.uncompressedSize, entry.dosTime, entry.dosDate, entry.data);
+            if (!added) {
+                error = "failed to write " + entry.name;
+                return false;
+            }
+        }
+        if (!writer.Finish()) {
+            error = "the archive exceeds the limits of a non-ZIP64 archive";
+            return false;
+        }
+
+        stats.archiveSize = writer.ArchiveSize();
+        stats.entries = writer.EntryCount();
+        stats.outputSize = output.Position();
+        return true;
+    }
+
+    // Appends the signature to an image whose bytes all went through `hasher`, then points the
+    // certificate table entry at it and refreshes the checksum
+    bool SignInPlace(const CodeSigner& signer, const PeSignatureFields& fields, AuthenticodeHasher& hasher,
+        OutputFile& output, PackStats& stats, std::string& error) {
+        static const unsigned char zeros[8] = {};
+        CertificatePlacement placement = PlaceCertificateTable(output.Position());
+        if (!output.Write(zeros, static_cast<size_t>(placement.padding))) {
+            error = "failed to write output";
+            return false;
+        }
+
+        unsigned char digest[Sha256::kDigestSize];
+        hasher.Digest(digest);
+        std::vector<unsigned char> signature;
+        if (!signer.Sign(digest, signature, error)) {
+            return false;
+        }
+        std::vector<unsigned char> table = BuildCertificateTable(signature);
+        if (placement.offset + table.size() > UINT32_MAX) {
+            error = "the installer is too large to sign";
+            return false;
+        }
+        if (!output.Write(table.data(), table.size())) {
+            error = "failed to write output";
+            return false;
+        }
+
+        unsigned char entry[8];
+        WriteLE32(entry, static_cast<uint32_t>(placement.offset));
+        WriteLE32(entry + 4, static_cast<uint32_t>(table.size()));
+        unsigned char checksum[4];
+        WriteLE32(checksum, hasher.Checksum(entry));
+        if (!output.Patch(fields.securityEntryOffset, entry, sizeof(entry)) ||
+            !output.Patch(fields.checksumOffset, checksum, sizeof(checksum))) {
+            error = "failed to write output";
+            return false;
+        }
+
+        stats.certificateTableSize = table.size();
+        stats.digest = DigestToHex(digest, sizeof(digest));
+        stats.outputSize = output.Position();
+        return true;
+    }
+}
+
+MappedInput::~MappedInput() {
+    if (data_ != nullptr) {
+        munmap(const_cast<unsigned char*>(data_), size_);
+    }
+}
+
+bool MappedInput::Open(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+    size_ = static_cast<size_t>(info.st_size);
+    void* view = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    data_ = static_cast<const unsigned char*>(view);
+    madvise(view, size_, MADV_SEQUENTIAL);
+    return true;
+}
+
+bool PackShared::Load(const std::string& stubPath, const std::string& configPath, const std::string& msiPath,
+    const MsiOptions& msiOptions, std::string& error) {
+    // The stub must be a PE image, or the SFX could not find its own payload
+    if (!stub_.Open(stubPath) || FindPeOverlayOffset(stub_.Data(), stub_.Size()) == 0) {
+        error = "the stub is not a PE image: " + stubPath;
+        return false;
+    }
+    if (!FindPeSignatureFields(stub_.Data(), stub_.Size(), stubFields_)) {
+        stubFields_ = PeSignatureFields();
+    }
+    if (!configPath.empty()) {
+        config_.reset(new MappedInput());
+        if (!config_->Open(configPath)) {
+            error = "cannot open " + configPath;
+            return false;
+        }
+    }
+    if (!msi_.Open(msiPath)) {
+        error = "cannot open " + msiPath;
+        return false;
+    }
+    return LoadMsiBlock(msiOptions, error);
+}
+
+bool PackShared::LoadSigner(const SigningOptions& options, std::string& error) {
+    if (stubFields_.securityEntryOffset == 0) {
+        error = "the stub has no certificate table entry to sign";
+        return false;
+    }
+    // The payload has to end the image, or the stub could not find it past a second signature
+    if (stubFields_.certificateOffset != 0 || stubFields_.certificateSize != 0) {
+        error = "the stub is already signed; sign the installer instead";
+        return false;
+    }
+    signer_.reset(new CodeSigner());
+    if (!signer_->Load(options, error)) {
+        signer_.reset();
+        return false;
+    }
+    return true;
+}
+
+bool PackShared::LoadMsiBlock(const MsiOptions& msiOptions, std::string& error) {
+    if (msiOptions.codec.method == kZipMethodStored) {
+        msiBlock_.method = kZipMethodStored;
+        msiBlock_.crc32 = UpdateCrc32(0, msi_.Data(), msi_.Size());
+        msiBlock_.compressedSize = msi_.Size();
+        msiBlock_.uncompressedSize = msi_.Size();
+        msiBlock_.data = msi_.Data();
+        msiSource_ = MsiBlockSource::Stored;
+        return true;
+    }
+
+    // A cached block replaces both the compression and the CRC pass over the MSI
+    std::string key;
+    MsiBlockCache cache(msiOptions.cacheDir);
+    if (!msiOptions.cacheDir.empty()) {
+        key = MsiBlockCache::Key(msi_, msiOptions.codec);
+        if (cache.Find(key, msi_, cachedBlock_, msiBlock_)) {
+            msiSource_ = MsiBlockSource::Cached;
+            return true;
+        }
+    }
+
+    if (!CompressMsi(msi_, msiOptions.codec, compressed_, msiBlock_)) {
+        error = "failed to compress the MSI";
+        return false;
+    }
+    msiSource_ = MsiBlockSource::Compressed;
+
+    // A cache that cannot be written only costs the next run a compression
+    std::string cacheError;
+    if (!key.empty() && !cache.Store(key, msiBlock_, cacheError)) {
+        fprintf(stderr, "sfxpack: %s\n", cacheError.c_str());
+    }
+    return true;
+}
+
+bool ThemeInput::Open(const std::string& path, const ThemeOptions& options, std::string& error) {
+    if (!file_.Open(path)) {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    PayloadLocation location;
+    std::vector<ZipEntry> entries;
+    const unsigned char* data = file_.Data();
+    if (!LocateZipPayload(data, file_.Size(), location) || !ReadZipEntries(data, file_.Size(), location, entries)) {
+        error = "the theme is not a readable ZIP archive: " + path;
+        return false;
+    }
+
+    entries_.reserve(entries.size());
+    buffers_.reserve(entries.size());
+    for (const auto& entry : entries) {
+        if (!IsSafeEntryName(entry.name)) {
+            error = "unsafe entry name in theme: " + entry.name;
+            return false;
+        }
+
+        Entry renamed = { "build/" + entry.name, entry.utf8Name, entry.isDirectory, entry.method, entry.crc32,
+            entry.compressedSize, entry.uncompressedSize, 0, kDefaultDosDate, nullptr };
+        if (!entry.isDirectory) {
+            if (FindCodec(entry.method) == nullptr) {
+                error = "unsupported compression method in theme entry " + entry.name;
+                return false;
+            }
+            if (options.recompress) {
+                if (!Recompress(entry, options.codec, renamed, error)) {
+                    return false;
+                }
+                entries_.push_back(std::move(renamed));
+                continue;
+            }
+
+            // The data follows the local header, whose name and extra lengths are its own
+            uint64_t pos = entry.localHeaderOffset;
+            if (pos + kLocalFileHeaderSize > file_.Size() || ReadLE32(data + pos) != kLocalFileHeader) {
+                error = "corrupt local header for theme entry " + entry.name;
+                return false;
+            }
+            uint64_t dataOffset = pos + kLocalFileHeaderSize + ReadLE16(data + pos + 26) + ReadLE16(data + pos + 28);
+            if (dataOffset + entry.compressedSize > file_.Size()) {
+                error = "truncated theme entry " + entry.name;
+                return false;
+            }
+            renamed.dosTime = ReadLE16(data + pos + 10);
+            renamed.dosDate = ReadLE16(data + pos + 12);
+            renamed.data = data + dataOffset;
+        }
+        entries_.push_back(std::move(renamed));
+    }
+    return true;
+}
+
+bool ThemeInput::Recompress(const ZipEntry& source, const CodecChoice& codec, Entry& entry, std::string& error) {
+    // Decoding checks the CRC, so a damaged theme is caught before it is re-encoded
+    std::vector<unsigned char> decoded;
+    decoded.reserve(static_cast<size_t>(source.uncompressedSize));
+    BufferSink sink(decoded);
+    if (!ExtractZipEntry(file_.Data(), file_.Size(), source, sink)) {
+        error = "corrupt theme entry " + source.name;
+        return false;
+    }
+
+    std::vector<unsigned char> encoded;
+    if (!EncodePayload(codec, decoded.data(), decoded.size(), encoded, entry.method)) {
+        error = "failed to compress theme entry " + source.name;
+        return false;
+    }
+    buffers_.push_back(encoded.empty() ? std::move(decoded) : std::move(encoded));
+    entry.compressedSize = buffers_.back().size();
+    entry.data = buffers_.back().data();
+
+    // Keep the entry's timestamp from its local header
+    uint64_t pos = source.localHeaderOffset;
+    if (pos + kLocalFileHeaderSize <= file_.Size()) {
+        entry.dosTime = ReadLE16(file_.Data() + pos + 10);
+        entry.dosDate = ReadLE16(file_.Data() + pos + 12);
+    }
+    return true;
+}
+
+bool WriteInstaller(const PackShared& shared, const ThemeInput& theme, const std::string& outputPath,
+    PackStats& stats, std::string& error) {
+    OutputFile output;
+    if (!output.Open(outputPath.c_str())) {
+        error = "cannot create " + outputPath;
+        return false;
+    }
+
+    // The hasher sees each byte once, on its way to the file
+    std::unique_ptr<AuthenticodeHasher> hasher;
+    if (shared.Signer() != nullptr) {
+        hasher.reset(new AuthenticodeHasher(shared.StubFields()));
+        output.SetHasher(hasher.get());
+    }
+
+    bool packed = Pack(shared, theme, output, stats, error);
+    if (packed && hasher != nullptr) {
+        packed = SignInPlace(*shared.Signer(), shared.StubFields(), *hasher, output, stats, error);
+    }
+    if (!output.Close() && packed) {
+        error = "failed to write " + outputPath;
+        packed = false;
+    }
+    if (!packed) {
+        remove(outputPath.c_str());
+    }
+    return packed;
+}
+
+bool PackTheme(const PackShared& shared, const std::string& themePath, const ThemeOptions& themeOptions,
+    const std::string& outputPath, PackStats& stats, std::string& error) {
+    ThemeInput theme;
+    return theme.Open(themePath, themeOptions, error) && WriteInstaller(shared, theme, outputPath, stats, error);
+}
+
+bool PackSfx(const PackRequest& request, PackStats& stats, std::string& error) {
+    PackShared shared;
+    return shared.Load(request.stubPath, request.configPath, request.msiPath, request.msiOptions, error) &&
+        (request.signing.pkcs12Path.empty() || shared.LoadSigner(request.signing, error)) &&
+        PackTheme(shared, request.themePath, request.themeOptions, request.outputPath, stats, error);
+}
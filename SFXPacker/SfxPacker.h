@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Authenticode.h"
+#include "MsiBlock.h"
+#include "../SFX/ZipReader.h"
+
+// How the MSI goes into the archive
+struct MsiOptions {
+    CodecChoice codec;       // Applied once per MSI, not once per installer
+    std::string cacheDir;    // Keeps the compressed MSI across runs; empty compresses in memory
+};
+
+// How theme entries go into the archive
+struct ThemeOptions {
+    bool recompress = false; // Otherwise entries are copied as compressed in the theme ZIP
+    CodecChoice codec;
+};
+
+struct PackRequest {
+    std::string stubPath;      // SFX.exe
+    std::string configPath;    // Optional block placed between the stub and the archive
+    std::string msiPath;       // Placed at the archive root as NewTabSetup.msi
+    std::string themePath;     // Theme ZIP; its entries are placed under build/
+    std::string outputPath;
+    MsiOptions msiOptions;
+    ThemeOptions themeOptions;
+    SigningOptions signing;
+};
+
+struct PackStats {
+    uint64_t outputSize = 0;
+    uint64_t archiveSize = 0;
+    size_t entries = 0;
+    uint64_t certificateTableSize = 0;  // Zero if the installer is not signed
+    std::string digest;                 // Authenticode digest of a signed installer, in hex
+};
+
+// Read-only mapping of an input file; the page cache backs it, not the heap
+class MappedInput {
+public:
+    MappedInput() = default;
+    ~MappedInput();
+    MappedInput(const MappedInput&) = delete;
+    MappedInput& operator=(const MappedInput&) = delete;
+
+    bool Open(const std::string& path);
+    const unsigned char* Data() const { return data_; }
+    size_t Size() const { return size_; }
+
+private:
+    const unsigned char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Where the MSI block of a run came from
+enum class MsiBlockSource { Stored, Compressed, Cached };
+
+// Inputs common to every installer: the stub, the config block and the MSI. They are mapped
+// once and the MSI is compressed at most once, so each installer only adds its theme and
+// splices in the same MSI block.
+class PackShared {
+public:
+    bool Load(const std::string& stubPath, const std::string& configPath, const std::string& msiPath,
+        const MsiOptions& msiOptions, std::string& error);
+
+    // Signs every installer written from these inputs. The stub must not be signed itself.
+    bool LoadSigner(const SigningOptions& options, std::string& error);
+
+    const MappedInput& Stub() const { return stub_; }
+    const PeSignatureFields& StubFields() const { return stubFields_; }
+    const CodeSigner* Signer() const { return signer_.get(); }
+    const MappedInput* Config() const { return config_.get(); }
+    const MsiBlock& Msi() const { return msiBlock_; }
+    MsiBlockSource MsiSource() const { return msiSource_; }
+
+private:
+    MappedInput stub_;
+    std::unique_ptr<MappedInput> config_;
+    MappedInput msi_;
+    MappedInput cachedBlock_;
+    std::vector<unsigned char> compressed_;
+    MsiBlock msiBlock_;
+    MsiBlockSource msiSource_ = MsiBlockSource::Stored;
+    PeSignatureFields stubFields_;
+    std::unique_ptr<CodeSigner> signer_;
+
+    bool LoadMsiBlock(const MsiOptions& msiOptions, std::string& error);
+};
+
+// A theme archive mapped and checked, with its entries renamed under build/ and, if asked,
+// re-encoded with another codec
+class ThemeInput {
+public:
+    struct Entry {
+        std::string name;
+        bool utf8Name;
+        bool isDirectory;
+        uint16_t method;
+        uint32_t crc32;
+        uint64_t compressedSize;
+        uint64_t uncompressedSize;
+        uint16_t dosTime;
+        uint16_t dosDate;
+        const unsigned char* data;   // Compressed bytes inside the mapping or a re-encoded buffer
+    };
+
+    bool Open(const std::string& path, const ThemeOptions& options, std::string& error);
+    const std::vector<Entry>& Entries() const { return entries_; }
+
+private:
+    MappedInput file_;
+    std::vector<Entry> entries_;
+    std::vector<std::vector<unsigned char>> buffers_;
+
+    bool Recompress(const ZipEntry& source, const CodecChoice& codec, Entry& entry, std::string& error);
+};
+
+// Writes one installer from loaded inputs. Safe to call from several threads. With a signer,
+// the Authenticode digest is taken as the bytes are written and the signature is appended
+// and patched into the headers in place, so the output is neither re-read nor copied.
+bool WriteInstaller(const PackShared& shared, const ThemeInput& theme, const std::string& outputPath,
+    PackStats& stats, std::string& error);
+
+// Opens a theme and writes its installer
+bool PackTheme(const PackShared& shared, const std::string& themePath, const ThemeOptions& themeOptions,
+    const std::string& outputPath, PackStats& stats, std::string& error);
+
+// Builds an SFX image in one pass: the stub, the config block, then a ZIP archive holding the
+// MSI and the theme. The MSI block and the theme entries are copied still compressed unless
+// the theme is re-encoded, and inputs are mapped rather than read into memory; the output is
+// written once, and signed as it is written if the request names a certificate. A partial
+// output is removed on failure.
+bool PackSfx(const PackRequest& request, PackStats& stats, std::string& error);
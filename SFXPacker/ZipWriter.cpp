@@ -0,0 +1,146 @@
+#include "ZipWriter.h"
+#include "Authenticode.h"
+#include "../SFX/ByteOrder.h"
+
+namespace {
+    const uint32_t kLocalFileHeader = 0x04034b50;
+    const uint32_t kCentralDirectoryHeader = 0x02014b50;
+    const uint32_t kEndOfCentralDirectory = 0x06054b50;
+    const size_t kLocalFileHeaderSize = 30;
+    const size_t kCentralDirectoryHeaderSize = 46;
+    const size_t kEndOfCentralDirectorySize = 22;
+    const uint16_t kFlagUtf8 = 0x0800;
+    const uint16_t kVersionNeeded = 20;
+    const uint32_t kDirectoryAttribute = 0x10;
+    const uint64_t kMaxClassicValue = 0xFFFFFFFE;
+    const size_t kMaxClassicEntries = 0xFFFF;
+
+    // 1980-01-01 00:00, the earliest DOS date
+    const uint16_t kDefaultDosDate = (1 << 5) | 1;
+}
+
+OutputFile::~OutputFile() {
+    if (file_ != nullptr) {
+        fclose(file_);
+    }
+}
+
+bool OutputFile::Open(const char* path) {
+    file_ = fopen(path, "wb");
+    position_ = 0;
+    return file_ != nullptr;
+}
+
+bool OutputFile::Write(const void* data, size_t size) {
+    if (size > 0 && fwrite(data, 1, size, file_) != size) {
+        return false;
+    }
+    if (hasher_ != nullptr) {
+        hasher_->Update(data, size);
+    }
+    position_ += size;
+    return true;
+}
+
+bool OutputFile::Patch(uint64_t offset, const void* data, size_t size) {
+    if (offset + size > position_ || fseeko(file_, static_cast<off_t>(offset), SEEK_SET) != 0) {
+        return false;
+    }
+    bool written = fwrite(data, 1, size, file_) == size;
+    return fseeko(file_, static_cast<off_t>(position_), SEEK_SET) == 0 && written;
+}
+
+bool OutputFile::Close() {
+    bool ok = file_ != nullptr && fclose(file_) == 0;
+    file_ = nullptr;
+    return ok;
+}
+
+ZipWriter::ZipWriter(OutputFile& output) : output_(output), base_(output.Position()) {}
+
+void ZipWriter::FillLocalHeader(const Record& record, unsigned char* header) {
+    WriteLE32(header, kLocalFileHeader);
+    WriteLE16(header + 4, kVersionNeeded);
+    WriteLE16(header + 6, record.flags);
+    WriteLE16(header + 8, record.method);
+    WriteLE16(header + 10, record.dosTime);
+    WriteLE16(header + 12, record.dosDate);
+    WriteLE32(header + 14, record.crc32);
+    WriteLE32(header + 18, static_cast<uint32_t>(record.compressedSize));
+    WriteLE32(header + 22, static_cast<uint32_t>(record.uncompressedSize));
+    WriteLE16(header + 26, static_cast<uint16_t>(record.name.size()));
+    WriteLE16(header + 28, 0);
+}
+
+bool ZipWriter::WriteLocalHeader(const Record& record) {
+    unsigned char header[kLocalFileHeaderSize];
+    FillLocalHeader(record, header);
+    return output_.Write(header, sizeof(header)) && output_.Write(record.name.data(), record.name.size());
+}
+
+bool ZipWriter::AddDirectory(const std::string& name, bool utf8Name) {
+    std::string directory = name;
+    if (directory.empty() || directory.back() != '/') {
+        directory.push_back('/');
+    }
+
+    Record record = { directory, static_cast<uint16_t>(utf8Name ? kFlagUtf8 : 0), 0, 0, kDefaultDosDate, 0, 0, 0,
+        ArchiveSize(), kDirectoryAttribute };
+    if (records_.size() >= kMaxClassicEntries || directory.size() > 0xFFFF || !WriteLocalHeader(record)) {
+        return false;
+    }
+    records_.push_back(std::move(record));
+    return true;
+}
+
+bool ZipWriter::AddRaw(const std::string& name, bool utf8Name, uint16_t method, uint32_t crc32,
+    uint64_t compressedSize, uint64_t uncompressedSize, uint16_t dosTime, uint16_t dosDate, const unsigned char* data) {
+    if (records_.size() >= kMaxClassicEntries || name.size() > 0xFFFF ||
+        compressedSize > kMaxClassicValue || uncompressedSize > kMaxClassicValue) {
+        return false;
+    }
+
+    Record record = { name, static_cast<uint16_t>(utf8Name ? kFlagUtf8 : 0), method, dosTime, dosDate, crc32,
+        compressedSize, uncompressedSize, ArchiveSize(), 0 };
+    if (!WriteLocalHeader(record) || !output_.Write(data, static_cast<size_t>(compressedSize))) {
+        return false;
+    }
+    records_.push_back(std::move(record));
+    return true;
+}
+
+bool ZipWriter::Finish() {
+    uint64_t centralDirectoryOffset = ArchiveSize();
+    for (const auto& record : records_) {
+        unsigned char header[kCentralDirectoryHeaderSize] = {};
+        WriteLE32(header, kCentralDirectoryHeader);
+        WriteLE16(header + 4, kVersionNeeded);
+        WriteLE16(header + 6, kVersionNeeded);
+        WriteLE16(header + 8, record.flags);
+        WriteLE16(header + 10, record.method);
+        WriteLE16(header + 12, record.dosTime);
+        WriteLE16(header + 14, record.dosDate);
+        WriteLE32(header + 16, record.crc32);
+        WriteLE32(header + 20, static_cast<uint32_t>(record.compressedSize));
+        WriteLE32(header + 24, static_cast<uint32_t>(record.uncompressedSize));
+        WriteLE16(header + 28, static_cast<uint16_t>(record.name.size()));
+        WriteLE32(header + 38, record.externalAttributes);
+        WriteLE32(header + 42, static_cast<uint32_t>(record.localHeaderOffset));
+        if (!output_.Write(header, sizeof(header)) || !output_.Write(record.name.data(), record.name.size())) {
+            return false;
+        }
+    }
+
+    uint64_t centralDirectorySize = ArchiveSize() - centralDirectoryOffset;
+    if (centralDirectoryOffset > kMaxClassicValue || centralDirectorySize > kMaxClassicValue) {
+        return false;
+    }
+
+    unsigned char record[kEndOfCentralDirectorySize] = {};
+    WriteLE32(record, kEndOfCentralDirectory);
+    WriteLE16(record + 8, static_cast<uint16_t>(records_.size()));
+    WriteLE16(record + 10, static_cast<uint16_t>(records_.size()));
+    WriteLE32(record + 12, static_cast<uint32_t>(centralDirectorySize));
+    WriteLE32(record + 16, static_cast<uint32_t>(centralDirectoryOffset));
+    return output_.Write(record, sizeof(record));
+}
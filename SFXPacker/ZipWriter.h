@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class AuthenticodeHasher;
+
+// Output file written front to back. Header fields can be patched once the rest is written.
+class OutputFile {
+public:
+    OutputFile() = default;
+    ~OutputFile();
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+
+    bool Open(const char* path);
+    bool Write(const void* data, size_t size);
+    // Overwrites bytes already written; the patched bytes bypass the hasher
+    bool Patch(uint64_t offset, const void* data, size_t size);
+    bool Close();
+    uint64_t Position() const { return position_; }
+
+    // Passes every byte written from now on to `hasher`; null stops it
+    void SetHasher(AuthenticodeHasher* hasher) { hasher_ = hasher; }
+
+private:
+    FILE* file_ = nullptr;
+    uint64_t position_ = 0;
+    AuthenticodeHasher* hasher_ = nullptr;
+};
+
+// Sequential ZIP writer for SFX payloads. The archive starts at the output's current position
+// and its offsets are relative to that start, so it can follow a stub and a config block; the
+// SFX reader derives the base from the central directory. Sizes are limited to what a
+// classic (non-ZIP64) archive can describe, which is also all the SFX stub accepts.
+class ZipWriter {
+public:
+    explicit ZipWriter(OutputFile& output);
+
+    bool AddDirectory(const std::string& name, bool utf8Name);
+
+    // Copies an entry's compressed bytes unchanged, e.g. from another archive
+    bool AddRaw(const std::string& name, bool utf8Name, uint16_t method, uint32_t crc32,
+        uint64_t compressedSize, uint64_t uncompressedSize, uint16_t dosTime, uint16_t dosDate,
+        const unsigned char* data);
+
+    // Writes the central directory and end record
+    bool Finish();
+
+    uint64_t ArchiveSize() const { return output_.Position() - base_; }
+    size_t EntryCount() const { return records_.size(); }
+
+private:
+    struct Record {
+        std::string name;
+        uint16_t flags;
+        uint16_t method;
+        uint16_t dosTime;
+        uint16_t dosDate;
+        uint32_t crc32;
+        uint64_t compressedSize;
+        uint64_t uncompressedSize;
+        uint64_t localHeaderOffset;
+        uint32_t externalAttributes;
+    };
+
+    OutputFile& output_;
+    uint64_t base_;
+    std::vector<Record> records_;
+
+    bool WriteLocalHeader(const Record& record);
+    static void FillLocalHeader(const Record& record, unsigned char* header);
+};
@@ -0,0 +1,259 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "BatchPacker.h"
+#include "CodecMeasure.h"
+#include "SfxPacker.h"
+
+// Prints command line usage
+void PrintUsage() {
+    fprintf(stderr,
+        "Usage: sfxpack --stub SFX.exe --msi NewTabSetup.msi --theme theme.zip --output NewTabSetup.exe [options]\n"
+        "       sfxpack --stub SFX.exe --msi NewTabSetup.msi --batch manifest.tsv [--input-dir dir] [--output-dir dir]\n"
+        "               [--jobs N] [--io N] [options]\n"
+        "       sfxpack --measure theme.zip [--measure theme.zip ...] [--codecs store,deflate:1,deflate:9]\n"
+        "Options: --config config.txt  --cache-dir dir  --msi-codec CODEC  --theme-codec keep|CODEC\n"
+        "         --pkcs12 cert.pfx [--pass password] [--description text] [--url url]\n"
+        "CODEC is store, deflate or deflate:1-9\n");
+}
+
+// Helper function to describe where the MSI block came from
+const char* DescribeMsiSource(MsiBlockSource source) {
+    switch (source) {
+    case MsiBlockSource::Cached:
+        return "reused from the cache";
+    case MsiBlockSource::Compressed:
+        return "compressed";
+    default:
+        return "stored";
+    }
+}
+
+// Helper function to read a latency percentile from sorted samples
+double Percentile(const std::vector<double>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+// Helper function to parse a comma-separated list of codecs
+bool ParseCodecList(const std::string& text, std::vector<CodecChoice>& codecs) {
+    codecs.clear();
+    size_t begin = 0;
+    while (begin <= text.size()) {
+        size_t end = text.find(',', begin);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        CodecChoice codec;
+        if (!ParseCodecChoice(text.substr(begin, end - begin), codec)) {
+            return false;
+        }
+        codecs.push_back(codec);
+        begin = end + 1;
+    }
+    return !codecs.empty();
+}
+
+// Prints size and speed of each codec on the given themes
+int RunMeasure(const std::vector<std::string>& themePaths, const std::vector<CodecChoice>& codecs) {
+    std::vector<CodecMeasurement> results;
+    std::string error;
+    if (!MeasureCodecs(themePaths, codecs, results, error)) {
+        fprintf(stderr, "sfxpack: %s\n", error.c_str());
+        return 1;
+    }
+
+    const double megabyte = 1024.0 * 1024.0;
+    printf("%-10s %8s %14s %14s %7s %12s %12s\n", "codec", "files", "input", "output", "ratio", "pack MB/s", "unpack MB/s");
+    for (const auto& result : results) {
+        double input = static_cast<double>(result.inputBytes);
+        printf("%-10s %8llu %14llu %14llu %6.1f%% %12.1f %12.1f\n", DescribeCodecChoice(result.codec).c_str(),
+            static_cast<unsigned long long>(result.files), static_cast<unsigned long long>(result.inputBytes),
+            static_cast<unsigned long long>(result.outputBytes), input > 0 ? 100.0 * result.outputBytes / input : 0.0,
+            result.packSeconds > 0 ? input / megabyte / result.packSeconds : 0.0,
+            result.unpackSeconds > 0 ? input / megabyte / result.unpackSeconds : 0.0);
+    }
+    return 0;
+}
+
+// Builds every installer listed in the manifest and prints per-item and aggregate figures
+int RunBatch(const PackShared& shared, const std::vector<BatchItem>& items, const BatchOptions& options) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<BatchResult> results = PackBatch(shared, items, options);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t failures = 0;
+    uint64_t bytes = 0;
+    std::vector<double> latencies;
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BatchResult& result = results[i];
+        if (result.success) {
+            printf("%s: %.1f ms, %llu bytes\n", items[i].outputPath.c_str(), result.milliseconds,
+                static_cast<unsigned long long>(result.stats.outputSize));
+            bytes += result.stats.outputSize;
+            latencies.push_back(result.milliseconds);
+        }
+        else {
+            fprintf(stderr, "sfxpack: %s: %s\n", items[i].outputPath.c_str(), result.error.c_str());
+            ++failures;
+        }
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    double rate = seconds > 0 ? latencies.size() / seconds : 0;
+    double throughput = seconds > 0 ? bytes / seconds / (1024.0 * 1024.0) : 0;
+    printf("Built %zu of %zu installers in %.2f s (%.1f installers/s, %.1f MB/s), p50 %.1f ms, p95 %.1f ms\n",
+        latencies.size(), items.size(), seconds, rate, throughput, Percentile(latencies, 0.50), Percentile(latencies, 0.95));
+    return failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    PackRequest request;
+    std::string batchPath;
+    std::string inputDir;
+    std::string outputDir;
+    BatchOptions batchOptions;
+    std::vector<std::string> measurePaths;
+    std::vector<CodecChoice> measureCodecs;
+    ParseCodecList("store,deflate:1,deflate:6,deflate:9", measureCodecs);
+    for (int i = 1; i < argc; ++i) {
+        const char* option = argv[i];
+        if (i + 1 >= argc) {
+            PrintUsage();
+            return 2;
+        }
+        const char* value = argv[++i];
+        if (strcmp(option, "--stub") == 0) {
+            request.stubPath = value;
+        }
+        else if (strcmp(option, "--msi") == 0) {
+            request.msiPath = value;
+        }
+        else if (strcmp(option, "--theme") == 0) {
+            request.themePath = value;
+        }
+        else if (strcmp(option, "--output") == 0) {
+            request.outputPath = value;
+        }
+        else if (strcmp(option, "--config") == 0) {
+            request.configPath = value;
+        }
+        else if (strcmp(option, "--cache-dir") == 0) {
+            request.msiOptions.cacheDir = value;
+        }
+        else if (strcmp(option, "--msi-codec") == 0) {
+            if (!ParseCodecChoice(value, request.msiOptions.codec)) {
+                PrintUsage();
+                return 2;
+            }
+        }
+        else if (strcmp(option, "--theme-codec") == 0) {
+            request.themeOptions.recompress = strcmp(value, "keep") != 0;
+            if (request.themeOptions.recompress && !ParseCodecChoice(value, request.themeOptions.codec)) {
+                PrintUsage();
+                return 2;
+            }
+        }
+        else if (strcmp(option, "--pkcs12") == 0) {
+            request.signing.pkcs12Path = value;
+        }
+        else if (strcmp(option, "--pass") == 0) {
+            request.signing.password = value;
+        }
+        else if (strcmp(option, "--description") == 0) {
+            request.signing.description = value;
+        }
+        else if (strcmp(option, "--url") == 0) {
+            request.signing.url = value;
+        }
+        else if (strcmp(option, "--measure") == 0) {
+            measurePaths.push_back(value);
+        }
+        else if (strcmp(option, "--codecs") == 0) {
+            if (!ParseCodecList(value, measureCodecs)) {
+                PrintUsage();
+                return 2;
+            }
+        }
+        else if (strcmp(option, "--batch") == 0) {
+            batchPath = value;
+        }
+        else if (strcmp(option, "--input-dir") == 0) {
+            inputDir = value;
+        }
+        else if (strcmp(option, "--output-dir") == 0) {
+            outputDir = value;
+        }
+        else if (strcmp(option, "--jobs") == 0) {
+            batchOptions.workers = static_cast<unsigned>(strtoul(value, nullptr, 10));
+        }
+        else if (strcmp(option, "--io") == 0) {
+            batchOptions.ioSlots = static_cast<unsigned>(strtoul(value, nullptr, 10));
+        }
+        else {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    if (!measurePaths.empty()) {
+        return RunMeasure(measurePaths, measureCodecs);
+    }
+
+    bool batch = !batchPath.empty();
+    if (request.stubPath.empty() || request.msiPath.empty() ||
+        (!batch && (request.themePath.empty() || request.outputPath.empty()))) {
+        PrintUsage();
+        return 2;
+    }
+
+    PackShared shared;
+    std::string error;
+    auto loadStart = std::chrono::steady_clock::now();
+    if (!shared.Load(request.stubPath, request.configPath, request.msiPath, request.msiOptions, error)) {
+        fprintf(stderr, "sfxpack: %s\n", error.c_str());
+        return 1;
+    }
+    const MsiBlock& msi = shared.Msi();
+    printf("MSI block %s: %llu of %llu bytes in %.1f ms\n", DescribeMsiSource(shared.MsiSource()),
+        static_cast<unsigned long long>(msi.compressedSize), static_cast<unsigned long long>(msi.uncompressedSize),
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count());
+    if (!request.signing.pkcs12Path.empty() && !shared.LoadSigner(request.signing, error)) {
+        fprintf(stderr, "sfxpack: %s\n", error.c_str());
+        return 1;
+    }
+
+    if (batch) {
+        std::vector<BatchItem> items;
+        if (!ReadBatchManifest(batchPath, inputDir, outputDir, items, error)) {
+            fprintf(stderr, "sfxpack: %s\n", error.c_str());
+            return 1;
+        }
+        batchOptions.theme = request.themeOptions;
+        return RunBatch(shared, items, batchOptions);
+    }
+
+    PackStats stats;
+    if (!PackTheme(shared, request.themePath, request.themeOptions, request.outputPath, stats, error)) {
+        fprintf(stderr, "sfxpack: %s\n", error.c_str());
+        return 1;
+    }
+
+    printf("Wrote %s: %zu entries, %llu byte archive, %llu bytes total\n", request.outputPath.c_str(), stats.entries,
+        static_cast<unsigned long long>(stats.archiveSize), static_cast<unsigned long long>(stats.outputSize));
+    if (stats.certificateTableSize != 0) {
+        // A separate signer would read the unsigned image and write it out again
+        uint64_t imageSize = stats.outputSize - stats.certificateTableSize;
+        printf("Signed in place: Authenticode digest %s, %llu byte certificate table; %.1f MB of signing I/O avoided\n",
+            stats.digest.c_str(), static_cast<unsigned long long>(stats.certificateTableSize),
+            2.0 * imageSize / (1024.0 * 1024.0));
+    }
+    return 0;
+}
@@ -0,0 +1,45 @@
+#include <benchmark/benchmark.h>
+
+#include "PayloadEncoder.h"
+#include "TestSupport.h"
+
+namespace {
+    const Bytes& ScriptData() {
+        static Bytes data = MakeContent(1024 * 1024, 7);
+        return data;
+    }
+}
+
+// Encoding cost of each deflate level, the choice --msi-codec and --theme-codec expose
+static void BM_EncodePayload(benchmark::State& state) {
+    CodecChoice choice;
+    choice.level = static_cast<int>(state.range(0));
+    Bytes encoded;
+    uint16_t method = 0;
+    for (auto _ : state) {
+        if (!EncodePayload(choice, ScriptData().data(), ScriptData().size(), encoded, method)) {
+            state.SkipWithError("encoding failed");
+        }
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * ScriptData().size()));
+    state.counters["ratio"] = static_cast<double>(encoded.size()) / static_cast<double>(ScriptData().size());
+}
+BENCHMARK(BM_EncodePayload)->Arg(1)->Arg(6)->Arg(9)->Unit(benchmark::kMillisecond);
+
+// Decoding the same output through the stub's codec table
+static void BM_DecodePayload(benchmark::State& state) {
+    CodecChoice choice;
+    choice.level = static_cast<int>(state.range(0));
+    Bytes encoded;
+    uint16_t method = 0;
+    EncodePayload(choice, ScriptData().data(), ScriptData().size(), encoded, method);
+    const PayloadCodec* codec = FindCodec(method);
+    for (auto _ : state) {
+        NullSink sink;
+        if (!codec->decode(encoded.data(), encoded.size(), sink)) {
+            state.SkipWithError("decoding failed");
+        }
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * ScriptData().size()));
+}
+BENCHMARK(BM_DecodePayload)->Arg(1)->Arg(9)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,375 @@
+// Compares a Google Benchmark JSON result file with a baseline recorded on the same machine.
+//
+//   bench_compare <baseline.json> <results.json> [--threshold <percent>] [--thresholds <file>]
+//                 [--noise <factor>] [--history <file.csv>] [--bootstrap]
+//
+// Each benchmark's median real time (or its single run, without repetitions) is compared with
+// the baseline's. A benchmark may be slower by its threshold plus `factor` times the larger
+// coefficient of variation of the two runs, so a noisy benchmark needs a bigger change to
+// fail. --thresholds names a file of "<benchmark name prefix> <percent>" lines that override
+// --threshold; the longest matching prefix wins. The exit code is 1 if any benchmark is
+// slower than allowed, 2 if a file cannot be read. With --bootstrap, a missing baseline is
+// created from the results instead. With --history, one CSV row per benchmark is appended,
+// so runs can be tracked over time.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+    // Just enough JSON for benchmark output: objects, arrays, strings, numbers and literals
+    struct JsonValue {
+        enum class Kind { Null, Bool, Number, String, Array, Object } kind = Kind::Null;
+        double number = 0;
+        std::string text;
+        std::vector<JsonValue> items;
+        std::map<std::string, JsonValue> members;
+
+        const JsonValue* Find(const std::string& name) const {
+            auto it = members.find(name);
+            return it == members.end() ? nullptr : &it->second;
+        }
+
+        std::string Text(const std::string& name) const {
+            const JsonValue* value = Find(name);
+            return value != nullptr && value->kind == Kind::String ? value->text : std::string();
+        }
+
+        double Number(const std::string& name) const {
+            const JsonValue* value = Find(name);
+            return value != nullptr && value->kind == Kind::Number ? value->number : 0;
+        }
+    };
+
+    class JsonParser {
+    public:
+        explicit JsonParser(const std::string& text) : text_(text) {}
+
+        bool Parse(JsonValue& value) {
+            return ParseValue(value) && (SkipSpace(), pos_ == text_.size());
+        }
+
+    private:
+        const std::string& text_;
+        size_t pos_ = 0;
+
+        void SkipSpace() {
+            while (pos_ < text_.size() && (text_[pos_] == ' ' || text_[pos_] == '\n' || text_[pos_] == '\r' || text_[pos_] == '\t')) {
+                ++pos_;
+            }
+        }
+
+        bool Consume(char c) {
+            SkipSpace();
+            if (pos_ < text_.size() && text_[pos_] == c) {
+                ++pos_;
+                return true;
+            }
+            return false;
+        }
+
+        bool ParseString(std::string& out) {
+            if (!Consume('"')) {
+                return false;
+            }
+            while (pos_ < text_.size() && text_[pos_] != '"') {
+                char c = text_[pos_++];
+                if (c == '\\' && pos_ < text_.size()) {
+                    char escaped = text_[pos_++];
+                    switch (escaped) {
+                    case 'n': c = '\n'; break;
+                    case 't': c = '\t'; break;
+                    case 'u': c = '?'; pos_ += 4; break;  // Names and units are ASCII
+                    default: c = escaped; break;
+                    }
+                }
+                out.push_back(c);
+            }
+            return pos_++ < text_.size();
+        }
+
+        bool ParseValue(JsonValue& value) {
+            SkipSpace();
+            if (pos_ >= text_.size()) {
+                return false;
+            }
+            char c = text_[pos_];
+            if (c == '{') {
+                value.kind = JsonValue::Kind::Object;
+                ++pos_;
+                if (Consume('}')) {
+                    return true;
+                }
+                do {
+                    std::string name;
+                    JsonValue member;
+                    if (!ParseString(name) || !Consume(':') || !ParseValue(member)) {
+                        return false;
+                    }
+                    value.members[name] = std::move(member);
+                } while (Consume(','));
+                return Consume('}');
+            }
+            if (c == '[') {
+                value.kind = JsonValue::Kind::Array;
+                ++pos_;
+                if (Consume(']')) {
+                    return true;
+                }
+                do {
+                    value.items.emplace_back();
+                    if (!ParseValue(value.items.back())) {
+                        return false;
+                    }
+                } while (Consume(','));
+                return Consume(']');
+            }
+            if (c == '"') {
+                value.kind = JsonValue::Kind::String;
+                return ParseString(value.text);
+            }
+            for (const char* literal : { "true", "false", "null" }) {
+                std::string word(literal);
+                if (text_.compare(pos_, word.size(), word) == 0) {
+                    pos_ += word.size();
+                    value.kind = word == "null" ? JsonValue::Kind::Null : JsonValue::Kind::Bool;
+                    value.number = word == "true" ? 1 : 0;
+                    return true;
+                }
+            }
+            const char* start = text_.c_str() + pos_;
+            char* end = nullptr;
+            value.number = std::strtod(start, &end);
+            if (end == start) {
+                return false;
+            }
+            value.kind = JsonValue::Kind::Number;
+            pos_ += static_cast<size_t>(end - start);
+            return true;
+        }
+    };
+
+    struct Timing {
+        double nanoseconds = 0;
+        double cvPercent = 0;  // Spread of repeated runs; 0 without repetitions
+        bool median = false;
+    };
+
+    double ToNanoseconds(double time, const std::string& unit) {
+        if (unit == "us") {
+            return time * 1e3;
+        }
+        if (unit == "ms") {
+            return time * 1e6;
+        }
+        if (unit == "s") {
+            return time * 1e9;
+        }
+        return time;
+    }
+
+    // Real time per benchmark, preferring the median of repeated runs
+    bool LoadTimings(const char* path, std::map<std::string, Timing>& timings, std::string& date) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            return false;
+        }
+        std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        JsonValue root;
+        if (!JsonParser(text).Parse(root) || root.Find("benchmarks") == nullptr) {
+            return false;
+        }
+        if (const JsonValue* context = root.Find("context")) {
+            date = context->Text("date");
+        }
+
+        for (const auto& run : root.Find("benchmarks")->items) {
+            std::string name = run.Text("run_name");
+            if (name.empty()) {
+                name = run.Text("name");
+            }
+            std::string type = run.Text("run_type");
+            std::string aggregate = run.Text("aggregate_name");
+            bool median = type == "aggregate" && aggregate == "median";
+            if (type == "aggregate" && aggregate == "cv") {
+                // Reported as a fraction, whatever time_unit says
+                timings[name].cvPercent = run.Number("real_time") * 100;
+                continue;
+            }
+            if (type == "aggregate" && !median) {
+                continue;
+            }
+            Timing& timing = timings[name];
+            if (median || !timing.median) {
+                timing.nanoseconds = ToNanoseconds(run.Number("real_time"), run.Text("time_unit"));
+                timing.median = median;
+            }
+        }
+        return true;
+    }
+
+    // "<benchmark name prefix> <percent>" per line; blank lines and '#' comments are skipped
+    bool LoadThresholds(const char* path, std::map<std::string, double>& thresholds) {
+        std::ifstream in(path);
+        if (!in) {
+            return false;
+        }
+        std::string line;
+        while (std::getline(in, line)) {
+            size_t start = line.find_first_not_of(" \t\r");
+            if (start == std::string::npos || line[start] == '#') {
+                continue;
+            }
+            size_t end = line.find_first_of(" \t", start);
+            if (end == std::string::npos) {
+                return false;
+            }
+            thresholds[line.substr(start, end - start)] = std::atof(line.c_str() + end);
+        }
+        return true;
+    }
+
+    double ThresholdFor(const std::string& name, const std::map<std::string, double>& thresholds, double fallback) {
+        size_t longest = 0;
+        double threshold = fallback;
+        for (const auto& entry : thresholds) {
+            if (entry.first.size() >= longest && name.compare(0, entry.first.size(), entry.first) == 0) {
+                longest = entry.first.size();
+                threshold = entry.second;
+            }
+        }
+        return threshold;
+    }
+
+    bool CopyFileContents(const char* from, const char* to) {
+        std::ifstream in(from, std::ios::binary);
+        std::ofstream out(to, std::ios::binary | std::ios::trunc);
+        return in && out && (out << in.rdbuf()) && out.flush();
+    }
+
+    std::string FormatTime(double nanoseconds) {
+        char text[32];
+        if (nanoseconds >= 1e9) {
+            snprintf(text, sizeof(text), "%.2f s", nanoseconds / 1e9);
+        }
+        else if (nanoseconds >= 1e6) {
+            snprintf(text, sizeof(text), "%.2f ms", nanoseconds / 1e6);
+        }
+        else if (nanoseconds >= 1e3) {
+            snprintf(text, sizeof(text), "%.2f us", nanoseconds / 1e3);
+        }
+        else {
+            snprintf(text, sizeof(text), "%.1f ns", nanoseconds);
+        }
+        return text;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <baseline.json> <results.json> [--threshold <percent>] [--thresholds <file>] "
+            "[--noise <factor>] [--history <file.csv>] [--bootstrap]\n", argv[0]);
+        return 2;
+    }
+
+    double threshold = 10;
+    double noise = 2;
+    std::map<std::string, double> thresholds;
+    const char* historyPath = nullptr;
+    bool bootstrap = false;
+    for (int i = 3; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "--bootstrap") {
+            bootstrap = true;
+        }
+        else if (i + 1 >= argc) {
+            break;
+        }
+        else if (option == "--threshold") {
+            threshold = std::atof(argv[++i]);
+        }
+        else if (option == "--noise") {
+            noise = std::atof(argv[++i]);
+        }
+        else if (option == "--thresholds") {
+            if (!LoadThresholds(argv[++i], thresholds)) {
+                fprintf(stderr, "Cannot read thresholds %s\n", argv[i]);
+                return 2;
+            }
+        }
+        else if (option == "--history") {
+            historyPath = argv[++i];
+        }
+    }
+
+    std::map<std::string, Timing> baseline;
+    std::map<std::string, Timing> results;
+    std::string baselineDate;
+    std::string date;
+    if (bootstrap && !std::ifstream(argv[1]).good()) {
+        // First run on this machine: the results are the reference for the next ones
+        if (!LoadTimings(argv[2], results, date) || !CopyFileContents(argv[2], argv[1])) {
+            fprintf(stderr, "Cannot record %s as the baseline %s\n", argv[2], argv[1]);
+            return 2;
+        }
+        printf("No baseline yet; recorded %zu benchmark(s) from this run as %s\n", results.size(), argv[1]);
+        return 0;
+    }
+    if (!LoadTimings(argv[1], baseline, baselineDate)) {
+        fprintf(stderr, "Cannot read baseline %s\n", argv[1]);
+        return 2;
+    }
+    if (!LoadTimings(argv[2], results, date)) {
+        fprintf(stderr, "Cannot read results %s\n", argv[2]);
+        return 2;
+    }
+
+    std::unique_ptr<std::ofstream> history;
+    if (historyPath != nullptr) {
+        bool exists = std::ifstream(historyPath).good();
+        history.reset(new std::ofstream(historyPath, std::ios::app));
+        if (!exists) {
+            *history << "date,benchmark,real_time_ns,baseline_ns,change_percent\n";
+        }
+    }
+
+    printf("%-52s %12s %12s %9s %9s\n", "Benchmark", "Baseline", "Now", "Change", "Allowed");
+    size_t regressions = 0;
+    for (const auto& result : results) {
+        auto base = baseline.find(result.first);
+        if (base == baseline.end() || base->second.nanoseconds <= 0) {
+            printf("%-52s %12s %12s %9s\n", result.first.c_str(), "-", FormatTime(result.second.nanoseconds).c_str(), "new");
+            continue;
+        }
+
+        double change = (result.second.nanoseconds / base->second.nanoseconds - 1) * 100;
+        double allowed = ThresholdFor(result.first, thresholds, threshold) +
+            noise * std::max(base->second.cvPercent, result.second.cvPercent);
+        bool regressed = change > allowed;
+        regressions += regressed ? 1 : 0;
+        printf("%-52s %12s %12s %+8.1f%% %8.1f%%%s\n", result.first.c_str(), FormatTime(base->second.nanoseconds).c_str(),
+            FormatTime(result.second.nanoseconds).c_str(), change, allowed, regressed ? "  REGRESSED" : "");
+        if (history) {
+            *history << date << ',' << result.first << ',' << result.second.nanoseconds << ','
+                << base->second.nanoseconds << ',' << change << '\n';
+        }
+    }
+    for (const auto& base : baseline) {
+        if (results.count(base.first) == 0) {
+            printf("%-52s %12s %12s %9s\n", base.first.c_str(), FormatTime(base.second.nanoseconds).c_str(), "-", "missing");
+        }
+    }
+
+    if (regressions != 0) {
+        printf("%zu benchmark(s) slower than the baseline (%s) by more than allowed\n", regressions, baselineDate.c_str());
+        return 1;
+    }
+    printf("No benchmark slower than the baseline (%s) by more than allowed\n", baselineDate.c_str());
+    return 0;
+}
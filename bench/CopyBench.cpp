@@ -0,0 +1,166 @@
+#include <benchmark/benchmark.h>
+
+#include <map>
+#include "CopyBuildFolder/CopyEngine.h"
+#include "CopyBuildFolder/PayloadInstall.h"
+#include "TestSupport.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+    const size_t kFileSize = 8 * 1024;
+
+    // Theme-like trees of small files, one per file count, shared by the benchmarks and
+    // deleted at exit
+    const fs::path& SourceTree(size_t files) {
+        static TempDirectory temp;
+        static std::map<size_t, fs::path> trees;
+        auto it = trees.find(files);
+        if (it == trees.end()) {
+            fs::path root = temp.Path() / ("source" + std::to_string(files));
+            MakeTree(root, files, files / 50, kFileSize);
+            it = trees.emplace(files, root).first;
+        }
+        return it->second;
+    }
+
+    // SFX image whose build/ folder holds the same kind of theme as SourceTree, deflated
+    const Bytes& InstallerImage(size_t files) {
+        static std::map<size_t, Bytes> images;
+        auto it = images.find(files);
+        if (it == images.end()) {
+            ZipBuilder zip;
+            zip.AddFile("NewTabSetup.msi", MakeContent(256 * 1024, 0x4D5349), 8);
+            for (size_t i = 0; i < files; ++i) {
+                zip.AddFile("build/dir" + std::to_string(i % (files / 50)) + "/file" + std::to_string(i) + ".js",
+                    MakeContent(kFileSize, static_cast<uint32_t>(i)), 8);
+            }
+            Bytes image = MakePeImage(true, 64 * 1024);
+            Append(image, zip.Build());
+            it = images.emplace(files, std::move(image)).first;
+        }
+        return it->second;
+    }
+
+    // Copies the tree into a fresh destination each iteration, timing only the copy
+    template <typename Copy>
+    void RunCopy(benchmark::State& state, Copy copy) {
+        const size_t files = static_cast<size_t>(state.range(0));
+        const fs::path& source = SourceTree(files);
+        TempDirectory temp;
+
+        size_t run = 0;
+        for (auto _ : state) {
+            fs::path destination = temp.Path() / ("destination" + std::to_string(run++));
+            if (!copy(source, destination)) {
+                state.SkipWithError("copy failed");
+            }
+
+            state.PauseTiming();
+            fs::remove_all(destination);
+            state.ResumeTiming();
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * files));
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * files * kFileSize));
+    }
+}
+
+static void BM_CopyTree(benchmark::State& state) {
+    RunCopy(state, [](const fs::path& source, const fs::path& destination) {
+        CopyStats stats;
+        return CopyTree(source, destination, CopyOptions(), stats);
+    });
+}
+BENCHMARK(BM_CopyTree)->Arg(1000)->Arg(10000)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// A plain recursive std::filesystem::copy of the same tree, the baseline CopyTree has to beat
+static void BM_FilesystemCopy(benchmark::State& state) {
+    RunCopy(state, [](const fs::path& source, const fs::path& destination) {
+        std::error_code error;
+        fs::copy(source, destination, fs::copy_options::recursive | fs::copy_options::overwrite_existing, error);
+        return !error;
+    });
+}
+BENCHMARK(BM_FilesystemCopy)->Arg(1000)->Arg(10000)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Upgrade of an installed 2000-file tree where the argument is the percentage of files that
+// changed; with incremental copying the time should follow the change, not the tree
+static void BM_CopyTreeIncremental(benchmark::State& state) {
+    const size_t files = 2000;
+    const size_t directories = files / 50;
+    const size_t percent = static_cast<size_t>(state.range(0));
+    TempDirectory temp;
+    fs::path source = temp.Path() / "source";
+    fs::path destination = temp.Path() / "destination";
+    MakeTree(source, files, directories, kFileSize);
+
+    CopyOptions options;
+    options.incremental = true;
+    CopyStats initial;
+    CopyTree(source, destination, options, initial);
+
+    uint32_t version = 0;
+    size_t changed = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        ++version;
+        for (size_t i = 0; i < files * percent / 100; ++i) {
+            // A different size each version, so the change shows whatever the timestamp resolution
+            WriteFile(source / ("dir" + std::to_string(i % directories)) / ("file" + std::to_string(i) + ".js"),
+                MakeContent(kFileSize + version % 2, version));
+            ++changed;
+        }
+        state.ResumeTiming();
+
+        CopyStats stats;
+        if (!CopyTree(source, destination, options, stats)) {
+            state.SkipWithError("copy failed");
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * files));
+    state.counters["changed_per_run"] = benchmark::Counter(static_cast<double>(changed), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_CopyTreeIncremental)->Arg(0)->Arg(5)->Arg(100)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Installing the theme of an SFX payload. The direct install decodes each entry into place; the
+// staged install it replaced extracts the theme to a temporary folder and copies it from there.
+// bytes_written is the disk traffic each one causes per run.
+template <typename Install>
+void RunPayloadInstall(benchmark::State& state, Install install) {
+    const size_t files = static_cast<size_t>(state.range(0));
+    const Bytes& image = InstallerImage(files);
+    TempDirectory temp;
+
+    size_t run = 0;
+    uint64_t written = 0;
+    for (auto _ : state) {
+        fs::path root = temp.Path() / ("run" + std::to_string(run++));
+        CopyStats stats;
+        if (!install(image, root, stats)) {
+            state.SkipWithError("install failed");
+        }
+        written += stats.bytesWritten;
+
+        state.PauseTiming();
+        fs::remove_all(root);
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * files));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * files * kFileSize));
+    state.counters["bytes_written"] = benchmark::Counter(static_cast<double>(written), benchmark::Counter::kAvgIterations);
+}
+
+static void BM_InstallFromPayload(benchmark::State& state) {
+    RunPayloadInstall(state, [](const Bytes& image, const fs::path& root, CopyStats& stats) {
+        return InstallFromPayload(image.data(), image.size(), "build/", root / "build", CopyOptions(), stats);
+    });
+}
+BENCHMARK(BM_InstallFromPayload)->Arg(1000)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_StagedInstall(benchmark::State& state) {
+    RunPayloadInstall(state, [](const Bytes& image, const fs::path& root, CopyStats& stats) {
+        return InstallFromPayload(image.data(), image.size(), "build/", root / "staging", CopyOptions(), stats) &&
+            CopyTree(root / "staging", root / "build", CopyOptions(), stats);
+    });
+}
+BENCHMARK(BM_StagedInstall)->Arg(1000)->Unit(benchmark::kMillisecond)->UseRealTime();
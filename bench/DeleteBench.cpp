@@ -0,0 +1,44 @@
+#include <benchmark/benchmark.h>
+
+#include "CopyBuildFolder/DeleteEngine.h"
+#include "TestSupport.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+    // Builds a fresh tree before each iteration, outside the timing, and times `remove` on it
+    template <typename Remove>
+    void RunRemove(benchmark::State& state, Remove remove) {
+        const size_t files = static_cast<size_t>(state.range(0));
+        TempDirectory temp;
+        fs::path root = temp.Path() / "build";
+        for (auto _ : state) {
+            state.PauseTiming();
+            MakeTree(root, files, files / 50, 64);
+            state.ResumeTiming();
+
+            if (!remove(root)) {
+                state.SkipWithError("removal failed");
+            }
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * files));
+    }
+}
+
+static void BM_RemoveTree(benchmark::State& state) {
+    RunRemove(state, [](const fs::path& root) {
+        StdRemoveBackend backend;
+        return RemoveTree(root, backend, RemoveOptions()).Complete();
+    });
+}
+BENCHMARK(BM_RemoveTree)->Arg(20000)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// The single remove_all call DeleteBuildFolder used before RemoveTree
+static void BM_RemoveAll(benchmark::State& state) {
+    RunRemove(state, [](const fs::path& root) {
+        std::error_code error;
+        fs::remove_all(root, error);
+        return !error;
+    });
+}
+BENCHMARK(BM_RemoveAll)->Arg(20000)->Unit(benchmark::kMillisecond)->UseRealTime();
@@ -0,0 +1,161 @@
+#include <benchmark/benchmark.h>
+
+#include <zlib.h>
+#include "Fakes.h"
+#include "SFX/Crc32.h"
+#include "SFX/ParallelExtract.h"
+#include "SFX/ZipReader.h"
+#include "TestSupport.h"
+
+namespace {
+    // Theme-like payload: a few hundred deflated scripts and styles plus stored photos
+    struct ThemePayload {
+        Bytes image;
+        std::vector<ZipEntry> entries;
+        uint64_t bytes = 0;
+    };
+
+    const ThemePayload& Theme() {
+        static ThemePayload theme = [] {
+            ThemePayload payload;
+            ZipBuilder zip;
+            for (int i = 0; i < 400; ++i) {
+                Bytes data = MakeContent(4 * 1024 + (i % 7) * 8 * 1024, i);
+                payload.bytes += data.size();
+                zip.AddFile("build/static/file" + std::to_string(i) + ".js", data, 8);
+            }
+            for (int i = 0; i < 20; ++i) {
+                Bytes photo = MakeNoise(256 * 1024, i);
+                payload.bytes += photo.size();
+                zip.AddFile("store_photos/photo" + std::to_string(i) + ".jpg", photo, 0);
+            }
+            payload.image = MakePeImage(true, 64 * 1024);
+            Append(payload.image, zip.Build());
+
+            PayloadLocation location;
+            LocateZipPayload(payload.image.data(), payload.image.size(), location);
+            ReadZipEntries(payload.image.data(), payload.image.size(), location, payload.entries);
+            return payload;
+        }();
+        return theme;
+    }
+
+    const Bytes& ScriptData() {
+        static Bytes data = MakeContent(4 * 1024 * 1024, 42);
+        return data;
+    }
+}
+
+// The CRC-32 every extracted entry is checked with; the argument is the buffer size, as entries
+// range from small scripts to photos of several megabytes
+static void BM_Crc32(benchmark::State& state) {
+    size_t size = static_cast<size_t>(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(UpdateCrc32(0, ScriptData().data(), size));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * size));
+}
+BENCHMARK(BM_Crc32)->Arg(256)->Arg(64 * 1024)->Arg(4 * 1024 * 1024);
+
+// zlib's crc32 on the same buffers, as the reference
+static void BM_ZlibCrc32(benchmark::State& state) {
+    size_t size = static_cast<size_t>(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(crc32(0, ScriptData().data(), static_cast<uInt>(size)));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * size));
+}
+BENCHMARK(BM_ZlibCrc32)->Arg(256)->Arg(64 * 1024)->Arg(4 * 1024 * 1024);
+
+static void BM_InflateRaw(benchmark::State& state) {
+    Bytes stream = DeflateRaw(ScriptData());
+    for (auto _ : state) {
+        NullSink sink;
+        benchmark::DoNotOptimize(InflateRaw(stream.data(), stream.size(), sink));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * ScriptData().size()));
+}
+BENCHMARK(BM_InflateRaw)->Unit(benchmark::kMillisecond);
+
+// zlib on the same stream, as the reference the stub's inflater is measured against
+static void BM_ZlibInflate(benchmark::State& state) {
+    Bytes stream = DeflateRaw(ScriptData());
+    Bytes window(64 * 1024);
+    for (auto _ : state) {
+        z_stream z = {};
+        inflateInit2(&z, -15);
+        z.next_in = stream.data();
+        z.avail_in = static_cast<uInt>(stream.size());
+        int status;
+        do {
+            z.next_out = window.data();
+            z.avail_out = static_cast<uInt>(window.size());
+            status = inflate(&z, Z_NO_FLUSH);
+        } while (status == Z_OK);
+        inflateEnd(&z);
+        benchmark::DoNotOptimize(status);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * ScriptData().size()));
+}
+BENCHMARK(BM_ZlibInflate)->Unit(benchmark::kMillisecond);
+
+// Reads the central directory and decodes every entry, one after another
+static void BM_ExtractArchive(benchmark::State& state) {
+    const ThemePayload& theme = Theme();
+    for (auto _ : state) {
+        PayloadLocation location;
+        std::vector<ZipEntry> entries;
+        LocateZipPayload(theme.image.data(), theme.image.size(), location);
+        ReadZipEntries(theme.image.data(), theme.image.size(), location, entries);
+        for (const auto& entry : entries) {
+            NullSink sink;
+            if (!ExtractZipEntry(theme.image.data(), theme.image.size(), entry, sink)) {
+                state.SkipWithError("entry failed to extract");
+            }
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * theme.entries.size()));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * theme.bytes));
+}
+BENCHMARK(BM_ExtractArchive)->Unit(benchmark::kMillisecond);
+
+// The same archive through the work-stealing pool; the argument is the thread cap (0 = hardware
+// thread count), so the 1-thread run shows what the pool costs over the loop above
+static void BM_ExtractParallel(benchmark::State& state) {
+    const ThemePayload& theme = Theme();
+    ExtractionOptions options;
+    options.maxThreads = static_cast<unsigned>(state.range(0));
+    for (auto _ : state) {
+        MemoryExtractionTarget target;
+        target.keepContents = false;
+        if (!ExtractEntriesParallel(theme.image.data(), theme.image.size(), theme.entries, target, options)) {
+            state.SkipWithError("extraction failed");
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * theme.entries.size()));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * theme.bytes));
+}
+BENCHMARK(BM_ExtractParallel)->Arg(1)->Arg(2)->Arg(4)->Arg(0)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// A rerun after an interrupted extraction that had already written every file: each entry is
+// verified by size and CRC-32 instead of being decoded again
+static void BM_ExtractResume(benchmark::State& state) {
+    const ThemePayload& theme = Theme();
+    MemoryExtractionTarget target;
+    if (!ExtractEntriesParallel(theme.image.data(), theme.image.size(), theme.entries, target, ExtractionOptions())) {
+        state.SkipWithError("extraction failed");
+    }
+    target.verifyContents = true;
+    ExtractionOptions options;
+    options.resume = true;
+    for (auto _ : state) {
+        target.writes = 0;
+        if (!ExtractEntriesParallel(theme.image.data(), theme.image.size(), theme.entries, target, options) ||
+            target.writes != 0) {
+            state.SkipWithError("resume rewrote entries");
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * theme.entries.size()));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * theme.bytes));
+}
+BENCHMARK(BM_ExtractResume)->Unit(benchmark::kMillisecond)->UseRealTime();
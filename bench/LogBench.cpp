@@ -0,0 +1,89 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include "Common/ActionLog.h"
+#include "Common/Trace.h"
+#include "Fakes.h"
+
+// Cost a caller pays per logged line: formatting into the ring, with the sink behind the
+// writer thread taking batches no larger than the MSI log accepts
+static void BM_ActionLogLine(benchmark::State& state) {
+    MemoryLogSink sink;
+    sink.keepLines = false;
+    sink.maxBatch = kMsiLogBatch;
+    ActionLog log(sink, LogLevel::Verbose);
+    size_t i = 0;
+    for (auto _ : state) {
+        log.Log(LogLevel::Verbose, "Copied C:\\Program Files\\New Tab\\build\\static\\js\\%zu.chunk.js (%zu bytes)", i, i * 7);
+        ++i;
+    }
+    log.Flush();
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_ActionLogLine);
+
+// A Verbose line when the threshold is Standard, which is how most installs run
+static void BM_ActionLogFiltered(benchmark::State& state) {
+    MemoryLogSink sink;
+    ActionLog log(sink, LogLevel::Standard);
+    size_t i = 0;
+    for (auto _ : state) {
+        log.Log(LogLevel::Verbose, "Copied C:\\Program Files\\New Tab\\build\\static\\js\\%zu.chunk.js (%zu bytes)", i, i * 7);
+        ++i;
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_ActionLogFiltered);
+
+// The same line formatted and handed to the sink synchronously, one call per line, as the
+// custom actions logged before ActionLog
+static void BM_SynchronousLogLine(benchmark::State& state) {
+    MemoryLogSink sink;
+    sink.keepLines = false;
+    char line[500];
+    size_t i = 0;
+    for (auto _ : state) {
+        int length = snprintf(line, sizeof(line), "Copied C:\\Program Files\\New Tab\\build\\static\\js\\%zu.chunk.js (%zu bytes)", i, i * 7);
+        sink.Write(line, static_cast<size_t>(length));
+        ++i;
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_SynchronousLogLine);
+
+// A phase span while tracing is off, as every install runs without /trace
+static void BM_TraceSpanDisabled(benchmark::State& state) {
+    for (auto _ : state) {
+        TraceSpan span("profile");
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_TraceSpanDisabled);
+
+// The same span recorded, as with /trace
+static void BM_TraceSpanEnabled(benchmark::State& state) {
+    TraceRecorder recorder("BrowserUpdater", 1);
+    SetActiveTrace(&recorder);
+    for (auto _ : state) {
+        TraceSpan span("profile");
+    }
+    SetActiveTrace(nullptr);
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_TraceSpanEnabled);
+
+// Writing the timeline of a fan-out over 500 profiles at the end of a custom action
+static void BM_ChromeTraceJson(benchmark::State& state) {
+    TraceRecorder recorder("BrowserUpdater", 1);
+    for (uint32_t i = 0; i < 2000; ++i) {
+        recorder.Record({ i % 4 == 0 ? "profile" : "registry", 'X', i % 8 + 1, 1700000000000000u + i * 100, 90, 0 });
+    }
+    size_t bytes = 0;
+    for (auto _ : state) {
+        bytes = recorder.ToChromeTrace().size();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * 2000));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+}
+BENCHMARK(BM_ChromeTraceJson)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,117 @@
+#include <benchmark/benchmark.h>
+
+#include "BatchPacker.h"
+#include "PackerInputs.h"
+
+namespace {
+    // One MSI and 24 themes of 200 scripts each, written once and shared by the benchmarks
+    struct BatchInputs {
+        PackerInputs inputs{ 8 * 1024 * 1024 };
+        std::vector<BatchItem> items;
+        std::string certificate;
+
+        BatchInputs() {
+            for (uint32_t i = 0; i < 24; ++i) {
+                std::string name = "theme" + std::to_string(i);
+                items.push_back({ inputs.Theme(name + ".zip", 200, i * 1000), inputs.Path(name + ".exe") });
+            }
+            certificate = inputs.Certificate("signer.p12", "bench");
+        }
+    };
+
+    BatchInputs& Batch() {
+        static BatchInputs batch;
+        return batch;
+    }
+}
+
+// Installers per second from one batch; the argument is the worker count (0 = hardware threads)
+static void BM_PackBatch(benchmark::State& state) {
+    BatchInputs& batch = Batch();
+    MsiOptions msiOptions;
+    msiOptions.codec.level = 6;
+    PackShared shared;
+    std::string error;
+    if (!shared.Load(batch.inputs.stub, "", batch.inputs.msi, msiOptions, error)) {
+        state.SkipWithError(error.c_str());
+        return;
+    }
+
+    BatchOptions options;
+    options.workers = static_cast<unsigned>(state.range(0));
+    uint64_t bytes = 0;
+    for (auto _ : state) {
+        for (const auto& result : PackBatch(shared, batch.items, options)) {
+            if (!result.success) {
+                state.SkipWithError(result.error.c_str());
+            }
+            bytes += result.stats.outputSize;
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * batch.items.size()));
+    state.SetBytesProcessed(static_cast<int64_t>(bytes));
+}
+BENCHMARK(BM_PackBatch)->Arg(1)->Arg(4)->Arg(0)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Obtaining the MSI block for a run: deflating the MSI (argument 0) or mapping the block a
+// previous run left in the cache (argument 1)
+static void BM_LoadMsiBlock(benchmark::State& state) {
+    BatchInputs& batch = Batch();
+    const bool cached = state.range(0) != 0;
+    MsiOptions options;
+    options.cacheDir = cached ? batch.inputs.Path("cache") : std::string();
+    std::string error;
+    if (cached) {
+        PackShared warm;
+        warm.Load(batch.inputs.stub, "", batch.inputs.msi, options, error);
+    }
+
+    for (auto _ : state) {
+        PackShared shared;
+        if (!shared.Load(batch.inputs.stub, "", batch.inputs.msi, options, error)) {
+            state.SkipWithError(error.c_str());
+        }
+        benchmark::DoNotOptimize(shared.Msi().data);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * batch.inputs.msiContent.size()));
+}
+BENCHMARK(BM_LoadMsiBlock)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+// One installer written unsigned (argument 0) or signed as it is written (argument 1), so the
+// difference is what hashing the stream, the signature and the header patch cost
+static void BM_PackSigned(benchmark::State& state) {
+    BatchInputs& batch = Batch();
+    MsiOptions msiOptions;
+    msiOptions.codec.level = 6;
+    PackShared shared;
+    std::string error;
+    if (!shared.Load(batch.inputs.stub, "", batch.inputs.msi, msiOptions, error)) {
+        state.SkipWithError(error.c_str());
+        return;
+    }
+    if (state.range(0) != 0) {
+        SigningOptions signing;
+        signing.pkcs12Path = batch.certificate;
+        signing.password = "bench";
+        if (!shared.LoadSigner(signing, error)) {
+            state.SkipWithError(error.c_str());
+            return;
+        }
+    }
+    ThemeInput theme;
+    if (!theme.Open(batch.items[0].themePath, ThemeOptions(), error)) {
+        state.SkipWithError(error.c_str());
+        return;
+    }
+
+    uint64_t bytes = 0;
+    for (auto _ : state) {
+        PackStats stats;
+        if (!WriteInstaller(shared, theme, batch.items[0].outputPath, stats, error)) {
+            state.SkipWithError(error.c_str());
+        }
+        bytes += stats.outputSize;
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(bytes));
+}
+BENCHMARK(BM_PackSigned)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
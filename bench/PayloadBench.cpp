@@ -0,0 +1,82 @@
+#include <benchmark/benchmark.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fstream>
+#include "SFX/PayloadLocator.h"
+#include "TestSupport.h"
+
+namespace {
+    // SFX image of `size` bytes: a stub, then a theme archive holding mostly one large entry
+    Bytes MakeSfxImage(size_t size) {
+        Bytes image = MakePeImage(true, 64 * 1024);
+        ZipBuilder zip;
+        for (int i = 0; i < 200; ++i) {
+            zip.AddFile("build/asset" + std::to_string(i) + ".js", MakeContent(512, i), 0);
+        }
+        size_t used = image.size() + 200 * 600 + 64 * 1024;
+        zip.AddFile("store_photos/photo.jpg", Bytes(size > used ? size - used : 0, 0x5A), 0);
+        Append(image, zip.Build());
+        return image;
+    }
+
+    // The same layout written as a sparse file, so a 1 GB image costs neither memory nor disk:
+    // the stub, a hole standing in for the photo data, then the central directory and end record
+    void WriteSparseSfxImage(const std::filesystem::path& path, uint64_t size) {
+        Bytes stub = MakePeImage(true, 64 * 1024);
+        Bytes photo(4096, 0x5A);
+        ZipBuilder zip;
+        zip.AddFile("store_photos/photo.jpg", photo, 0);
+        Bytes archive = zip.Build();
+
+        // Locating reads only the directory and end record; the hole just moves where the
+        // archive appears to start
+        size_t tail = archive.size() - (30 + 22 + photo.size());
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(stub.data()), static_cast<std::streamsize>(stub.size()));
+        out.write(reinterpret_cast<const char*>(archive.data()), 30 + 22 + static_cast<std::streamsize>(photo.size()));
+        out.seekp(static_cast<std::streamoff>(size - tail));
+        out.write(reinterpret_cast<const char*>(archive.data() + archive.size() - tail), static_cast<std::streamsize>(tail));
+    }
+}
+
+static void BM_LocateZipPayload(benchmark::State& state) {
+    Bytes image = MakeSfxImage(static_cast<size_t>(state.range(0)) << 20);
+    for (auto _ : state) {
+        PayloadLocation location;
+        bool found = LocateZipPayload(image.data(), image.size(), location);
+        benchmark::DoNotOptimize(found);
+        benchmark::DoNotOptimize(location);
+    }
+}
+BENCHMARK(BM_LocateZipPayload)->Arg(10)->Unit(benchmark::kMicrosecond);
+
+// What a launch pays: open and map the image, locate the payload, unmap. The cost should not
+// grow with the image, as only the headers and the tail are touched.
+static void BM_MapAndLocatePayload(benchmark::State& state) {
+    TempDirectory temp;
+    std::filesystem::path path = temp.Path() / "theme.exe";
+    WriteSparseSfxImage(path, static_cast<uint64_t>(state.range(0)) << 20);
+
+    for (auto _ : state) {
+        int file = open(path.c_str(), O_RDONLY);
+        struct stat info;
+        fstat(file, &info);
+        size_t size = static_cast<size_t>(info.st_size);
+        void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+        close(file);
+        if (view == MAP_FAILED) {
+            state.SkipWithError("mmap failed");
+            break;
+        }
+
+        PayloadLocation location;
+        if (!LocateZipPayload(static_cast<const unsigned char*>(view), size, location)) {
+            state.SkipWithError("payload not found");
+        }
+        munmap(view, size);
+    }
+}
+BENCHMARK(BM_MapAndLocatePayload)->Arg(10)->Arg(100)->Arg(1024)->Unit(benchmark::kMicrosecond);
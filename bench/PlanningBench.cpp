@@ -0,0 +1,96 @@
+#include <benchmark/benchmark.h>
+
+#include "BrowserUpdater/BrowserCatalog.h"
+#include "BrowserUpdater/CommandLineRewriter.h"
+#include "Fakes.h"
+#include "TestSupport.h"
+
+namespace {
+    const wchar_t* const kTargets[] = {
+        L"C:\\Program Files\\Google\\Chrome\\Application\\chrome.exe",
+        L"C:\\Program Files (x86)\\Microsoft\\Edge\\Application\\msedge.exe",
+        L"C:\\Program Files\\BraveSoftware\\Brave-Browser\\Application\\brave.exe",
+        L"C:\\Windows\\System32\\notepad.exe"
+    };
+}
+
+// Discovery over a fake folder of shortcuts, a quarter of which point at other programs
+static void BM_ShortcutIndexBuild(benchmark::State& state) {
+    const size_t count = static_cast<size_t>(state.range(0));
+    const std::wstring folder = L"C:\\ProgramData\\Microsoft\\Windows\\Start Menu\\Programs";
+    MemoryShortcutFileSystem files;
+    for (size_t i = 0; i < count; ++i) {
+        files.AddShortcut(folder, L"Shortcut" + std::to_wstring(i) + L".lnk",
+            MakeShortcut(kTargets[i % 4], i % 2 == 0 ? ShortcutEncoding::Unicode : ShortcutEncoding::Ansi), i % 3 == 0);
+    }
+    std::vector<ShortcutFolder> folders = { { ShortcutLocation::CommonStartMenu, folder, true } };
+
+    for (auto _ : state) {
+        ShortcutIndex index;
+        index.Build(files, folders);
+        benchmark::DoNotOptimize(index.Shortcuts().data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+}
+BENCHMARK(BM_ShortcutIndexBuild)->Arg(100)->Arg(5000)->Unit(benchmark::kMicrosecond);
+
+// Prepares and commits the install edit for every catalog key against an in-memory registry
+static void BM_RegistryTransactionCatalog(benchmark::State& state) {
+    const CommandLineEdit edits[] = {
+        { CommandLineEditKind::RemoveFlag, L"--single-argument", nullptr },
+        { CommandLineEditKind::SetFlag, L"--load-extension", L"C:\\Program Files\\New Tab Theme\\build" }
+    };
+    auto transform = [&](const std::wstring& current, std::wstring& updated) {
+        updated.resize(CommandLineRewriteBound(current.size(), edits, 2));
+        size_t length = 0;
+        if (!RewriteCommandLine(current.c_str(), current.size(), edits, 2, &updated[0], updated.size(), length)) {
+            return false;
+        }
+        updated.resize(length);
+        return true;
+    };
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        MemoryRegistry registry;
+        for (const auto& key : kBrowserCommandKeys) {
+            registry.values[{ RegistryRoot::ClassesRoot, key.subKey }] = L"\"C:\\browser.exe\" --single-argument %1";
+        }
+        state.ResumeTiming();
+
+        RegistryTransaction transaction(registry);
+        for (const auto& key : kBrowserCommandKeys) {
+            transaction.Add(RegistryRoot::ClassesRoot, key.subKey);
+        }
+        transaction.Prepare(transform);
+        benchmark::DoNotOptimize(transaction.Commit());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * kBrowserCommandKeys.size()));
+}
+BENCHMARK(BM_RegistryTransactionCatalog)->Unit(benchmark::kMicrosecond);
+
+// A repair (argument 0) and an install (argument 1) through CheckSearchPolicy and the deferred
+// refresh, with gpupdate stood in for by a 5 ms process: the repair finds the values in place
+// and skips it
+static void BM_SearchPolicyRefresh(benchmark::State& state) {
+    const bool install = state.range(0) != 0;
+    ScriptedProcessRunner runner;
+    runner.result.outcome = ProcessOutcome::Exited;
+    runner.delayMilliseconds = 5;
+    PolicyRefreshOptions options;
+    options.systemDirectory = L"C:\\Windows\\system32";
+
+    for (auto _ : state) {
+        MemoryPolicyReader reader;
+        if (!install) {
+            reader.Write(kSearchPolicyValues, kSearchPolicyValueCount);
+        }
+        PolicyComparison comparison = ComparePolicyValues(reader, kSearchPolicyValues, kSearchPolicyValueCount, true);
+        PolicyUpdateData data;
+        ParsePolicyUpdateData(std::wstring(PolicyChangeState(comparison)) + L";", data);
+        reader.Write(kSearchPolicyValues, kSearchPolicyValueCount);
+        benchmark::DoNotOptimize(RefreshSearchPolicy(data.policyChanged, runner, options).outcome);
+    }
+    state.counters["refreshes"] = static_cast<double>(runner.runs) / static_cast<double>(state.iterations());
+}
+BENCHMARK(BM_SearchPolicyRefresh)->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond)->UseRealTime();
@@ -0,0 +1,70 @@
+#include <benchmark/benchmark.h>
+
+#include "BrowserUpdater/BrowserCatalog.h"
+#include "BrowserUpdater/CommandLineRewriter.h"
+#include "BrowserUpdater/ProfileFanOut.h"
+#include "Fakes.h"
+
+namespace {
+    const size_t kProfiles = 500;
+
+    // A terminal server's worth of profiles, most of them logged off, on a store whose calls
+    // wait like registry round trips
+    void AddProfiles(MemoryProfileStore& store, MemoryRegistry& registry) {
+        store.latencyMicroseconds = 20;
+        for (size_t i = 0; i < kProfiles; ++i) {
+            std::wstring sid = L"S-1-5-21-" + std::to_wstring(1000 + i);
+            store.directories.push_back({ sid, L"C:\\Users\\user" + std::to_wstring(i) });
+            if (i % 10 == 0) {
+                store.loadedHives.insert(sid);
+            }
+            if (i % 3 == 0) {
+                store.shellFolders[{ sid, L"Desktop" }] = L"%USERPROFILE%\\OneDrive\\Desktop";
+            }
+            for (const auto& key : kBrowserCommandKeys) {
+                registry.values[{ RegistryRoot::Users, UserClassesKey(sid, key.subKey) }] = L"\"C:\\browser.exe\" \"%1\"";
+            }
+        }
+    }
+}
+
+// One direction of the extension change over 500 profiles: each is opened, loading its hive
+// and resolving its shell folders, and its command keys are rewritten as one batch. The
+// argument is the worker count; iterations alternate install and uninstall so every run writes.
+static void BM_FanOutProfiles(benchmark::State& state) {
+    MemoryProfileStore store;
+    MemoryRegistry registry;
+    AddProfiles(store, registry);
+    std::vector<UserProfile> profiles = EnumerateProfiles(store);
+    CommandLineEditKind kind = CommandLineEditKind::SetFlag;
+
+    for (auto _ : state) {
+        const CommandLineEdit edits[] = { { kind, L"--load-extension", L"C:\\Program Files\\New Tab Theme\\build" } };
+        auto transform = [&edits](const std::wstring& current, std::wstring& updated) {
+            updated.resize(CommandLineRewriteBound(current.size(), edits, 1));
+            size_t length = 0;
+            if (!RewriteCommandLine(current.c_str(), current.size(), edits, 1, &updated[0], updated.size(), length)) {
+                return false;
+            }
+            updated.resize(length);
+            return true;
+        };
+        std::vector<ProfileSummary> summaries = FanOutProfiles(profiles, [&](const UserProfile& profile, ProfileSummary& summary) {
+            OpenedProfile opened = OpenProfile(store, profile);
+            benchmark::DoNotOptimize(opened.shortcutFolders.data());
+            if (opened.registryReachable) {
+                RegistryTransaction transaction(registry);
+                AddBrowserCommandKeys(transaction, &profile);
+                transaction.Prepare(transform);
+                CountRegistryChanges(transaction.Changes(), transaction.Commit(), summary);
+            }
+        }, static_cast<unsigned>(state.range(0)));
+        if (summaries.back().keysWritten == 0) {
+            state.SkipWithError("profile was not rewritten");
+        }
+        kind = kind == CommandLineEditKind::SetFlag ? CommandLineEditKind::RemoveFlag : CommandLineEditKind::SetFlag;
+    }
+    state.counters["hive_loads"] = static_cast<double>(store.loads) / static_cast<double>(state.iterations());
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * profiles.size()));
+}
+BENCHMARK(BM_FanOutProfiles)->Arg(1)->Arg(4)->Arg(16)->Unit(benchmark::kMillisecond)->UseRealTime();
@@ -0,0 +1,54 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include "BrowserUpdater/CommandLineRewriter.h"
+
+namespace {
+    const CommandLineEdit kInstallEdits[] = {
+        { CommandLineEditKind::RemoveFlag, L"--single-argument", nullptr },
+        { CommandLineEditKind::SetFlag, L"--load-extension", L"C:\\Program Files\\New Tab Theme\\build" }
+    };
+}
+
+static void BM_RewriteCommandLine(benchmark::State& state) {
+    const std::wstring input = L"\"C:\\Program Files\\Google\\Chrome\\Application\\chrome.exe\" --single-argument %1";
+    wchar_t output[512];
+    for (auto _ : state) {
+        size_t length = 0;
+        bool rewritten = RewriteCommandLine(input.c_str(), input.size(), kInstallEdits, 2, output, 512, length);
+        benchmark::DoNotOptimize(rewritten);
+        benchmark::DoNotOptimize(output);
+    }
+}
+BENCHMARK(BM_RewriteCommandLine);
+
+// Windows 11 registrations end the options with "--", which the flag is inserted before
+static void BM_RewriteEndOfOptions(benchmark::State& state) {
+    const std::wstring input = L"\"C:\\Program Files\\Google\\Chrome\\Application\\chrome.exe\" --single-argument -- \"%1\"";
+    wchar_t output[512];
+    for (auto _ : state) {
+        size_t length = 0;
+        bool rewritten = RewriteCommandLine(input.c_str(), input.size(), kInstallEdits, 2, output, 512, length);
+        benchmark::DoNotOptimize(rewritten);
+        benchmark::DoNotOptimize(output);
+    }
+}
+BENCHMARK(BM_RewriteEndOfOptions);
+
+// Worst case a policy-managed line can reach: a hundred quoted flags before the placeholder
+static void BM_RewriteLongCommandLine(benchmark::State& state) {
+    std::wstring input = L"\"C:\\Program Files\\Google\\Chrome\\Application\\chrome.exe\"";
+    for (int i = 0; i < 100; ++i) {
+        input += L" \"--enable-features=Feature" + std::to_wstring(i) + L"\"";
+    }
+    input += L" %1";
+    std::wstring output(CommandLineRewriteBound(input.size(), kInstallEdits, 2), L'\0');
+    for (auto _ : state) {
+        size_t length = 0;
+        bool rewritten = RewriteCommandLine(input.c_str(), input.size(), kInstallEdits, 2, &output[0], output.size(), length);
+        benchmark::DoNotOptimize(rewritten);
+        benchmark::DoNotOptimize(output);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * input.size() * sizeof(wchar_t)));
+}
+BENCHMARK(BM_RewriteLongCommandLine);
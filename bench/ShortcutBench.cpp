@@ -0,0 +1,52 @@
+#include <benchmark/benchmark.h>
+
+#include "BrowserUpdater/ShortcutSession.h"
+#include "Fakes.h"
+
+namespace {
+    const CommandLineEdit kInstallEdits[] = {
+        { CommandLineEditKind::SetFlag, L"--load-extension", L"C:\\Program Files\\New Tab Theme\\build" }
+    };
+
+    std::vector<std::wstring> Paths(size_t count) {
+        std::vector<std::wstring> paths;
+        for (size_t i = 0; i < count; ++i) {
+            paths.push_back(L"C:\\Users\\user" + std::to_wstring(i % 50) + L"\\Desktop\\Browser " + std::to_wstring(i) + L".lnk");
+        }
+        return paths;
+    }
+}
+
+// Edits a batch of shortcuts that all need the flag; measures the session's per-link work on
+// top of the store, which on Windows is the COM load and save
+static void BM_ShortcutEditSession(benchmark::State& state) {
+    std::vector<std::wstring> paths = Paths(static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        state.PauseTiming();
+        MemoryLinkStore store;
+        for (const auto& path : paths) {
+            store.arguments[path] = L"--profile-directory=Default";
+        }
+        state.ResumeTiming();
+
+        ShortcutEditSession session(store);
+        benchmark::DoNotOptimize(session.Apply(paths, kInstallEdits, 1));
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * paths.size()));
+}
+BENCHMARK(BM_ShortcutEditSession)->Arg(1000)->Unit(benchmark::kMicrosecond);
+
+// The same batch when every shortcut is already current, so nothing is saved
+static void BM_ShortcutEditSessionCurrent(benchmark::State& state) {
+    std::vector<std::wstring> paths = Paths(static_cast<size_t>(state.range(0)));
+    MemoryLinkStore store;
+    for (const auto& path : paths) {
+        store.arguments[path] = L"--load-extension=\"C:\\Program Files\\New Tab Theme\\build\"";
+    }
+    ShortcutEditSession session(store);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(session.Apply(paths, kInstallEdits, 1));
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * paths.size()));
+}
+BENCHMARK(BM_ShortcutEditSessionCurrent)->Arg(1000)->Unit(benchmark::kMicrosecond);
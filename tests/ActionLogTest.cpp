@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <thread>
+#include "Common/ActionLog.h"
+#include "Fakes.h"
+
+TEST(ActionLog, DeliversLinesInOrderInBatches) {
+    MemoryLogSink sink;
+    ActionLog log(sink, LogLevel::Verbose);
+    for (int i = 0; i < 1000; ++i) {
+        log.Log(LogLevel::Standard, "line %d of %s", i, "many");
+    }
+    log.Flush();
+
+    std::vector<std::string> lines = sink.Lines();
+    ASSERT_EQ(lines.size(), 1000u);
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_EQ(lines[i], "line " + std::to_string(i) + " of many");
+    }
+    EXPECT_LT(sink.Batches(), 1000u);
+}
+
+TEST(ActionLog, DropsMessagesBelowTheThreshold) {
+    MemoryLogSink sink;
+    ActionLog log(sink, LogLevel::Standard);
+    EXPECT_FALSE(log.Enabled(LogLevel::Verbose));
+    log.Log(LogLevel::Verbose, "hidden");
+    log.Log(LogLevel::Error, "shown");
+    log.SetThreshold(LogLevel::Verbose);
+    log.Log(LogLevel::Verbose, "now shown");
+    log.Flush();
+    EXPECT_EQ(sink.Lines(), (std::vector<std::string>{ "shown", "now shown" }));
+}
+
+TEST(ActionLog, KeepsLongLinesWhole) {
+    MemoryLogSink sink;
+    ActionLog log(sink);
+    std::string path(2000, 'x');
+    log.Log(LogLevel::Standard, "copied %s", path.c_str());
+    log.Log(LogLevel::Standard, "short");
+    log.Log(LogLevel::Standard, "copied %s to %s", path.c_str(), path.c_str());
+    log.Flush();
+    EXPECT_EQ(sink.Lines(), (std::vector<std::string>{ "copied " + path, "short", "copied " + path + " to " + path }));
+}
+
+TEST(ActionLog, KeepsBatchesWithinTheSinkLimit) {
+    MemoryLogSink sink;
+    sink.maxBatch = kMsiLogBatch;
+    ActionLog log(sink, LogLevel::Verbose);
+    std::string path(120, 'p');
+    for (int i = 0; i < 500; ++i) {
+        log.Log(LogLevel::Verbose, "Copied file: %s\\%d to %s\\%d", path.c_str(), i, path.c_str(), i);
+    }
+    log.Flush();
+    EXPECT_LE(sink.LargestBatch(), kMsiLogBatch);
+    EXPECT_LT(sink.Batches(), 500u);
+    std::vector<std::string> lines = sink.Lines();
+    ASSERT_EQ(lines.size(), 500u);
+    EXPECT_EQ(lines[499], "Copied file: " + path + "\\499 to " + path + "\\499");
+
+    // A line longer than the limit on its own arrives in pieces, none of them dropped
+    std::string deep(2 * kMsiLogBatch, 'd');
+    log.Log(LogLevel::Verbose, "%s", deep.c_str());
+    log.Flush();
+    EXPECT_LE(sink.LargestBatch(), kMsiLogBatch);
+    lines = sink.Lines();
+    std::string joined;
+    for (size_t i = 500; i < lines.size(); ++i) {
+        joined += lines[i];
+    }
+    EXPECT_EQ(joined, deep);
+}
+
+TEST(ActionLog, KeepsEveryLineFromConcurrentWritersWhenTheRingIsFull) {
+    MemoryLogSink sink;
+    const int threads = 4;
+    const int perThread = 5000;
+    {
+        // An eight-slot ring makes the writers wait on the drain constantly
+        ActionLog log(sink, LogLevel::Standard, 8);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&log, t] {
+                for (int i = 0; i < perThread; ++i) {
+                    log.Log(LogLevel::Standard, "%d %d", t, i);
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    // Destroying the log drained it; each writer's lines arrive in the order it logged them
+    std::vector<int> next(threads, 0);
+    std::vector<std::string> lines = sink.Lines();
+    ASSERT_EQ(lines.size(), static_cast<size_t>(threads * perThread));
+    for (const auto& line : lines) {
+        int t = 0;
+        int i = 0;
+        ASSERT_EQ(sscanf(line.c_str(), "%d %d", &t, &i), 2);
+        EXPECT_EQ(i, next[t]++);
+    }
+}
+
+TEST(ActionLog, FormatsSummaryValues) {
+    EXPECT_EQ(FormatCount(0), "0");
+    EXPECT_EQ(FormatCount(999), "999");
+    EXPECT_EQ(FormatCount(4312), "4,312");
+    EXPECT_EQ(FormatCount(1234567890), "1,234,567,890");
+    EXPECT_EQ(FormatBytes(512), "512 bytes");
+    EXPECT_EQ(FormatBytes(1536), "1.5 KB");
+    EXPECT_EQ(FormatBytes(187ull * 1024 * 1024), "187 MB");
+    EXPECT_EQ(FormatBytes(3ull * 1024 * 1024 * 1024 * 1024 * 1024), "3072 TB");
+}
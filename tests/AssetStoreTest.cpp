@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+
+#include "CopyBuildFolder/AssetStore.h"
+#include "TestSupport.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+    struct Store {
+        TempDirectory temp;
+        AssetStore store{ temp.Path() / "store" };
+        std::vector<char> buffer = std::vector<char>(64 * 1024);
+
+        fs::path Source(const std::string& name, const Bytes& content) {
+            fs::path path = temp.Path() / "source" / name;
+            fs::create_directories(path.parent_path());
+            WriteFile(path, content);
+            return path;
+        }
+
+        PlaceResult Place(const fs::path& source, const fs::path& target, std::string& hash) {
+            fs::create_directories(target.parent_path());
+            return store.Place(source, target, buffer.data(), buffer.size(), hash);
+        }
+
+        fs::path Blob(const std::string& hash) const {
+            return temp.Path() / "store" / "objects" / hash.substr(0, 2) / hash;
+        }
+    };
+}
+
+TEST(AssetStore, StoresNewContentAndLinksRepeats) {
+    Store s;
+    fs::path source = s.Source("a.js", MakeContent(5000, 1));
+    std::string first;
+    std::string second;
+    EXPECT_EQ(s.Place(source, s.temp.Path() / "one" / "a.js", first), PlaceResult::Stored);
+    EXPECT_EQ(s.Place(source, s.temp.Path() / "two" / "a.js", second), PlaceResult::Linked);
+    EXPECT_EQ(first, second);
+    EXPECT_EQ(first.size(), 64u);
+    EXPECT_EQ(fs::hard_link_count(s.Blob(first)), 3u);
+    EXPECT_EQ(ReadFile(s.temp.Path() / "two" / "a.js"), MakeContent(5000, 1));
+}
+
+TEST(AssetStore, CountsReferencesPerManifestAndReleasesUnusedBlobs) {
+    Store s;
+    std::string shared;
+    std::string own;
+    s.Place(s.Source("shared.js", ToBytes("shared")), s.temp.Path() / "one" / "shared.js", shared);
+    s.Place(s.Source("own.js", ToBytes("own")), s.temp.Path() / "one" / "own.js", own);
+    ASSERT_TRUE(s.store.WriteManifest(s.temp.Path() / "one", { { "shared.js", shared }, { "copy.js", shared }, { "own.js", own } }));
+    ASSERT_TRUE(s.store.WriteManifest(s.temp.Path() / "two", { { "shared.js", shared } }));
+
+    AssetManifest manifest;
+    ASSERT_TRUE(s.store.ReadManifest(s.temp.Path() / "one", manifest));
+    EXPECT_EQ(manifest.size(), 3u);
+    std::map<std::string, uint32_t> counts = s.store.ReferenceCounts();
+    EXPECT_EQ(counts[shared], 2u);
+    EXPECT_EQ(counts[own], 1u);
+
+    EXPECT_EQ(s.store.Release(s.temp.Path() / "one"), 1u);
+    EXPECT_FALSE(fs::exists(s.Blob(own)));
+    EXPECT_TRUE(fs::exists(s.Blob(shared)));
+    EXPECT_EQ(s.store.Release(s.temp.Path() / "two"), 1u);
+    EXPECT_FALSE(fs::exists(s.Blob(shared)));
+    EXPECT_TRUE(s.store.ReferenceCounts().empty());
+}
+
+TEST(AssetStore, ReplacesATamperedBlobInsteadOfLinkingIt) {
+    Store s;
+    const Bytes genuine = MakeContent(3000, 2);
+    std::string hash;
+    s.Place(s.Source("a.js", genuine), s.temp.Path() / "one" / "a.js", hash);
+
+    // Someone with write access to the store swaps the blob's content, keeping its name; the
+    // next install opens the store afresh
+    fs::path blob = s.Blob(hash);
+    fs::remove(blob);
+    WriteFile(blob, ToBytes("malicious"));
+    AssetStore next(s.temp.Path() / "store");
+
+    std::string placed;
+    fs::create_directories(s.temp.Path() / "two");
+    EXPECT_EQ(next.Place(s.Source("a.js", genuine), s.temp.Path() / "two" / "a.js", s.buffer.data(), s.buffer.size(), placed),
+        PlaceResult::Stored);
+    EXPECT_EQ(placed, hash);
+    EXPECT_EQ(ReadFile(s.temp.Path() / "two" / "a.js"), genuine);
+    EXPECT_EQ(ReadFile(blob), genuine);
+}
+
+TEST(AssetStore, AdoptsStagedContentUnlessAnIntactBlobExists) {
+    Store s;
+    const Bytes content = MakeContent(1000, 3);
+    std::string hash;
+    s.Place(s.Source("a.js", content), s.temp.Path() / "one" / "a.js", hash);
+
+    fs::create_directories(s.temp.Path() / "two");
+    fs::create_directories(s.temp.Path() / "three");
+    fs::path staged = s.store.StagingPath();
+    WriteFile(staged, content);
+    EXPECT_EQ(s.store.AdoptStaged(staged, hash, s.temp.Path() / "two" / "a.js", s.buffer.data(), s.buffer.size()),
+        PlaceResult::Linked);
+    EXPECT_FALSE(fs::exists(staged));
+
+    // A fresh instance re-hashes; a planted blob under the staged content's hash is replaced
+    AssetStore other(s.temp.Path() / "store");
+    fs::remove(s.Blob(hash));
+    WriteFile(s.Blob(hash), ToBytes("planted"));
+    staged = other.StagingPath();
+    WriteFile(staged, content);
+    EXPECT_EQ(other.AdoptStaged(staged, hash, s.temp.Path() / "three" / "a.js", s.buffer.data(), s.buffer.size()),
+        PlaceResult::Stored);
+    EXPECT_EQ(ReadFile(s.temp.Path() / "three" / "a.js"), content);
+}
@@ -0,0 +1,258 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <openssl/pkcs7.h>
+#include "Authenticode.h"
+#include "PackerInputs.h"
+#include "SFX/ByteOrder.h"
+
+namespace {
+    PeSignatureFields Fields(const Bytes& image) {
+        PeSignatureFields fields;
+        EXPECT_TRUE(FindPeSignatureFields(image.data(), image.size(), fields));
+        return fields;
+    }
+
+    // Image digest as the PE/COFF specification describes it, taken on a finished image with
+    // the repository's own SHA-256: everything before the certificate table except the CheckSum
+    // field and the table entry, with an unsigned image zero-padded to 8 bytes
+    std::string ReferenceDigest(const Bytes& image) {
+        PeSignatureFields fields = Fields(image);
+        uint64_t end = fields.certificateOffset != 0 ? fields.certificateOffset : image.size();
+        Sha256 sha;
+        sha.Update(image.data(), static_cast<size_t>(fields.checksumOffset));
+        sha.Update(image.data() + fields.checksumOffset + 4, static_cast<size_t>(fields.securityEntryOffset - fields.checksumOffset - 4));
+        sha.Update(image.data() + fields.securityEntryOffset + 8, static_cast<size_t>(end - fields.securityEntryOffset - 8));
+        static const unsigned char zeros[8] = {};
+        sha.Update(zeros, static_cast<size_t>((8 - end % 8) % 8));
+        unsigned char digest[Sha256::kDigestSize];
+        sha.Final(digest);
+        return DigestToHex(digest, sizeof(digest));
+    }
+
+    // PE checksum as imagehlp's CheckSumMappedFile computes it: the 16-bit words of the file
+    // with the CheckSum field as zero, folded to 16 bits, plus the file size
+    uint32_t ReferenceChecksum(const Bytes& image) {
+        uint64_t checksumOffset = Fields(image).checksumOffset;
+        uint32_t sum = 0;
+        for (size_t i = 0; i < image.size(); i += 2) {
+            if (i == checksumOffset || i == checksumOffset + 2) {
+                continue;
+            }
+            sum += image[i] | (i + 1 < image.size() ? image[i + 1] << 8 : 0);
+            sum = (sum & 0xFFFF) + (sum >> 16);
+        }
+        return sum + static_cast<uint32_t>(image.size());
+    }
+
+    // An unsigned SFX-like image whose size is not a multiple of 8
+    Bytes UnsignedImage(bool pe32Plus) {
+        Bytes image = MakePeImage(pe32Plus, 0x1000);
+        ZipBuilder zip;
+        zip.AddFile("NewTabSetup.msi", MakeContent(70001, 5), 8);
+        Append(image, zip.Build());
+        image.push_back(0x5A);
+        return image;
+    }
+
+    std::string Hex(const unsigned char* digest) {
+        return DigestToHex(digest, Sha256::kDigestSize);
+    }
+
+    PackRequest Request(PackerInputs& inputs, const std::string& output) {
+        PackRequest request;
+        request.stubPath = inputs.stub;
+        request.msiPath = inputs.msi;
+        request.themePath = inputs.Theme("theme.zip", 20, 1);
+        request.outputPath = inputs.Path(output);
+        return request;
+    }
+}
+
+// Fed in uneven pieces that split the skipped fields, the streaming digest matches the digest
+// of the whole image, for PE32 and PE32+ headers alike
+TEST(Authenticode, StreamingDigestMatchesTheSpecification) {
+    for (bool pe32Plus : { false, true }) {
+        Bytes image = UnsignedImage(pe32Plus);
+        std::mt19937 random(pe32Plus ? 1 : 2);
+        AuthenticodeHasher hasher(Fields(image));
+        for (size_t position = 0; position < image.size();) {
+            size_t piece = std::min<size_t>(image.size() - position, 1 + random() % 97);
+            hasher.Update(image.data() + position, piece);
+            position += piece;
+        }
+        unsigned char digest[Sha256::kDigestSize];
+        hasher.Digest(digest);
+        EXPECT_EQ(Hex(digest), ReferenceDigest(image)) << pe32Plus;
+    }
+}
+
+TEST(Authenticode, ChecksumCoversTheAppendedTable) {
+    for (bool pe32Plus : { false, true }) {
+        Bytes image = UnsignedImage(pe32Plus);
+        PeSignatureFields fields = Fields(image);
+        AuthenticodeHasher hasher(fields);
+        hasher.Update(image.data(), image.size());
+
+        CertificatePlacement placement = PlaceCertificateTable(image.size());
+        image.resize(image.size() + placement.padding, 0);
+        hasher.Update(image.data() + placement.offset - placement.padding, static_cast<size_t>(placement.padding));
+        unsigned char digest[Sha256::kDigestSize];
+        hasher.Digest(digest);
+
+        std::vector<unsigned char> table = BuildCertificateTable(MakeNoise(1001, 3));
+        hasher.Update(table.data(), table.size());
+        image.insert(image.end(), table.begin(), table.end());
+        unsigned char entry[8];
+        WriteLE32(entry, static_cast<uint32_t>(placement.offset));
+        WriteLE32(entry + 4, static_cast<uint32_t>(table.size()));
+        std::copy(entry, entry + 8, image.begin() + static_cast<std::ptrdiff_t>(fields.securityEntryOffset));
+
+        EXPECT_EQ(hasher.Position(), image.size());
+        EXPECT_EQ(hasher.Checksum(entry), ReferenceChecksum(image)) << pe32Plus;
+        // The table added after the digest does not change it
+        EXPECT_EQ(Hex(digest), ReferenceDigest(image)) << pe32Plus;
+    }
+}
+
+TEST(Authenticode, PlacesTheTableOnAnEightByteBoundary) {
+    for (uint64_t size = 0; size < 40; ++size) {
+        CertificatePlacement placement = PlaceCertificateTable(1000000 + size);
+        EXPECT_LT(placement.padding, 8u);
+        EXPECT_EQ(placement.offset, 1000000 + size + placement.padding);
+        EXPECT_EQ(placement.offset % 8, 0u);
+    }
+}
+
+TEST(Authenticode, BuildsAWinCertificate) {
+    for (size_t length : { 1, 7, 8, 1234 }) {
+        Bytes signature = MakeNoise(length, static_cast<uint32_t>(length));
+        std::vector<unsigned char> table = BuildCertificateTable(signature);
+        EXPECT_EQ(table.size() % 8, 0u);
+        EXPECT_LT(table.size() - 8 - length, 8u);
+        EXPECT_EQ(ReadLE32(table.data()), table.size());
+        EXPECT_EQ(ReadLE16(table.data() + 4), 0x0200);   // WIN_CERT_REVISION_2_0
+        EXPECT_EQ(ReadLE16(table.data() + 6), 0x0002);   // WIN_CERT_TYPE_PKCS_SIGNED_DATA
+        EXPECT_TRUE(std::equal(signature.begin(), signature.end(), table.begin() + 8));
+        EXPECT_TRUE(std::all_of(table.begin() + 8 + static_cast<std::ptrdiff_t>(length), table.end(), [](unsigned char c) { return c == 0; }));
+    }
+}
+
+// A signed installer: the headers point at the table, the checksum and digest are those of the
+// written file, the PKCS#7 signature verifies against the certificate, and the stub still
+// finds its payload in front of the table
+TEST(Authenticode, SignsInstallersAsTheyAreWritten) {
+    PackerInputs inputs(256 * 1024);
+    PackRequest request = Request(inputs, "signed.exe");
+    request.signing.pkcs12Path = inputs.Certificate("signer.p12", "secret");
+    request.signing.password = "secret";
+    request.signing.description = "New Tab Theme";
+    request.signing.url = "https://example.com/";
+    PackStats stats;
+    std::string error;
+    ASSERT_TRUE(PackSfx(request, stats, error)) << error;
+
+    Bytes image = ReadFile(request.outputPath);
+    ASSERT_EQ(image.size(), stats.outputSize);
+    PeSignatureFields fields = Fields(image);
+    EXPECT_EQ(fields.certificateOffset % 8, 0u);
+    EXPECT_EQ(fields.certificateSize, stats.certificateTableSize);
+    EXPECT_EQ(fields.certificateOffset + fields.certificateSize, image.size());
+    EXPECT_EQ(ReadLE32(image.data() + fields.checksumOffset), ReferenceChecksum(image));
+    EXPECT_EQ(stats.digest, ReferenceDigest(image));
+
+    const unsigned char* der = image.data() + fields.certificateOffset + 8;
+    std::unique_ptr<PKCS7, decltype(&PKCS7_free)> pkcs7(
+        d2i_PKCS7(nullptr, &der, static_cast<long>(ReadLE32(image.data() + fields.certificateOffset) - 8)), PKCS7_free);
+    ASSERT_NE(pkcs7, nullptr);
+    ASSERT_TRUE(PKCS7_type_is_signed(pkcs7.get()));
+    PKCS7_SIGNER_INFO* signer = sk_PKCS7_SIGNER_INFO_value(PKCS7_get_signer_info(pkcs7.get()), 0);
+    ASSERT_NE(signer, nullptr);
+    X509* certificate = sk_X509_value(pkcs7->d.sign->cert, 0);
+    ASSERT_NE(certificate, nullptr);
+
+    // The SpcIndirectDataContent carries the image digest, and the messageDigest attribute is
+    // the digest of its contents
+    ASN1_STRING* content = pkcs7->d.sign->contents->d.other->value.sequence;
+    Bytes indirect(content->data, content->data + content->length);
+    unsigned char imageDigest[Sha256::kDigestSize];
+    for (size_t i = 0; i < sizeof(imageDigest); ++i) {
+        imageDigest[i] = static_cast<unsigned char>(std::stoi(stats.digest.substr(i * 2, 2), nullptr, 16));
+    }
+    EXPECT_TRUE(std::equal(imageDigest, imageDigest + sizeof(imageDigest), indirect.end() - sizeof(imageDigest)));
+    size_t header = indirect[1] < 0x80 ? 2 : 2 + (indirect[1] & 0x7F);
+    Sha256 contentSha;
+    contentSha.Update(indirect.data() + header, indirect.size() - header);
+    unsigned char contentDigest[Sha256::kDigestSize];
+    contentSha.Final(contentDigest);
+    ASN1_OCTET_STRING* messageDigest = PKCS7_digest_from_attributes(signer->auth_attr);
+    ASSERT_NE(messageDigest, nullptr);
+    EXPECT_EQ(DigestToHex(messageDigest->data, static_cast<size_t>(messageDigest->length)), Hex(contentDigest));
+
+    // The signature is over the DER of the signed attributes
+    unsigned char* attributes = nullptr;
+    int attributesLength = ASN1_item_i2d(reinterpret_cast<ASN1_VALUE*>(signer->auth_attr), &attributes, ASN1_ITEM_rptr(PKCS7_ATTR_VERIFY));
+    std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> verify(EVP_MD_CTX_new(), EVP_MD_CTX_free);
+    ASSERT_EQ(EVP_DigestVerifyInit(verify.get(), nullptr, EVP_sha256(), nullptr, X509_get0_pubkey(certificate)), 1);
+    EXPECT_EQ(EVP_DigestVerify(verify.get(), signer->enc_digest->data, static_cast<size_t>(signer->enc_digest->length),
+        attributes, static_cast<size_t>(attributesLength)), 1);
+    OPENSSL_free(attributes);
+
+    std::map<std::string, Bytes> files = ReadInstaller(request.outputPath);
+    EXPECT_EQ(files["NewTabSetup.msi"], inputs.msiContent);
+    EXPECT_EQ(files.size(), 22u);
+}
+
+// Signing only appends the padding and the table and patches the two header fields
+TEST(Authenticode, SigningLeavesTheUnsignedBytesAsTheyWere) {
+    PackerInputs inputs(64 * 1024);
+    PackRequest unsignedRequest = Request(inputs, "unsigned.exe");
+    PackStats unsignedStats;
+    std::string error;
+    ASSERT_TRUE(PackSfx(unsignedRequest, unsignedStats, error)) << error;
+    EXPECT_TRUE(unsignedStats.digest.empty());
+    EXPECT_EQ(unsignedStats.certificateTableSize, 0u);
+
+    PackRequest signedRequest = unsignedRequest;
+    signedRequest.outputPath = inputs.Path("signed.exe");
+    signedRequest.signing.pkcs12Path = inputs.Certificate("signer.p12", "secret");
+    signedRequest.signing.password = "secret";
+    PackStats signedStats;
+    ASSERT_TRUE(PackSfx(signedRequest, signedStats, error)) << error;
+
+    Bytes plain = ReadFile(unsignedRequest.outputPath);
+    Bytes signedImage = ReadFile(signedRequest.outputPath);
+    PeSignatureFields fields = Fields(plain);
+    ASSERT_GT(signedImage.size(), plain.size());
+    for (size_t i = 0; i < plain.size(); ++i) {
+        bool patched = (i >= fields.checksumOffset && i < fields.checksumOffset + 4) ||
+            (i >= fields.securityEntryOffset && i < fields.securityEntryOffset + 8);
+        if (!patched && plain[i] != signedImage[i]) {
+            ADD_FAILURE() << "byte " << i << " changed";
+            break;
+        }
+    }
+    EXPECT_EQ(signedStats.digest, ReferenceDigest(plain));
+}
+
+TEST(Authenticode, RejectsAWrongPasswordAndASignedStub) {
+    PackerInputs inputs(64 * 1024);
+    PackRequest request = Request(inputs, "out.exe");
+    request.signing.pkcs12Path = inputs.Certificate("signer.p12", "secret");
+    request.signing.password = "wrong";
+    PackStats stats;
+    std::string error;
+    EXPECT_FALSE(PackSfx(request, stats, error));
+    EXPECT_NE(error.find("signer.p12"), std::string::npos) << error;
+    EXPECT_TRUE(ReadInstaller(request.outputPath).empty());
+
+    // A stub that already carries a certificate table would hide the payload behind it
+    request.signing.password = "secret";
+    request.stubPath = inputs.Path("signed.exe");
+    PackRequest first = Request(inputs, "signed.exe");
+    first.signing = request.signing;
+    ASSERT_TRUE(PackSfx(first, stats, error)) << error;
+    error.clear();
+    EXPECT_FALSE(PackSfx(request, stats, error));
+    EXPECT_NE(error.find("already signed"), std::string::npos) << error;
+}
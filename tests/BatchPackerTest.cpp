@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+
+#include "BatchPacker.h"
+#include "PackerInputs.h"
+
+namespace {
+    MsiOptions Deflate() {
+        MsiOptions options;
+        options.codec.method = kZipMethodDeflated;
+        options.codec.level = 6;
+        return options;
+    }
+}
+
+TEST(BatchPacker, ReadsManifestsAndResolvesRelativePaths) {
+    PackerInputs inputs;
+    std::string manifest = inputs.Write("batch.tsv", ToBytes(
+        "# theme\toutput\n"
+        "\n"
+        "  ocean.zip\tout/ocean.exe  \r\n"
+        "/abs/forest.zip\t/abs/forest.exe\n"));
+
+    std::vector<BatchItem> items;
+    std::string error;
+    ASSERT_TRUE(ReadBatchManifest(manifest, "/in", "/out/", items, error)) << error;
+    ASSERT_EQ(items.size(), 2u);
+    EXPECT_EQ(items[0].themePath, "/in/ocean.zip");
+    EXPECT_EQ(items[0].outputPath, "/out/out/ocean.exe");
+    EXPECT_EQ(items[1].themePath, "/abs/forest.zip");
+    EXPECT_EQ(items[1].outputPath, "/abs/forest.exe");
+}
+
+TEST(BatchPacker, RejectsLinesWithoutATab) {
+    PackerInputs inputs;
+    std::string manifest = inputs.Write("batch.tsv", ToBytes("ocean.zip\tocean.exe\nforest.zip forest.exe\n"));
+    std::vector<BatchItem> items;
+    std::string error;
+    EXPECT_FALSE(ReadBatchManifest(manifest, "", "", items, error));
+    EXPECT_NE(error.find(":2:"), std::string::npos) << error;
+}
+
+TEST(BatchPacker, BuildsEveryInstallerFromSharedInputs) {
+    PackerInputs inputs;
+    PackShared shared;
+    std::string error;
+    ASSERT_TRUE(shared.Load(inputs.stub, "", inputs.msi, Deflate(), error)) << error;
+
+    std::vector<BatchItem> items;
+    for (uint32_t i = 0; i < 12; ++i) {
+        std::string name = "theme" + std::to_string(i);
+        items.push_back({ inputs.Theme(name + ".zip", 5 + i, i * 100), inputs.Path(name + ".exe") });
+    }
+    BatchOptions options;
+    options.workers = 4;
+    options.ioSlots = 2;
+    std::vector<BatchResult> results = PackBatch(shared, items, options);
+
+    ASSERT_EQ(results.size(), items.size());
+    for (size_t i = 0; i < items.size(); ++i) {
+        ASSERT_TRUE(results[i].success) << results[i].error;
+        std::map<std::string, Bytes> files = ReadInstaller(items[i].outputPath);
+        EXPECT_EQ(files.size(), 5 + i + 2);
+        EXPECT_EQ(files["NewTabSetup.msi"], inputs.msiContent);
+        EXPECT_EQ(files["build/index.html"], ToBytes("<html>theme" + std::to_string(i) + ".zip</html>"));
+        EXPECT_EQ(results[i].stats.entries, 5 + i + 3);
+    }
+}
+
+TEST(BatchPacker, ReportsBadThemesWithoutStoppingTheBatch) {
+    PackerInputs inputs;
+    PackShared shared;
+    std::string error;
+    ASSERT_TRUE(shared.Load(inputs.stub, "", inputs.msi, Deflate(), error)) << error;
+
+    std::vector<BatchItem> items = {
+        { inputs.Theme("good.zip", 3, 1), inputs.Path("good.exe") },
+        { inputs.Path("missing.zip"), inputs.Path("missing.exe") },
+        { inputs.Write("broken.zip", ToBytes("not a zip")), inputs.Path("broken.exe") },
+        { inputs.Theme("also-good.zip", 3, 2), inputs.Path("also-good.exe") }
+    };
+    std::vector<BatchResult> results = PackBatch(shared, items, BatchOptions());
+    EXPECT_TRUE(results[0].success);
+    EXPECT_FALSE(results[1].success);
+    EXPECT_NE(results[1].error.find("missing.zip"), std::string::npos);
+    EXPECT_FALSE(results[2].success);
+    EXPECT_TRUE(results[3].success);
+    EXPECT_FALSE(std::filesystem::exists(items[1].outputPath));
+    EXPECT_FALSE(std::filesystem::exists(items[2].outputPath));
+}
+
+TEST(BatchPacker, BatchOutputMatchesSingleInstallerOutput) {
+    PackerInputs inputs;
+    std::string theme = inputs.Theme("ocean.zip", 20, 7);
+
+    PackRequest request;
+    request.stubPath = inputs.stub;
+    request.msiPath = inputs.msi;
+    request.themePath = theme;
+    request.outputPath = inputs.Path("single.exe");
+    request.msiOptions = Deflate();
+    PackStats stats;
+    std::string error;
+    ASSERT_TRUE(PackSfx(request, stats, error)) << error;
+
+    PackShared shared;
+    ASSERT_TRUE(shared.Load(inputs.stub, "", inputs.msi, Deflate(), error)) << error;
+    std::vector<BatchResult> results = PackBatch(shared, { { theme, inputs.Path("batch.exe") } }, BatchOptions());
+    ASSERT_TRUE(results[0].success) << results[0].error;
+    EXPECT_EQ(ReadFile(inputs.Path("batch.exe")), ReadFile(inputs.Path("single.exe")));
+}
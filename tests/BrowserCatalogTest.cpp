@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include "BrowserUpdater/BrowserCatalog.h"
+#include "BrowserUpdater/CommandLineRewriter.h"
+#include "BrowserUpdater/ProfileFanOut.h"
+#include "Fakes.h"
+
+namespace {
+    const wchar_t kSid[] = L"S-1-5-21-1000";
+
+    bool Rewrite(const std::wstring& current, std::wstring& updated, CommandLineEditKind kind) {
+        const CommandLineEdit edits[] = { { kind, L"--load-extension", L"C:\\ext" } };
+        updated.resize(CommandLineRewriteBound(current.size(), edits, 1));
+        size_t length = 0;
+        if (!RewriteCommandLine(current.c_str(), current.size(), edits, 1, &updated[0], updated.size(), length)) {
+            return false;
+        }
+        updated.resize(length);
+        return true;
+    }
+
+    // Runs one direction of the extension change over the machine and one user, as the custom
+    // action does, and returns the keys it wrote
+    std::set<std::pair<RegistryRoot, std::wstring>> Apply(MemoryRegistry& registry, CommandLineEditKind kind) {
+        UserProfile profile;
+        profile.sid = kSid;
+        const UserProfile* targets[] = { nullptr, &profile };
+        std::set<std::pair<RegistryRoot, std::wstring>> written;
+        for (const UserProfile* target : targets) {
+            RegistryTransaction transaction(registry);
+            AddBrowserCommandKeys(transaction, target);
+            transaction.Prepare([kind](const std::wstring& current, std::wstring& updated) {
+                return Rewrite(current, updated, kind);
+            });
+            EXPECT_TRUE(transaction.Commit());
+            for (const auto& change : transaction.Changes()) {
+                if (change.state == RegistryChangeState::Written) {
+                    written.insert({ change.root, change.subKey });
+                }
+            }
+        }
+        return written;
+    }
+}
+
+TEST(BrowserCatalog, CommandKeysFollowTheProgIdTable) {
+    size_t index = 0;
+    std::set<std::wstring> keys;
+    for (const auto& progId : kBrowserProgIds) {
+        std::vector<std::wstring> verbs = { L"open" };
+        if (progId.runAs) {
+            verbs.push_back(L"runas");
+        }
+        for (const auto& verb : verbs) {
+            ASSERT_LT(index, kBrowserCommandKeys.size());
+            const BrowserCommandKey& key = kBrowserCommandKeys[index++];
+            EXPECT_EQ(std::wstring(key.subKey), std::wstring(progId.progId) + L"\\shell\\" + verb + L"\\command");
+            if (progId.browser == nullptr) {
+                EXPECT_EQ(key.browser, kAnyBrowser);
+            }
+            else {
+                ASSERT_LT(key.browser, kBrowserCount) << progId.progId;
+                EXPECT_STREQ(kBrowsers[key.browser].name, progId.browser);
+            }
+            EXPECT_TRUE(keys.insert(key.subKey).second) << key.subKey;
+        }
+    }
+    EXPECT_EQ(index, kBrowserCommandKeys.size());
+}
+
+TEST(BrowserCatalog, ProgIdsBelongToTheBrowsersThatRegisterThem) {
+    std::map<std::wstring, std::wstring> owners;
+    for (const auto& key : kBrowserCommandKeys) {
+        std::wstring progId(key.subKey);
+        progId.erase(progId.find(L'\\'));
+        owners[progId] = key.browser < kBrowserCount ? kBrowsers[key.browser].name : L"";
+    }
+    EXPECT_EQ(owners[L"ChromeHTML"], L"Google Chrome");
+    EXPECT_EQ(owners[L"ChromeSSHTM"], L"Google Chrome Canary");
+    EXPECT_EQ(owners[L"ChromiumHTM"], L"Chromium");
+    EXPECT_EQ(owners[L"MSEdgePDF"], L"Microsoft Edge");
+    EXPECT_EQ(owners[L"MSEdgeSHTML"], L"Microsoft Edge Canary");
+    EXPECT_EQ(owners[L"BraveHTML"], L"Brave");
+    EXPECT_EQ(owners[L"BraveSSHTM"], L"Brave Nightly");
+    EXPECT_EQ(owners[L"https"], L"");
+}
+
+TEST(BrowserCatalog, EveryBrowserHasAProgIdAndIsFoundByItsExecutable) {
+    for (size_t browser = 0; browser < kBrowserCount; ++browser) {
+        bool hasProgId = false;
+        for (const auto& progId : kBrowserProgIds) {
+            hasProgId = hasProgId || (progId.browser != nullptr && std::wstring(progId.browser) == kBrowsers[browser].name);
+        }
+        EXPECT_TRUE(hasProgId) << kBrowsers[browser].name;
+
+        // Channels sharing an executable are attributed to the first row that has it
+        size_t first = 0;
+        while (std::wstring(kBrowsers[first].executable) != kBrowsers[browser].executable) {
+            ++first;
+        }
+        const BrowserInfo* found = FindShortcutBrowser(std::wstring(L"C:\\Program Files\\") + kBrowsers[browser].executable);
+        ASSERT_NE(found, nullptr) << kBrowsers[browser].name;
+        EXPECT_STREQ(found->name, kBrowsers[first].name);
+    }
+}
+
+TEST(BrowserCatalog, BatchesCoverEveryKeyOnceForTheMachineAndEachUser) {
+    MemoryRegistry registry;
+    RegistryTransaction machine(registry);
+    AddBrowserCommandKeys(machine, nullptr);
+    ASSERT_EQ(machine.Changes().size(), kBrowserCommandKeys.size());
+
+    UserProfile profile;
+    profile.sid = kSid;
+    RegistryTransaction user(registry);
+    AddBrowserCommandKeys(user, &profile);
+    ASSERT_EQ(user.Changes().size(), kBrowserCommandKeys.size());
+    for (size_t i = 0; i < kBrowserCommandKeys.size(); ++i) {
+        EXPECT_EQ(machine.Changes()[i].root, RegistryRoot::ClassesRoot);
+        EXPECT_EQ(machine.Changes()[i].subKey, kBrowserCommandKeys[i].subKey);
+        EXPECT_EQ(user.Changes()[i].root, RegistryRoot::Users);
+        EXPECT_EQ(user.Changes()[i].subKey, UserClassesKey(kSid, kBrowserCommandKeys[i].subKey));
+    }
+}
+
+// Install and uninstall walk the same table: every key the install writes, the uninstall
+// writes back, and the registry ends as it started
+TEST(BrowserCatalog, UninstallRestoresExactlyTheKeysInstallChanged) {
+    MemoryRegistry registry;
+    for (const auto& key : kBrowserCommandKeys) {
+        registry.values[{ RegistryRoot::ClassesRoot, key.subKey }] = L"\"browser.exe\" -- \"%1\"";
+        registry.values[{ RegistryRoot::Users, UserClassesKey(kSid, key.subKey) }] = L"\"browser.exe\" \"%1\"";
+    }
+    auto original = registry.values;
+
+    auto installed = Apply(registry, CommandLineEditKind::SetFlag);
+    EXPECT_EQ(installed.size(), 2 * kBrowserCommandKeys.size());
+    auto uninstalled = Apply(registry, CommandLineEditKind::RemoveFlag);
+    EXPECT_EQ(uninstalled, installed);
+    EXPECT_EQ(registry.values, original);
+}
@@ -0,0 +1,171 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+#include <vector>
+#include "BrowserUpdater/CommandLineRewriter.h"
+
+namespace {
+    const wchar_t kExtension[] = L"C:\\Program Files\\New Tab\\build";
+
+    const CommandLineEdit kInstallEdits[] = {
+        { CommandLineEditKind::RemoveFlag, L"--single-argument", nullptr },
+        { CommandLineEditKind::SetFlag, L"--load-extension", kExtension }
+    };
+
+    const CommandLineEdit kRemoveEdits[] = {
+        { CommandLineEditKind::RemoveFlag, L"--load-extension", kExtension }
+    };
+
+    // The rewritten line, or "<failed>" when the rewriter rejects the input
+    template <size_t N>
+    std::wstring Rewrite(const std::wstring& input, const CommandLineEdit (&edits)[N]) {
+        std::vector<wchar_t> output(CommandLineRewriteBound(input.size(), edits, N));
+        size_t length = 0;
+        if (!RewriteCommandLine(input.c_str(), input.size(), edits, N, output.data(), output.size(), length)) {
+            return L"<failed>";
+        }
+        EXPECT_EQ(output[length], L'\0');
+        return std::wstring(output.data(), length);
+    }
+}
+
+TEST(CommandLineRewriter, InsertsExtensionBeforePlaceholder) {
+    EXPECT_EQ(Rewrite(L"\"C:\\chrome.exe\" --single-argument %1", kInstallEdits),
+        L"\"C:\\chrome.exe\" --load-extension=\"C:\\Program Files\\New Tab\\build\" %1");
+    EXPECT_EQ(Rewrite(L"\"C:\\chrome.exe\" \"%1\"", kInstallEdits),
+        L"\"C:\\chrome.exe\" --load-extension=\"C:\\Program Files\\New Tab\\build\" \"%1\"");
+}
+
+TEST(CommandLineRewriter, InsertsExtensionBeforeEndOfOptions) {
+    EXPECT_EQ(Rewrite(L"\"chrome.exe\" -- \"%1\"", kInstallEdits),
+        L"\"chrome.exe\" --load-extension=\"C:\\Program Files\\New Tab\\build\" -- \"%1\"");
+    EXPECT_EQ(Rewrite(L"chrome.exe --", kInstallEdits),
+        L"chrome.exe --load-extension=\"C:\\Program Files\\New Tab\\build\" --");
+}
+
+TEST(CommandLineRewriter, LeavesArgumentsAfterEndOfOptionsAlone) {
+    EXPECT_EQ(Rewrite(L"chrome.exe -- --load-extension=\"C:\\Program Files\\New Tab\\build\"", kRemoveEdits),
+        L"chrome.exe -- --load-extension=\"C:\\Program Files\\New Tab\\build\"");
+    EXPECT_EQ(Rewrite(L"chrome.exe -- --single-argument", kInstallEdits),
+        L"chrome.exe --load-extension=\"C:\\Program Files\\New Tab\\build\" -- --single-argument");
+}
+
+TEST(CommandLineRewriter, MatchesFlagsQuotedAsAWhole) {
+    EXPECT_EQ(Rewrite(L"chrome.exe \"--load-extension=C:\\Program Files\\New Tab\\build\" %1", kRemoveEdits),
+        L"chrome.exe %1");
+    EXPECT_EQ(Rewrite(L"chrome.exe \"--load-extension=C:\\Program Files\\old\" \"--single-argument\" %1", kInstallEdits),
+        L"chrome.exe --load-extension=\"C:\\Program Files\\New Tab\\build\" %1");
+    EXPECT_EQ(Rewrite(L"chrome.exe \"--load-extension=C:\\other\" %1", kRemoveEdits),
+        L"chrome.exe \"--load-extension=C:\\other\" %1");
+}
+
+TEST(CommandLineRewriter, AppendsWhenThereIsNoPlaceholder) {
+    EXPECT_EQ(Rewrite(L"chrome.exe --profile-directory=Default", kInstallEdits),
+        L"chrome.exe --profile-directory=Default --load-extension=\"C:\\Program Files\\New Tab\\build\"");
+}
+
+TEST(CommandLineRewriter, ReplacesExistingFlagAndDropsDuplicates) {
+    EXPECT_EQ(Rewrite(L"chrome.exe --load-extension=C:\\old --load-extension=\"C:\\older\" %1", kInstallEdits),
+        L"chrome.exe --load-extension=\"C:\\Program Files\\New Tab\\build\" %1");
+}
+
+TEST(CommandLineRewriter, InstallIsIdempotent) {
+    std::wstring once = Rewrite(L"\"C:\\chrome.exe\" --single-argument %1", kInstallEdits);
+    EXPECT_EQ(Rewrite(once, kInstallEdits), once);
+}
+
+TEST(CommandLineRewriter, RemovesOnlyOurExtension) {
+    EXPECT_EQ(Rewrite(L"chrome.exe --load-extension=\"C:\\Program Files\\New Tab\\build\" %1", kRemoveEdits),
+        L"chrome.exe %1");
+    EXPECT_EQ(Rewrite(L"chrome.exe --load-extension=C:\\other %1", kRemoveEdits),
+        L"chrome.exe --load-extension=C:\\other %1");
+}
+
+TEST(CommandLineRewriter, RemoveUndoesInstall) {
+    const std::wstring original = L"\"C:\\chrome.exe\" --profile-directory=Default %1";
+    EXPECT_EQ(Rewrite(Rewrite(original, kInstallEdits), kRemoveEdits), original);
+}
+
+TEST(CommandLineRewriter, KeepsQuotedArgumentsWhole) {
+    EXPECT_EQ(Rewrite(L"\"C:\\Program Files\\Browser\\chrome.exe\"   --flag=\"a b\"\t%1", kRemoveEdits),
+        L"\"C:\\Program Files\\Browser\\chrome.exe\" --flag=\"a b\" %1");
+}
+
+TEST(CommandLineRewriter, DoesNotMatchFlagPrefixes) {
+    EXPECT_EQ(Rewrite(L"chrome.exe --load-extensions=x %1", kRemoveEdits), L"chrome.exe --load-extensions=x %1");
+    const CommandLineEdit removeAll[] = { { CommandLineEditKind::RemoveFlag, L"--single-argument", nullptr } };
+    EXPECT_EQ(Rewrite(L"chrome.exe --single-argument-x %1", removeAll), L"chrome.exe --single-argument-x %1");
+}
+
+TEST(CommandLineRewriter, RejectsUnterminatedQuote) {
+    EXPECT_EQ(Rewrite(L"\"C:\\chrome.exe %1", kInstallEdits), L"<failed>");
+}
+
+TEST(CommandLineRewriter, RejectsTooManyArguments) {
+    std::wstring line = L"chrome.exe";
+    for (size_t i = 0; i < kMaxCommandLineTokens; ++i) {
+        line += L" -x";
+    }
+    EXPECT_EQ(Rewrite(line, kInstallEdits), L"<failed>");
+}
+
+TEST(CommandLineRewriter, FailsWhenOutputDoesNotFit) {
+    const std::wstring input = L"chrome.exe %1";
+    wchar_t output[16];
+    size_t length = 0;
+    EXPECT_FALSE(RewriteCommandLine(input.c_str(), input.size(), kInstallEdits, 2, output, 16, length));
+}
+
+TEST(CommandLineRewriter, BoundCoversEveryInsertion) {
+    const std::wstring input = L"chrome.exe";
+    size_t bound = CommandLineRewriteBound(input.size(), kInstallEdits, 2);
+    std::vector<wchar_t> output(bound);
+    size_t length = 0;
+    ASSERT_TRUE(RewriteCommandLine(input.c_str(), input.size(), kInstallEdits, 2, output.data(), output.size(), length));
+    EXPECT_LT(length, bound);
+}
+
+// Random option lists from the argument shapes seen in browser registrations, followed by
+// one of the usual endings. Whatever the options, install must be idempotent and stay within
+// the bound, leave exactly one copy of our flag among the options and the ending as it was,
+// and remove must take out just that copy.
+TEST(CommandLineRewriter, PropertiesHoldForRandomLines) {
+    const wchar_t* const options[] = {
+        L"--profile-directory=Default", L"--single-argument", L"\"--single-argument\"",
+        L"--load-extension=C:\\old", L"\"--load-extension=C:\\Program Files\\New Tab\\build\"",
+        L"--load-extensions=x", L"--flag=\"a b\"", L"\"quoted arg\"", L"-x"
+    };
+    const wchar_t* const endings[] = {
+        L"", L" %1", L" \"%1\"", L" -- \"%1\"", L" -- --single-argument --load-extension=C:\\x %1"
+    };
+    const std::wstring flag = L" --load-extension=\"C:\\Program Files\\New Tab\\build\"";
+
+    std::mt19937 random(20261017);
+    for (int run = 0; run < 2000; ++run) {
+        std::wstring line = L"\"C:\\Program Files\\Browser\\chrome.exe\"";
+        size_t count = random() % 8;
+        for (size_t i = 0; i < count; ++i) {
+            line += L" ";
+            line += options[random() % (sizeof(options) / sizeof(options[0]))];
+        }
+        const std::wstring ending = endings[random() % (sizeof(endings) / sizeof(endings[0]))];
+        line += ending;
+
+        std::wstring installed = Rewrite(line, kInstallEdits);
+        ASSERT_NE(installed, L"<failed>") << line;
+        EXPECT_LT(installed.size(), CommandLineRewriteBound(line.size(), kInstallEdits, 2)) << line;
+        EXPECT_EQ(Rewrite(installed, kInstallEdits), installed) << line;
+
+        ASSERT_GE(installed.size(), flag.size() + ending.size()) << line;
+        std::wstring head = installed.substr(0, installed.size() - ending.size());
+        EXPECT_EQ(installed.substr(head.size()), ending) << line;
+        size_t flagAt = head.find(flag);
+        ASSERT_NE(flagAt, std::wstring::npos) << line;
+        EXPECT_EQ(head.rfind(flag), flagAt) << line;
+        EXPECT_EQ(head.find(L"--single-argument"), std::wstring::npos) << line;
+
+        std::wstring removed = Rewrite(installed, kRemoveEdits);
+        EXPECT_EQ(removed, head.substr(0, flagAt) + head.substr(flagAt + flag.size()) + ending) << line;
+    }
+}
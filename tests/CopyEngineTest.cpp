@@ -0,0 +1,191 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <map>
+#include <string>
+#include "CopyBuildFolder/AssetStore.h"
+#include "CopyBuildFolder/CopyEngine.h"
+#include "TestSupport.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+    // Every file below `root` with its contents, keyed by relative path
+    std::map<std::string, Bytes> Snapshot(const fs::path& root) {
+        std::map<std::string, Bytes> files;
+        for (const auto& entry : fs::recursive_directory_iterator(root)) {
+            if (entry.is_regular_file()) {
+                files[fs::relative(entry.path(), root).generic_string()] = ReadFile(entry.path());
+            }
+        }
+        return files;
+    }
+}
+
+TEST(CopyEngine, CopiesTreeWithSmallMediumAndChunkedFiles) {
+    TempDirectory temp;
+    fs::path source = temp.Path() / "source";
+    MakeTree(source, 40, 4, 300);
+    fs::create_directories(source / "empty" / "nested");
+    WriteFile(source / "medium.bin", MakeContent(100 * 1024, 7));
+    WriteFile(source / "large.bin", MakeContent(5 * 1024 * 1024 + 123, 8));
+
+    CopyOptions options;
+    options.maxThreads = 4;
+    options.bufferSize = 64 * 1024;
+    options.chunkSize = 1024 * 1024;
+    CopyStats stats;
+    ASSERT_TRUE(CopyTree(source, temp.Path() / "destination", options, stats));
+
+    EXPECT_EQ(Snapshot(source), Snapshot(temp.Path() / "destination"));
+    EXPECT_TRUE(fs::is_directory(temp.Path() / "destination" / "empty" / "nested"));
+    EXPECT_EQ(stats.files, 42u);
+    EXPECT_EQ(stats.directories, 6u);
+    EXPECT_EQ(stats.bytesWritten, stats.bytes);
+    EXPECT_TRUE(stats.errors.empty());
+}
+
+TEST(CopyEngine, OverwritesExistingFiles) {
+    TempDirectory temp;
+    fs::path source = temp.Path() / "source";
+    fs::path destination = temp.Path() / "destination";
+    fs::create_directories(source);
+    fs::create_directories(destination);
+    WriteFile(source / "a.js", ToBytes("new"));
+    WriteFile(destination / "a.js", ToBytes("old contents"));
+
+    CopyStats stats;
+    ASSERT_TRUE(CopyTree(source, destination, CopyOptions(), stats));
+    EXPECT_EQ(ReadFile(destination / "a.js"), ToBytes("new"));
+}
+
+TEST(CopyEngine, IncrementalCopySkipsUnchangedFiles) {
+    TempDirectory temp;
+    fs::path source = temp.Path() / "source";
+    fs::path destination = temp.Path() / "destination";
+    MakeTree(source, 20, 2, 1000);
+
+    CopyOptions options;
+    options.incremental = true;
+    CopyStats first;
+    ASSERT_TRUE(CopyTree(source, destination, options, first));
+    EXPECT_EQ(first.files, 20u);
+
+    WriteFile(source / "dir0" / "file0.js", MakeContent(1001, 99));
+    CopyStats second;
+    ASSERT_TRUE(CopyTree(source, destination, options, second));
+    EXPECT_EQ(second.files, 1u);
+    EXPECT_EQ(second.skipped, 19u);
+    EXPECT_EQ(Snapshot(source), Snapshot(destination));
+}
+
+TEST(CopyEngine, IncrementalWritesFollowTheSizeOfTheChange) {
+    TempDirectory temp;
+    fs::path source = temp.Path() / "source";
+    fs::path destination = temp.Path() / "destination";
+    MakeTree(source, 100, 5, 2000);
+
+    CopyOptions options;
+    options.incremental = true;
+    CopyStats first;
+    ASSERT_TRUE(CopyTree(source, destination, options, first));
+
+    CopyStats unchanged;
+    ASSERT_TRUE(CopyTree(source, destination, options, unchanged));
+    EXPECT_EQ(unchanged.files, 0u);
+    EXPECT_EQ(unchanged.skipped, 100u);
+    EXPECT_EQ(unchanged.bytesWritten, 0u);
+    EXPECT_EQ(unchanged.bytesRead, 0u);
+
+    // Five files edited in place and one added
+    for (size_t i = 0; i < 100; i += 20) {
+        WriteFile(source / ("dir" + std::to_string(i % 5)) / ("file" + std::to_string(i) + ".js"), MakeContent(2500, 1000 + i));
+    }
+    WriteFile(source / "dir1" / "added.js", MakeContent(700, 5));
+    CopyStats upgrade;
+    ASSERT_TRUE(CopyTree(source, destination, options, upgrade));
+    EXPECT_EQ(upgrade.files, 6u);
+    EXPECT_EQ(upgrade.skipped, 100u - 5u);
+    EXPECT_EQ(upgrade.bytesWritten, 5u * 2500u + 700u);
+    EXPECT_EQ(Snapshot(source), Snapshot(destination));
+}
+
+TEST(CopyEngine, ContentComparisonCatchesSameSizedEdits) {
+    TempDirectory temp;
+    fs::path source = temp.Path() / "source";
+    fs::path destination = temp.Path() / "destination";
+    fs::create_directories(source);
+    WriteFile(source / "a.js", ToBytes("aaaa"));
+    WriteFile(source / "b.js", ToBytes("bbbb"));
+
+    CopyOptions options;
+    options.incremental = true;
+    options.compareContent = true;
+    CopyStats first;
+    ASSERT_TRUE(CopyTree(source, destination, options, first));
+
+    // Same size, different timestamp: only a content check can tell the two apart
+    WriteFile(source / "a.js", ToBytes("AAAA"));
+    fs::last_write_time(source / "b.js", fs::last_write_time(source / "b.js") + std::chrono::seconds(5));
+    CopyStats second;
+    ASSERT_TRUE(CopyTree(source, destination, options, second));
+    EXPECT_EQ(second.files, 1u);
+    EXPECT_EQ(second.skipped, 1u);
+    EXPECT_EQ(ReadFile(destination / "a.js"), ToBytes("AAAA"));
+}
+
+TEST(CopyEngine, RemovesStaleEntries) {
+    TempDirectory temp;
+    fs::path source = temp.Path() / "source";
+    fs::path destination = temp.Path() / "destination";
+    MakeTree(source, 4, 2, 10);
+    fs::create_directories(destination / "old" / "deeper");
+    WriteFile(destination / "old" / "deeper" / "x.js", ToBytes("x"));
+    WriteFile(destination / "stale.js", ToBytes("y"));
+
+    CopyOptions options;
+    options.removeStale = true;
+    CopyStats stats;
+    ASSERT_TRUE(CopyTree(source, destination, options, stats));
+    EXPECT_FALSE(fs::exists(destination / "old"));
+    EXPECT_FALSE(fs::exists(destination / "stale.js"));
+    EXPECT_EQ(stats.removed, 4u);
+    EXPECT_EQ(Snapshot(source), Snapshot(destination));
+}
+
+TEST(CopyEngine, CopyWithoutTheStoreLeavesOtherThemesLinksAlone) {
+    TempDirectory temp;
+    fs::path source = temp.Path() / "source";
+    MakeTree(source, 10, 2, 500);
+    WriteFile(source / "large.bin", MakeContent(3 * 1024 * 1024, 11));
+
+    AssetStore store(temp.Path() / "store");
+    CopyOptions linked;
+    linked.store = &store;
+    CopyStats one;
+    CopyStats two;
+    ASSERT_TRUE(CopyTree(source, temp.Path() / "one", linked, one));
+    ASSERT_TRUE(CopyTree(source, temp.Path() / "two", linked, two));
+    ASSERT_EQ(two.linked, 11u);
+    const std::map<std::string, Bytes> original = Snapshot(source);
+
+    // A later run that could not open the store rewrites "one", small files and chunked alike
+    MakeTree(source, 10, 2, 600);
+    WriteFile(source / "large.bin", MakeContent(3 * 1024 * 1024, 12));
+    CopyOptions plain;
+    plain.maxThreads = 4;
+    plain.chunkSize = 1024 * 1024;
+    CopyStats again;
+    ASSERT_TRUE(CopyTree(source, temp.Path() / "one", plain, again));
+
+    EXPECT_EQ(Snapshot(temp.Path() / "one"), Snapshot(source));
+    EXPECT_EQ(Snapshot(temp.Path() / "two"), original);
+    EXPECT_EQ(fs::hard_link_count(temp.Path() / "one" / "large.bin"), 1u);
+}
+
+TEST(CopyEngine, ReportsMissingSource) {
+    TempDirectory temp;
+    CopyStats stats;
+    EXPECT_FALSE(CopyTree(temp.Path() / "missing", temp.Path() / "destination", CopyOptions(), stats));
+    EXPECT_FALSE(stats.errors.empty());
+}
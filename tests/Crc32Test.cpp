@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <zlib.h>
+#include "SFX/Crc32.h"
+#include "TestSupport.h"
+
+namespace {
+    uint32_t ZlibCrc32(const unsigned char* data, size_t size) {
+        return static_cast<uint32_t>(crc32(0, data, static_cast<uInt>(size)));
+    }
+}
+
+TEST(Crc32, MatchesKnownValues) {
+    Bytes check = ToBytes("123456789");
+    EXPECT_EQ(UpdateCrc32(0, check.data(), check.size()), 0xCBF43926u);
+    EXPECT_EQ(UpdateCrc32(0, nullptr, 0), 0u);
+    EXPECT_EQ(UpdateCrc32(0x12345678, nullptr, 0), 0x12345678u);
+}
+
+TEST(Crc32, MatchesZlibAtEverySizeAndAlignment) {
+    // Sizes around the 64-byte folding threshold and its multiples, at every offset within a
+    // 16-byte line, so both the folding path and the table tail are covered
+    Bytes data = MakeNoise(4096 + 64, 1);
+    for (size_t offset = 0; offset < 16; ++offset) {
+        for (size_t size = 0; size <= 300; ++size) {
+            ASSERT_EQ(UpdateCrc32(0, data.data() + offset, size), ZlibCrc32(data.data() + offset, size))
+                << "offset " << offset << " size " << size;
+        }
+    }
+}
+
+TEST(Crc32, MatchesZlibOnRandomInputs) {
+    std::mt19937 random(17);
+    Bytes data = MakeNoise(1 << 20, 2);
+    for (int run = 0; run < 500; ++run) {
+        size_t offset = random() % 64;
+        size_t size = random() % (data.size() - offset);
+        ASSERT_EQ(UpdateCrc32(0, data.data() + offset, size), ZlibCrc32(data.data() + offset, size))
+            << "offset " << offset << " size " << size;
+    }
+}
+
+TEST(Crc32, ContinuesAcrossChunks) {
+    std::mt19937 random(23);
+    Bytes data = MakeContent(3 * 1024 * 1024 + 5, 3);
+    uint32_t expected = ZlibCrc32(data.data(), data.size());
+    for (int run = 0; run < 20; ++run) {
+        uint32_t crc = 0;
+        size_t pos = 0;
+        while (pos < data.size()) {
+            size_t chunk = std::min<size_t>(data.size() - pos, random() % 100000);
+            crc = UpdateCrc32(crc, data.data() + pos, chunk);
+            pos += chunk;
+        }
+        EXPECT_EQ(crc, expected) << run;
+    }
+}
@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include "CopyBuildFolder/DeleteEngine.h"
+#include "Fakes.h"
+#include "TestSupport.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+    RemoveOptions Fast() {
+        RemoveOptions options;
+        options.maxThreads = 4;
+        options.batchSize = 8;
+        options.retries = 3;
+        options.retryDelayMs = 1;
+        return options;
+    }
+}
+
+TEST(DeleteEngine, RemovesTheWholeTree) {
+    TempDirectory temp;
+    fs::path root = temp.Path() / "build";
+    MakeTree(root, 200, 10, 100);
+    fs::create_directories(root / "empty" / "nested");
+
+    StdRemoveBackend backend;
+    RemoveReport report = RemoveTree(root, backend, Fast());
+    EXPECT_TRUE(report.Complete());
+    EXPECT_EQ(report.filesRemoved, 200u);
+    EXPECT_EQ(report.directoriesRemoved, 13u);
+    EXPECT_EQ(report.retried, 0u);
+    EXPECT_FALSE(fs::exists(root));
+}
+
+TEST(DeleteEngine, MissingRootIsNothingToDo) {
+    TempDirectory temp;
+    StdRemoveBackend backend;
+    RemoveReport report = RemoveTree(temp.Path() / "absent", backend, Fast());
+    EXPECT_TRUE(report.Complete());
+    EXPECT_EQ(report.filesRemoved, 0u);
+}
+
+TEST(DeleteEngine, RetriesFilesReleasedWhileWaiting) {
+    TempDirectory temp;
+    fs::path root = temp.Path() / "build";
+    MakeTree(root, 20, 2, 10);
+
+    ScriptedRemoveBackend backend;
+    backend.busy[root / "dir0" / "file0.js"] = 2;
+    backend.busy[root / "dir1" / "file1.js"] = 1;
+    RemoveReport report = RemoveTree(root, backend, Fast());
+    EXPECT_TRUE(report.Complete());
+    EXPECT_EQ(report.retried, 2u);
+    EXPECT_EQ(report.filesRemoved, 20u);
+    EXPECT_TRUE(backend.scheduled.empty());
+    EXPECT_FALSE(fs::exists(root));
+}
+
+TEST(DeleteEngine, DefersFilesStillBusyAndTheirDirectoriesAfterThem) {
+    TempDirectory temp;
+    fs::path root = temp.Path() / "build";
+    MakeTree(root, 20, 2, 10);
+    const fs::path locked = root / "dir0" / "file0.js";
+
+    ScriptedRemoveBackend backend;
+    backend.busy[locked] = -1;
+    RemoveReport report = RemoveTree(root, backend, Fast());
+    EXPECT_FALSE(report.Complete());
+    EXPECT_TRUE(report.failed.empty());
+    EXPECT_EQ(report.filesRemoved, 19u);
+    EXPECT_EQ(report.retried, 1u);
+    // The file, then its directory, then the root; dir1 emptied out and is gone
+    EXPECT_EQ(report.deferred, (std::vector<fs::path>{ locked, root / "dir0", root }));
+    EXPECT_EQ(backend.scheduled, report.deferred);
+    EXPECT_FALSE(fs::exists(root / "dir1"));
+    // One attempt per file up front, one per retry round for the locked file, and the three
+    // directories, which the std backend also removes through RemoveFile
+    EXPECT_EQ(backend.attempts, 20u + 3u + 3u);
+}
+
+TEST(DeleteEngine, ReportsBusyFilesAsFailedWhenRemovalCannotBeDeferred) {
+    TempDirectory temp;
+    fs::path root = temp.Path() / "build";
+    MakeTree(root, 4, 1, 10);
+    const fs::path locked = root / "dir0" / "file1.js";
+
+    ScriptedRemoveBackend backend;
+    backend.canDefer = false;
+    backend.busy[locked] = -1;
+    RemoveReport report = RemoveTree(root, backend, Fast());
+    EXPECT_TRUE(report.deferred.empty());
+    EXPECT_EQ(report.failed, (std::vector<fs::path>{ locked, root / "dir0", root }));
+    EXPECT_TRUE(fs::exists(locked));
+}
@@ -0,0 +1,571 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "BrowserUpdater/PolicyRefresh.h"
+#include "BrowserUpdater/ProfileFanOut.h"
+#include "BrowserUpdater/RegistryTransaction.h"
+#include "BrowserUpdater/ShortcutIndex.h"
+#include "BrowserUpdater/ShortcutSession.h"
+#include "Common/ActionLog.h"
+#include "CopyBuildFolder/DeleteEngine.h"
+#include "SFX/Crc32.h"
+#include "SFX/ParallelExtract.h"
+#include "SFX/StagingDirectory.h"
+#include "TestSupport.h"
+
+// In-memory stand-ins for the Windows backends. They hold their state in plain containers so
+// tests can seed and inspect it, and count calls so benchmarks can report them.
+
+// Registry default values keyed by root and subkey. Writes to keys in `failWrites` fail.
+class MemoryRegistry : public RegistryBackend {
+public:
+    std::map<std::pair<RegistryRoot, std::wstring>, std::wstring> values;
+    std::set<std::wstring> failWrites;
+    size_t reads = 0;
+    size_t writes = 0;
+
+    bool ReadDefaultValue(RegistryRoot root, const std::wstring& subKey, std::wstring& value) override {
+        std::lock_guard<std::mutex> guard(lock_);
+        ++reads;
+        auto it = values.find({ root, subKey });
+        if (it == values.end()) {
+            return false;
+        }
+        value = it->second;
+        return true;
+    }
+
+    bool WriteDefaultValue(RegistryRoot root, const std::wstring& subKey, const std::wstring& value) override {
+        std::lock_guard<std::mutex> guard(lock_);
+        ++writes;
+        if (failWrites.count(subKey) != 0) {
+            return false;
+        }
+        values[{ root, subKey }] = value;
+        return true;
+    }
+
+    const std::wstring& Value(RegistryRoot root, const std::wstring& subKey) {
+        return values[{ root, subKey }];
+    }
+
+private:
+    std::mutex lock_;
+};
+
+// Folders of shortcut files. A folder that was never added is reported as missing.
+class MemoryShortcutFileSystem : public ShortcutFileSystem {
+public:
+    struct Folder {
+        std::vector<std::wstring> files;         // Directly in the folder
+        std::vector<std::wstring> nestedFiles;   // In subfolders, listed only when recursive
+    };
+    std::map<std::wstring, Folder> folders;
+    std::map<std::wstring, std::vector<unsigned char>> contents;
+
+    void AddShortcut(const std::wstring& folder, const std::wstring& name, const std::vector<unsigned char>& data,
+        bool nested = false) {
+        std::lock_guard<std::mutex> guard(lock_);
+        std::wstring path = folder + L"\\" + name;
+        (nested ? folders[folder].nestedFiles : folders[folder].files).push_back(path);
+        contents[path] = data;
+    }
+
+    bool ListShortcuts(const std::wstring& folder, bool recursive, std::vector<std::wstring>& paths) override {
+        std::lock_guard<std::mutex> guard(lock_);
+        auto it = folders.find(folder);
+        if (it == folders.end()) {
+            return false;
+        }
+        paths.insert(paths.end(), it->second.files.begin(), it->second.files.end());
+        if (recursive) {
+            paths.insert(paths.end(), it->second.nestedFiles.begin(), it->second.nestedFiles.end());
+        }
+        return true;
+    }
+
+    bool ReadFileHead(const std::wstring& path, size_t maxBytes, std::vector<unsigned char>& data) override {
+        std::lock_guard<std::mutex> guard(lock_);
+        auto it = contents.find(path);
+        if (it == contents.end()) {
+            return false;
+        }
+        size_t size = std::min(maxBytes, it->second.size());
+        data.assign(it->second.begin(), it->second.begin() + static_cast<std::ptrdiff_t>(size));
+        return true;
+    }
+
+private:
+    std::mutex lock_;
+};
+
+// Shortcut arguments by path. Saving a path in `failSaves` fails.
+class MemoryLinkStore : public ShortcutLinkStore {
+public:
+    std::map<std::wstring, std::wstring> arguments;
+    std::set<std::wstring> failSaves;
+    bool ready = true;
+    size_t loads = 0;
+    size_t saves = 0;
+
+    bool IsReady() const override {
+        return ready;
+    }
+
+    bool Load(const std::wstring& path) override {
+        ++loads;
+        auto it = arguments.find(path);
+        if (it == arguments.end()) {
+            return false;
+        }
+        loaded_ = path;
+        pending_ = it->second;
+        return true;
+    }
+
+    bool GetArguments(std::wstring& value) override {
+        value = pending_;
+        return true;
+    }
+
+    bool SetArguments(const std::wstring& value) override {
+        pending_ = value;
+        return true;
+    }
+
+    bool Save() override {
+        ++saves;
+        if (failSaves.count(loaded_) != 0) {
+            return false;
+        }
+        arguments[loaded_] = pending_;
+        return true;
+    }
+
+private:
+    std::wstring loaded_;
+    std::wstring pending_;
+};
+
+// Extraction into memory. Records the order of directory and file creation; writing the entry
+// named `failEntry` fails, and `interruptEntry` keeps half of its file and fails, as a run
+// stopped while writing it would. Entries listed in `present` count as already extracted;
+// with `verifyContents`, held files whose size and CRC-32 match do instead, as the stub's
+// directory target checks them on disk.
+class MemoryExtractionTarget : public ExtractionTarget {
+public:
+    std::vector<std::string> directories;
+    std::map<std::string, Bytes> files;
+    std::set<std::string> present;
+    std::string failEntry;
+    std::string interruptEntry;
+    size_t filesBeforeDirectories = 0;  // Files written while directories were still being made
+    size_t writes = 0;
+    bool keepContents = true;           // Off for benchmarks, which only need the decoding
+    bool verifyContents = false;
+
+    bool MakeDirectory(const ZipEntry& directory) override {
+        std::lock_guard<std::mutex> guard(lock_);
+        filesBeforeDirectories += files.size();
+        directories.push_back(directory.name);
+        return true;
+    }
+
+    bool WriteEntry(const unsigned char* image, size_t size, const ZipEntry& entry) override {
+        if (entry.name == failEntry) {
+            return false;
+        }
+        bool success;
+        if (keepContents) {
+            VectorSink sink;
+            success = ExtractZipEntry(image, size, entry, sink);
+            if (entry.name == interruptEntry) {
+                sink.data.resize(sink.data.size() / 2);
+                success = false;
+            }
+            std::lock_guard<std::mutex> guard(lock_);
+            ++writes;
+            files[entry.name] = std::move(sink.data);
+        }
+        else {
+            NullSink sink;
+            success = ExtractZipEntry(image, size, entry, sink);
+        }
+        return success;
+    }
+
+    bool IsExtracted(const ZipEntry& entry) override {
+        std::unique_lock<std::mutex> guard(lock_);
+        if (!verifyContents) {
+            return present.count(entry.name) != 0;
+        }
+        auto file = files.find(entry.name);
+        if (file == files.end() || file->second.size() != entry.uncompressedSize) {
+            return false;
+        }
+        // Only this worker handles the entry, so its file stays put while the CRC is taken unlocked
+        const Bytes& data = file->second;
+        guard.unlock();
+        return UpdateCrc32(0, data.data(), data.size()) == entry.crc32;
+    }
+
+private:
+    std::mutex lock_;
+};
+
+// Collects logged lines, split back out of the batches the writer thread hands over
+class MemoryLogSink : public LogSink {
+public:
+    void Write(const char* lines, size_t length) override {
+        std::lock_guard<std::mutex> guard(lock_);
+        ++batches_;
+        bytes_ += length;
+        largest_ = std::max(largest_, length);
+        if (!keepLines) {
+            return;
+        }
+        size_t start = 0;
+        for (size_t i = 0; i <= length; ++i) {
+            if (i == length || lines[i] == '\n') {
+                lines_.emplace_back(lines + start, i - start);
+                start = i + 1;
+            }
+        }
+    }
+
+    std::vector<std::string> Lines() {
+        std::lock_guard<std::mutex> guard(lock_);
+        return lines_;
+    }
+
+    size_t Batches() {
+        std::lock_guard<std::mutex> guard(lock_);
+        return batches_;
+    }
+
+    size_t LargestBatch() {
+        std::lock_guard<std::mutex> guard(lock_);
+        return largest_;
+    }
+
+    size_t MaxBatch() const override {
+        return maxBatch;
+    }
+
+    bool keepLines = true; // Off for benchmarks, which only count
+    size_t maxBatch = 16 * 1024;
+
+private:
+    std::mutex lock_;
+    std::vector<std::string> lines_;
+    size_t batches_ = 0;
+    size_t bytes_ = 0;
+    size_t largest_ = 0;
+};
+
+// Removes through std::filesystem, but reports the files in `busy` as held open for the given
+// number of attempts (or forever, for a count of -1). Deferrals are recorded in order.
+class ScriptedRemoveBackend : public StdRemoveBackend {
+public:
+    std::map<std::filesystem::path, int> busy;
+    bool canDefer = true;
+    std::vector<std::filesystem::path> scheduled;
+    size_t attempts = 0;
+
+    RemoveResult RemoveFile(const std::filesystem::path& path) override {
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            ++attempts;
+            auto it = busy.find(path);
+            if (it != busy.end() && it->second != 0) {
+                if (it->second > 0) {
+                    --it->second;
+                }
+                return RemoveResult::Busy;
+            }
+        }
+        return StdRemoveBackend::RemoveFile(path);
+    }
+
+    bool ScheduleRemoval(const std::filesystem::path& path) override {
+        std::lock_guard<std::mutex> guard(lock_);
+        if (canDefer) {
+            scheduled.push_back(path);
+        }
+        return canDefer;
+    }
+
+private:
+    std::mutex lock_;
+};
+
+// Directories and files as sets of paths. Locks behave as the stub's unshared handles: a path
+// held by one lock cannot be locked again or deleted until the lock is gone. `lockCreated`
+// lets another run take the next N new directories before their creator can.
+class MemoryStagingBackend : public StagingBackend {
+public:
+    std::set<std::wstring> directories;
+    std::set<std::wstring> files;
+    int lockCreated = 0;
+    bool failAllCreates = false;
+    std::vector<std::unique_ptr<StagingLock>> foreignLocks;
+
+    // The locks reach back into the backend, so they go while it is still whole
+    ~MemoryStagingBackend() override {
+        foreignLocks.clear();
+    }
+
+    wchar_t Separator() const override { return L'/'; }
+
+    std::vector<std::wstring> ListDirectories(const std::wstring& root, const std::wstring& prefix) override {
+        std::lock_guard<std::mutex> guard(lock_);
+        std::vector<std::wstring> names;
+        for (const auto& directory : directories) {
+            if (directory.compare(0, root.size(), root) == 0) {
+                std::wstring name = directory.substr(root.size());
+                if (name.compare(0, prefix.size(), prefix) == 0 && name.find(L'/') == std::wstring::npos) {
+                    names.push_back(name);
+                }
+            }
+        }
+        return names;
+    }
+
+    bool CreatePrivateDirectory(const std::wstring& path) override {
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            if (failAllCreates || !directories.insert(path).second) {
+                return false;
+            }
+            if (lockCreated <= 0) {
+                return true;
+            }
+            --lockCreated;
+        }
+        std::unique_ptr<StagingLock> stolen = Lock(path + L"/.lock");
+        std::lock_guard<std::mutex> guard(lock_);
+        foreignLocks.push_back(std::move(stolen));
+        return true;
+    }
+
+    std::unique_ptr<StagingLock> Lock(const std::wstring& path) override {
+        std::lock_guard<std::mutex> guard(lock_);
+        if (!held_.insert(path).second) {
+            return nullptr;
+        }
+        files.insert(path);
+        return std::unique_ptr<StagingLock>(new HeldLock(*this, path));
+    }
+
+    void RemoveContents(const std::wstring& directory, const std::wstring& keep) override {
+        std::lock_guard<std::mutex> guard(lock_);
+        for (auto it = files.begin(); it != files.end();) {
+            bool inside = it->compare(0, directory.size(), directory) == 0 && *it != directory + keep;
+            it = inside && held_.count(*it) == 0 ? files.erase(it) : std::next(it);
+        }
+        for (auto it = directories.begin(); it != directories.end();) {
+            bool inside = it->size() > directory.size() && it->compare(0, directory.size(), directory) == 0;
+            it = inside ? directories.erase(it) : std::next(it);
+        }
+    }
+
+    bool RemoveFile(const std::wstring& path) override {
+        std::lock_guard<std::mutex> guard(lock_);
+        return held_.count(path) == 0 && files.erase(path) != 0;
+    }
+
+    bool RemoveEmptyDirectory(const std::wstring& path) override {
+        std::lock_guard<std::mutex> guard(lock_);
+        std::wstring inside = path + L"/";
+        auto file = files.lower_bound(inside);
+        if (file != files.end() && file->compare(0, inside.size(), inside) == 0) {
+            return false;
+        }
+        auto directory = directories.lower_bound(inside);
+        if (directory != directories.end() && directory->compare(0, inside.size(), inside) == 0) {
+            return false;
+        }
+        return directories.erase(path) != 0;
+    }
+
+    void AddFile(const std::wstring& path) {
+        std::lock_guard<std::mutex> guard(lock_);
+        files.insert(path);
+    }
+
+    bool IsHeld(const std::wstring& path) {
+        std::lock_guard<std::mutex> guard(lock_);
+        return held_.count(path) != 0;
+    }
+
+private:
+    class HeldLock : public StagingLock {
+    public:
+        HeldLock(MemoryStagingBackend& backend, const std::wstring& path) : backend_(backend), path_(path) {}
+        ~HeldLock() override {
+            std::lock_guard<std::mutex> guard(backend_.lock_);
+            backend_.held_.erase(path_);
+        }
+
+    private:
+        MemoryStagingBackend& backend_;
+        std::wstring path_;
+    };
+
+    std::mutex lock_;
+    std::set<std::wstring> held_;
+};
+
+// Profiles and hives of a machine. Hives in `loadedHives` are under HKEY_USERS; LoadHive adds
+// a profile's hive there until the returned handle goes, unless its SID is in `unloadable`.
+// User Shell Folders values are keyed by SID and name and readable only while the hive is
+// loaded. Every call waits `latencyMicroseconds`, like a registry round trip.
+class MemoryProfileStore : public ProfileStore {
+public:
+    std::vector<ProfileDirectory> directories;
+    std::set<std::wstring> loadedHives;
+    std::set<std::wstring> unloadable;
+    std::map<std::pair<std::wstring, std::wstring>, std::wstring> shellFolders;
+    unsigned latencyMicroseconds = 0;
+    int loads = 0;
+    int unloads = 0;
+
+    bool ListProfileDirectories(std::vector<ProfileDirectory>& profiles) override {
+        Wait();
+        profiles = directories;
+        return true;
+    }
+
+    bool ListLoadedHives(std::vector<std::wstring>& sids) override {
+        Wait();
+        std::lock_guard<std::mutex> guard(lock_);
+        sids.assign(loadedHives.begin(), loadedHives.end());
+        return true;
+    }
+
+    std::unique_ptr<LoadedHive> LoadHive(const UserProfile& profile) override {
+        Wait();
+        std::lock_guard<std::mutex> guard(lock_);
+        if (unloadable.count(profile.sid) != 0 || !loadedHives.insert(profile.sid).second) {
+            return nullptr;
+        }
+        loadedHives.insert(profile.sid + L"_Classes");
+        ++loads;
+        return std::unique_ptr<LoadedHive>(new MemoryHive(*this, profile.sid));
+    }
+
+    bool ReadShellFolder(const std::wstring& sid, const wchar_t* name, std::wstring& value) override {
+        Wait();
+        std::lock_guard<std::mutex> guard(lock_);
+        auto found = shellFolders.find({ sid, name });
+        if (loadedHives.count(sid) == 0 || found == shellFolders.end()) {
+            return false;
+        }
+        value = found->second;
+        return true;
+    }
+
+private:
+    class MemoryHive : public LoadedHive {
+    public:
+        MemoryHive(MemoryProfileStore& store, const std::wstring& sid) : store_(store), sid_(sid) {}
+        ~MemoryHive() override {
+            std::lock_guard<std::mutex> guard(store_.lock_);
+            store_.loadedHives.erase(sid_);
+            store_.loadedHives.erase(sid_ + L"_Classes");
+            ++store_.unloads;
+        }
+
+    private:
+        MemoryProfileStore& store_;
+        std::wstring sid_;
+    };
+
+    void Wait() const {
+        if (latencyMicroseconds != 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(latencyMicroseconds));
+        }
+    }
+
+    std::mutex lock_;
+};
+
+// Machine policy values keyed by key and name. Write and Remove stand in for the registry
+// changes of the installation's deferred script.
+class MemoryPolicyReader : public PolicyReader {
+public:
+    std::map<std::wstring, uint32_t> dwords;
+    std::map<std::wstring, std::wstring> strings;
+
+    bool ReadDword(const wchar_t* key, const wchar_t* name, uint32_t& value) override {
+        auto found = dwords.find(Path(key, name));
+        if (found == dwords.end()) {
+            return false;
+        }
+        value = found->second;
+        return true;
+    }
+
+    bool ReadString(const wchar_t* key, const wchar_t* name, std::wstring& value) override {
+        auto found = strings.find(Path(key, name));
+        if (found == strings.end()) {
+            return false;
+        }
+        value = found->second;
+        return true;
+    }
+
+    void Write(const PolicyValue* values, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            if (values[i].type == PolicyValueType::Dword) {
+                dwords[Path(values[i].key, values[i].name)] = values[i].number;
+            }
+            else {
+                strings[Path(values[i].key, values[i].name)] = values[i].text;
+            }
+        }
+    }
+
+    void Remove(const PolicyValue* values, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            dwords.erase(Path(values[i].key, values[i].name));
+            strings.erase(Path(values[i].key, values[i].name));
+        }
+    }
+
+private:
+    static std::wstring Path(const wchar_t* key, const wchar_t* name) {
+        return std::wstring(key) + L"\\" + name;
+    }
+};
+
+// Process runner returning `result` after `delayMilliseconds`, recording what it was asked to run
+class ScriptedProcessRunner : public ProcessRunner {
+public:
+    ProcessResult result;
+    unsigned delayMilliseconds = 0;
+    int runs = 0;
+    std::wstring commandLine;
+    uint32_t timeoutMilliseconds = 0;
+
+    ProcessResult Run(const std::wstring& command, uint32_t timeout) override {
+        ++runs;
+        commandLine = command;
+        timeoutMilliseconds = timeout;
+        if (delayMilliseconds != 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(delayMilliseconds));
+        }
+        return result;
+    }
+};
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+
+#include <zlib.h>
+#include "SFX/Inflate.h"
+#include "TestSupport.h"
+
+namespace {
+    Bytes Inflate(const Bytes& stream, bool& success) {
+        VectorSink sink;
+        success = InflateRaw(stream.data(), stream.size(), sink);
+        return sink.data;
+    }
+
+    // Every input is decoded with our inflater and compared with the original zlib compressed
+    void ExpectRoundTrip(const Bytes& data, int level, int strategy) {
+        Bytes stream = DeflateRaw(data, level, strategy);
+        bool success = false;
+        Bytes decoded = Inflate(stream, success);
+        ASSERT_TRUE(success) << "level " << level << " strategy " << strategy << " size " << data.size();
+        EXPECT_TRUE(decoded == data) << "level " << level << " strategy " << strategy << " size " << data.size();
+    }
+}
+
+TEST(Inflate, MatchesZlibAtEveryLevel) {
+    Bytes data = MakeContent(200 * 1024, 1);
+    for (int level = 0; level <= 9; ++level) {
+        ExpectRoundTrip(data, level, Z_DEFAULT_STRATEGY);
+    }
+}
+
+TEST(Inflate, MatchesZlibForEveryStrategy) {
+    Bytes data = MakeContent(100 * 1024, 2);
+    for (int strategy : { Z_FILTERED, Z_HUFFMAN_ONLY, Z_RLE, Z_FIXED }) {
+        ExpectRoundTrip(data, 6, strategy);
+    }
+}
+
+TEST(Inflate, HandlesIncompressibleAndRepetitiveData) {
+    ExpectRoundTrip(MakeNoise(300 * 1024, 3), 9, Z_DEFAULT_STRATEGY);
+    ExpectRoundTrip(Bytes(1 << 20, 'a'), 9, Z_DEFAULT_STRATEGY);
+    ExpectRoundTrip(Bytes(), 6, Z_DEFAULT_STRATEGY);
+    ExpectRoundTrip(Bytes(1, 'x'), 6, Z_DEFAULT_STRATEGY);
+}
+
+TEST(Inflate, StreamsOutputLargerThanTheWindow) {
+    // Matches reach back across window wraps many times over
+    Bytes data = MakeContent(5 * 1024 * 1024 + 17, 4);
+    ExpectRoundTrip(data, 1, Z_DEFAULT_STRATEGY);
+}
+
+TEST(Inflate, RejectsTruncatedStreams) {
+    Bytes stream = DeflateRaw(MakeContent(64 * 1024, 5));
+    for (size_t size : { size_t(0), size_t(1), stream.size() / 2, stream.size() - 1 }) {
+        Bytes truncated(stream.begin(), stream.begin() + static_cast<std::ptrdiff_t>(size));
+        bool success = true;
+        Inflate(truncated, success);
+        EXPECT_FALSE(success) << size;
+    }
+}
+
+TEST(Inflate, RejectsInvalidBlockType) {
+    // BFINAL=1, BTYPE=11 (reserved)
+    Bytes stream = { 0x07, 0x00 };
+    bool success = true;
+    Inflate(stream, success);
+    EXPECT_FALSE(success);
+}
+
+TEST(Inflate, RejectsStoredBlockWithBadLength) {
+    // Stored block whose LEN and NLEN do not complement each other
+    Bytes stream = { 0x01, 0x05, 0x00, 0x00, 0x00, 'h', 'e', 'l', 'l', 'o' };
+    bool success = true;
+    Inflate(stream, success);
+    EXPECT_FALSE(success);
+}
+
+TEST(Inflate, RejectsDistanceBeforeTheStart) {
+    // Final fixed Huffman block: literal 'a', then a match of length 3 at distance 2, which
+    // reaches before the first byte; zlib reports "invalid distance too far back"
+    Bytes stream = { 0x4B, 0x04, 0x42, 0x00 };
+    bool success = true;
+    Inflate(stream, success);
+    EXPECT_FALSE(success);
+}
+
+TEST(Inflate, StopsWhenTheSinkFails) {
+    Bytes stream = DeflateRaw(MakeContent(512 * 1024, 6));
+    VectorSink sink;
+    sink.limit = 100 * 1024;
+    EXPECT_FALSE(InflateRaw(stream.data(), stream.size(), sink));
+    EXPECT_LE(sink.data.size(), sink.limit);
+}
@@ -0,0 +1,146 @@
+#include <gtest/gtest.h>
+
+#include "MsiBlock.h"
+#include "PackerInputs.h"
+#include "SFX/Crc32.h"
+
+namespace {
+    MsiOptions Cached(const std::string& directory, int level = 9) {
+        MsiOptions options;
+        options.codec.level = level;
+        options.cacheDir = directory;
+        return options;
+    }
+
+    Bytes Decode(const MsiBlock& block) {
+        if (block.method == kZipMethodStored) {
+            return Bytes(block.data, block.data + block.compressedSize);
+        }
+        VectorSink sink;
+        EXPECT_TRUE(InflateRaw(block.data, static_cast<size_t>(block.compressedSize), sink));
+        return sink.data;
+    }
+
+    std::string Pack(PackerInputs& inputs, const MsiOptions& options, const std::string& output, MsiBlockSource& source) {
+        PackShared shared;
+        std::string error;
+        EXPECT_TRUE(shared.Load(inputs.stub, "", inputs.msi, options, error)) << error;
+        source = shared.MsiSource();
+        PackStats stats;
+        EXPECT_TRUE(PackTheme(shared, inputs.Theme("theme.zip", 4, 1), ThemeOptions(), inputs.Path(output), stats, error)) << error;
+        return inputs.Path(output);
+    }
+}
+
+TEST(MsiBlock, DeflatesTheMsiOnce) {
+    PackerInputs inputs;
+    MappedInput msi;
+    ASSERT_TRUE(msi.Open(inputs.msi));
+    std::vector<unsigned char> buffer;
+    MsiBlock block;
+    ASSERT_TRUE(CompressMsi(msi, CodecChoice(), buffer, block));
+    EXPECT_EQ(block.method, kZipMethodDeflated);
+    EXPECT_LT(block.compressedSize, block.uncompressedSize / 2);
+    EXPECT_EQ(block.crc32, UpdateCrc32(0, inputs.msiContent.data(), inputs.msiContent.size()));
+    EXPECT_EQ(Decode(block), inputs.msiContent);
+}
+
+TEST(MsiBlock, StoresAnMsiThatDoesNotCompress) {
+    PackerInputs inputs;
+    std::string noise = inputs.Write("noise.msi", MakeNoise(256 * 1024, 5));
+    MappedInput msi;
+    ASSERT_TRUE(msi.Open(noise));
+    std::vector<unsigned char> buffer;
+    MsiBlock block;
+    ASSERT_TRUE(CompressMsi(msi, CodecChoice(), buffer, block));
+    EXPECT_EQ(block.method, kZipMethodStored);
+    EXPECT_EQ(block.data, msi.Data());
+    EXPECT_EQ(block.compressedSize, msi.Size());
+}
+
+TEST(MsiBlock, ReusesTheCachedBlockOnTheNextRun) {
+    PackerInputs inputs;
+    std::string cache = inputs.Path("cache");
+    MsiBlockSource first;
+    MsiBlockSource second;
+    MsiBlockSource uncached;
+    std::string compressed = Pack(inputs, Cached(cache), "first.exe", first);
+    std::string cached = Pack(inputs, Cached(cache), "second.exe", second);
+    std::string plain = Pack(inputs, Cached(""), "plain.exe", uncached);
+
+    EXPECT_EQ(first, MsiBlockSource::Compressed);
+    EXPECT_EQ(second, MsiBlockSource::Cached);
+    EXPECT_EQ(uncached, MsiBlockSource::Compressed);
+    EXPECT_EQ(ReadFile(cached), ReadFile(compressed));
+    EXPECT_EQ(ReadFile(plain), ReadFile(compressed));
+    EXPECT_EQ(ReadInstaller(cached)["NewTabSetup.msi"], inputs.msiContent);
+}
+
+TEST(MsiBlock, KeysBlocksByContentAndCodec) {
+    PackerInputs inputs;
+    MappedInput msi;
+    ASSERT_TRUE(msi.Open(inputs.msi));
+    CodecChoice level6;
+    level6.level = 6;
+    EXPECT_NE(MsiBlockCache::Key(msi, CodecChoice()), MsiBlockCache::Key(msi, level6));
+    EXPECT_EQ(MsiBlockCache::Key(msi, CodecChoice()).find(':'), std::string::npos);
+
+    PackerInputs other(1024 * 1024);
+    MappedInput otherMsi;
+    ASSERT_TRUE(otherMsi.Open(other.msi));
+    EXPECT_NE(MsiBlockCache::Key(msi, CodecChoice()), MsiBlockCache::Key(otherMsi, CodecChoice()));
+}
+
+TEST(MsiBlock, IgnoresDamagedCacheEntries) {
+    PackerInputs inputs;
+    std::string cache = inputs.Path("cache");
+    MsiBlockSource source;
+    Pack(inputs, Cached(cache), "first.exe", source);
+
+    MappedInput msi;
+    ASSERT_TRUE(msi.Open(inputs.msi));
+    std::filesystem::path entry = std::filesystem::path(cache) / (MsiBlockCache::Key(msi, CodecChoice()) + ".msiblock");
+    ASSERT_TRUE(std::filesystem::exists(entry));
+
+    // Truncated data, a header claiming another size, a flipped byte in the compressed data and
+    // a changed CRC; each is compressed afresh and replaced
+    Bytes block = ReadFile(entry);
+    WriteFile(entry, Bytes(block.begin(), block.end() - 100));
+    Pack(inputs, Cached(cache), "truncated.exe", source);
+    EXPECT_EQ(source, MsiBlockSource::Compressed);
+    EXPECT_EQ(ReadFile(entry), block);
+
+    Bytes resized = block;
+    resized[16] ^= 1;
+    WriteFile(entry, resized);
+    std::string output = Pack(inputs, Cached(cache), "resized.exe", source);
+    EXPECT_EQ(source, MsiBlockSource::Compressed);
+    EXPECT_EQ(ReadInstaller(output)["NewTabSetup.msi"], inputs.msiContent);
+
+    Bytes flipped = block;
+    flipped[flipped.size() / 2] ^= 0x40;
+    WriteFile(entry, flipped);
+    output = Pack(inputs, Cached(cache), "flipped.exe", source);
+    EXPECT_EQ(source, MsiBlockSource::Compressed);
+    EXPECT_EQ(ReadInstaller(output)["NewTabSetup.msi"], inputs.msiContent);
+    EXPECT_EQ(ReadFile(entry), block);
+
+    Bytes crc = block;
+    crc[8] ^= 1;
+    WriteFile(entry, crc);
+    output = Pack(inputs, Cached(cache), "crc.exe", source);
+    EXPECT_EQ(source, MsiBlockSource::Compressed);
+    EXPECT_EQ(ReadInstaller(output)["NewTabSetup.msi"], inputs.msiContent);
+}
+
+TEST(MsiBlock, CachesTheDecisionToStore) {
+    PackerInputs inputs;
+    inputs.msi = inputs.Write("noise.msi", MakeNoise(128 * 1024, 6));
+    std::string cache = inputs.Path("cache");
+    MsiBlockSource first;
+    MsiBlockSource second;
+    Pack(inputs, Cached(cache), "first.exe", first);
+    std::string output = Pack(inputs, Cached(cache), "second.exe", second);
+    EXPECT_EQ(second, MsiBlockSource::Cached);
+    EXPECT_EQ(ReadInstaller(output)["NewTabSetup.msi"], ReadFile(inputs.msi));
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <openssl/evp.h>
+#include <openssl/pkcs12.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+#include "SFX/ZipReader.h"
+#include "SfxPacker.h"
+#include "TestSupport.h"
+
+// Files sfxpack reads, written to a scratch directory: an unsigned PE32+ stub with a
+// certificate table entry, a compressible MSI, theme archives of script-like files and, for
+// signing, a self-signed certificate.
+class PackerInputs {
+public:
+    explicit PackerInputs(size_t msiSize = 2 * 1024 * 1024) {
+        stub = Write("SFX.exe", MakePeImage(true, 0x1000));
+        msi = Write("NewTabSetup.msi", MakeContent(msiSize, 0x4D5349));
+        msiContent = ReadFile(msi);
+    }
+
+    std::string Path(const std::string& name) const {
+        return (temp.Path() / name).string();
+    }
+
+    std::string Write(const std::string& name, const Bytes& content) {
+        WriteFile(temp.Path() / name, content);
+        return Path(name);
+    }
+
+    // Theme ZIP with `files` deflated scripts in a static/ folder; returns its path
+    std::string Theme(const std::string& name, size_t files, uint32_t seed) {
+        ZipBuilder zip;
+        zip.AddDirectory("static");
+        for (size_t i = 0; i < files; ++i) {
+            zip.AddFile("static/file" + std::to_string(i) + ".js", MakeContent(2000 + i * 300, seed + static_cast<uint32_t>(i)), 8);
+        }
+        zip.AddFile("index.html", ToBytes("<html>" + name + "</html>"), 0);
+        return Write(name, zip.Build());
+    }
+
+    // Self-signed certificate and RSA key in a PKCS#12 file protected by `password`, as
+    // --pkcs12 takes; returns its path
+    std::string Certificate(const std::string& name, const std::string& password) {
+        EVP_PKEY* key = nullptr;
+        EVP_PKEY_CTX* context = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr);
+        if (context == nullptr || EVP_PKEY_keygen_init(context) <= 0 ||
+            EVP_PKEY_CTX_set_rsa_keygen_bits(context, 2048) <= 0 || EVP_PKEY_keygen(context, &key) <= 0) {
+            throw std::runtime_error("RSA key generation failed");
+        }
+        EVP_PKEY_CTX_free(context);
+
+        X509* certificate = X509_new();
+        X509_set_version(certificate, 2);
+        ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+        X509_gmtime_adj(X509_getm_notBefore(certificate), 0);
+        X509_gmtime_adj(X509_getm_notAfter(certificate), 365L * 24 * 3600);
+        X509_set_pubkey(certificate, key);
+        X509_NAME* subject = X509_get_subject_name(certificate);
+        X509_NAME_add_entry_by_txt(subject, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("New Tab Test Signer"), -1, -1, 0);
+        X509_set_issuer_name(certificate, subject);
+        X509_sign(certificate, key, EVP_sha256());
+
+        PKCS12* pkcs12 = PKCS12_create(password.c_str(), "signer", key, certificate, nullptr, 0, 0, 0, 0, 0);
+        if (pkcs12 == nullptr) {
+            throw std::runtime_error("PKCS12_create failed");
+        }
+        int length = i2d_PKCS12(pkcs12, nullptr);
+        Bytes der(static_cast<size_t>(length));
+        unsigned char* p = der.data();
+        i2d_PKCS12(pkcs12, &p);
+        PKCS12_free(pkcs12);
+        X509_free(certificate);
+        EVP_PKEY_free(key);
+        return Write(name, der);
+    }
+
+    TempDirectory temp;
+    std::string stub;
+    std::string msi;
+    Bytes msiContent;
+};
+
+// Decodes every file entry of an installer, keyed by name. Empty if the payload cannot be read.
+inline std::map<std::string, Bytes> ReadInstaller(const std::string& path) {
+    std::map<std::string, Bytes> files;
+    Bytes image = ReadFile(path);
+    PayloadLocation location;
+    std::vector<ZipEntry> entries;
+    if (!LocateZipPayload(image.data(), image.size(), location) ||
+        !ReadZipEntries(image.data(), image.size(), location, entries)) {
+        return files;
+    }
+    for (const auto& entry : entries) {
+        VectorSink sink;
+        if (!entry.isDirectory && ExtractZipEntry(image.data(), image.size(), entry, sink)) {
+            files[entry.name] = std::move(sink.data);
+        }
+    }
+    return files;
+}
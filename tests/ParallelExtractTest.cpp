@@ -0,0 +1,153 @@
+#include <gtest/gtest.h>
+
+#include "Fakes.h"
+#include "SFX/ParallelExtract.h"
+#include "TestSupport.h"
+
+namespace {
+    struct Payload {
+        Bytes image;
+        std::vector<ZipEntry> entries;
+        std::map<std::string, Bytes> contents;
+    };
+
+    Payload MakePayload(size_t files) {
+        Payload payload;
+        ZipBuilder zip;
+        for (size_t i = 0; i < files; ++i) {
+            std::string name = "build/" + std::to_string(i % 5) + "/deep/file" + std::to_string(i) + ".js";
+            Bytes data = MakeContent(100 + i * 37, static_cast<uint32_t>(i));
+            zip.AddFile(name, data, i % 3 == 0 ? 0 : 8);
+            payload.contents[name] = data;
+        }
+        payload.image = MakePeImage(true, 0x200);
+        Append(payload.image, zip.Build());
+
+        PayloadLocation location;
+        EXPECT_TRUE(LocateZipPayload(payload.image.data(), payload.image.size(), location));
+        EXPECT_TRUE(ReadZipEntries(payload.image.data(), payload.image.size(), location, payload.entries));
+        return payload;
+    }
+
+    ExtractionOptions Threads(unsigned count) {
+        ExtractionOptions options;
+        options.maxThreads = count;
+        return options;
+    }
+}
+
+TEST(ParallelExtract, PlansParentsBeforeChildren) {
+    std::vector<ZipEntry> entries(3);
+    entries[0].name = "a/b/c/file.txt";
+    entries[1].name = "a/x/";
+    entries[1].isDirectory = true;
+    entries[2].name = "top.txt";
+
+    std::vector<std::string> names;
+    for (const auto& directory : PlanDirectories(entries)) {
+        EXPECT_TRUE(directory.isDirectory);
+        names.push_back(directory.name);
+    }
+    EXPECT_EQ(names, (std::vector<std::string>{ "a", "a/b", "a/x", "a/b/c" }));
+}
+
+TEST(ParallelExtract, ExtractsEveryEntryOnceWithAnyThreadCount) {
+    Payload payload = MakePayload(120);
+    for (unsigned threads : { 1u, 2u, 4u, 0u }) {
+        MemoryExtractionTarget target;
+        ASSERT_TRUE(ExtractEntriesParallel(payload.image.data(), payload.image.size(), payload.entries, target,
+            Threads(threads))) << threads;
+        EXPECT_EQ(target.files, payload.contents) << threads;
+        EXPECT_EQ(target.filesBeforeDirectories, 0u);
+        EXPECT_EQ(target.directories.size(), 11u);
+    }
+}
+
+TEST(ParallelExtract, StopsAfterAFailure) {
+    Payload payload = MakePayload(60);
+    MemoryExtractionTarget target;
+    target.failEntry = payload.entries[10].name;
+    EXPECT_FALSE(ExtractEntriesParallel(payload.image.data(), payload.image.size(), payload.entries, target, Threads(4)));
+    EXPECT_EQ(target.files.count(target.failEntry), 0u);
+}
+
+TEST(ParallelExtract, RefusesUnsafeNamesBeforeWritingAnything) {
+    Payload payload = MakePayload(4);
+    payload.entries[3].name = "build/../../evil.dll";
+    MemoryExtractionTarget target;
+    EXPECT_FALSE(ExtractEntriesParallel(payload.image.data(), payload.image.size(), payload.entries, target, Threads(2)));
+    EXPECT_TRUE(target.directories.empty());
+    EXPECT_TRUE(target.files.empty());
+}
+
+TEST(ParallelExtract, ResumeSkipsEntriesAlreadyExtracted) {
+    Payload payload = MakePayload(30);
+    MemoryExtractionTarget target;
+    for (size_t i = 0; i < 20; ++i) {
+        target.present.insert(payload.entries[i].name);
+    }
+
+    ExtractionOptions options = Threads(2);
+    options.resume = true;
+    ASSERT_TRUE(ExtractEntriesParallel(payload.image.data(), payload.image.size(), payload.entries, target, options));
+    EXPECT_EQ(target.files.size(), 10u);
+    for (size_t i = 20; i < 30; ++i) {
+        EXPECT_EQ(target.files.count(payload.entries[i].name), 1u);
+    }
+}
+
+TEST(ParallelExtract, WithoutResumeEverythingIsWritten) {
+    Payload payload = MakePayload(10);
+    MemoryExtractionTarget target;
+    for (const auto& entry : payload.entries) {
+        target.present.insert(entry.name);
+    }
+    ASSERT_TRUE(ExtractEntriesParallel(payload.image.data(), payload.image.size(), payload.entries, target, Threads(2)));
+    EXPECT_EQ(target.files.size(), 10u);
+}
+
+TEST(ParallelExtract, ResumesAnInterruptedRun) {
+    Payload payload = MakePayload(80);
+    for (unsigned threads : { 1u, 4u }) {
+        MemoryExtractionTarget target;
+        target.verifyContents = true;
+        target.interruptEntry = payload.entries[50].name;
+        ASSERT_FALSE(ExtractEntriesParallel(payload.image.data(), payload.image.size(), payload.entries, target,
+            Threads(threads)));
+        ASSERT_EQ(target.files.count(target.interruptEntry), 1u);
+        EXPECT_LT(target.files[target.interruptEntry].size(), payload.contents[target.interruptEntry].size());
+
+        // Damage a finished file the way a bad sector or another process might; its size still matches
+        std::string damaged = payload.entries[5].name;
+        if (target.files.count(damaged) != 0) {
+            target.files[damaged][0] ^= 0xFF;
+        }
+
+        size_t intact = 0;
+        for (const auto& file : target.files) {
+            intact += file.second == payload.contents[file.first] ? 1 : 0;
+        }
+
+        // The rerun rewrites the cut and damaged files and whatever was never reached
+        target.interruptEntry.clear();
+        target.writes = 0;
+        ExtractionOptions options = Threads(threads);
+        options.resume = true;
+        ASSERT_TRUE(ExtractEntriesParallel(payload.image.data(), payload.image.size(), payload.entries, target, options))
+            << threads;
+        EXPECT_EQ(target.files, payload.contents) << threads;
+        EXPECT_EQ(target.writes, payload.contents.size() - intact) << threads;
+    }
+}
+
+TEST(ParallelExtract, ResumeOfACompleteRunWritesNothing) {
+    Payload payload = MakePayload(40);
+    MemoryExtractionTarget target;
+    target.verifyContents = true;
+    target.files = payload.contents;
+
+    ExtractionOptions options = Threads(4);
+    options.resume = true;
+    ASSERT_TRUE(ExtractEntriesParallel(payload.image.data(), payload.image.size(), payload.entries, target, options));
+    EXPECT_EQ(target.writes, 0u);
+}
@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+
+#include "CodecMeasure.h"
+#include "PackerInputs.h"
+#include "PayloadEncoder.h"
+
+namespace {
+    CodecChoice Parse(const std::string& text) {
+        CodecChoice choice;
+        EXPECT_TRUE(ParseCodecChoice(text, choice)) << text;
+        return choice;
+    }
+
+    Bytes Decode(uint16_t method, const Bytes& data, bool& success) {
+        VectorSink sink;
+        const PayloadCodec* codec = FindCodec(method);
+        success = codec != nullptr && codec->decode(data.data(), data.size(), sink);
+        return sink.data;
+    }
+}
+
+TEST(PayloadCodec, StubDecodesOnlyStoredAndDeflated) {
+    ASSERT_NE(FindCodec(kZipMethodStored), nullptr);
+    ASSERT_NE(FindCodec(kZipMethodDeflated), nullptr);
+    EXPECT_STREQ(FindCodec(kZipMethodStored)->name, "store");
+    EXPECT_EQ(FindCodecByName("deflate"), FindCodec(kZipMethodDeflated));
+
+    // zstd (93) and LZMA (14) have no decoder in the stub
+    EXPECT_EQ(FindCodec(93), nullptr);
+    EXPECT_EQ(FindCodec(14), nullptr);
+    EXPECT_EQ(FindCodecByName("zstd"), nullptr);
+    EXPECT_EQ(FindCodecByName("lzma"), nullptr);
+}
+
+TEST(PayloadCodec, ParsesCodecsAndLevels) {
+    CodecChoice store = Parse("store");
+    EXPECT_EQ(store.method, kZipMethodStored);
+    EXPECT_EQ(DescribeCodecChoice(store), "store");
+
+    CodecChoice deflate = Parse("deflate");
+    EXPECT_EQ(deflate.method, kZipMethodDeflated);
+    EXPECT_EQ(deflate.level, 9);
+    EXPECT_EQ(DescribeCodecChoice(Parse("deflate:1")), "deflate:1");
+
+    for (const char* text : { "store:1", "deflate:0", "deflate:10", "deflate:", "deflate:5x", "zstd", "lzma:9", "" }) {
+        CodecChoice choice;
+        EXPECT_FALSE(ParseCodecChoice(text, choice)) << text;
+    }
+}
+
+TEST(PayloadCodec, EncodedPayloadsDecodeThroughTheStubTable) {
+    Bytes data = MakeContent(256 * 1024, 1);
+    for (int level = 1; level <= 9; ++level) {
+        CodecChoice choice;
+        choice.level = level;
+        Bytes encoded;
+        uint16_t method = 0;
+        ASSERT_TRUE(EncodePayload(choice, data.data(), data.size(), encoded, method)) << level;
+        ASSERT_EQ(method, kZipMethodDeflated) << level;
+        EXPECT_LT(encoded.size(), data.size()) << level;
+
+        bool success = false;
+        EXPECT_TRUE(Decode(method, encoded, success) == data) << level;
+        EXPECT_TRUE(success) << level;
+    }
+}
+
+TEST(PayloadCodec, KeepsDataTheCodecCannotShrink) {
+    Bytes noise = MakeNoise(64 * 1024, 2);
+    Bytes encoded = ToBytes("stale");
+    uint16_t method = kZipMethodDeflated;
+    ASSERT_TRUE(EncodePayload(Parse("deflate"), noise.data(), noise.size(), encoded, method));
+    EXPECT_EQ(method, kZipMethodStored);
+    EXPECT_TRUE(encoded.empty());
+
+    ASSERT_TRUE(EncodePayload(Parse("deflate"), nullptr, 0, encoded, method));
+    EXPECT_EQ(method, kZipMethodStored);
+    ASSERT_TRUE(EncodePayload(Parse("store"), noise.data(), noise.size(), encoded, method));
+    EXPECT_EQ(method, kZipMethodStored);
+    EXPECT_TRUE(encoded.empty());
+}
+
+TEST(PayloadCodec, RecompressedThemesKeepTheirContent) {
+    PackerInputs inputs(64 * 1024);
+    std::string theme = inputs.Theme("theme.zip", 6, 3);
+    ThemeInput original;
+    std::string error;
+    ASSERT_TRUE(original.Open(theme, ThemeOptions(), error)) << error;
+
+    for (const char* codec : { "store", "deflate:1", "deflate:9" }) {
+        ThemeOptions options;
+        options.recompress = true;
+        options.codec = Parse(codec);
+        ThemeInput input;
+        ASSERT_TRUE(input.Open(theme, options, error)) << codec << ": " << error;
+        ASSERT_EQ(input.Entries().size(), original.Entries().size());
+
+        for (size_t i = 0; i < input.Entries().size(); ++i) {
+            const ThemeInput::Entry& entry = input.Entries()[i];
+            EXPECT_EQ(entry.name, original.Entries()[i].name);
+            EXPECT_EQ(entry.crc32, original.Entries()[i].crc32);
+            if (entry.isDirectory) {
+                continue;
+            }
+            if (options.codec.method == kZipMethodStored) {
+                EXPECT_EQ(entry.method, kZipMethodStored) << entry.name;
+            }
+            bool success = false;
+            Bytes data(entry.data, entry.data + entry.compressedSize);
+            EXPECT_EQ(Decode(entry.method, data, success).size(), entry.uncompressedSize) << codec << " " << entry.name;
+            EXPECT_TRUE(success) << codec << " " << entry.name;
+        }
+    }
+}
+
+TEST(PayloadCodec, MeasuresEveryCodecOnTheSameFiles) {
+    PackerInputs inputs(64 * 1024);
+    std::vector<std::string> themes = { inputs.Theme("a.zip", 10, 1), inputs.Theme("b.zip", 5, 2) };
+    std::vector<CodecChoice> codecs = { Parse("store"), Parse("deflate:1"), Parse("deflate:9") };
+
+    std::vector<CodecMeasurement> results;
+    std::string error;
+    ASSERT_TRUE(MeasureCodecs(themes, codecs, results, error)) << error;
+    ASSERT_EQ(results.size(), 3u);
+    for (const auto& result : results) {
+        EXPECT_EQ(result.files, 17u);
+        EXPECT_EQ(result.inputBytes, results[0].inputBytes);
+    }
+    EXPECT_EQ(results[0].outputBytes, results[0].inputBytes);
+    EXPECT_LT(results[1].outputBytes, results[1].inputBytes);
+    EXPECT_LE(results[2].outputBytes, results[1].outputBytes);
+    EXPECT_EQ(DescribeCodecChoice(results[2].codec), "deflate:9");
+}
+
+TEST(PayloadCodec, MeasureReportsUnreadableThemes) {
+    PackerInputs inputs(64 * 1024);
+    std::vector<CodecMeasurement> results;
+    std::string error;
+    EXPECT_FALSE(MeasureCodecs({ inputs.Write("bad.zip", ToBytes("not a zip")) }, { Parse("store") }, results, error));
+    EXPECT_NE(error.find("bad.zip"), std::string::npos) << error;
+    EXPECT_TRUE(results.empty());
+}
@@ -0,0 +1,181 @@
+#include <gtest/gtest.h>
+
+#include <map>
+#include <string>
+#include "CopyBuildFolder/AssetStore.h"
+#include "CopyBuildFolder/PayloadInstall.h"
+#include "TestSupport.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+    // An SFX image holding the MSI and a theme under build/, with the theme's files by
+    // relative path and their total size
+    struct Installer {
+        Bytes image;
+        std::map<std::string, Bytes> theme;
+        uint64_t themeBytes = 0;
+    };
+
+    Installer MakeInstaller(size_t files, uint32_t seed) {
+        Installer installer;
+        ZipBuilder zip;
+        zip.AddFile("NewTabSetup.msi", MakeContent(50000, 0x4D5349), 8);
+        zip.AddDirectory("build/static");
+        for (size_t i = 0; i < files; ++i) {
+            std::string name = "static/" + std::to_string(i % 4) + "/file" + std::to_string(i) + ".js";
+            Bytes data = MakeContent(1000 + i * 97, seed + static_cast<uint32_t>(i));
+            zip.AddFile("build/" + name, data, i % 5 == 0 ? 0 : 8);
+            installer.themeBytes += data.size();
+            installer.theme[name] = std::move(data);
+        }
+        installer.image = MakePeImage(true, 0x1000);
+        Append(installer.image, zip.Build());
+        return installer;
+    }
+
+    std::map<std::string, Bytes> Snapshot(const fs::path& root) {
+        std::map<std::string, Bytes> files;
+        for (const auto& entry : fs::recursive_directory_iterator(root)) {
+            if (entry.is_regular_file()) {
+                files[fs::relative(entry.path(), root).generic_string()] = ReadFile(entry.path());
+            }
+        }
+        return files;
+    }
+
+    bool Install(const Installer& installer, const fs::path& destination, const CopyOptions& options, CopyStats& stats) {
+        return InstallFromPayload(installer.image.data(), installer.image.size(), "build/", destination, options, stats);
+    }
+
+    CopyOptions Upgrade() {
+        CopyOptions options;
+        options.incremental = true;
+        options.removeStale = true;
+        options.maxThreads = 4;
+        return options;
+    }
+}
+
+TEST(PayloadInstall, InstallsOnlyTheThemeFromThePayload) {
+    TempDirectory temp;
+    Installer installer = MakeInstaller(30, 1);
+    CopyStats stats;
+    ASSERT_TRUE(Install(installer, temp.Path() / "build", CopyOptions(), stats));
+
+    EXPECT_EQ(Snapshot(temp.Path() / "build"), installer.theme);
+    EXPECT_FALSE(fs::exists(temp.Path() / "build" / "NewTabSetup.msi"));
+    EXPECT_EQ(stats.files, 30u);
+    EXPECT_EQ(stats.bytes, installer.themeBytes);
+    EXPECT_TRUE(stats.errors.empty());
+}
+
+// The direct install writes each theme byte once and reads only the compressed entries. The
+// staged path it replaces wrote the theme on extraction and again on the copy, and read it back
+// in between.
+TEST(PayloadInstall, WritesTheThemeOnceInsteadOfTwice) {
+    TempDirectory temp;
+    Installer installer = MakeInstaller(40, 2);
+    CopyStats direct;
+    ASSERT_TRUE(Install(installer, temp.Path() / "direct", CopyOptions(), direct));
+    EXPECT_EQ(direct.bytesWritten, installer.themeBytes);
+    EXPECT_LT(direct.bytesRead, installer.themeBytes);
+
+    fs::path staged = temp.Path() / "staged";
+    for (const auto& file : installer.theme) {
+        fs::create_directories((staged / file.first).parent_path());
+        WriteFile(staged / file.first, file.second);
+    }
+    CopyStats copy;
+    ASSERT_TRUE(CopyTree(staged, temp.Path() / "copied", CopyOptions(), copy));
+    EXPECT_EQ(installer.themeBytes + copy.bytesWritten, 2 * direct.bytesWritten);
+    EXPECT_EQ(copy.bytesRead, installer.themeBytes);
+    EXPECT_EQ(Snapshot(temp.Path() / "direct"), Snapshot(temp.Path() / "copied"));
+}
+
+TEST(PayloadInstall, UpgradesRewriteOnlyWhatChanged) {
+    TempDirectory temp;
+    fs::path destination = temp.Path() / "build";
+    Installer installer = MakeInstaller(20, 3);
+    CopyStats first;
+    ASSERT_TRUE(Install(installer, destination, Upgrade(), first));
+
+    CopyStats same;
+    ASSERT_TRUE(Install(installer, destination, Upgrade(), same));
+    EXPECT_EQ(same.files, 0u);
+    EXPECT_EQ(same.skipped, 20u);
+    EXPECT_EQ(same.bytesWritten, 0u);
+
+    // One file damaged in place, one stale file left by an older theme
+    Bytes damaged = installer.theme["static/1/file1.js"];
+    damaged[10] ^= 0xFF;
+    WriteFile(destination / "static" / "1" / "file1.js", damaged);
+    WriteFile(destination / "static" / "old.js", ToBytes("stale"));
+
+    CopyStats repair;
+    ASSERT_TRUE(Install(installer, destination, Upgrade(), repair));
+    EXPECT_EQ(repair.files, 1u);
+    EXPECT_EQ(repair.bytesWritten, installer.theme["static/1/file1.js"].size());
+    EXPECT_EQ(repair.removed, 1u);
+    EXPECT_EQ(Snapshot(destination), installer.theme);
+}
+
+TEST(PayloadInstall, ThemesShareFilesThroughTheAssetStore) {
+    TempDirectory temp;
+    AssetStore store(temp.Path() / "store");
+    CopyOptions options;
+    options.store = &store;
+    Installer installer = MakeInstaller(12, 4);
+
+    CopyStats first;
+    ASSERT_TRUE(Install(installer, temp.Path() / "one", options, first));
+    CopyStats second;
+    ASSERT_TRUE(Install(installer, temp.Path() / "two", options, second));
+    EXPECT_EQ(first.linked, 0u);
+    EXPECT_EQ(second.linked, 12u);
+    EXPECT_EQ(Snapshot(temp.Path() / "two"), installer.theme);
+    EXPECT_EQ(fs::hard_link_count(temp.Path() / "two" / "static" / "0" / "file0.js"), 3u);
+}
+
+TEST(PayloadInstall, InstallWithoutTheStoreLeavesOtherThemesLinksAlone) {
+    TempDirectory temp;
+    AssetStore store(temp.Path() / "store");
+    CopyOptions linked;
+    linked.store = &store;
+    Installer installer = MakeInstaller(12, 4);
+    CopyStats one;
+    CopyStats two;
+    ASSERT_TRUE(Install(installer, temp.Path() / "one", linked, one));
+    ASSERT_TRUE(Install(installer, temp.Path() / "two", linked, two));
+
+    // A later upgrade of "one" that could not open the store decodes over its linked files
+    Installer upgrade = MakeInstaller(12, 5);
+    CopyStats again;
+    ASSERT_TRUE(Install(upgrade, temp.Path() / "one", Upgrade(), again));
+
+    EXPECT_EQ(Snapshot(temp.Path() / "one"), upgrade.theme);
+    EXPECT_EQ(Snapshot(temp.Path() / "two"), installer.theme);
+}
+
+TEST(PayloadInstall, RejectsAnImageWithoutAPayload) {
+    TempDirectory temp;
+    Bytes image = MakePeImage(true, 0x1000);
+    CopyStats stats;
+    EXPECT_FALSE(InstallFromPayload(image.data(), image.size(), "build/", temp.Path() / "build", CopyOptions(), stats));
+    ASSERT_EQ(stats.errors.size(), 1u);
+}
+
+TEST(PayloadInstall, RefusesEntriesOutsideTheDestination) {
+    TempDirectory temp;
+    ZipBuilder zip;
+    zip.AddFile("build/index.html", ToBytes("<html></html>"), 0);
+    zip.AddFile("build/../../escape.dll", ToBytes("MZ"), 0);
+    Bytes image = MakePeImage(true, 0x1000);
+    Append(image, zip.Build());
+
+    CopyStats stats;
+    EXPECT_FALSE(InstallFromPayload(image.data(), image.size(), "build/", temp.Path() / "a" / "build", CopyOptions(), stats));
+    EXPECT_FALSE(stats.errors.empty());
+    EXPECT_FALSE(fs::exists(temp.Path() / "escape.dll"));
+    EXPECT_FALSE(fs::exists(temp.Path() / "a" / "build" / "index.html"));
+}
@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+
+#include "SFX/ByteOrder.h"
+#include "SFX/PayloadLocator.h"
+#include "TestSupport.h"
+
+namespace {
+    Bytes MakeArchive() {
+        ZipBuilder zip;
+        zip.AddDirectory("build");
+        zip.AddFile("build/index.html", ToBytes("<html></html>"), 0);
+        zip.AddFile("NewTabSetup.msi", MakeContent(4096, 1), 8);
+        return zip.Build();
+    }
+
+    // Image with a certificate table after the payload, laid out as a signer leaves it
+    Bytes Sign(Bytes image, bool pe32Plus) {
+        size_t padding = (8 - image.size() % 8) % 8;
+        image.insert(image.end(), padding, 0);
+        uint32_t certificateOffset = static_cast<uint32_t>(image.size());
+        Bytes certificate(64, 0xA5);
+        Append(image, certificate);
+
+        uint64_t securityEntry = 0x80 + 24 + (pe32Plus ? 112 : 96) + 4 * 8;
+        WriteLE32(image.data() + securityEntry, certificateOffset);
+        WriteLE32(image.data() + securityEntry + 4, static_cast<uint32_t>(certificate.size()));
+        return image;
+    }
+}
+
+TEST(PayloadLocator, OverlayFollowsTheLastSection) {
+    Bytes image = MakePeImage(true, 0x1200);
+    EXPECT_EQ(FindPeOverlayOffset(image.data(), image.size()), 0x200u + 0x1200u);
+
+    Bytes image32 = MakePeImage(false, 0x400);
+    EXPECT_EQ(FindPeOverlayOffset(image32.data(), image32.size()), 0x600u);
+}
+
+TEST(PayloadLocator, RejectsImagesThatAreNotPe) {
+    Bytes text = ToBytes(std::string(256, 'x'));
+    EXPECT_EQ(FindPeOverlayOffset(text.data(), text.size()), 0u);
+
+    Bytes truncated = MakePeImage(true, 0x200);
+    truncated.resize(0x100);
+    EXPECT_EQ(FindPeOverlayOffset(truncated.data(), truncated.size()), 0u);
+
+    Bytes badSignature = MakePeImage(true, 0x200);
+    badSignature[0x80] = 'X';
+    EXPECT_EQ(FindPeOverlayOffset(badSignature.data(), badSignature.size()), 0u);
+}
+
+TEST(PayloadLocator, FindsArchiveAppendedToStub) {
+    Bytes image = MakePeImage(true, 0x400);
+    uint64_t stubSize = image.size();
+    Bytes archive = MakeArchive();
+    Append(image, archive);
+
+    PayloadLocation location;
+    ASSERT_TRUE(LocateZipPayload(image.data(), image.size(), location));
+    EXPECT_EQ(location.overlayOffset, stubSize);
+    EXPECT_EQ(location.archiveOffset, stubSize);
+    EXPECT_EQ(location.archiveSize, archive.size());
+    EXPECT_EQ(location.entryCount, 3u);
+    EXPECT_EQ(location.endOfCentralDirectoryOffset, image.size() - 22);
+    EXPECT_EQ(ReadLE32(image.data() + location.centralDirectoryOffset), 0x02014b50u);
+}
+
+TEST(PayloadLocator, FindsArchiveWithRebasedOffsets) {
+    Bytes image = MakePeImage(false, 0x400);
+    ZipBuilder zip;
+    zip.AddFile("a.txt", ToBytes("alpha"), 0);
+    Append(image, zip.Build(image.size()));
+
+    PayloadLocation location;
+    ASSERT_TRUE(LocateZipPayload(image.data(), image.size(), location));
+    EXPECT_EQ(location.archiveOffset, 0u);
+    EXPECT_EQ(location.entryCount, 1u);
+}
+
+TEST(PayloadLocator, ToleratesArchiveComment) {
+    Bytes image = MakePeImage(true, 0x200);
+    ZipBuilder zip;
+    zip.AddFile("a.txt", ToBytes("alpha"), 0);
+    zip.SetComment(std::string(1000, 'c'));
+    Append(image, zip.Build());
+
+    PayloadLocation location;
+    ASSERT_TRUE(LocateZipPayload(image.data(), image.size(), location));
+    EXPECT_EQ(location.endOfCentralDirectoryOffset, image.size() - 22 - 1000);
+}
+
+TEST(PayloadLocator, StopsAtTheCertificateTable) {
+    for (bool pe32Plus : { false, true }) {
+        Bytes unsigned_ = MakePeImage(pe32Plus, 0x200);
+        Append(unsigned_, MakeArchive());
+        Bytes image = Sign(unsigned_, pe32Plus);
+
+        PeSignatureFields fields;
+        ASSERT_TRUE(FindPeSignatureFields(image.data(), image.size(), fields));
+        EXPECT_EQ(fields.checksumOffset, 0x80u + 24 + 64);
+        EXPECT_EQ(fields.certificateSize, 64u);
+        EXPECT_EQ(FindPayloadEnd(image.data(), image.size()), fields.certificateOffset);
+
+        PayloadLocation location;
+        ASSERT_TRUE(LocateZipPayload(image.data(), image.size(), location)) << "pe32Plus=" << pe32Plus;
+        EXPECT_EQ(location.endOfCentralDirectoryOffset, unsigned_.size() - 22);
+    }
+}
+
+TEST(PayloadLocator, RejectsDataAfterTheEndRecord) {
+    Bytes image = MakePeImage(true, 0x200);
+    Append(image, MakeArchive());
+    image.push_back(0x01);
+
+    PayloadLocation location;
+    EXPECT_FALSE(LocateZipPayload(image.data(), image.size(), location));
+}
+
+TEST(PayloadLocator, RejectsMultiDiskArchives) {
+    Bytes image = MakePeImage(true, 0x200);
+    Append(image, MakeArchive());
+    WriteLE16(image.data() + image.size() - 22 + 4, 1);
+
+    PayloadLocation location;
+    EXPECT_FALSE(LocateZipPayload(image.data(), image.size(), location));
+}
+
+TEST(PayloadLocator, RejectsCentralDirectoryLargerThanThePayload) {
+    Bytes image = MakePeImage(true, 0x200);
+    Append(image, MakeArchive());
+    WriteLE32(image.data() + image.size() - 22 + 12, 0x100000);
+
+    PayloadLocation location;
+    EXPECT_FALSE(LocateZipPayload(image.data(), image.size(), location));
+}
+
+TEST(PayloadLocator, IgnoresEndRecordSignatureInsideTheStub) {
+    // A stray signature in the stub is outside the overlay and must not be picked up
+    Bytes image = MakePeImage(true, 0x200);
+    WriteLE32(image.data() + 0x300, 0x06054b50);
+
+    PayloadLocation location;
+    EXPECT_FALSE(LocateZipPayload(image.data(), image.size(), location));
+}
@@ -0,0 +1,165 @@
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "BrowserUpdater/PolicyRefresh.h"
+#include "Fakes.h"
+
+namespace {
+    ProcessResult Exited(uint32_t code) {
+        ProcessResult result;
+        result.outcome = ProcessOutcome::Exited;
+        result.exitCode = code;
+        return result;
+    }
+
+    PolicyRefreshOptions Options() {
+        PolicyRefreshOptions options;
+        options.systemDirectory = L"C:\\Windows\\system32";
+        return options;
+    }
+
+    // The state CheckSearchPolicy hands on, passed through the CustomActionData it sets
+    PolicyUpdateData CheckSearchPolicy(MemoryPolicyReader& reader, bool install) {
+        PolicyComparison comparison = ComparePolicyValues(reader, kSearchPolicyValues, kSearchPolicyValueCount, install);
+        PolicyUpdateData data;
+        EXPECT_TRUE(ParsePolicyUpdateData(std::wstring(PolicyChangeState(comparison)) + L";", data));
+        return data;
+    }
+}
+
+TEST(PolicyRefresh, ComparesWithWhatTheInstallationLeaves) {
+    MemoryPolicyReader reader;
+    PolicyComparison install = ComparePolicyValues(reader, kSearchPolicyValues, kSearchPolicyValueCount, true);
+    EXPECT_EQ(install.matching, 0u);
+    EXPECT_EQ(install.differing.size(), kSearchPolicyValueCount);
+    EXPECT_STREQ(PolicyChangeState(install), L"changed");
+    EXPECT_STREQ(PolicyChangeState(ComparePolicyValues(reader, kSearchPolicyValues, kSearchPolicyValueCount, false)), L"unchanged");
+
+    reader.Write(kSearchPolicyValues, kSearchPolicyValueCount);
+    EXPECT_STREQ(PolicyChangeState(ComparePolicyValues(reader, kSearchPolicyValues, kSearchPolicyValueCount, true)), L"unchanged");
+    PolicyComparison remove = ComparePolicyValues(reader, kSearchPolicyValues, kSearchPolicyValueCount, false);
+    EXPECT_EQ(remove.differing.size(), kSearchPolicyValueCount);
+
+    // Another provider, or a value of the wrong type, is a change
+    reader.strings[PolicyValuePath(kSearchPolicyValues[1])] = L"https://example.com/?q={searchTerms}";
+    reader.dwords.erase(PolicyValuePath(kSearchPolicyValues[2]));
+    reader.strings[PolicyValuePath(kSearchPolicyValues[2])] = L"1";
+    PolicyComparison edited = ComparePolicyValues(reader, kSearchPolicyValues, kSearchPolicyValueCount, true);
+    ASSERT_EQ(edited.differing.size(), 2u);
+    EXPECT_EQ(edited.differing[0], &kSearchPolicyValues[1]);
+    EXPECT_EQ(edited.differing[1], &kSearchPolicyValues[2]);
+}
+
+// The registry is written by the deferred script, before the deferred refresh runs: compared
+// there, the values always match. The check runs first and its answer reaches the refresh.
+TEST(PolicyRefresh, TheCheckBeforeTheWriteDecidesTheRefresh) {
+    MemoryPolicyReader reader;
+    ScriptedProcessRunner runner;
+    runner.result = Exited(0);
+
+    PolicyUpdateData install = CheckSearchPolicy(reader, true);
+    reader.Write(kSearchPolicyValues, kSearchPolicyValueCount);
+    EXPECT_STREQ(PolicyChangeState(ComparePolicyValues(reader, kSearchPolicyValues, kSearchPolicyValueCount, true)), L"unchanged");
+    EXPECT_EQ(RefreshSearchPolicy(install.policyChanged, runner, Options()).outcome, PolicyRefreshOutcome::Refreshed);
+    EXPECT_EQ(runner.runs, 1);
+
+    // A repair finds them in place and leaves policy alone
+    PolicyUpdateData repair = CheckSearchPolicy(reader, true);
+    reader.Write(kSearchPolicyValues, kSearchPolicyValueCount);
+    EXPECT_EQ(RefreshSearchPolicy(repair.policyChanged, runner, Options()).outcome, PolicyRefreshOutcome::AlreadyCurrent);
+    EXPECT_EQ(runner.runs, 1);
+
+    PolicyUpdateData uninstall = CheckSearchPolicy(reader, false);
+    reader.Remove(kSearchPolicyValues, kSearchPolicyValueCount);
+    EXPECT_EQ(RefreshSearchPolicy(uninstall.policyChanged, runner, Options()).outcome, PolicyRefreshOutcome::Refreshed);
+    EXPECT_EQ(runner.runs, 2);
+}
+
+TEST(PolicyRefresh, ParsesTheCustomActionData) {
+    PolicyUpdateData data;
+    ASSERT_TRUE(ParsePolicyUpdateData(L"unchanged;C:\\Temp\\NewTabSetup-1\\trace\\", data));
+    EXPECT_FALSE(data.policyChanged);
+    EXPECT_EQ(data.traceDirectory, L"C:\\Temp\\NewTabSetup-1\\trace\\");
+
+    ASSERT_TRUE(ParsePolicyUpdateData(L"changed;", data));
+    EXPECT_TRUE(data.policyChanged);
+    EXPECT_TRUE(data.traceDirectory.empty());
+
+    // Without a state, as when the check failed, the refresh still runs
+    for (const wchar_t* text : { L";", L"" }) {
+        ASSERT_TRUE(ParsePolicyUpdateData(text, data)) << text;
+        EXPECT_TRUE(data.policyChanged) << text;
+    }
+    for (const wchar_t* text : { L"install;changed;", L"maybe;", L"Changed;" }) {
+        EXPECT_FALSE(ParsePolicyUpdateData(text, data)) << text;
+    }
+}
+
+TEST(PolicyRefresh, RunsAComputerRefreshBoundedByTheTimeout) {
+    PolicyRefreshOptions options = Options();
+    options.waitSeconds = 5;
+    options.graceSeconds = 3;
+    EXPECT_EQ(PolicyRefreshCommand(options), L"\"C:\\Windows\\system32\\gpupdate.exe\" /target:computer /force /wait:5");
+    options.systemDirectory += L"\\";
+    EXPECT_EQ(PolicyRefreshCommand(options), L"\"C:\\Windows\\system32\\gpupdate.exe\" /target:computer /force /wait:5");
+    EXPECT_EQ(PolicyRefreshTimeout(options), 8000u);
+
+    ScriptedProcessRunner runner;
+    runner.result = Exited(0);
+    RefreshSearchPolicy(true, runner, options);
+    EXPECT_EQ(runner.commandLine, PolicyRefreshCommand(options));
+    EXPECT_EQ(runner.timeoutMilliseconds, 8000u);
+}
+
+TEST(PolicyRefresh, ReportsEachOutcome) {
+    ScriptedProcessRunner runner;
+    PolicyRefreshResult skipped = RefreshSearchPolicy(false, runner, Options());
+    EXPECT_EQ(runner.runs, 0);
+    EXPECT_EQ(DescribePolicyRefresh(skipped), "Search policy unchanged by this installation; no refresh needed");
+
+    runner.result = Exited(1);
+    PolicyRefreshResult failed = RefreshSearchPolicy(true, runner, Options());
+    EXPECT_EQ(failed.outcome, PolicyRefreshOutcome::Failed);
+    EXPECT_EQ(failed.exitCode, 1u);
+    EXPECT_EQ(DescribePolicyRefresh(failed).compare(0, 34, "Policy refresh exited with code 1 "), 0);
+
+    runner.result.outcome = ProcessOutcome::TimedOut;
+    runner.delayMilliseconds = 20;
+    PolicyRefreshResult timedOut = RefreshSearchPolicy(true, runner, Options());
+    EXPECT_EQ(timedOut.outcome, PolicyRefreshOutcome::TimedOut);
+    EXPECT_GE(timedOut.milliseconds, 20u);
+    EXPECT_NE(DescribePolicyRefresh(timedOut).find("timed out"), std::string::npos);
+
+    runner.result.outcome = ProcessOutcome::FailedToStart;
+    runner.delayMilliseconds = 0;
+    EXPECT_EQ(DescribePolicyRefresh(RefreshSearchPolicy(true, runner, Options())), "Policy refresh could not be started");
+}
+
+// kSearchPolicyValues mirrors the RegistryValue elements of SearchEngine.wxs
+TEST(PolicyRefresh, ValuesMatchTheInstallerSource) {
+    std::ifstream file(std::string(NEWTAB_SOURCE_DIR) + "/NewTabSetup/SearchEngine.wxs");
+    ASSERT_TRUE(file.good());
+    std::stringstream text;
+    text << file.rdbuf();
+    std::string wxs = text.str();
+
+    for (const auto& value : kSearchPolicyValues) {
+        std::wstring key = value.key;
+        size_t keyAt = wxs.find("Key=\"" + std::string(key.begin(), key.end()) + "\"");
+        ASSERT_NE(keyAt, std::string::npos);
+        std::wstring name = value.name;
+        std::string expected = "Name=\"" + std::string(name.begin(), name.end()) + "\" Value=\"";
+        if (value.type == PolicyValueType::Dword) {
+            expected = "Type=\"integer\" " + expected + std::to_string(value.number) + "\"";
+        }
+        else {
+            std::wstring url = value.text;
+            expected = "Type=\"string\" " + expected + std::string(url.begin(), url.end()) + "\"";
+        }
+        size_t valueAt = wxs.find(expected, keyAt);
+        EXPECT_NE(valueAt, std::string::npos) << expected;
+        EXPECT_LT(valueAt, wxs.find("</RegistryKey>", keyAt)) << expected;
+    }
+}
@@ -0,0 +1,185 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <set>
+#include <string>
+#include "BrowserUpdater/ProfileFanOut.h"
+#include "Fakes.h"
+
+namespace {
+    const wchar_t kAlice[] = L"S-1-5-21-1000";
+    const wchar_t kBob[] = L"S-1-5-21-1001";
+
+    UserProfile Profile(const wchar_t* sid, const wchar_t* directory, bool hiveLoaded) {
+        UserProfile profile;
+        profile.sid = sid;
+        profile.directory = directory;
+        profile.hiveLoaded = hiveLoaded;
+        return profile;
+    }
+
+    std::wstring FolderOf(const OpenedProfile& opened, ShortcutLocation location) {
+        for (const auto& folder : opened.shortcutFolders) {
+            if (folder.location == location) {
+                return folder.path;
+            }
+        }
+        return std::wstring();
+    }
+}
+
+TEST(ProfileFanOut, EnumeratesUserProfilesAndLoadedHives) {
+    MemoryProfileStore store;
+    store.directories = {
+        { kAlice, L"C:\\Users\\alice" },
+        { kBob, L"C:\\Users\\bob" },
+        { L"S-1-5-18", L"C:\\Windows\\system32\\config\\systemprofile" },
+    };
+    store.loadedHives = { L".DEFAULT", L"S-1-5-18", kAlice, std::wstring(kAlice) + L"_Classes", L"S-1-5-21-2000" };
+
+    std::vector<UserProfile> profiles = EnumerateProfiles(store);
+    ASSERT_EQ(profiles.size(), 3u);
+    EXPECT_EQ(profiles[0].sid, kAlice);
+    EXPECT_EQ(profiles[0].directory, L"C:\\Users\\alice");
+    EXPECT_TRUE(profiles[0].hiveLoaded);
+    EXPECT_EQ(profiles[1].sid, kBob);
+    EXPECT_FALSE(profiles[1].hiveLoaded);
+    EXPECT_EQ(profiles[2].sid, L"S-1-5-21-2000");
+    EXPECT_TRUE(profiles[2].directory.empty());
+}
+
+TEST(ProfileFanOut, UserKeysLiveInTheClassesHive) {
+    EXPECT_EQ(UserClassesKey(kAlice, L"ChromeHTML\\shell\\open\\command"), std::wstring(kAlice) + L"_Classes\\ChromeHTML\\shell\\open\\command");
+}
+
+// An uninstall after the user logged off still reaches the registry: the hive is loaded for the
+// change and unloaded once the profile is done
+TEST(ProfileFanOut, LoadsTheHiveOfALoggedOffUser) {
+    MemoryProfileStore store;
+    {
+        OpenedProfile opened = OpenProfile(store, Profile(kBob, L"C:\\Users\\bob", false));
+        EXPECT_TRUE(opened.registryReachable);
+        EXPECT_NE(opened.hive, nullptr);
+        EXPECT_EQ(store.loadedHives.count(kBob), 1u);
+        EXPECT_EQ(store.loadedHives.count(std::wstring(kBob) + L"_Classes"), 1u);
+    }
+    EXPECT_TRUE(store.loadedHives.empty());
+    EXPECT_EQ(store.loads, 1);
+    EXPECT_EQ(store.unloads, 1);
+
+    // Logged-on users keep the hive they have
+    store.loadedHives.insert(kAlice);
+    OpenedProfile opened = OpenProfile(store, Profile(kAlice, L"C:\\Users\\alice", true));
+    EXPECT_TRUE(opened.registryReachable);
+    EXPECT_EQ(opened.hive, nullptr);
+    EXPECT_EQ(store.loads, 1);
+}
+
+TEST(ProfileFanOut, ReportsAHiveThatCannotBeLoaded) {
+    MemoryProfileStore store;
+    store.unloadable.insert(kBob);
+    OpenedProfile opened = OpenProfile(store, Profile(kBob, L"C:\\Users\\bob", false));
+    EXPECT_FALSE(opened.registryReachable);
+    EXPECT_EQ(FolderOf(opened, ShortcutLocation::UserDesktop), L"C:\\Users\\bob\\Desktop");
+
+    // Without a profile folder there is no hive file to load
+    OpenedProfile orphan = OpenProfile(store, Profile(L"S-1-5-21-2000", L"", false));
+    EXPECT_FALSE(orphan.registryReachable);
+    EXPECT_TRUE(orphan.shortcutFolders.empty());
+    EXPECT_EQ(store.loads, 0);
+}
+
+TEST(ProfileFanOut, FallsBackToTheDefaultFolders) {
+    MemoryProfileStore store;
+    store.loadedHives.insert(kAlice);
+    OpenedProfile opened = OpenProfile(store, Profile(kAlice, L"C:\\Users\\alice", true));
+    ASSERT_EQ(opened.shortcutFolders.size(), 3u);
+    EXPECT_EQ(FolderOf(opened, ShortcutLocation::UserStartMenu), L"C:\\Users\\alice\\AppData\\Roaming\\Microsoft\\Windows\\Start Menu\\Programs");
+    EXPECT_EQ(FolderOf(opened, ShortcutLocation::UserDesktop), L"C:\\Users\\alice\\Desktop");
+    EXPECT_EQ(FolderOf(opened, ShortcutLocation::TaskbarPins),
+        L"C:\\Users\\alice\\AppData\\Roaming\\Microsoft\\Internet Explorer\\Quick Launch\\User Pinned\\TaskBar");
+    EXPECT_TRUE(opened.shortcutFolders[0].recursive);
+}
+
+// Folder redirection and OneDrive move the desktop and AppData; the hive's User Shell Folders
+// say where, relative to the profile or AppData or as an absolute path
+TEST(ProfileFanOut, ResolvesRedirectedShellFolders) {
+    MemoryProfileStore store;
+    store.shellFolders[{ kBob, L"AppData" }] = L"\\\\server\\profiles\\bob\\AppData";
+    store.shellFolders[{ kBob, L"Programs" }] = L"%AppData%\\Microsoft\\Windows\\Start Menu\\Programs";
+    store.shellFolders[{ kBob, L"Desktop" }] = L"%USERPROFILE%\\OneDrive\\Desktop";
+    {
+        OpenedProfile opened = OpenProfile(store, Profile(kBob, L"C:\\Users\\bob", false));
+        EXPECT_EQ(FolderOf(opened, ShortcutLocation::UserStartMenu), L"\\\\server\\profiles\\bob\\AppData\\Microsoft\\Windows\\Start Menu\\Programs");
+        EXPECT_EQ(FolderOf(opened, ShortcutLocation::UserDesktop), L"C:\\Users\\bob\\OneDrive\\Desktop");
+        EXPECT_EQ(FolderOf(opened, ShortcutLocation::TaskbarPins),
+            L"\\\\server\\profiles\\bob\\AppData\\Microsoft\\Internet Explorer\\Quick Launch\\User Pinned\\TaskBar");
+    }
+
+    // Variables of another account's environment cannot be expanded for this user
+    store.shellFolders[{ kBob, L"Desktop" }] = L"%HOMESHARE%\\Desktop";
+    OpenedProfile opened = OpenProfile(store, Profile(kBob, L"C:\\Users\\bob", false));
+    EXPECT_EQ(FolderOf(opened, ShortcutLocation::UserDesktop), L"C:\\Users\\bob\\Desktop");
+
+    // An unloadable hive cannot be asked at all
+    store.unloadable.insert(kBob);
+    OpenedProfile unreadable = OpenProfile(store, Profile(kBob, L"C:\\Users\\bob", false));
+    EXPECT_EQ(FolderOf(unreadable, ShortcutLocation::UserStartMenu), L"C:\\Users\\bob\\AppData\\Roaming\\Microsoft\\Windows\\Start Menu\\Programs");
+}
+
+TEST(ProfileFanOut, RunsEachProfileOnceInOrder) {
+    std::vector<UserProfile> profiles;
+    for (int i = 0; i < 100; ++i) {
+        profiles.push_back(Profile((L"S-1-5-21-" + std::to_wstring(i)).c_str(), L"", false));
+    }
+    std::atomic<int> calls(0);
+    std::vector<ProfileSummary> summaries = FanOutProfiles(profiles, [&calls](const UserProfile& profile, ProfileSummary& summary) {
+        ++calls;
+        summary.keysWritten = static_cast<uint32_t>(std::stoul(profile.sid.substr(9)));
+    }, 8);
+
+    EXPECT_EQ(calls.load(), 100);
+    ASSERT_EQ(summaries.size(), 100u);
+    for (size_t i = 0; i < summaries.size(); ++i) {
+        EXPECT_EQ(summaries[i].profile.sid, profiles[i].sid);
+        EXPECT_EQ(summaries[i].keysWritten, i);
+    }
+    EXPECT_TRUE(FanOutProfiles({}, [](const UserProfile&, ProfileSummary&) {}, 8).empty());
+}
+
+TEST(ProfileFanOut, StaysWithinTheWorkerCount) {
+    std::vector<UserProfile> profiles(64);
+    std::atomic<int> running(0);
+    std::atomic<int> peak(0);
+    FanOutProfiles(profiles, [&](const UserProfile&, ProfileSummary&) {
+        int now = ++running;
+        int seen = peak.load();
+        while (now > seen && !peak.compare_exchange_weak(seen, now)) {
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        --running;
+    }, 4);
+    EXPECT_GE(peak.load(), 1);
+    EXPECT_LE(peak.load(), 4);
+}
+
+// The whole change over many logged-off users: every hive is loaded once and unloaded again
+TEST(ProfileFanOut, LoadsAndUnloadsEveryHiveAcrossTheFanOut) {
+    MemoryProfileStore store;
+    for (int i = 0; i < 50; ++i) {
+        std::wstring sid = L"S-1-5-21-" + std::to_wstring(i);
+        store.directories.push_back({ sid, L"C:\\Users\\user" + std::to_wstring(i) });
+    }
+    std::vector<UserProfile> profiles = EnumerateProfiles(store);
+    std::vector<ProfileSummary> summaries = FanOutProfiles(profiles, [&store](const UserProfile& profile, ProfileSummary& summary) {
+        OpenedProfile opened = OpenProfile(store, profile);
+        summary.registrySkipped = !opened.registryReachable;
+    }, 8);
+
+    for (const auto& summary : summaries) {
+        EXPECT_FALSE(summary.registrySkipped) << summary.profile.sid;
+    }
+    EXPECT_EQ(store.loads, 50);
+    EXPECT_EQ(store.unloads, 50);
+    EXPECT_TRUE(store.loadedHives.empty());
+}
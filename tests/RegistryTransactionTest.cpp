@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include "BrowserUpdater/BrowserCatalog.h"
+#include "BrowserUpdater/CommandLineRewriter.h"
+#include "BrowserUpdater/ProfileFanOut.h"
+#include "Fakes.h"
+
+namespace {
+    const wchar_t kChromeOpen[] = L"ChromeHTML\\shell\\open\\command";
+    const wchar_t kEdgeOpen[] = L"MSEdgeHTM\\shell\\open\\command";
+    const wchar_t kEdgeRunAs[] = L"MSEdgeHTM\\shell\\runas\\command";
+
+    // The install transform of the custom action: add the extension before %1
+    bool AddExtension(const std::wstring& current, std::wstring& updated) {
+        const CommandLineEdit edits[] = {
+            { CommandLineEditKind::RemoveFlag, L"--single-argument", nullptr },
+            { CommandLineEditKind::SetFlag, L"--load-extension", L"C:\\ext" }
+        };
+        updated.resize(CommandLineRewriteBound(current.size(), edits, 2));
+        size_t length = 0;
+        if (!RewriteCommandLine(current.c_str(), current.size(), edits, 2, &updated[0], updated.size(), length)) {
+            return false;
+        }
+        updated.resize(length);
+        return true;
+    }
+}
+
+TEST(RegistryTransaction, PlansEveryCatalogKeyAndSkipsMissingOnes) {
+    MemoryRegistry registry;
+    registry.values[{ RegistryRoot::ClassesRoot, kChromeOpen }] = L"\"chrome.exe\" --single-argument %1";
+    registry.values[{ RegistryRoot::ClassesRoot, kEdgeOpen }] = L"\"msedge.exe\" --load-extension=\"C:\\ext\" %1";
+
+    RegistryTransaction transaction(registry);
+    AddBrowserCommandKeys(transaction, nullptr);
+    transaction.Prepare(AddExtension);
+
+    ASSERT_EQ(transaction.Changes().size(), kBrowserCommandKeys.size());
+    size_t missing = 0;
+    for (const auto& change : transaction.Changes()) {
+        if (change.subKey == kChromeOpen) {
+            EXPECT_EQ(change.state, RegistryChangeState::Changed);
+        }
+        else if (change.subKey == kEdgeOpen) {
+            EXPECT_EQ(change.state, RegistryChangeState::Unchanged);
+        }
+        else {
+            EXPECT_EQ(change.state, RegistryChangeState::Missing);
+            ++missing;
+        }
+    }
+    EXPECT_EQ(missing, kBrowserCommandKeys.size() - 2);
+    EXPECT_EQ(registry.writes, 0u);
+
+    ASSERT_TRUE(transaction.Commit());
+    EXPECT_EQ(registry.writes, 1u);
+    EXPECT_EQ(registry.Value(RegistryRoot::ClassesRoot, kChromeOpen), L"\"chrome.exe\" --load-extension=\"C:\\ext\" %1");
+}
+
+TEST(RegistryTransaction, RollsBackEarlierWritesWhenOneFails) {
+    MemoryRegistry registry;
+    registry.values[{ RegistryRoot::ClassesRoot, kChromeOpen }] = L"chrome.exe %1";
+    registry.values[{ RegistryRoot::ClassesRoot, kEdgeOpen }] = L"msedge.exe %1";
+    registry.values[{ RegistryRoot::ClassesRoot, kEdgeRunAs }] = L"msedge.exe --do-not-de-elevate %1";
+    registry.failWrites.insert(kEdgeRunAs);
+
+    RegistryTransaction transaction(registry);
+    transaction.Add(RegistryRoot::ClassesRoot, kChromeOpen);
+    transaction.Add(RegistryRoot::ClassesRoot, kEdgeOpen);
+    transaction.Add(RegistryRoot::ClassesRoot, kEdgeRunAs);
+    transaction.Prepare(AddExtension);
+
+    EXPECT_FALSE(transaction.Commit());
+    EXPECT_EQ(transaction.Changes()[0].state, RegistryChangeState::RolledBack);
+    EXPECT_EQ(transaction.Changes()[1].state, RegistryChangeState::RolledBack);
+    EXPECT_EQ(transaction.Changes()[2].state, RegistryChangeState::Failed);
+    EXPECT_EQ(registry.Value(RegistryRoot::ClassesRoot, kChromeOpen), L"chrome.exe %1");
+    EXPECT_EQ(registry.Value(RegistryRoot::ClassesRoot, kEdgeOpen), L"msedge.exe %1");
+}
+
+TEST(RegistryTransaction, TransformFailureLeavesValueUnchanged) {
+    MemoryRegistry registry;
+    registry.values[{ RegistryRoot::ClassesRoot, kChromeOpen }] = L"\"chrome.exe %1";
+
+    RegistryTransaction transaction(registry);
+    transaction.Add(RegistryRoot::ClassesRoot, kChromeOpen);
+    transaction.Prepare(AddExtension);
+
+    EXPECT_EQ(transaction.Changes()[0].state, RegistryChangeState::Unchanged);
+    EXPECT_TRUE(transaction.Commit());
+    EXPECT_EQ(registry.writes, 0u);
+}
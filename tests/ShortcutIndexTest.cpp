@@ -0,0 +1,178 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include "BrowserUpdater/ShortcutIndex.h"
+#include "Fakes.h"
+#include "SFX/ByteOrder.h"
+#include "TestSupport.h"
+
+namespace {
+    const std::wstring kStartMenu = L"C:\\ProgramData\\Microsoft\\Windows\\Start Menu\\Programs";
+    const std::wstring kDesktop = L"C:\\Users\\Public\\Desktop";
+    const std::wstring kPins = L"C:\\Users\\a\\AppData\\Roaming\\Microsoft\\Internet Explorer\\Quick Launch\\User Pinned\\TaskBar";
+
+    // Offset of the LinkInfo structure in the shortcuts MakeShortcut builds
+    const size_t kLinkInfo = 0x4C;
+}
+
+TEST(ShortcutIndex, ReadsTargetsInEveryEncoding) {
+    const std::wstring target = L"C:\\Program Files\\Google\\Chrome\\Application\\chrome.exe";
+    for (ShortcutEncoding encoding : { ShortcutEncoding::Ansi, ShortcutEncoding::Unicode, ShortcutEncoding::RelativePath }) {
+        Bytes link = MakeShortcut(target, encoding);
+        std::wstring read;
+        ASSERT_TRUE(ReadShortcutTarget(link.data(), link.size(), read)) << static_cast<int>(encoding);
+        EXPECT_EQ(read, target);
+    }
+}
+
+TEST(ShortcutIndex, PrefersUnicodePathOverAnsi) {
+    const std::wstring target = L"C:\\Programme\\Brav\u00e9\\brave.exe";
+    Bytes link = MakeShortcut(target, ShortcutEncoding::Unicode);
+    std::wstring read;
+    ASSERT_TRUE(ReadShortcutTarget(link.data(), link.size(), read));
+    EXPECT_EQ(read, target);
+}
+
+TEST(ShortcutIndex, RejectsTruncatedShortcuts) {
+    Bytes link = MakeShortcut(L"C:\\chrome.exe", ShortcutEncoding::Unicode);
+    std::wstring read;
+    for (size_t size : { size_t(0), size_t(0x20), size_t(0x4C), link.size() - 3 }) {
+        EXPECT_FALSE(ReadShortcutTarget(link.data(), size, read)) << size;
+    }
+}
+
+TEST(ShortcutIndex, IgnoresUnicodeOffsetsPastAShortLinkInfo) {
+    // A 28-byte LinkInfo that claims the 36-byte header. The bytes after it, which the Unicode
+    // offsets would be read from, belong to the relative path the reader must fall back to.
+    Bytes link = MakeShortcut(L"C:\\chrome.exe", ShortcutEncoding::Ansi);
+    link.resize(kLinkInfo + 28);
+    WriteLE32(link.data() + 0x14, 0x02 | 0x08);
+    WriteLE32(link.data() + kLinkInfo, 28);
+    WriteLE32(link.data() + kLinkInfo + 4, 0x24);
+    const char relative[] = "..\\Chrome\\chrome.exe";
+    link.push_back(sizeof(relative) - 1);
+    link.push_back(0);
+    link.insert(link.end(), relative, relative + sizeof(relative) - 1);
+
+    std::wstring read;
+    ASSERT_TRUE(ReadShortcutTarget(link.data(), link.size(), read));
+    EXPECT_EQ(read, L"..\\Chrome\\chrome.exe");
+}
+
+TEST(ShortcutIndex, NeverReadsUnicodeOffsetsPastTheFile) {
+    // The file ends with a 28-byte LinkInfo claiming the 36-byte header. The memory after the
+    // end holds offsets into the header; reading them would turn header bytes into a target.
+    Bytes link = MakeShortcut(L"C:\\chrome.exe", ShortcutEncoding::Ansi);
+    link.resize(kLinkInfo + 28);
+    WriteLE32(link.data() + 0x14, 0x02);
+    WriteLE32(link.data() + kLinkInfo, 28);
+    WriteLE32(link.data() + kLinkInfo + 4, 0x24);
+    WriteLE32(link.data() + kLinkInfo + 16, 28);
+    WriteLE32(link.data() + kLinkInfo + 24, 28);
+    const size_t size = link.size();
+    link.resize(size + 8);
+    WriteLE32(link.data() + size, 12);
+    WriteLE32(link.data() + size + 4, 26);
+
+    std::wstring read;
+    EXPECT_FALSE(ReadShortcutTarget(link.data(), size, read));
+}
+
+TEST(ShortcutIndex, RejectsStringOffsetsOutsideTheLinkInfo) {
+    Bytes ansi = MakeShortcut(L"C:\\chrome.exe", ShortcutEncoding::Ansi);
+    uint32_t ansiSize = ReadLE32(ansi.data() + kLinkInfo);
+    Bytes unicode = MakeShortcut(L"C:\\chrome.exe", ShortcutEncoding::Unicode);
+    uint32_t unicodeSize = ReadLE32(unicode.data() + kLinkInfo);
+
+    const struct {
+        const Bytes* link;
+        size_t field;
+        uint32_t offset;
+    } cases[] = {
+        { &ansi, 16, ansiSize }, { &ansi, 24, ansiSize }, { &ansi, 16, 0xFFFFFFF0u },
+        { &unicode, 28, unicodeSize }, { &unicode, 32, unicodeSize + 1 }, { &unicode, 28, 0x80000000u }
+    };
+    for (const auto& test : cases) {
+        Bytes link = *test.link;
+        // Trailing text the reader would pick up if it followed the bad offset
+        link.insert(link.end(), 32, 'A');
+        WriteLE32(link.data() + kLinkInfo + test.field, test.offset);
+        std::wstring read;
+        EXPECT_FALSE(ReadShortcutTarget(link.data(), link.size(), read)) << test.field << " " << test.offset;
+    }
+}
+
+TEST(ShortcutIndex, RejectsLinkInfoLargerThanTheFile) {
+    Bytes link = MakeShortcut(L"C:\\chrome.exe", ShortcutEncoding::Unicode);
+    std::wstring read;
+    for (uint32_t size : { 0u, 27u, static_cast<uint32_t>(link.size() - kLinkInfo + 1), 0xFFFFFFFFu }) {
+        WriteLE32(link.data() + kLinkInfo, size);
+        EXPECT_FALSE(ReadShortcutTarget(link.data(), link.size(), read)) << size;
+    }
+}
+
+TEST(ShortcutIndex, SurvivesCorruptedShortcuts) {
+    // Every read must stay inside the buffer; each corrupted copy is its own allocation so a
+    // sanitizer build catches an overrun
+    std::mt19937 random(6);
+    const Bytes originals[] = {
+        MakeShortcut(L"C:\\Program Files\\Google\\Chrome\\Application\\chrome.exe", ShortcutEncoding::Unicode),
+        MakeShortcut(L"C:\\Program Files\\Google\\Chrome\\Application\\chrome.exe", ShortcutEncoding::Ansi),
+        MakeShortcut(L"..\\msedge.exe", ShortcutEncoding::RelativePath)
+    };
+    for (int run = 0; run < 20000; ++run) {
+        const Bytes& original = originals[run % 3];
+        Bytes link(original.begin(), original.begin() + static_cast<std::ptrdiff_t>(random() % (original.size() + 1)));
+        for (int flips = random() % 4; flips >= 0 && !link.empty(); --flips) {
+            link[random() % link.size()] = static_cast<unsigned char>(random());
+        }
+        std::wstring read;
+        if (ReadShortcutTarget(link.data(), link.size(), read)) {
+            EXPECT_FALSE(read.empty());
+        }
+    }
+}
+
+TEST(ShortcutIndex, MatchesBrowsersByExecutableName) {
+    EXPECT_STREQ(FindShortcutBrowser(L"C:\\x\\CHROME.EXE")->executable, L"chrome.exe");
+    EXPECT_STREQ(FindShortcutBrowser(L"msedge.exe")->name, L"Microsoft Edge");
+    EXPECT_STREQ(FindShortcutBrowser(L"D:/apps/brave.exe")->name, L"Brave");
+    EXPECT_EQ(FindShortcutBrowser(L"C:\\x\\notchrome.exe"), nullptr);
+    EXPECT_EQ(FindShortcutBrowser(L"C:\\chrome.exe\\readme.txt"), nullptr);
+}
+
+TEST(ShortcutIndex, IndexesBrowserShortcutsAcrossFolders) {
+    MemoryShortcutFileSystem files;
+    files.AddShortcut(kStartMenu, L"Google Chrome.lnk", MakeShortcut(L"C:\\Chrome\\chrome.exe", ShortcutEncoding::Unicode));
+    files.AddShortcut(kStartMenu, L"Brave.lnk", MakeShortcut(L"C:\\Brave\\brave.exe", ShortcutEncoding::Ansi), true);
+    files.AddShortcut(kStartMenu, L"Notepad.lnk", MakeShortcut(L"C:\\Windows\\notepad.exe", ShortcutEncoding::Unicode));
+    files.AddShortcut(kDesktop, L"Edge.lnk", MakeShortcut(L"C:\\Edge\\msedge.exe", ShortcutEncoding::RelativePath));
+    files.AddShortcut(kDesktop, L"Broken.lnk", ToBytes("not a shortcut"));
+
+    std::vector<ShortcutFolder> folders = {
+        { ShortcutLocation::CommonStartMenu, kStartMenu, true },
+        { ShortcutLocation::PublicDesktop, kDesktop, false },
+        { ShortcutLocation::TaskbarPins, kPins, false }
+    };
+    ShortcutIndex index;
+    index.Build(files, folders);
+
+    ASSERT_EQ(index.Shortcuts().size(), 3u);
+    EXPECT_EQ(index.Shortcuts()[0].path, kStartMenu + L"\\Google Chrome.lnk");
+    EXPECT_EQ(index.Shortcuts()[0].location, ShortcutLocation::CommonStartMenu);
+    EXPECT_STREQ(index.Shortcuts()[1].browser->name, L"Brave");
+    EXPECT_EQ(index.Shortcuts()[2].location, ShortcutLocation::PublicDesktop);
+    EXPECT_STREQ(index.Shortcuts()[2].browser->name, L"Microsoft Edge");
+    ASSERT_EQ(index.MissingFolders().size(), 1u);
+    EXPECT_EQ(index.MissingFolders()[0], kPins);
+}
+
+TEST(ShortcutIndex, NonRecursiveFoldersSkipSubfolders) {
+    MemoryShortcutFileSystem files;
+    files.AddShortcut(kDesktop, L"Chrome.lnk", MakeShortcut(L"C:\\chrome.exe", ShortcutEncoding::Ansi), true);
+
+    ShortcutIndex index;
+    index.Build(files, { { ShortcutLocation::PublicDesktop, kDesktop, false } });
+    EXPECT_TRUE(index.Shortcuts().empty());
+    EXPECT_TRUE(index.MissingFolders().empty());
+}
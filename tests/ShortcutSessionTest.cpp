@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+
+#include "BrowserUpdater/ShortcutSession.h"
+#include "Fakes.h"
+
+namespace {
+    const CommandLineEdit kInstallEdits[] = {
+        { CommandLineEditKind::SetFlag, L"--load-extension", L"C:\\Program Files\\New Tab\\build" }
+    };
+    const std::wstring kInstalled = L"--load-extension=\"C:\\Program Files\\New Tab\\build\"";
+}
+
+TEST(ShortcutSession, RewritesEveryShortcutThroughOneStore) {
+    MemoryLinkStore store;
+    store.arguments[L"a.lnk"] = L"";
+    store.arguments[L"b.lnk"] = L"--profile-directory=Default";
+
+    ShortcutEditSession session(store);
+    auto results = session.Apply({ L"a.lnk", L"b.lnk" }, kInstallEdits, 1);
+
+    ASSERT_EQ(results.size(), 2u);
+    for (const auto& result : results) {
+        EXPECT_TRUE(result.success);
+        EXPECT_TRUE(result.changed);
+    }
+    EXPECT_EQ(results[1].path, L"b.lnk");
+    EXPECT_EQ(store.arguments[L"a.lnk"], kInstalled);
+    EXPECT_EQ(store.arguments[L"b.lnk"], L"--profile-directory=Default " + kInstalled);
+    EXPECT_EQ(store.saves, 2u);
+}
+
+TEST(ShortcutSession, DoesNotSaveShortcutsAlreadyCurrent) {
+    MemoryLinkStore store;
+    store.arguments[L"a.lnk"] = kInstalled;
+
+    ShortcutEditSession session(store);
+    auto results = session.Apply({ L"a.lnk" }, kInstallEdits, 1);
+    EXPECT_TRUE(results[0].success);
+    EXPECT_FALSE(results[0].changed);
+    EXPECT_EQ(store.saves, 0u);
+}
+
+TEST(ShortcutSession, ReportsFailuresPerShortcut) {
+    MemoryLinkStore store;
+    store.arguments[L"locked.lnk"] = L"";
+    store.arguments[L"ok.lnk"] = L"";
+    store.arguments[L"quoted.lnk"] = L"\"unterminated";
+    store.failSaves.insert(L"locked.lnk");
+
+    ShortcutEditSession session(store);
+    auto results = session.Apply({ L"missing.lnk", L"locked.lnk", L"quoted.lnk", L"ok.lnk" }, kInstallEdits, 1);
+    EXPECT_FALSE(results[0].success);
+    EXPECT_FALSE(results[1].success);
+    EXPECT_TRUE(results[1].changed);
+    EXPECT_FALSE(results[2].success);
+    EXPECT_TRUE(results[3].success);
+    EXPECT_EQ(store.arguments[L"locked.lnk"], L"");
+    EXPECT_EQ(store.arguments[L"quoted.lnk"], L"\"unterminated");
+    EXPECT_EQ(store.arguments[L"ok.lnk"], kInstalled);
+}
+
+TEST(ShortcutSession, FailsEverythingWhenTheStoreIsNotReady) {
+    MemoryLinkStore store;
+    store.ready = false;
+    store.arguments[L"a.lnk"] = L"";
+
+    ShortcutEditSession session(store);
+    auto results = session.Apply({ L"a.lnk", L"b.lnk" }, kInstallEdits, 1);
+    EXPECT_FALSE(results[0].success);
+    EXPECT_FALSE(results[1].success);
+    EXPECT_EQ(store.loads, 0u);
+}
@@ -0,0 +1,162 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include "Fakes.h"
+#include "SFX/StagingDirectory.h"
+
+namespace {
+    const std::wstring kRoot = L"/tmp";
+    const std::wstring kPrefix = L"NewTabSetup-1234ABCD-";
+
+    // A directory left by a killed run: its files are there, its lock is not held
+    std::wstring Abandon(MemoryStagingBackend& backend, const std::wstring& suffix) {
+        std::wstring path = kRoot + L"/" + kPrefix + suffix;
+        backend.directories.insert(path);
+        backend.files.insert(path + L"/.lock");
+        backend.files.insert(path + L"/NewTabSetup.msi");
+        return path + L"/";
+    }
+}
+
+TEST(StagingDirectory, CreatesALockedDirectoryAndRemovesItOnRelease) {
+    MemoryStagingBackend backend;
+    std::wstring path;
+    {
+        StagingDirectory staging(backend, kRoot, kPrefix);
+        ASSERT_TRUE(staging.Acquire());
+        path = staging.Path();
+        EXPECT_EQ(path.compare(0, kRoot.size() + 1 + kPrefix.size(), kRoot + L"/" + kPrefix), 0);
+        EXPECT_EQ(path.back(), L'/');
+        EXPECT_FALSE(staging.Resumed());
+        EXPECT_TRUE(backend.IsHeld(path + L".lock"));
+        backend.AddFile(path + L"NewTabSetup.msi");
+        backend.directories.insert(path + L"build");
+        backend.AddFile(path + L"build/index.html");
+    }
+    EXPECT_TRUE(backend.directories.empty());
+    EXPECT_TRUE(backend.files.empty());
+    EXPECT_FALSE(backend.IsHeld(path + L".lock"));
+}
+
+TEST(StagingDirectory, ReleaseIsSafeToRepeat) {
+    MemoryStagingBackend backend;
+    StagingDirectory staging(backend, kRoot + L"/", kPrefix);
+    staging.Release();
+    ASSERT_TRUE(staging.Acquire());
+    staging.Release();
+    staging.Release();
+    EXPECT_TRUE(staging.Path().empty());
+    EXPECT_TRUE(backend.directories.empty());
+}
+
+TEST(StagingDirectory, ConcurrentRunsGetTheirOwnDirectories) {
+    MemoryStagingBackend backend;
+    std::vector<std::unique_ptr<StagingDirectory>> runs;
+    std::set<std::wstring> paths;
+    for (int i = 0; i < 20; ++i) {
+        runs.emplace_back(new StagingDirectory(backend, kRoot, kPrefix));
+        ASSERT_TRUE(runs.back()->Acquire());
+        EXPECT_FALSE(runs.back()->Resumed());
+        EXPECT_TRUE(paths.insert(runs.back()->Path()).second);
+    }
+    EXPECT_EQ(backend.directories.size(), 20u);
+    runs.clear();
+    EXPECT_TRUE(backend.directories.empty());
+}
+
+TEST(StagingDirectory, AdoptsTheDirectoryOfAKilledRun) {
+    MemoryStagingBackend backend;
+    std::wstring abandoned = Abandon(backend, L"0000000000000001");
+
+    StagingDirectory staging(backend, kRoot, kPrefix);
+    ASSERT_TRUE(staging.Acquire());
+    EXPECT_TRUE(staging.Resumed());
+    EXPECT_EQ(staging.Path(), abandoned);
+    EXPECT_EQ(backend.files.count(abandoned + L"NewTabSetup.msi"), 1u);
+
+    // A second run finds it held and makes its own
+    StagingDirectory second(backend, kRoot, kPrefix);
+    ASSERT_TRUE(second.Acquire());
+    EXPECT_FALSE(second.Resumed());
+    EXPECT_NE(second.Path(), abandoned);
+}
+
+TEST(StagingDirectory, LeavesOtherPayloadsAlone) {
+    MemoryStagingBackend backend;
+    backend.directories.insert(kRoot + L"/NewTabSetup-FFFFFFFF-0000000000000001");
+    backend.directories.insert(kRoot + L"/Other");
+
+    StagingDirectory staging(backend, kRoot, kPrefix);
+    ASSERT_TRUE(staging.Acquire());
+    EXPECT_FALSE(staging.Resumed());
+    staging.Release();
+    EXPECT_EQ(backend.directories.size(), 2u);
+}
+
+TEST(StagingDirectory, TriesAnotherNameWhenANewDirectoryIsTaken) {
+    MemoryStagingBackend backend;
+    backend.lockCreated = 3;
+    StagingDirectory staging(backend, kRoot, kPrefix);
+    ASSERT_TRUE(staging.Acquire());
+    EXPECT_FALSE(staging.Resumed());
+    EXPECT_EQ(backend.foreignLocks.size(), 3u);
+    EXPECT_EQ(backend.directories.size(), 4u);
+}
+
+TEST(StagingDirectory, FailsWhenNoDirectoryCanBeMade) {
+    MemoryStagingBackend backend;
+    backend.failAllCreates = true;
+    StagingDirectory staging(backend, kRoot, kPrefix);
+    EXPECT_FALSE(staging.Acquire());
+    EXPECT_TRUE(staging.Path().empty());
+    staging.Release();
+    EXPECT_TRUE(backend.files.empty());
+}
+
+// Dozens of installers of the same payload start at once while some killed runs left their
+// directories behind. No two live runs may ever share a directory, and nothing is left when
+// they have all finished.
+TEST(StagingDirectory, ParallelRunsNeverShareADirectory) {
+    MemoryStagingBackend backend;
+    for (int i = 0; i < 8; ++i) {
+        Abandon(backend, L"00000000000000A" + std::to_wstring(i));
+    }
+
+    std::mutex lock;
+    std::set<std::wstring> live;
+    std::atomic<int> shared(0);
+    std::atomic<int> failed(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 48; ++i) {
+        threads.emplace_back([&] {
+            for (int round = 0; round < 5; ++round) {
+                StagingDirectory staging(backend, kRoot, kPrefix);
+                if (!staging.Acquire()) {
+                    ++failed;
+                    return;
+                }
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    if (!live.insert(staging.Path()).second) {
+                        ++shared;
+                    }
+                }
+                backend.AddFile(staging.Path() + L"NewTabSetup.msi");
+                std::this_thread::yield();
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    live.erase(staging.Path());
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(failed.load(), 0);
+    EXPECT_EQ(shared.load(), 0);
+    EXPECT_TRUE(backend.directories.empty());
+    EXPECT_TRUE(backend.files.empty());
+}
@@ -0,0 +1,303 @@
+#include "TestSupport.h"
+#include "SFX/ByteOrder.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <zlib.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+    const uint16_t kDosTime = 0x6000;  // 12:00:00
+    const uint16_t kDosDate = 0x5821;  // 2024-01-01
+
+    void PutLE16(Bytes& out, uint16_t value) {
+        unsigned char bytes[2];
+        WriteLE16(bytes, value);
+        out.insert(out.end(), bytes, bytes + 2);
+    }
+
+    void PutLE32(Bytes& out, uint32_t value) {
+        unsigned char bytes[4];
+        WriteLE32(bytes, value);
+        out.insert(out.end(), bytes, bytes + 4);
+    }
+
+    void PutText(Bytes& out, const std::string& text) {
+        out.insert(out.end(), text.begin(), text.end());
+    }
+}
+
+Bytes ToBytes(const std::string& text) {
+    return Bytes(text.begin(), text.end());
+}
+
+Bytes MakeContent(size_t size, uint32_t seed) {
+    static const char* const kWords[] = {
+        "function", "return", "const", "window", "document", "style", "color", "margin",
+        "background", "url(", "0px", "{", "}", ";", "\n", "theme", "tab", "=>"
+    };
+    const size_t wordCount = sizeof(kWords) / sizeof(kWords[0]);
+
+    Bytes data;
+    data.reserve(size + 16);
+    uint32_t state = seed * 2654435761u + 1;
+    while (data.size() < size) {
+        state = state * 1103515245u + 12345u;
+        const char* word = kWords[(state >> 16) % wordCount];
+        PutText(data, word);
+        data.push_back(static_cast<unsigned char>(' ' + ((state >> 8) & 1)));
+    }
+    data.resize(size);
+    return data;
+}
+
+Bytes MakeNoise(size_t size, uint32_t seed) {
+    Bytes data(size);
+    uint64_t state = seed * 0x9E3779B97F4A7C15ull + 1;
+    for (auto& byte : data) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        byte = static_cast<unsigned char>(state >> 24);
+    }
+    return data;
+}
+
+Bytes MakePeImage(bool pe32Plus, size_t sectionSize) {
+    const uint32_t peOffset = 0x80;
+    const uint16_t optionalHeaderSize = pe32Plus ? 240 : 224;
+    const uint32_t headersSize = 0x200;
+
+    Bytes image(headersSize + sectionSize, 0);
+    unsigned char* data = image.data();
+    data[0] = 'M';
+    data[1] = 'Z';
+    WriteLE32(data + 0x3C, peOffset);
+
+    unsigned char* pe = data + peOffset;
+    WriteLE32(pe, 0x00004550);
+    WriteLE16(pe + 4, pe32Plus ? 0x8664 : 0x014C);
+    WriteLE16(pe + 6, 1);
+    WriteLE16(pe + 20, optionalHeaderSize);
+    WriteLE16(pe + 22, 0x0022);
+
+    unsigned char* optional = pe + 24;
+    WriteLE16(optional, pe32Plus ? 0x20B : 0x10B);
+    WriteLE32(optional + 60, headersSize);                // SizeOfHeaders
+    WriteLE32(optional + (pe32Plus ? 108 : 92), 16);      // NumberOfRvaAndSizes
+
+    unsigned char* section = optional + optionalHeaderSize;
+    std::memcpy(section, ".text\0\0\0", 8);
+    WriteLE32(section + 8, static_cast<uint32_t>(sectionSize));
+    WriteLE32(section + 12, 0x1000);
+    WriteLE32(section + 16, static_cast<uint32_t>(sectionSize));
+    WriteLE32(section + 20, sectionSize != 0 ? headersSize : 0);
+    return image;
+}
+
+Bytes DeflateRaw(const Bytes& data, int level, int strategy) {
+    z_stream stream = {};
+    if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8, strategy) != Z_OK) {
+        throw std::runtime_error("deflateInit2 failed");
+    }
+    Bytes out(deflateBound(&stream, static_cast<uLong>(data.size())));
+    stream.next_in = const_cast<unsigned char*>(data.data());
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = out.data();
+    stream.avail_out = static_cast<uInt>(out.size());
+    int status = deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    if (status != Z_STREAM_END) {
+        throw std::runtime_error("deflate failed");
+    }
+    return out;
+}
+
+void Append(Bytes& to, const Bytes& from) {
+    to.insert(to.end(), from.begin(), from.end());
+}
+
+void ZipBuilder::AddFile(const std::string& name, const Bytes& data, uint16_t method) {
+    Entry entry;
+    entry.name = name;
+    entry.method = method;
+    entry.crc = static_cast<uint32_t>(crc32(0, data.data(), static_cast<uInt>(data.size())));
+    entry.size = data.size();
+    entry.stored = method == 8 ? DeflateRaw(data) : data;
+    entries_.push_back(std::move(entry));
+}
+
+void ZipBuilder::AddDirectory(const std::string& name) {
+    Entry entry;
+    entry.name = name.back() == '/' ? name : name + "/";
+    entry.method = 0;
+    entry.crc = 0;
+    entry.size = 0;
+    entries_.push_back(std::move(entry));
+}
+
+Bytes ZipBuilder::Build(uint64_t base) const {
+    Bytes archive;
+    std::vector<uint64_t> offsets;
+    for (const auto& entry : entries_) {
+        offsets.push_back(base + archive.size());
+        PutLE32(archive, 0x04034b50);
+        PutLE16(archive, 20);
+        PutLE16(archive, 0x0800);
+        PutLE16(archive, entry.method);
+        PutLE16(archive, kDosTime);
+        PutLE16(archive, kDosDate);
+        PutLE32(archive, entry.crc);
+        PutLE32(archive, static_cast<uint32_t>(entry.stored.size()));
+        PutLE32(archive, static_cast<uint32_t>(entry.size));
+        PutLE16(archive, static_cast<uint16_t>(entry.name.size()));
+        PutLE16(archive, 0);
+        PutText(archive, entry.name);
+        Append(archive, entry.stored);
+    }
+
+    uint64_t centralDirectory = archive.size();
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        const Entry& entry = entries_[i];
+        bool directory = entry.name.back() == '/';
+        PutLE32(archive, 0x02014b50);
+        PutLE16(archive, 20);
+        PutLE16(archive, 20);
+        PutLE16(archive, 0x0800);
+        PutLE16(archive, entry.method);
+        PutLE16(archive, kDosTime);
+        PutLE16(archive, kDosDate);
+        PutLE32(archive, entry.crc);
+        PutLE32(archive, static_cast<uint32_t>(entry.stored.size()));
+        PutLE32(archive, static_cast<uint32_t>(entry.size));
+        PutLE16(archive, static_cast<uint16_t>(entry.name.size()));
+        PutLE16(archive, 0);
+        PutLE16(archive, 0);
+        PutLE16(archive, 0);
+        PutLE16(archive, 0);
+        PutLE32(archive, directory ? 0x10 : 0);
+        PutLE32(archive, static_cast<uint32_t>(offsets[i]));
+        PutText(archive, entry.name);
+    }
+    uint64_t centralDirectorySize = archive.size() - centralDirectory;
+
+    PutLE32(archive, 0x06054b50);
+    PutLE16(archive, 0);
+    PutLE16(archive, 0);
+    PutLE16(archive, static_cast<uint16_t>(entries_.size()));
+    PutLE16(archive, static_cast<uint16_t>(entries_.size()));
+    PutLE32(archive, static_cast<uint32_t>(centralDirectorySize));
+    PutLE32(archive, static_cast<uint32_t>(base + centralDirectory));
+    PutLE16(archive, static_cast<uint16_t>(comment_.size()));
+    PutText(archive, comment_);
+    return archive;
+}
+
+Bytes MakeShortcut(const std::wstring& target, ShortcutEncoding encoding) {
+    const uint32_t kHasLinkInfo = 0x02;
+    const uint32_t kHasRelativePath = 0x08;
+    const uint32_t kIsUnicode = 0x80;
+
+    Bytes link(0x4C, 0);
+    WriteLE32(link.data(), 0x4C);
+    // CLSID_ShellLink {00021401-0000-0000-C000-000000000046}
+    const unsigned char clsid[16] = { 0x01, 0x14, 0x02, 0, 0, 0, 0, 0, 0xC0, 0, 0, 0, 0, 0, 0, 0x46 };
+    std::memcpy(link.data() + 4, clsid, sizeof(clsid));
+
+    if (encoding == ShortcutEncoding::RelativePath) {
+        WriteLE32(link.data() + 0x14, kHasRelativePath | kIsUnicode);
+        PutLE16(link, static_cast<uint16_t>(target.size()));
+        for (wchar_t c : target) {
+            PutLE16(link, static_cast<uint16_t>(c));
+        }
+        return link;
+    }
+
+    WriteLE32(link.data() + 0x14, kHasLinkInfo | kIsUnicode);
+    const bool unicode = encoding == ShortcutEncoding::Unicode;
+    const uint32_t headerSize = unicode ? 0x24 : 0x1C;
+
+    // LinkInfo: header, an empty VolumeID, the ANSI base path and suffix, then the Unicode ones
+    Bytes info(headerSize, 0);
+    uint32_t volumeId = static_cast<uint32_t>(info.size());
+    PutLE32(info, 0x10);
+    PutLE32(info, 3);
+    PutLE32(info, 0);
+    PutLE32(info, 0x10);
+    uint32_t basePath = static_cast<uint32_t>(info.size());
+    for (wchar_t c : target) {
+        info.push_back(static_cast<unsigned char>(c < 0x80 ? c : '?'));
+    }
+    info.push_back(0);
+    uint32_t suffix = static_cast<uint32_t>(info.size());
+    info.push_back(0);
+    uint32_t basePathUnicode = 0;
+    uint32_t suffixUnicode = 0;
+    if (unicode) {
+        basePathUnicode = static_cast<uint32_t>(info.size());
+        for (wchar_t c : target) {
+            PutLE16(info, static_cast<uint16_t>(c));
+        }
+        PutLE16(info, 0);
+        suffixUnicode = static_cast<uint32_t>(info.size());
+        PutLE16(info, 0);
+    }
+
+    WriteLE32(info.data(), static_cast<uint32_t>(info.size()));
+    WriteLE32(info.data() + 4, headerSize);
+    WriteLE32(info.data() + 8, 0x01);
+    WriteLE32(info.data() + 12, volumeId);
+    WriteLE32(info.data() + 16, basePath);
+    WriteLE32(info.data() + 24, suffix);
+    if (unicode) {
+        WriteLE32(info.data() + 28, basePathUnicode);
+        WriteLE32(info.data() + 32, suffixUnicode);
+    }
+    Append(link, info);
+    return link;
+}
+
+TempDirectory::TempDirectory() {
+    static std::atomic<unsigned> counter(0);
+    auto stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+    path_ = fs::temp_directory_path() /
+        ("newtab-test-" + std::to_string(stamp) + "-" + std::to_string(counter++));
+    fs::create_directories(path_);
+}
+
+TempDirectory::~TempDirectory() {
+    std::error_code ec;
+    fs::remove_all(path_, ec);
+}
+
+void WriteFile(const fs::path& path, const Bytes& data) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    if (!out) {
+        throw std::runtime_error("cannot write " + path.string());
+    }
+}
+
+Bytes ReadFile(const fs::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    return Bytes(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+void MakeTree(const fs::path& root, size_t files, size_t directories, size_t fileSize) {
+    if (directories == 0) {
+        directories = 1;
+    }
+    for (size_t d = 0; d < directories; ++d) {
+        fs::create_directories(root / ("dir" + std::to_string(d)));
+    }
+    for (size_t i = 0; i < files; ++i) {
+        WriteFile(root / ("dir" + std::to_string(i % directories)) / ("file" + std::to_string(i) + ".js"),
+            MakeContent(fileSize, static_cast<uint32_t>(i)));
+    }
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "SFX/Inflate.h"
+
+// Builders for the inputs the installer code reads: PE images, ZIP archives and shortcut
+// files, plus scratch directories. Shared by the unit tests and the benchmarks.
+
+using Bytes = std::vector<unsigned char>;
+
+Bytes ToBytes(const std::string& text);
+
+// Deterministic filler that compresses about as well as text assets
+Bytes MakeContent(size_t size, uint32_t seed);
+
+// Deterministic bytes that do not compress, like photos
+Bytes MakeNoise(size_t size, uint32_t seed);
+
+// PE32 or PE32+ image with one section of `sectionSize` raw bytes and nothing after it
+Bytes MakePeImage(bool pe32Plus, size_t sectionSize);
+
+// ZIP archive written the way our packers do: local headers and data, then the central
+// directory and the end record
+class ZipBuilder {
+public:
+    // `method` is a ZIP method id; deflated entries are compressed with zlib
+    void AddFile(const std::string& name, const Bytes& data, uint16_t method);
+    void AddDirectory(const std::string& name);
+    void SetComment(const std::string& comment) { comment_ = comment; }
+
+    // Archive with offsets counted from `base`: 0 for an archive that is simply appended to a
+    // stub, the stub size for one whose offsets were rebased onto the image
+    Bytes Build(uint64_t base = 0) const;
+
+private:
+    struct Entry {
+        std::string name;
+        uint16_t method;
+        uint32_t crc;
+        uint64_t size;
+        Bytes stored;
+    };
+    std::vector<Entry> entries_;
+    std::string comment_;
+};
+
+// Raw DEFLATE stream of `data`, as zlib writes it with the given level and strategy
+Bytes DeflateRaw(const Bytes& data, int level = 6, int strategy = 0);
+
+// Collects decoded output; fails writes once `limit` bytes have been taken
+class VectorSink : public OutputSink {
+public:
+    Bytes data;
+    size_t limit = SIZE_MAX;
+
+    bool Write(const unsigned char* bytes, size_t size) override {
+        if (size > limit - data.size()) {
+            return false;
+        }
+        data.insert(data.end(), bytes, bytes + size);
+        return true;
+    }
+};
+
+// Discards decoded output, for throughput measurements
+class NullSink : public OutputSink {
+public:
+    uint64_t written = 0;
+
+    bool Write(const unsigned char*, size_t size) override {
+        written += size;
+        return true;
+    }
+};
+
+void Append(Bytes& to, const Bytes& from);
+
+// How a generated shortcut records its target
+enum class ShortcutEncoding {
+    Ansi,          // LinkInfo local base path
+    Unicode,       // LinkInfo with the Unicode path offsets
+    RelativePath   // No LinkInfo; only the relative path string
+};
+
+// Shell Link (.lnk) file pointing at `target`
+Bytes MakeShortcut(const std::wstring& target, ShortcutEncoding encoding);
+
+// Uniquely named directory below the system temporary directory, removed with its contents
+class TempDirectory {
+public:
+    TempDirectory();
+    ~TempDirectory();
+    TempDirectory(const TempDirectory&) = delete;
+    TempDirectory& operator=(const TempDirectory&) = delete;
+
+    const std::filesystem::path& Path() const { return path_; }
+
+private:
+    std::filesystem::path path_;
+};
+
+void WriteFile(const std::filesystem::path& path, const Bytes& data);
+Bytes ReadFile(const std::filesystem::path& path);
+
+// Tree of `files` files spread over `directories` subdirectories, `fileSize` bytes each
+void MakeTree(const std::filesystem::path& root, size_t files, size_t directories, size_t fileSize);
@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <set>
+#include <string>
+#include <thread>
+#include "Common/Trace.h"
+#include "TestSupport.h"
+
+namespace {
+    std::string ReadText(const std::filesystem::path& path) {
+        Bytes data = ReadFile(path);
+        return std::string(data.begin(), data.end());
+    }
+
+    size_t Count(const std::string& text, const std::string& part) {
+        size_t count = 0;
+        for (size_t pos = text.find(part); pos != std::string::npos; pos = text.find(part, pos + 1)) {
+            ++count;
+        }
+        return count;
+    }
+}
+
+TEST(Trace, RecordsNothingWhileOff) {
+    ASSERT_EQ(ActiveTrace(), nullptr);
+    TraceSession off(std::wstring(), "SFX", 1);
+    EXPECT_FALSE(off.Enabled());
+    EXPECT_EQ(ActiveTrace(), nullptr);
+    {
+        TraceSpan span("extract-payload");
+        TraceCounter("payload-files", 3);
+    }
+    EXPECT_EQ(off.Recorder(), nullptr);
+}
+
+TEST(Trace, SessionWritesSpansAndCountersToItsFile) {
+    TempDirectory temp;
+    std::filesystem::path file = temp.Path() / "SFX-42.json";
+    {
+        TraceSession session(file.wstring(), "SFX", 42);
+        ASSERT_TRUE(session.Enabled());
+        EXPECT_EQ(ActiveTrace(), session.Recorder());
+
+        TraceSpan outer("sfx");
+        {
+            TraceSpan inner("locate-payload");
+        }
+        TraceSpan closed("acquire-staging");
+        closed.End();
+        closed.End();
+        TraceCounter("payload-files", 12);
+        outer.End();
+
+        std::vector<TraceEvent> events = session.Recorder()->Events();
+        ASSERT_EQ(events.size(), 4u);
+        EXPECT_STREQ(events[0].name, "locate-payload");
+        EXPECT_STREQ(events[1].name, "acquire-staging");
+        EXPECT_EQ(events[2].phase, 'C');
+        EXPECT_EQ(events[2].value, 12);
+        EXPECT_STREQ(events[3].name, "sfx");
+        EXPECT_LE(events[3].timestamp, events[0].timestamp);
+        EXPECT_GE(events[3].timestamp + events[3].duration, events[1].timestamp + events[1].duration);
+    }
+    EXPECT_EQ(ActiveTrace(), nullptr);
+
+    std::string json = ReadText(file);
+    EXPECT_EQ(json.compare(0, 16, "{\"traceEvents\":["), 0);
+    EXPECT_NE(json.find("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":42,\"tid\":0,\"args\":{\"name\":\"SFX\"}}"), std::string::npos);
+    EXPECT_EQ(Count(json, "\"ph\":\"X\""), 3u);
+    EXPECT_NE(json.find("\"args\":{\"value\":12}"), std::string::npos);
+    EXPECT_NE(json.find("\"displayTimeUnit\":\"ms\"}"), std::string::npos);
+}
+
+// Timestamps are Unix time, so traces of the stub and the custom actions line up
+TEST(Trace, TimestampsAreUnixMicroseconds) {
+    TraceRecorder recorder("CopyBuildFolder", 7);
+    uint64_t unixNow = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    uint64_t now = recorder.Now();
+    EXPECT_LT(now > unixNow ? now - unixNow : unixNow - now, 5000000u);
+}
+
+TEST(Trace, EscapesNamesInJson) {
+    TraceRecorder recorder("New \"Tab\"\\Setup", 1);
+    recorder.Record({ "line\nbreak", 'X', 1, 10, 5, 0 });
+    std::string json = recorder.ToChromeTrace();
+    EXPECT_NE(json.find("\"New \\\"Tab\\\"\\\\Setup\""), std::string::npos);
+    EXPECT_NE(json.find("\"line\\u000abreak\""), std::string::npos);
+    EXPECT_NE(json.find("\"ts\":10,\"dur\":5"), std::string::npos);
+}
+
+TEST(Trace, ThreadsGetTheirOwnNumbers) {
+    TraceRecorder recorder("BrowserUpdater", 1);
+    SetActiveTrace(&recorder);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([] {
+            TraceSpan span("profile");
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    { TraceSpan span("fan-out-profiles"); }
+    SetActiveTrace(nullptr);
+
+    std::set<uint32_t> numbers;
+    for (const auto& event : recorder.Events()) {
+        numbers.insert(event.thread);
+    }
+    EXPECT_EQ(numbers.size(), 5u);
+    EXPECT_EQ(numbers.count(TraceThreadId()), 1u);
+}
+
+TEST(Trace, SummarizesByNameInOrderOfFirstUse) {
+    TraceRecorder recorder("BrowserUpdater", 1);
+    recorder.Record({ "profile", 'X', 1, 0, 1500, 0 });
+    recorder.Record({ "profiles", 'C', 1, 0, 0, 3 });
+    recorder.Record({ "profile", 'X', 2, 0, 2500, 0 });
+    recorder.Record({ "profiles", 'C', 1, 0, 0, 4 });
+    recorder.Record({ "registry", 'X', 2, 0, 100, 0 });
+
+    std::vector<TraceSummary> summaries = recorder.Summarize();
+    ASSERT_EQ(summaries.size(), 3u);
+    EXPECT_STREQ(summaries[0].name, "profile");
+    EXPECT_EQ(summaries[0].count, 2u);
+    EXPECT_EQ(summaries[0].total, 4000u);
+    EXPECT_EQ(summaries[0].maximum, 2500u);
+    EXPECT_EQ(summaries[1].total, 7u);
+    EXPECT_EQ(summaries[1].maximum, 4u);
+    EXPECT_STREQ(summaries[2].name, "registry");
+
+    EXPECT_EQ(FormatTraceSummary(summaries[0]), "profile: 2 spans, 4.0 ms total, 2.5 ms max");
+    EXPECT_EQ(FormatTraceSummary(summaries[1]), "profiles: 2 samples, 7 total, 4 max");
+    EXPECT_EQ(FormatTraceSummary(summaries[2]), "registry: 1 span, 0.1 ms total, 0.1 ms max");
+}
+
+TEST(Trace, ReportsAFileThatCannotBeWritten) {
+    TempDirectory temp;
+    EXPECT_FALSE(WriteTraceFile((temp.Path() / "missing" / "trace.json").wstring(), "{}"));
+    EXPECT_TRUE(WriteTraceFile((temp.Path() / "trace.json").wstring(), "{}"));
+    EXPECT_EQ(ReadText(temp.Path() / "trace.json"), "{}");
+}
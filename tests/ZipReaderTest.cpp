@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+
+#include "SFX/ByteOrder.h"
+#include "SFX/ZipReader.h"
+#include "TestSupport.h"
+
+namespace {
+    struct Payload {
+        Bytes image;
+        PayloadLocation location;
+        std::vector<ZipEntry> entries;
+    };
+
+    Payload Load(const ZipBuilder& zip) {
+        Payload payload;
+        payload.image = MakePeImage(true, 0x400);
+        Append(payload.image, zip.Build());
+        EXPECT_TRUE(LocateZipPayload(payload.image.data(), payload.image.size(), payload.location));
+        EXPECT_TRUE(ReadZipEntries(payload.image.data(), payload.image.size(), payload.location, payload.entries));
+        return payload;
+    }
+
+    bool Extract(const Payload& payload, size_t index, Bytes& output) {
+        VectorSink sink;
+        bool success = ExtractZipEntry(payload.image.data(), payload.image.size(), payload.entries[index], sink);
+        output = sink.data;
+        return success;
+    }
+}
+
+TEST(ZipReader, ReadsCentralDirectoryInArchiveOrder) {
+    ZipBuilder zip;
+    zip.AddDirectory("build");
+    zip.AddFile("build/index.html", ToBytes("<html></html>"), 0);
+    zip.AddFile("build/app.js", MakeContent(10000, 1), 8);
+    Payload payload = Load(zip);
+
+    ASSERT_EQ(payload.entries.size(), 3u);
+    EXPECT_EQ(payload.entries[0].name, "build/");
+    EXPECT_TRUE(payload.entries[0].isDirectory);
+    EXPECT_EQ(payload.entries[1].name, "build/index.html");
+    EXPECT_EQ(payload.entries[1].method, kZipMethodStored);
+    EXPECT_EQ(payload.entries[1].uncompressedSize, 13u);
+    EXPECT_EQ(payload.entries[2].method, kZipMethodDeflated);
+    EXPECT_LT(payload.entries[2].compressedSize, payload.entries[2].uncompressedSize);
+    EXPECT_TRUE(payload.entries[2].utf8Name);
+    EXPECT_EQ(ReadLE32(payload.image.data() + payload.entries[2].localHeaderOffset), 0x04034b50u);
+}
+
+TEST(ZipReader, ExtractsStoredAndDeflatedEntries) {
+    Bytes script = MakeContent(300000, 2);
+    Bytes photo = MakeNoise(70000, 3);
+    ZipBuilder zip;
+    zip.AddFile("build/app.js", script, 8);
+    zip.AddFile("store_photos/1.jpg", photo, 0);
+    zip.AddFile("empty.txt", Bytes(), 8);
+    Payload payload = Load(zip);
+
+    Bytes output;
+    ASSERT_TRUE(Extract(payload, 0, output));
+    EXPECT_TRUE(output == script);
+    ASSERT_TRUE(Extract(payload, 1, output));
+    EXPECT_TRUE(output == photo);
+    ASSERT_TRUE(Extract(payload, 2, output));
+    EXPECT_TRUE(output.empty());
+}
+
+TEST(ZipReader, RejectsCrcMismatch) {
+    ZipBuilder zip;
+    zip.AddFile("a.txt", ToBytes("alpha"), 0);
+    Payload payload = Load(zip);
+    payload.entries[0].crc32 ^= 1;
+
+    Bytes output;
+    EXPECT_FALSE(Extract(payload, 0, output));
+}
+
+TEST(ZipReader, RejectsSizeMismatch) {
+    ZipBuilder zip;
+    zip.AddFile("a.js", MakeContent(1000, 4), 8);
+    Payload payload = Load(zip);
+    payload.entries[0].uncompressedSize += 1;
+
+    Bytes output;
+    EXPECT_FALSE(Extract(payload, 0, output));
+}
+
+TEST(ZipReader, RejectsUnknownMethodAndMissingLocalHeader) {
+    ZipBuilder zip;
+    zip.AddFile("a.txt", ToBytes("alpha"), 0);
+    Payload payload = Load(zip);
+
+    Bytes output;
+    ZipEntry unknown = payload.entries[0];
+    unknown.method = 99;
+    payload.entries.push_back(unknown);
+    EXPECT_FALSE(Extract(payload, 1, output));
+
+    payload.entries[0].localHeaderOffset += 1;
+    EXPECT_FALSE(Extract(payload, 0, output));
+}
+
+TEST(ZipReader, RejectsTruncatedCentralDirectory) {
+    ZipBuilder zip;
+    zip.AddFile("a.txt", ToBytes("alpha"), 0);
+    zip.AddFile("b.txt", ToBytes("beta"), 0);
+    Payload payload = Load(zip);
+
+    PayloadLocation location = payload.location;
+    location.entryCount = 3;
+    std::vector<ZipEntry> entries;
+    EXPECT_FALSE(ReadZipEntries(payload.image.data(), payload.image.size(), location, entries));
+}
+
+TEST(ZipReader, RejectsEncryptedEntries) {
+    ZipBuilder zip;
+    zip.AddFile("secret.txt", ToBytes("s"), 0);
+    Payload payload = Load(zip);
+
+    WriteLE16(payload.image.data() + payload.location.centralDirectoryOffset + 8, 0x0801);
+    std::vector<ZipEntry> entries;
+    EXPECT_FALSE(ReadZipEntries(payload.image.data(), payload.image.size(), payload.location, entries));
+}
+
+TEST(ZipReader, NormalizesBackslashes) {
+    ZipBuilder zip;
+    zip.AddFile("build\\css\\a.css", ToBytes("a"), 0);
+    Payload payload = Load(zip);
+    EXPECT_EQ(payload.entries[0].name, "build/css/a.css");
+}
+
+TEST(ZipReader, AcceptsOnlyNamesInsideTheTarget) {
+    EXPECT_TRUE(IsSafeEntryName("build/index.html"));
+    EXPECT_TRUE(IsSafeEntryName("build/..hidden/a"));
+    EXPECT_TRUE(IsSafeEntryName("a..b"));
+    EXPECT_FALSE(IsSafeEntryName(""));
+    EXPECT_FALSE(IsSafeEntryName("/etc/passwd"));
+    EXPECT_FALSE(IsSafeEntryName("C:/Windows/system.ini"));
+    EXPECT_FALSE(IsSafeEntryName("../escape"));
+    EXPECT_FALSE(IsSafeEntryName("build/../../escape"));
+    EXPECT_FALSE(IsSafeEntryName("build/.."));
+}